@@ -212,4 +212,72 @@ unsigned vlc_CPU_raw(void);
 
 # endif
 
+/**
+ * \defgroup cpu_budget CPU budget
+ * \ingroup os
+ *
+ * The decoders and encoders of a LibVLC instance share a number of cores
+ * (\c --cpu-budget). Each one requests threads when it opens, and gets a
+ * quota depending on the cores left and on the number of streams: free cores
+ * are handed out first, then a fair share of the budget.
+ *
+ * Quotas are not taken back while in use, the budget is rebalanced as codecs
+ * open and close, or report that they use less threads than granted. A
+ * running codec keeps its threads: only the codecs opened afterwards, or
+ * reopened, get the rebalanced quotas.
+ * @{
+ */
+
+typedef struct vlc_cpu_quota vlc_cpu_quota_t;
+
+/**
+ * Requests threads from the CPU budget
+ *
+ * \param obj decoder or encoder object
+ * \param wanted number of threads the caller would run without budget
+ * \param quota set to the quota to release when closing, or NULL
+ * \return the number of threads to run, between 1 and wanted
+ */
+VLC_API unsigned vlc_cpu_quota_Acquire(vlc_object_t *obj, unsigned wanted,
+                                       vlc_cpu_quota_t **quota);
+#define vlc_cpu_quota_Acquire(o, w, q) \
+    vlc_cpu_quota_Acquire(VLC_OBJECT(o), w, q)
+
+/**
+ * Reports the number of threads actually run
+ *
+ * Threads granted but not used are returned to the budget.
+ *
+ * \param quota quota (can be NULL)
+ * \param used number of threads, not more than granted
+ */
+VLC_API void vlc_cpu_quota_Use(vlc_cpu_quota_t *quota, unsigned used);
+
+/**
+ * Returns threads to the CPU budget
+ *
+ * \param quota quota (can be NULL)
+ */
+VLC_API void vlc_cpu_quota_Release(vlc_cpu_quota_t *quota);
+
+struct vlc_cpu_budget_stats
+{
+    unsigned budget; /**< cores shared by the codecs */
+    unsigned codecs; /**< number of quotas */
+    unsigned requested; /**< threads requested */
+    unsigned assigned; /**< threads granted */
+    unsigned used; /**< threads reported as run */
+    unsigned load; /**< average cores busy in the process, in percents */
+};
+
+/**
+ * Reads the counters of the CPU budget of a LibVLC instance
+ */
+VLC_API void vlc_cpu_budget_GetStats(vlc_object_t *obj,
+                                     struct vlc_cpu_budget_stats *stats);
+#define vlc_cpu_budget_GetStats(o, s) \
+    vlc_cpu_budget_GetStats(VLC_OBJECT(o), s)
+
+/** @} */
+
 #endif /* !VLC_CPU_H */
@@ -142,6 +142,12 @@ VLC_API void httpd_StreamDelete( httpd_stream_t * );
 VLC_API int httpd_StreamHeader( httpd_stream_t *, uint8_t *p_data, int i_data );
 VLC_API int httpd_StreamSend( httpd_stream_t *, const block_t *p_block );
 VLC_API int httpd_StreamSetHTTPHeaders(httpd_stream_t *, const httpd_header *, size_t);
+/**
+ * Sends the stream with chunked transfer coding to HTTP/1.1 clients, so that
+ * each piece of data is delimited as soon as it is sent. HTTP/1.0 clients
+ * still get a body delimited by the connection end.
+ */
+VLC_API void httpd_StreamSetChunked(httpd_stream_t *, bool);
 
 /* Msg functions facilities */
 VLC_API void httpd_MsgAdd( httpd_message_t *, const char *psz_name, const char *psz_value, ... ) VLC_FORMAT( 3, 4 );
@@ -86,6 +86,10 @@ enum access_out_query_e
 {
     ACCESS_OUT_CONTROLS_PACE, /* arg1=bool *, can fail (assume true) */
     ACCESS_OUT_CAN_SEEK, /* arg1=bool *, can fail (assume false) */
+    ACCESS_OUT_COPY_RANGE, /* arg1=uint64_t from, arg2=uint64_t to,
+                              arg3=uint64_t size, ranges may overlap,
+                              fails if unsupported (a size of 0 probes it),
+                              or leaving the range partially copied */
 };
 
 VLC_API sout_access_out_t * sout_AccessOutNew( vlc_object_t *, const char *psz_access, const char *psz_name ) VLC_USED;
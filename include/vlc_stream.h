@@ -146,6 +146,22 @@ struct stream_t
     void *p_sys;
 };
 
+/**
+ * State of the read-ahead buffer of a stream, see STREAM_GET_BUFFER_STATS
+ */
+struct vlc_stream_buffer_stats
+{
+    size_t size; /**< current buffer size (bytes) */
+    size_t max_size; /**< limit the buffer may grow to (bytes) */
+    size_t fill; /**< data buffered ahead of the reader (bytes) */
+    size_t read_size; /**< current size of the reads from the source */
+    uint64_t input_rate; /**< source throughput (bytes/s) */
+    uint64_t output_rate; /**< reader consumption (bytes/s) */
+    vlc_tick_t latency; /**< average duration of a read from the source */
+    unsigned stalls; /**< times the reader had to wait for data */
+    unsigned resizes; /**< times the buffer was grown */
+};
+
 /**
  * Possible commands to send to vlc_stream_Control() and vlc_stream_vaControl()
  */
@@ -156,6 +172,7 @@ enum stream_query_e
     STREAM_CAN_FASTSEEK,        /**< arg1= bool *   res=cannot fail*/
     STREAM_CAN_PAUSE,           /**< arg1= bool *   res=cannot fail*/
     STREAM_CAN_CONTROL_PACE,    /**< arg1= bool *   res=cannot fail*/
+    STREAM_IS_MEMORY_MAPPED,    /**< arg1= bool *   res=can fail */
     /* */
     STREAM_GET_SIZE=6,          /**< arg1= uint64_t *     res=can fail */
 
@@ -168,6 +185,7 @@ enum stream_query_e
     STREAM_GET_CONTENT_TYPE,    /**< arg1= char **         res=can fail */
     STREAM_GET_SIGNAL,      /**< arg1=double *pf_quality, arg2=double *pf_strength   res=can fail */
     STREAM_GET_TAGS,        /**< arg1=const block_t ** res=can fail */
+    STREAM_GET_BUFFER_STATS, /**< arg1=struct vlc_stream_buffer_stats * res=can fail */
 
     STREAM_SET_PAUSE_STATE = 0x200, /**< arg1= bool        res=can fail */
     STREAM_SET_TITLE,       /**< arg1= int          res=can fail */
@@ -43,6 +43,22 @@ typedef struct vlc_thumbnailer_request_t vlc_thumbnailer_request_t;
  */
 typedef void(*vlc_thumbnailer_cb)( void* data, picture_t* thumbnail );
 
+/**
+ * \brief vlc_thumbnailer_batch_cb defines a callback invoked for each thumbnail
+ * of a batch request
+ *
+ * This callback is called once for each requested time or position, provided
+ * the request is not cancelled. The thumbnails are generated in ascending
+ * time or position order, which is not necessarily the requested order.
+ * The picture ownership rules are the same as vlc_thumbnailer_cb.
+ *
+ * \param data Is the opaque pointer passed as the request last parameter
+ * \param index The index of the time or position in the request
+ * \param thumbnail The generated thumbnail, or NULL in case of failure or timeout
+ */
+typedef void(*vlc_thumbnailer_batch_cb)( void* data, size_t index,
+                                         picture_t* thumbnail );
+
 
 /**
  * \brief vlc_thumbnailer_Create Creates a thumbnailer object
@@ -59,6 +75,8 @@ enum vlc_thumbnailer_seek_speed
     VLC_THUMBNAILER_SEEK_PRECISE,
     /** Fast, but potentially imprecise */
     VLC_THUMBNAILER_SEEK_FAST,
+    /** Fast seek, and only decode key frames: fastest, and least precise */
+    VLC_THUMBNAILER_SEEK_KEYFRAME,
 };
 
 /**
@@ -112,6 +130,59 @@ vlc_thumbnailer_RequestByPos( vlc_thumbnailer_t *thumbnailer,
                               input_item_t *input_item, vlc_tick_t timeout,
                               vlc_thumbnailer_cb cb, void* user_data );
 
+/**
+ * \brief vlc_thumbnailer_RequestBatchByTime Requests thumbnails at several times
+ * \param thumbnailer A thumbnailer object
+ * \param times The times at which the thumbnails should be taken
+ * \param count The number of times, must not be 0
+ * \param speed The seeking speed \sa{enum vlc_thumbnailer_seek_speed}
+ * \param input_item The input item to generate the thumbnails for
+ * \param timeout A timeout value for the whole batch, or VLC_TICK_INVALID to
+ * disable timeout
+ * \param cb A user callback to be called for each thumbnail (success & error)
+ * \param user_data An opaque value, provided as cb's first parameter
+ * \return An opaque request object, or NULL in case of failure
+ *
+ * The media is opened once, and the thumbnails are generated by seeking
+ * forward from one time to the next.
+ * If this function returns a valid request object, the callback is guaranteed
+ * to be called for each time, even in case of later failure.
+ * The returned request object must not be used after the last callback has
+ * been invoked. The times array can be released after calling this function.
+ */
+VLC_API vlc_thumbnailer_request_t*
+vlc_thumbnailer_RequestBatchByTime( vlc_thumbnailer_t *thumbnailer,
+                                    const vlc_tick_t *times, size_t count,
+                                    enum vlc_thumbnailer_seek_speed speed,
+                                    input_item_t *input_item,
+                                    vlc_tick_t timeout,
+                                    vlc_thumbnailer_batch_cb cb,
+                                    void* user_data );
+
+/**
+ * \brief vlc_thumbnailer_RequestBatchByPos Requests evenly spaced thumbnails
+ * \param thumbnailer A thumbnailer object
+ * \param count The number of thumbnails, must not be 0
+ * \param speed The seeking speed \sa{enum vlc_thumbnailer_seek_speed}
+ * \param input_item The input item to generate the thumbnails for
+ * \param timeout A timeout value for the whole batch, or VLC_TICK_INVALID to
+ * disable timeout
+ * \param cb A user callback to be called for each thumbnail (success & error)
+ * \param user_data An opaque value, provided as cb's first parameter
+ * \return An opaque request object, or NULL in case of failure
+ *
+ * The thumbnail of index i is taken at the position (i + 1) / (count + 1).
+ * \sa vlc_thumbnailer_RequestBatchByTime
+ */
+VLC_API vlc_thumbnailer_request_t*
+vlc_thumbnailer_RequestBatchByPos( vlc_thumbnailer_t *thumbnailer,
+                                   size_t count,
+                                   enum vlc_thumbnailer_seek_speed speed,
+                                   input_item_t *input_item,
+                                   vlc_tick_t timeout,
+                                   vlc_thumbnailer_batch_cb cb,
+                                   void* user_data );
+
 /**
  * \brief vlc_thumbnailer_Cancel Cancel a thumbnail request
  * \param thumbnailer A thumbnailer object
@@ -31,12 +31,15 @@
 #endif
 
 #include <limits.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #include <vlc_common.h>
 #include "fs.h"
 #include <vlc_access.h>
 #include <vlc_input_item.h>
+#include <vlc_interrupt.h>
+#include <vlc_list.h>
 
 #include <vlc_fs.h>
 #include <vlc_url.h>
@@ -48,6 +51,47 @@ typedef struct
     DIR *dir;
 } access_sys_t;
 
+#define DIR_MAX_THREADS 32
+
+/* Identifies a directory, to detect symbolic link loops */
+struct dir_id
+{
+    dev_t dev;
+    ino_t ino; /**< 0 if unknown */
+};
+
+/* A directory to list, into its own node of the tree */
+struct dir_job
+{
+    struct vlc_list node;
+    DIR *dir; /**< opened by the reader, unless borrowed from the access */
+    bool own_dir;
+    char *path; /**< NULL if the directory is only known by its handle */
+    char *base_uri;
+    bool need_separator;
+    input_item_node_t *root;
+    unsigned depth;
+    struct dir_id *ids; /**< from the root down to this directory */
+};
+
+/* Traversal shared by the readers */
+struct dir_walk
+{
+    stream_t *access;
+    bool special_files;
+    bool hidden_files;
+    unsigned max_depth;
+
+    vlc_mutex_t lock;
+    vlc_cond_t wait;
+    struct vlc_list jobs;
+    unsigned busy; /**< readers listing a directory */
+    int error;
+
+    unsigned dirs;
+    unsigned stats;
+};
+
 /*****************************************************************************
  * DirInit: Init the directory access with a directory stream
  *****************************************************************************/
@@ -115,61 +159,217 @@ void DirClose(vlc_object_t *obj)
     closedir(sys->dir);
 }
 
-int DirRead (stream_t *access, input_item_node_t *node)
+
+/* Return the next entry, and its type if the file system tells it, so that
+ * most entries do not need a stat() round trip (costly on network mounts) */
+static const char *DirNext(DIR *dir, int *type)
+{
+    *type = ITEM_TYPE_UNKNOWN;
+#if defined (DT_UNKNOWN) && !defined (_WIN32) && !defined (__OS2__)
+    struct dirent *ent = readdir(dir);
+    if (ent == NULL)
+        return NULL;
+
+    switch (ent->d_type)
+    {
+        case DT_REG:
+            *type = ITEM_TYPE_FILE;
+            break;
+        case DT_DIR:
+            *type = ITEM_TYPE_DIRECTORY;
+            break;
+    }
+    return ent->d_name;
+#else
+    return vlc_readdir(dir);
+#endif
+}
+
+/* Return the item type of an entry of unknown type, -1 to skip it */
+static int DirStat(struct dir_walk *walk, struct dir_job *job,
+                   const char *entry, struct dir_id *id)
+{
+    struct stat st;
+
+#ifdef HAVE_FSTATAT
+    if (fstatat(dirfd(job->dir), entry, &st, 0))
+        return -1;
+#else
+    char *path;
+    int val;
+
+    if (job->path == NULL
+     || asprintf(&path, "%s"DIR_SEP"%s", job->path, entry) == -1
+     || (val = vlc_stat(path, &st), free(path), val))
+        return -1;
+#endif
+    switch (st.st_mode & S_IFMT)
+    {
+#ifdef S_IFBLK
+        case S_IFBLK:
+            return walk->special_files ? ITEM_TYPE_DISC : -1;
+#endif
+        case S_IFCHR:
+            return walk->special_files ? ITEM_TYPE_CARD : -1;
+        case S_IFIFO:
+            return walk->special_files ? ITEM_TYPE_STREAM : -1;
+        case S_IFREG:
+            return ITEM_TYPE_FILE;
+        case S_IFDIR:
+            id->dev = st.st_dev;
+            id->ino = st.st_ino;
+            return ITEM_TYPE_DIRECTORY;
+        /* S_IFLNK cannot occur while following symbolic links */
+        /* S_IFSOCK cannot be opened with open()/openat() */
+        default:
+            return -1; /* ignore */
+    }
+}
+
+static void DirJobDelete(struct dir_job *job)
+{
+    if (job->own_dir && job->dir != NULL)
+        closedir(job->dir);
+    free(job->path);
+    free(job->base_uri);
+    free(job->ids);
+    free(job);
+}
+
+/* Tell if a directory is one of the first count ones of a walk path */
+static bool DirIdFound(const struct dir_id *ids, unsigned count,
+                       const struct dir_id *id)
+{
+    if (id->ino == 0)
+        return false;
+    for (unsigned i = 0; i < count; i++)
+        if (ids[i].ino == id->ino && ids[i].dev == id->dev)
+            return true;
+    return false;
+}
+
+static void DirWalkPush(struct dir_walk *walk, struct dir_job *job)
+{
+    vlc_mutex_lock(&walk->lock);
+    vlc_list_append(&job->node, &walk->jobs);
+    vlc_cond_signal(&walk->wait);
+    vlc_mutex_unlock(&walk->lock);
+}
+
+/* Add a subdirectory to traverse: it becomes a node of the tree, without an
+ * URI of its own, like the folders of an archive, so that it is not expanded
+ * again by the playlist */
+static int DirAddSubdir(struct dir_walk *walk, struct dir_job *job,
+                        const char *entry, const char *uri,
+                        const struct dir_id *id, struct vlc_list *subdirs)
+{
+    if (entry[0] == '.'
+     && (!walk->hidden_files || entry[1] == '\0' || !strcmp(entry, "..")))
+        return VLC_SUCCESS;
+
+    /* a symbolic link to a directory being listed would loop */
+    if (DirIdFound(job->ids, job->depth + 1, id))
+    {
+        msg_Dbg(walk->access, "skipping %s: directory loop", uri);
+        return VLC_SUCCESS;
+    }
+
+    struct dir_job *sub = malloc(sizeof (*sub));
+    if (unlikely(sub == NULL))
+        return VLC_ENOMEM;
+
+    sub->dir = NULL;
+    sub->own_dir = true;
+    sub->base_uri = strdup(uri);
+    sub->need_separator = true;
+    sub->depth = job->depth + 1;
+    sub->ids = vlc_alloc(sub->depth + 1, sizeof (*sub->ids));
+    if (unlikely(sub->base_uri == NULL || sub->ids == NULL)
+     || asprintf(&sub->path, "%s"DIR_SEP"%s", job->path, entry) == -1)
+    {
+        free(sub->base_uri);
+        free(sub->ids);
+        free(sub);
+        return VLC_ENOMEM;
+    }
+    memcpy(sub->ids, job->ids, sub->depth * sizeof (*sub->ids));
+    sub->ids[sub->depth] = *id;
+
+    input_item_t *item = input_item_NewExt(INPUT_ITEM_URI_NOP, entry,
+                                           INPUT_DURATION_UNSET,
+                                           ITEM_TYPE_DIRECTORY,
+                                           ITEM_NET_UNKNOWN);
+    if (unlikely(item == NULL))
+    {
+        DirJobDelete(sub);
+        return VLC_ENOMEM;
+    }
+    input_item_CopyOptions(item, job->root->p_item);
+    sub->root = input_item_node_AppendItem(job->root, item);
+    input_item_Release(item);
+    if (unlikely(sub->root == NULL))
+    {
+        DirJobDelete(sub);
+        return VLC_ENOMEM;
+    }
+
+    vlc_list_append(&sub->node, subdirs);
+    return VLC_SUCCESS;
+}
+
+/* List one directory into its node, queuing its subdirectories */
+static int DirList(struct dir_walk *walk, struct dir_job *job)
 {
-    access_sys_t *sys = access->p_sys;
     const char *entry;
-    int ret = VLC_SUCCESS;
+    int type, ret = VLC_SUCCESS;
+    unsigned stats = 0;
+    struct vlc_list subdirs;
 
-    bool special_files = var_InheritBool(access, "list-special-files");
+    if (job->dir == NULL)
+    {
+        job->dir = vlc_opendir(job->path);
+        if (job->dir == NULL)
+            return VLC_SUCCESS; /* left empty, as an unreadable directory */
+    }
 
-    struct vlc_readdir_helper rdh;
-    vlc_readdir_helper_init(&rdh, access, node);
+    bool recurse = job->depth < walk->max_depth && job->path != NULL;
+    vlc_list_init(&subdirs);
 
-    while (ret == VLC_SUCCESS && (entry = vlc_readdir(sys->dir)) != NULL)
+    /* The subdirectories check their ancestors, this one included. Symbolic
+     * links were resolved by DirStat() already. */
+    struct dir_id *self = &job->ids[job->depth];
+    if (recurse && self->ino == 0)
     {
         struct stat st;
-        int type;
 
+        stats++;
 #ifdef HAVE_FSTATAT
-        if (fstatat(dirfd(sys->dir), entry, &st, 0))
-            continue;
+        if (fstat(dirfd(job->dir), &st) == 0)
 #else
-        char *path;
-
-        if (asprintf(&path, "%s"DIR_SEP"%s", access->psz_filepath, entry) == -1
-         || (type = vlc_stat(path, &st), free(path), type))
-            continue;
+        if (vlc_stat(job->path, &st) == 0)
 #endif
-        switch (st.st_mode & S_IFMT)
         {
-#ifdef S_IFBLK
-            case S_IFBLK:
-                if (!special_files)
-                    continue;
-                type = ITEM_TYPE_DISC;
-                break;
-#endif
-            case S_IFCHR:
-                if (!special_files)
-                    continue;
-                type = ITEM_TYPE_CARD;
-                break;
-            case S_IFIFO:
-                if (!special_files)
-                    continue;
-                type = ITEM_TYPE_STREAM;
-                break;
-            case S_IFREG:
-                type = ITEM_TYPE_FILE;
-                break;
-            case S_IFDIR:
-                type = ITEM_TYPE_DIRECTORY;
-                break;
-            /* S_IFLNK cannot occur while following symbolic links */
-            /* S_IFSOCK cannot be opened with open()/openat() */
-            default:
-                continue; /* ignore */
+            self->dev = st.st_dev;
+            self->ino = st.st_ino;
+        }
+        /* a directory mounted within itself is not expanded again */
+        if (DirIdFound(job->ids, job->depth, self))
+            recurse = false;
+    }
+
+    struct vlc_readdir_helper rdh;
+    vlc_readdir_helper_init(&rdh, walk->access, job->root);
+
+    while (ret == VLC_SUCCESS && (entry = DirNext(job->dir, &type)) != NULL)
+    {
+        struct dir_id id = { 0, 0 };
+
+        if (type == ITEM_TYPE_UNKNOWN)
+        {
+            stats++;
+            type = DirStat(walk, job, entry, &id);
+            if (type < 0)
+                continue;
         }
 
         /* Create an input item for the current entry */
@@ -181,8 +381,8 @@ int DirRead (stream_t *access, input_item_node_t *node)
         }
 
         char *uri;
-        if (unlikely(asprintf(&uri, "%s%s%s", sys->base_uri,
-                              sys->need_separator ? "/" : "",
+        if (unlikely(asprintf(&uri, "%s%s%s", job->base_uri,
+                              job->need_separator ? "/" : "",
                               encoded) == -1))
             uri = NULL;
         free(encoded);
@@ -191,12 +391,152 @@ int DirRead (stream_t *access, input_item_node_t *node)
             ret = VLC_ENOMEM;
             break;
         }
-        ret = vlc_readdir_helper_additem(&rdh, uri, NULL, entry, type,
-                                         ITEM_NET_UNKNOWN);
+
+        if (type == ITEM_TYPE_DIRECTORY && recurse)
+            ret = DirAddSubdir(walk, job, entry, uri, &id, &subdirs);
+        else
+            ret = vlc_readdir_helper_additem(&rdh, uri, NULL, entry, type,
+                                             ITEM_NET_UNKNOWN);
         free(uri);
     }
 
+    /* sorts the node, recursively: subdirectories are queued afterwards */
     vlc_readdir_helper_finish(&rdh, ret == VLC_SUCCESS);
 
+    struct dir_job *sub;
+    vlc_list_foreach(sub, &subdirs, node)
+    {
+        vlc_list_remove(&sub->node);
+        if (ret == VLC_SUCCESS)
+            DirWalkPush(walk, sub);
+        else
+            DirJobDelete(sub);
+    }
+
+    vlc_mutex_lock(&walk->lock);
+    walk->dirs++;
+    walk->stats += stats;
+    vlc_mutex_unlock(&walk->lock);
     return ret;
 }
+
+/* Take and list directories until the traversal is complete */
+static void DirWalkRun(struct dir_walk *walk, bool interruptible)
+{
+    vlc_mutex_lock(&walk->lock);
+    for (;;)
+    {
+        if (interruptible && vlc_killed() && walk->error == VLC_SUCCESS)
+        {
+            walk->error = VLC_EGENERIC;
+            vlc_cond_broadcast(&walk->wait);
+        }
+        if (walk->error != VLC_SUCCESS)
+            break;
+
+        struct dir_job *job =
+            vlc_list_first_entry_or_null(&walk->jobs, struct dir_job, node);
+        if (job == NULL)
+        {
+            if (walk->busy == 0)
+                break; /* nothing left, nor to be found */
+            vlc_cond_wait(&walk->wait, &walk->lock);
+            continue;
+        }
+
+        vlc_list_remove(&job->node);
+        walk->busy++;
+        vlc_mutex_unlock(&walk->lock);
+
+        int ret = DirList(walk, job);
+        DirJobDelete(job);
+
+        vlc_mutex_lock(&walk->lock);
+        walk->busy--;
+        if (ret != VLC_SUCCESS && walk->error == VLC_SUCCESS)
+            walk->error = ret;
+        if (walk->busy == 0 || walk->error != VLC_SUCCESS)
+            vlc_cond_broadcast(&walk->wait);
+    }
+    vlc_mutex_unlock(&walk->lock);
+}
+
+static void *DirWalkThread(void *data)
+{
+    DirWalkRun(data, false);
+    return NULL;
+}
+
+int DirRead (stream_t *access, input_item_node_t *node)
+{
+    access_sys_t *sys = access->p_sys;
+
+    struct dir_job *root = malloc(sizeof (*root));
+    if (unlikely(root == NULL))
+        return VLC_ENOMEM;
+
+    root->dir = sys->dir;
+    root->own_dir = false;
+    root->path = NULL;
+    root->base_uri = strdup(sys->base_uri);
+    root->need_separator = sys->need_separator;
+    root->root = node;
+    root->depth = 0;
+    root->ids = calloc(1, sizeof (*root->ids));
+    if (unlikely(root->base_uri == NULL || root->ids == NULL)
+     || (access->psz_filepath != NULL
+      && unlikely((root->path = strdup(access->psz_filepath)) == NULL)))
+    {
+        DirJobDelete(root);
+        return VLC_ENOMEM;
+    }
+
+    struct dir_walk walk = {
+        .access = access,
+        .special_files = var_InheritBool(access, "list-special-files"),
+        .hidden_files = var_InheritBool(access, "show-hiddenfiles"),
+        .max_depth = var_InheritInteger(access, "directory-depth"),
+        .busy = 0,
+        .error = VLC_SUCCESS,
+        .dirs = 0,
+        .stats = 0,
+    };
+    vlc_mutex_init(&walk.lock);
+    vlc_cond_init(&walk.wait);
+    vlc_list_init(&walk.jobs);
+    vlc_list_append(&root->node, &walk.jobs);
+
+    /* Subdirectories are listed by a bounded pool of readers, the calling
+     * thread being one of them. A single directory is listed in place. */
+    vlc_thread_t threads[DIR_MAX_THREADS - 1];
+    unsigned nthreads = 0;
+
+    if (walk.max_depth > 0)
+    {
+        unsigned max = var_InheritInteger(access, "directory-threads");
+        if (max > DIR_MAX_THREADS)
+            max = DIR_MAX_THREADS;
+
+        while (nthreads + 1 < max)
+        {
+            if (vlc_clone(&threads[nthreads], DirWalkThread, &walk,
+                          VLC_THREAD_PRIORITY_LOW))
+                break;
+            nthreads++;
+        }
+    }
+
+    DirWalkRun(&walk, true);
+    for (unsigned i = 0; i < nthreads; i++)
+        vlc_join(threads[i], NULL);
+
+    /* left over on error */
+    struct dir_job *job;
+    vlc_list_foreach(job, &walk.jobs, node)
+        DirJobDelete(job);
+
+    if (walk.max_depth > 0)
+        msg_Dbg(access, "listed %u directories with %u readers, %u stat calls",
+                walk.dirs, nthreads + 1, walk.stats);
+    return walk.error;
+}
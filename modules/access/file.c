@@ -28,6 +28,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -50,6 +51,9 @@
 #else
 #   include <unistd.h>
 #endif
+#ifdef HAVE_MMAP
+#   include <sys/mman.h>
+#endif
 #include <dirent.h>
 
 #include <vlc_common.h>
@@ -61,12 +65,28 @@
 #include <vlc_fs.h>
 #include <vlc_url.h>
 #include <vlc_interrupt.h>
+#include <vlc_block.h>
+
+#if defined (HAVE_PREAD) && !defined (_WIN32)
+# define HAVE_READAHEAD 1
+struct readahead;
+#endif
+#ifdef HAVE_MMAP
+struct file_map;
+#endif
 
 typedef struct
 {
     int fd;
 
     bool b_pace_control;
+#ifdef HAVE_READAHEAD
+    struct readahead *readahead; /**< NULL when reading on demand */
+#endif
+#ifdef HAVE_MMAP
+    struct file_map *map; /**< NULL when not memory mapped */
+    uint64_t map_offset;
+#endif
 } access_sys_t;
 
 #if !defined (_WIN32) && !defined (__OS2__)
@@ -124,11 +144,331 @@ static bool IsRemote (const char *path)
 #ifndef HAVE_POSIX_FADVISE
 # define posix_fadvise(fd, off, len, adv)
 #endif
+#ifndef HAVE_POSIX_MADVISE
+# define posix_madvise(addr, len, adv)
+#endif
 
 static ssize_t Read (stream_t *, void *, size_t);
 static int FileSeek (stream_t *, uint64_t);
 static int FileControl (stream_t *, int, va_list);
 
+#ifdef HAVE_READAHEAD
+/*****************************************************************************
+ * Read-ahead: a thread reads large blocks ahead of the demuxer, straight into
+ * the blocks handed to the stream, while the kernel is told to fetch the next
+ * ones. This keeps several reads in flight on fast storage.
+ *****************************************************************************/
+struct readahead
+{
+    stream_t *access;
+    int fd;
+    size_t read_size;
+    size_t max_queued; /**< bytes kept read ahead */
+
+    vlc_thread_t thread;
+    vlc_mutex_t lock;
+    vlc_cond_t wait_data; /**< the reader waits for a block */
+    vlc_cond_t wait_space; /**< the thread waits for room or a seek */
+
+    block_t *queue;
+    block_t **queue_last;
+    size_t queued;
+    uint64_t offset; /**< file offset of the next read */
+    unsigned generation; /**< bumped on every seek */
+    bool eof;
+    bool closing;
+};
+
+static void ReadAheadFlush(struct readahead *ra)
+{
+    vlc_mutex_assert(&ra->lock);
+
+    block_ChainRelease(ra->queue);
+    ra->queue = NULL;
+    ra->queue_last = &ra->queue;
+    ra->queued = 0;
+}
+
+static void *ReadAheadThread(void *data)
+{
+    struct readahead *ra = data;
+
+    vlc_mutex_lock(&ra->lock);
+    for (;;)
+    {
+        while (!ra->closing && (ra->eof || ra->queued >= ra->max_queued))
+            vlc_cond_wait(&ra->wait_space, &ra->lock);
+        if (ra->closing)
+            break;
+
+        uint64_t offset = ra->offset;
+        unsigned generation = ra->generation;
+        vlc_mutex_unlock(&ra->lock);
+
+        /* the kernel reads the following blocks while we wait for this one */
+        posix_fadvise(ra->fd, offset + ra->read_size, ra->max_queued,
+                      POSIX_FADV_WILLNEED);
+
+        block_t *block = block_Alloc(ra->read_size);
+        ssize_t val = -1;
+
+        if (likely(block != NULL))
+            do
+                val = pread(ra->fd, block->p_buffer, ra->read_size, offset);
+            while (val < 0 && errno == EINTR);
+
+        if (val < 0)
+            msg_Err(ra->access, "read error: %s", vlc_strerror_c(errno));
+
+        vlc_mutex_lock(&ra->lock);
+        if (generation != ra->generation || val <= 0)
+        {   /* seeked meanwhile, end of file or error */
+            if (block != NULL)
+                block_Release(block);
+            if (generation == ra->generation)
+                ra->eof = true;
+            vlc_cond_signal(&ra->wait_data);
+            continue;
+        }
+
+        block->i_buffer = val;
+        *ra->queue_last = block;
+        ra->queue_last = &block->p_next;
+        ra->queued += val;
+        ra->offset += val;
+        vlc_cond_signal(&ra->wait_data);
+    }
+    vlc_mutex_unlock(&ra->lock);
+    return NULL;
+}
+
+static void ReadAheadWake(void *data)
+{
+    struct readahead *ra = data;
+
+    vlc_mutex_lock(&ra->lock);
+    vlc_cond_broadcast(&ra->wait_data);
+    vlc_mutex_unlock(&ra->lock);
+}
+
+static block_t *ReadAheadBlock(stream_t *p_access, bool *restrict eof)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    struct readahead *ra = p_sys->readahead;
+    block_t *block = NULL;
+
+    vlc_interrupt_register(ReadAheadWake, ra);
+    vlc_mutex_lock(&ra->lock);
+    while (ra->queue == NULL && !ra->eof && !vlc_killed())
+        vlc_cond_wait(&ra->wait_data, &ra->lock);
+
+    if (ra->queue != NULL)
+    {
+        block = ra->queue;
+        ra->queue = block->p_next;
+        if (ra->queue == NULL)
+            ra->queue_last = &ra->queue;
+        block->p_next = NULL;
+        ra->queued -= block->i_buffer;
+        vlc_cond_signal(&ra->wait_space);
+    }
+    else if (ra->eof)
+    {   /* the file may grow: read again next time */
+        *eof = true;
+        ra->eof = false;
+        vlc_cond_signal(&ra->wait_space);
+    }
+    vlc_mutex_unlock(&ra->lock);
+    vlc_interrupt_unregister();
+    return block;
+}
+
+static int ReadAheadSeek(stream_t *p_access, uint64_t i_pos)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    struct readahead *ra = p_sys->readahead;
+
+    vlc_mutex_lock(&ra->lock);
+    ReadAheadFlush(ra);
+    ra->offset = i_pos;
+    ra->generation++;
+    ra->eof = false;
+    vlc_cond_signal(&ra->wait_space);
+    vlc_mutex_unlock(&ra->lock);
+    return VLC_SUCCESS;
+}
+
+static struct readahead *ReadAheadNew(stream_t *p_access, int fd,
+                                      unsigned depth, size_t read_size)
+{
+    struct readahead *ra = malloc(sizeof (*ra));
+    if (unlikely(ra == NULL))
+        return NULL;
+
+    ra->access = p_access;
+    ra->fd = fd;
+    ra->read_size = read_size;
+    ra->max_queued = depth * read_size;
+    vlc_mutex_init(&ra->lock);
+    vlc_cond_init(&ra->wait_data);
+    vlc_cond_init(&ra->wait_space);
+    ra->queue = NULL;
+    ra->queue_last = &ra->queue;
+    ra->queued = 0;
+    ra->offset = 0;
+    ra->generation = 0;
+    ra->eof = false;
+    ra->closing = false;
+
+    if (vlc_clone(&ra->thread, ReadAheadThread, ra, VLC_THREAD_PRIORITY_INPUT))
+    {
+        free(ra);
+        return NULL;
+    }
+    return ra;
+}
+
+static void ReadAheadDelete(struct readahead *ra)
+{
+    vlc_mutex_lock(&ra->lock);
+    ra->closing = true;
+    vlc_cond_signal(&ra->wait_space);
+    vlc_mutex_unlock(&ra->lock);
+
+    vlc_join(ra->thread, NULL);
+    block_ChainRelease(ra->queue);
+    free(ra);
+}
+#endif
+
+#ifdef HAVE_MMAP
+/*****************************************************************************
+ * Memory mapping: blocks point into a private mapping of the whole file, so
+ * that seeking and peeking within a block need neither system call nor copy.
+ *****************************************************************************/
+#define FILE_MAP_BLOCK_SIZE (4 << 20)
+
+struct file_map
+{
+    atomic_uint refs; /**< one for the access, one per block */
+    void *addr;
+    size_t length;
+};
+
+struct file_map_block
+{
+    block_t self;
+    struct file_map *map;
+};
+
+static struct file_map *FileMapNew(int fd, uint64_t size)
+{
+    if (size == 0 || size > SIZE_MAX)
+        return NULL;
+
+    /* writable private pages, as blocks may be modified in place */
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED)
+        return NULL;
+
+    struct file_map *map = malloc(sizeof (*map));
+    if (unlikely(map == NULL))
+    {
+        munmap(addr, size);
+        return NULL;
+    }
+    atomic_init(&map->refs, 1);
+    map->addr = addr;
+    map->length = size;
+    return map;
+}
+
+static void FileMapRelease(struct file_map *map)
+{
+    if (atomic_fetch_sub_explicit(&map->refs, 1, memory_order_acq_rel) == 1)
+    {
+        munmap(map->addr, map->length);
+        free(map);
+    }
+}
+
+static void FileMapBlockRelease(block_t *block)
+{
+    struct file_map_block *mb = container_of(block, struct file_map_block,
+                                             self);
+
+    FileMapRelease(mb->map);
+    free(mb);
+}
+
+static const struct vlc_block_callbacks file_map_block_cbs =
+{
+    FileMapBlockRelease,
+};
+
+static block_t *FileMapBlock(stream_t *p_access, bool *restrict eof)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+    struct file_map *map = p_sys->map;
+
+    if (p_sys->map_offset >= map->length)
+    {   /* the file may have grown since it was mapped */
+        struct stat st;
+
+        if (fstat(p_sys->fd, &st) == 0 && (uint64_t)st.st_size > map->length)
+        {
+            struct file_map *grown = FileMapNew(p_sys->fd, st.st_size);
+            if (grown != NULL)
+            {
+                FileMapRelease(map);
+                p_sys->map = map = grown;
+            }
+        }
+
+        if (p_sys->map_offset >= map->length)
+        {
+            *eof = true;
+            return NULL;
+        }
+    }
+
+    struct file_map_block *mb = malloc(sizeof (*mb));
+    if (unlikely(mb == NULL))
+        return NULL;
+
+    size_t length = map->length - p_sys->map_offset;
+    if (length > FILE_MAP_BLOCK_SIZE)
+        length = FILE_MAP_BLOCK_SIZE;
+
+    uint8_t *data = (uint8_t *)map->addr + p_sys->map_offset;
+    block_Init(&mb->self, &file_map_block_cbs, data, length);
+    mb->map = map;
+    atomic_fetch_add_explicit(&map->refs, 1, memory_order_relaxed);
+    p_sys->map_offset += length;
+
+    /* have the kernel fetch the next block meanwhile */
+    if (p_sys->map_offset < map->length)
+    {
+        size_t page_mask = sysconf(_SC_PAGESIZE) - 1;
+        size_t start = p_sys->map_offset & ~page_mask;
+        size_t next = map->length - start;
+
+        if (next > FILE_MAP_BLOCK_SIZE)
+            next = FILE_MAP_BLOCK_SIZE;
+        posix_madvise((char *)map->addr + start, next, POSIX_MADV_WILLNEED);
+    }
+    return &mb->self;
+}
+
+static int FileMapSeek(stream_t *p_access, uint64_t i_pos)
+{
+    access_sys_t *p_sys = p_access->p_sys;
+
+    p_sys->map_offset = i_pos;
+    return VLC_SUCCESS;
+}
+#endif
+
 /*****************************************************************************
  * FileOpen: open the file
  *****************************************************************************/
@@ -210,6 +550,13 @@ int FileOpen( vlc_object_t *p_this )
     p_access->pf_control = FileControl;
     p_access->p_sys = p_sys;
     p_sys->fd = fd;
+#ifdef HAVE_READAHEAD
+    p_sys->readahead = NULL;
+#endif
+#ifdef HAVE_MMAP
+    p_sys->map = NULL;
+    p_sys->map_offset = 0;
+#endif
 
     if (S_ISREG (st.st_mode) || S_ISBLK (st.st_mode))
     {
@@ -228,6 +575,40 @@ int FileOpen( vlc_object_t *p_this )
             fcntl (fd, F_RDAHEAD, 0);
         else
             fcntl (fd, F_RDAHEAD, 1);
+#endif
+#ifdef HAVE_MMAP
+        if (S_ISREG (st.st_mode) && var_InheritBool (p_access, "file-mmap"))
+        {
+            p_sys->map = FileMapNew (fd, st.st_size);
+            if (p_sys->map != NULL)
+            {
+                msg_Dbg (p_access, "mapped %"PRIu64" bytes",
+                         (uint64_t)st.st_size);
+                p_access->pf_read = NULL;
+                p_access->pf_block = FileMapBlock;
+                p_access->pf_seek = FileMapSeek;
+            }
+            else
+                msg_Dbg (p_access, "cannot map file, reading it instead");
+        }
+#endif
+#ifdef HAVE_READAHEAD
+        unsigned depth = var_InheritInteger (p_access, "file-readahead");
+        if (depth > 0 && S_ISREG (st.st_mode) && p_access->pf_read != NULL)
+        {
+            size_t size = var_InheritInteger (p_access, "file-readahead-size");
+
+            p_sys->readahead = ReadAheadNew (p_access, fd, depth, size << 10);
+            if (p_sys->readahead != NULL)
+            {
+                msg_Dbg (p_access, "reading %u blocks of %zu KiB ahead",
+                         depth, size);
+                posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                p_access->pf_read = NULL;
+                p_access->pf_block = ReadAheadBlock;
+                p_access->pf_seek = ReadAheadSeek;
+            }
+        }
 #endif
     }
     else
@@ -250,7 +631,7 @@ void FileClose (vlc_object_t * p_this)
 {
     stream_t     *p_access = (stream_t*)p_this;
 
-    if (p_access->pf_read == NULL)
+    if (p_access->pf_read == NULL && p_access->pf_block == NULL)
     {
         DirClose (p_this);
         return;
@@ -258,6 +639,14 @@ void FileClose (vlc_object_t * p_this)
 
     access_sys_t *p_sys = p_access->p_sys;
 
+#ifdef HAVE_READAHEAD
+    if (p_sys->readahead != NULL)
+        ReadAheadDelete (p_sys->readahead);
+#endif
+#ifdef HAVE_MMAP
+    if (p_sys->map != NULL)
+        FileMapRelease (p_sys->map);
+#endif
     vlc_close (p_sys->fd);
 }
 
@@ -319,6 +708,14 @@ static int FileControl( stream_t *p_access, int i_query, va_list args )
             *pb_bool = p_sys->b_pace_control;
             break;
 
+#ifdef HAVE_MMAP
+        case STREAM_IS_MEMORY_MAPPED:
+            if (p_sys->map == NULL)
+                return VLC_EGENERIC;
+            *va_arg( args, bool * ) = true;
+            break;
+#endif
+
         case STREAM_GET_SIZE:
         {
             struct stat st;
@@ -39,6 +39,18 @@ vlc_module_begin ()
     set_capability( "access", 50 )
     add_shortcut( "file", "fd", "stream" )
     set_callbacks( FileOpen, FileClose )
+    add_integer("file-readahead", 0, N_("Read-ahead blocks"),
+                N_("Number of blocks read ahead of the demuxer from regular "
+                   "files, by a separate thread. This keeps fast storage "
+                   "busy with high bitrate files. 0 reads on demand."), true)
+        change_integer_range(0, 64)
+    add_integer("file-readahead-size", 1024, N_("Read-ahead block size"),
+                N_("Size of the blocks read ahead (KiB)."), true)
+        change_integer_range(64, 65536)
+    add_bool("file-mmap", false, N_("Memory map files"),
+             N_("Map regular files in memory, so that demuxers seek and "
+                "peek in the file without system calls nor copies. "
+                "The file must not be truncated while being read."), true)
 
     add_submodule()
     set_section( N_("Directory" ), NULL )
@@ -52,5 +64,15 @@ vlc_module_begin ()
 
     add_bool("list-special-files", false, N_("List special files"),
              N_("Include devices and pipes when listing directories"), true)
+    add_integer("directory-depth", 0, N_("Subdirectory depth"),
+                N_("Subdirectories are listed along with their parent, down "
+                   "to this depth, instead of being expanded one by one."),
+                true)
+        change_integer_range(0, 64)
+    add_integer("directory-threads", 4, N_("Directory readers"),
+                N_("Number of directories listed in parallel, when listing "
+                   "subdirectories. This hides the latency of network file "
+                   "systems."), true)
+        change_integer_range(1, 32)
     add_obsolete_string("directory-sort") /* since 3.0.0 */
 vlc_module_end ()
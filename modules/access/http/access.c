@@ -37,14 +37,18 @@
 #include <vlc_url.h>
 
 #include "connmgr.h"
+#include "message.h"
 #include "resource.h"
 #include "file.h"
 #include "live.h"
+#include "multi.h"
 
 typedef struct
 {
     struct vlc_http_mgr *manager;
     struct vlc_http_resource *resource;
+    struct vlc_http_multi *multi;
+    char *content_type; /**< of the initial response, with multi only */
 } access_sys_t;
 
 static block_t *FileRead(stream_t *access, bool *restrict eof)
@@ -66,6 +70,72 @@ static int FileSeek(stream_t *access, uint64_t pos)
     return VLC_SUCCESS;
 }
 
+static block_t *MultiRead(stream_t *access, bool *restrict eof)
+{
+    access_sys_t *sys = access->p_sys;
+
+    block_t *b = vlc_http_multi_read(sys->multi);
+    if (b == NULL)
+        *eof = true;
+    else if (b == vlc_http_error)
+        b = NULL; /* interrupted */
+    return b;
+}
+
+static int MultiSeek(stream_t *access, uint64_t pos)
+{
+    access_sys_t *sys = access->p_sys;
+
+    vlc_http_multi_seek(sys->multi, pos);
+    return VLC_SUCCESS;
+}
+
+static int MultiControl(stream_t *access, int query, va_list args)
+{
+    access_sys_t *sys = access->p_sys;
+
+    switch (query)
+    {
+        case STREAM_CAN_SEEK:
+        case STREAM_CAN_PAUSE:
+        case STREAM_CAN_CONTROL_PACE:
+            *va_arg(args, bool *) = true;
+            break;
+
+        case STREAM_CAN_FASTSEEK:
+            *va_arg(args, bool *) = false;
+            break;
+
+        case STREAM_GET_SIZE:
+            *va_arg(args, uint64_t *) = vlc_http_multi_get_size(sys->multi);
+            break;
+
+        case STREAM_GET_PTS_DELAY:
+            *va_arg(args, vlc_tick_t *) = VLC_TICK_FROM_MS(
+                var_InheritInteger(access, "network-caching") );
+            break;
+
+        case STREAM_GET_CONTENT_TYPE:
+        {
+            if (sys->content_type == NULL)
+                return VLC_EGENERIC;
+
+            char *type = strdup(sys->content_type);
+            if (unlikely(type == NULL))
+                return VLC_ENOMEM;
+            *va_arg(args, char **) = type;
+            break;
+        }
+
+        case STREAM_SET_PAUSE_STATE:
+            break;
+
+        default:
+            return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
 static int FileControl(stream_t *access, int query, va_list args)
 {
     access_sys_t *sys = access->p_sys;
@@ -162,6 +232,8 @@ static int Open(vlc_object_t *obj)
 
     sys->manager = NULL;
     sys->resource = NULL;
+    sys->multi = NULL;
+    sys->content_type = NULL;
 
     void *jar = NULL;
     if (var_InheritBool(obj, "http-forward-cookies"))
@@ -237,6 +309,33 @@ static int Open(vlc_object_t *obj)
         goto error;
     }
 
+    unsigned conns = var_InheritInteger(obj, "http-connections");
+    if (!live && conns > 1)
+    {   /* Fetch byte ranges in parallel, if the server supports them.
+         * The initial response is used for its metadata only. */
+        size_t range_size = var_InheritInteger(obj, "http-range-size") << 10;
+
+        ua = var_InheritString(obj, "http-user-agent");
+        referer = var_InheritString(obj, "http-referrer");
+        sys->multi = vlc_http_multi_create(obj, jar, sys->resource,
+                                           access->psz_url, ua, referer,
+                                           conns, range_size, 0);
+        free(referer);
+        free(ua);
+
+        if (sys->multi == NULL)
+            msg_Dbg(access, "byte ranges not supported, "
+                    "using a single connection");
+        else
+        {   /* Do not leave its connection open with an unread body */
+            sys->content_type = vlc_http_file_get_type(sys->resource);
+            vlc_http_res_destroy(sys->resource);
+            sys->resource = NULL;
+            vlc_http_mgr_destroy(sys->manager);
+            sys->manager = NULL;
+        }
+    }
+
     vlc_credential_store(&crd, obj);
     free(psz_realm);
     vlc_credential_clean(&crd);
@@ -249,6 +348,12 @@ static int Open(vlc_object_t *obj)
         access->pf_seek = NULL;
         access->pf_control = LiveControl;
     }
+    else if (sys->multi != NULL)
+    {
+        access->pf_block = MultiRead;
+        access->pf_seek = MultiSeek;
+        access->pf_control = MultiControl;
+    }
     else
     {
         access->pf_block = FileRead;
@@ -275,8 +380,13 @@ static void Close(vlc_object_t *obj)
     stream_t *access = (stream_t *)obj;
     access_sys_t *sys = access->p_sys;
 
-    vlc_http_res_destroy(sys->resource);
-    vlc_http_mgr_destroy(sys->manager);
+    if (sys->multi != NULL)
+        vlc_http_multi_destroy(sys->multi);
+    if (sys->resource != NULL)
+        vlc_http_res_destroy(sys->resource);
+    if (sys->manager != NULL)
+        vlc_http_mgr_destroy(sys->manager);
+    free(sys->content_type);
     free(sys);
 }
 
@@ -294,6 +404,14 @@ vlc_module_begin()
         change_volatile()
     add_bool("http-forward-cookies", true, N_("Cookies forwarding"),
              N_("Forward cookies across HTTP redirections."), true)
+    add_integer("http-connections", 1, N_("Connections"),
+                N_("Number of connections reading byte ranges of a file in "
+                   "parallel, to fill high latency links."), true)
+        change_integer_range(1, 16)
+    add_integer("http-range-size", 4096, N_("Byte range size (KiB)"),
+                N_("Size of the byte ranges requested by each connection "
+                   "when using several connections."), true)
+        change_integer_range(64, 65536)
     add_string("http-referrer", NULL, N_("Referrer"),
                N_("Provide the referral URL, i.e. HTTP \"Referer\" (sic)."),
                true)
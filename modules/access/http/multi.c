@@ -0,0 +1,495 @@
+/*****************************************************************************
+ * multi.c: HTTP file read over several connections
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_interrupt.h>
+#include "message.h"
+#include "connmgr.h"
+#include "resource.h"
+#include "file.h"
+#include "multi.h"
+
+#pragma GCC visibility push(default)
+
+/* Failed requests in a row before giving up on a range */
+#define VLC_HTTP_MULTI_RETRIES 3
+
+struct vlc_http_range
+{
+    struct vlc_http_range *next;
+    uintmax_t start; /**< offset of the first byte not read yet */
+    uintmax_t end; /**< offset after the last byte of the range */
+    uintmax_t received; /**< offset after the last byte received */
+    block_t *blocks;
+    block_t **blocks_last;
+    bool fetching; /**< a connection is using the range */
+    bool dropped; /**< the range is not needed anymore */
+};
+
+struct vlc_http_multi_conn
+{
+    struct vlc_http_multi *multi;
+    struct vlc_http_mgr *manager;
+    struct vlc_http_resource *resource;
+    vlc_interrupt_t *interrupt;
+    vlc_thread_t thread;
+};
+
+struct vlc_http_multi
+{
+    vlc_mutex_t lock;
+    vlc_cond_t wait_data; /**< wait for data or errors (reader) */
+    vlc_cond_t wait_space; /**< wait for a range to fetch (connections) */
+
+    uintmax_t size;
+    size_t range_size;
+    size_t window; /**< maximum bytes assigned ahead of the read offset */
+    char *etag;
+    time_t mtime;
+
+    uintmax_t offset; /**< read offset */
+    uintmax_t next; /**< start of the first range not assigned yet */
+    struct vlc_http_range *ranges; /**< assigned ranges, in file order */
+    struct vlc_http_range **ranges_last;
+    bool error;
+    bool closing;
+
+    unsigned conns;
+    struct vlc_http_multi_conn conn[];
+};
+
+/* Range requests are made through a resource per connection */
+struct vlc_http_range_file
+{
+    struct vlc_http_resource resource;
+    const struct vlc_http_multi *multi;
+};
+
+static int vlc_http_range_req(const struct vlc_http_resource *res,
+                              struct vlc_http_msg *req, void *opaque)
+{
+    const struct vlc_http_range_file *file =
+        (const struct vlc_http_range_file *)res;
+    const struct vlc_http_multi *multi = file->multi;
+    const uintmax_t *bounds = opaque;
+
+    /* All ranges must come from the same version of the file */
+    if (multi->etag != NULL)
+    {
+        const char *str = multi->etag;
+
+        if (!memcmp(str, "W/", 2))
+            str += 2; /* skip weak mark */
+        vlc_http_msg_add_header(req, "If-Match", "%s", str);
+    }
+    else if (multi->mtime != -1)
+        vlc_http_msg_add_time(req, "If-Unmodified-Since", &multi->mtime);
+
+    return vlc_http_msg_add_header(req, "Range", "bytes=%" PRIuMAX "-%"
+                                   PRIuMAX, bounds[0], bounds[1]);
+}
+
+static int vlc_http_range_resp(const struct vlc_http_resource *res,
+                               const struct vlc_http_msg *resp, void *opaque)
+{
+    const uintmax_t *bounds = opaque;
+
+    if (vlc_http_msg_get_status(resp) != 206)
+        goto fail; /* changed file, or range not honoured anymore */
+
+    const char *str = vlc_http_msg_get_header(resp, "Content-Range");
+    uintmax_t start, end;
+
+    if (str == NULL
+     || sscanf(str, "bytes %" SCNuMAX "-%" SCNuMAX, &start, &end) != 2
+     || start != bounds[0] || start > end)
+        goto fail;
+
+    (void) res;
+    return 0;
+
+fail:
+    errno = EIO;
+    return -1;
+}
+
+static const struct vlc_http_resource_cbs vlc_http_range_callbacks =
+{
+    vlc_http_range_req,
+    vlc_http_range_resp,
+};
+
+static void vlc_http_range_flush(struct vlc_http_range *range)
+{
+    block_ChainRelease(range->blocks);
+    range->blocks = NULL;
+    range->blocks_last = &range->blocks;
+}
+
+/* Removes a range from the list, releasing it unless a connection uses it */
+static void vlc_http_range_drop(struct vlc_http_range *range)
+{
+    vlc_http_range_flush(range);
+    if (range->fetching)
+        range->dropped = true; /* released by the connection */
+    else
+        free(range);
+}
+
+/**
+ * Fetches a range, resuming after the last received byte if the connection
+ * fails. Called with the lock held.
+ */
+static void vlc_http_multi_fetch(struct vlc_http_multi_conn *conn,
+                                 struct vlc_http_range *range)
+{
+    struct vlc_http_multi *multi = conn->multi;
+    unsigned retries = 0;
+
+    while (!range->dropped && !multi->closing && range->received < range->end)
+    {
+        uintmax_t bounds[2] = { range->received, range->end - 1 };
+
+        vlc_mutex_unlock(&multi->lock);
+        struct vlc_http_msg *resp = vlc_http_res_open(conn->resource, bounds);
+        vlc_mutex_lock(&multi->lock);
+
+        if (resp == NULL)
+        {
+            if (++retries >= VLC_HTTP_MULTI_RETRIES || multi->closing)
+            {
+                if (!range->dropped && !multi->closing)
+                    multi->error = true;
+                vlc_cond_signal(&multi->wait_data);
+                break;
+            }
+            continue;
+        }
+
+        while (!range->dropped && !multi->closing)
+        {
+            vlc_mutex_unlock(&multi->lock);
+            block_t *block = vlc_http_msg_read(resp);
+            vlc_mutex_lock(&multi->lock);
+
+            if (block == NULL || block == vlc_http_error)
+                break; /* connection closed early: request the rest */
+            if (range->dropped)
+            {
+                block_Release(block);
+                break;
+            }
+
+            if (block->i_buffer > range->end - range->received)
+                block->i_buffer = range->end - range->received;
+
+            range->received += block->i_buffer;
+            *range->blocks_last = block;
+            range->blocks_last = &block->p_next;
+            retries = 0;
+            vlc_cond_signal(&multi->wait_data);
+
+            if (range->received >= range->end)
+                break;
+        }
+
+        vlc_mutex_unlock(&multi->lock);
+        vlc_http_msg_destroy(resp);
+        vlc_mutex_lock(&multi->lock);
+
+        if (range->received == bounds[0] && !range->dropped
+         && ++retries >= VLC_HTTP_MULTI_RETRIES)
+        {   /* connection closed without any data, repeatedly */
+            multi->error = true;
+            vlc_cond_signal(&multi->wait_data);
+            break;
+        }
+    }
+
+    range->fetching = false;
+    if (range->dropped)
+        free(range);
+}
+
+static void *vlc_http_multi_thread(void *data)
+{
+    struct vlc_http_multi_conn *conn = data;
+    struct vlc_http_multi *multi = conn->multi;
+
+    vlc_interrupt_set(conn->interrupt);
+
+    vlc_mutex_lock(&multi->lock);
+    for (;;)
+    {
+        while (!multi->closing
+            && (multi->next >= multi->size || multi->error
+             || multi->next - multi->offset >= multi->window))
+            vlc_cond_wait(&multi->wait_space, &multi->lock);
+        if (multi->closing)
+            break;
+
+        struct vlc_http_range *range = malloc(sizeof (*range));
+        if (unlikely(range == NULL))
+        {
+            multi->error = true;
+            vlc_cond_signal(&multi->wait_data);
+            continue;
+        }
+
+        range->next = NULL;
+        range->start = multi->next;
+        range->end = multi->next + multi->range_size;
+        if (range->end > multi->size)
+            range->end = multi->size;
+        range->received = range->start;
+        range->blocks = NULL;
+        range->blocks_last = &range->blocks;
+        range->fetching = true;
+        range->dropped = false;
+
+        *multi->ranges_last = range;
+        multi->ranges_last = &range->next;
+        multi->next = range->end;
+
+        vlc_http_multi_fetch(conn, range);
+    }
+    vlc_mutex_unlock(&multi->lock);
+    return NULL;
+}
+
+struct vlc_http_multi *vlc_http_multi_create(vlc_object_t *obj,
+                                             struct vlc_http_cookie_jar_t *jar,
+                                             struct vlc_http_resource *file,
+                                             const char *url, const char *ua,
+                                             const char *ref, unsigned conns,
+                                             size_t range_size,
+                                             uintmax_t offset)
+{
+    assert(conns > 0 && range_size > 0);
+
+    uintmax_t size = vlc_http_file_get_size(file);
+    if (size == (uintmax_t)-1 || !vlc_http_file_can_seek(file))
+        return NULL;
+
+    struct vlc_http_multi *multi =
+        malloc(sizeof (*multi) + conns * sizeof (multi->conn[0]));
+    if (unlikely(multi == NULL))
+        return NULL;
+
+    vlc_mutex_init(&multi->lock);
+    vlc_cond_init(&multi->wait_data);
+    vlc_cond_init(&multi->wait_space);
+    multi->size = size;
+    multi->range_size = range_size;
+    /* every connection can have a range in flight, and as much buffered */
+    multi->window = 2 * conns * range_size;
+
+    const char *etag = vlc_http_msg_get_header(file->response, "ETag");
+    multi->etag = (etag != NULL) ? strdup(etag) : NULL;
+    multi->mtime = vlc_http_msg_get_mtime(file->response);
+
+    multi->offset = offset;
+    multi->next = offset;
+    multi->ranges = NULL;
+    multi->ranges_last = &multi->ranges;
+    multi->error = false;
+    multi->closing = false;
+    multi->conns = 0;
+
+    for (unsigned i = 0; i < conns; i++)
+    {
+        struct vlc_http_multi_conn *conn = &multi->conn[i];
+        struct vlc_http_range_file *res = malloc(sizeof (*res));
+
+        if (unlikely(res == NULL))
+            break;
+
+        conn->multi = multi;
+        conn->manager = vlc_http_mgr_create(obj, jar);
+        conn->interrupt = vlc_interrupt_create();
+        if (conn->manager == NULL || conn->interrupt == NULL
+         || vlc_http_res_init(&res->resource, &vlc_http_range_callbacks,
+                              conn->manager, url, ua, ref))
+        {
+            if (conn->interrupt != NULL)
+                vlc_interrupt_destroy(conn->interrupt);
+            if (conn->manager != NULL)
+                vlc_http_mgr_destroy(conn->manager);
+            free(res);
+            break;
+        }
+
+        res->multi = multi;
+        conn->resource = &res->resource;
+        if (file->username != NULL)
+            vlc_http_res_set_login(conn->resource, file->username,
+                                   file->password);
+
+        if (vlc_clone(&conn->thread, vlc_http_multi_thread, conn,
+                      VLC_THREAD_PRIORITY_INPUT))
+        {
+            vlc_http_res_destroy(conn->resource);
+            vlc_interrupt_destroy(conn->interrupt);
+            vlc_http_mgr_destroy(conn->manager);
+            break;
+        }
+        multi->conns++;
+    }
+
+    if (multi->conns == 0)
+    {
+        free(multi->etag);
+        free(multi);
+        return NULL;
+    }
+    return multi;
+}
+
+void vlc_http_multi_destroy(struct vlc_http_multi *multi)
+{
+    vlc_mutex_lock(&multi->lock);
+    multi->closing = true;
+    vlc_cond_broadcast(&multi->wait_space);
+    vlc_mutex_unlock(&multi->lock);
+
+    for (unsigned i = 0; i < multi->conns; i++)
+        vlc_interrupt_kill(multi->conn[i].interrupt);
+
+    for (unsigned i = 0; i < multi->conns; i++)
+    {
+        struct vlc_http_multi_conn *conn = &multi->conn[i];
+
+        vlc_join(conn->thread, NULL);
+        vlc_http_res_destroy(conn->resource);
+        vlc_interrupt_destroy(conn->interrupt);
+        vlc_http_mgr_destroy(conn->manager);
+    }
+
+    for (struct vlc_http_range *range = multi->ranges, *next;
+         range != NULL; range = next)
+    {
+        next = range->next;
+        assert(!range->fetching);
+        vlc_http_range_drop(range);
+    }
+
+    free(multi->etag);
+    free(multi);
+}
+
+uintmax_t vlc_http_multi_get_size(const struct vlc_http_multi *multi)
+{
+    return multi->size;
+}
+
+static void vlc_http_multi_wake(void *data)
+{
+    struct vlc_http_multi *multi = data;
+
+    vlc_mutex_lock(&multi->lock);
+    vlc_cond_broadcast(&multi->wait_data);
+    vlc_mutex_unlock(&multi->lock);
+}
+
+block_t *vlc_http_multi_read(struct vlc_http_multi *multi)
+{
+    block_t *block = NULL;
+
+    vlc_interrupt_register(vlc_http_multi_wake, multi);
+    vlc_mutex_lock(&multi->lock);
+
+    for (;;)
+    {
+        struct vlc_http_range *range = multi->ranges;
+
+        if (multi->offset >= multi->size)
+            break; /* end of file */
+
+        if (range != NULL && range->blocks != NULL)
+        {
+            assert(range->start == multi->offset);
+            block = range->blocks;
+            range->blocks = block->p_next;
+            if (range->blocks == NULL)
+                range->blocks_last = &range->blocks;
+            block->p_next = NULL;
+
+            range->start += block->i_buffer;
+            multi->offset += block->i_buffer;
+
+            if (range->start >= range->end)
+            {   /* done with this range, make room for another one */
+                multi->ranges = range->next;
+                if (multi->ranges == NULL)
+                    multi->ranges_last = &multi->ranges;
+                vlc_http_range_drop(range);
+                vlc_cond_signal(&multi->wait_space);
+            }
+            break;
+        }
+
+        if (multi->error)
+            break;
+        if (vlc_killed())
+        {
+            block = vlc_http_error;
+            break;
+        }
+        vlc_cond_wait(&multi->wait_data, &multi->lock);
+    }
+
+    vlc_mutex_unlock(&multi->lock);
+    vlc_interrupt_unregister();
+    return block;
+}
+
+void vlc_http_multi_seek(struct vlc_http_multi *multi, uintmax_t offset)
+{
+    vlc_mutex_lock(&multi->lock);
+
+    for (struct vlc_http_range *range = multi->ranges, *next;
+         range != NULL; range = next)
+    {
+        next = range->next;
+        vlc_http_range_drop(range);
+    }
+    multi->ranges = NULL;
+    multi->ranges_last = &multi->ranges;
+
+    multi->offset = offset;
+    multi->next = offset;
+    multi->error = false;
+    vlc_cond_broadcast(&multi->wait_space);
+    vlc_mutex_unlock(&multi->lock);
+}
@@ -0,0 +1,100 @@
+/*****************************************************************************
+ * multi.h: HTTP file read over several connections
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include <stdint.h>
+
+/**
+ * \defgroup http_multi Multiple connections
+ * HTTP read-only files fetched in parallel byte ranges
+ * \ingroup http_res
+ *
+ * The file is split in consecutive byte ranges. Each connection fetches one
+ * range at a time, starting with the first range not assigned yet. The data
+ * is handed to the reader in file order; ranges are assigned only as far as
+ * the reorder buffer allows ahead of the read offset.
+ * @{
+ */
+
+struct vlc_http_multi;
+struct vlc_http_resource;
+struct vlc_http_cookie_jar_t;
+struct block_t;
+
+/**
+ * Starts reading an HTTP file over several connections.
+ *
+ * The file must have been opened successfully, support byte ranges, and
+ * have a known size. Its ETag or modification time is used to make sure
+ * that every range belongs to the same version of the file.
+ *
+ * Each connection uses its own HTTP connection manager.
+ *
+ * @param obj parent VLC object (for the connection managers)
+ * @param jar HTTP cookies jar (or NULL to disable cookies)
+ * @param file HTTP file as already opened, for its metadata only: it can be
+ *             destroyed once this function returns
+ * @param url URL of the file to read
+ * @param ua user agent string (or NULL to ignore)
+ * @param ref referral URL (or NULL to ignore)
+ * @param conns number of connections
+ * @param range_size byte size of each range
+ * @param offset byte offset of the first read
+ *
+ * @return an object pointer, or NULL on error
+ */
+struct vlc_http_multi *vlc_http_multi_create(vlc_object_t *obj,
+                                             struct vlc_http_cookie_jar_t *jar,
+                                             struct vlc_http_resource *file,
+                                             const char *url, const char *ua,
+                                             const char *ref, unsigned conns,
+                                             size_t range_size,
+                                             uintmax_t offset);
+
+/**
+ * Stops all connections and releases all data.
+ */
+void vlc_http_multi_destroy(struct vlc_http_multi *);
+
+/**
+ * Gets the file size.
+ *
+ * @return the byte size of the file, as of its opening
+ */
+uintmax_t vlc_http_multi_get_size(const struct vlc_http_multi *);
+
+/**
+ * Reads data.
+ *
+ * Waits for the data following the last read.
+ *
+ * @return a data block, NULL at the end of the file or on error, or
+ * vlc_http_error if the calling thread was interrupted.
+ */
+struct block_t *vlc_http_multi_read(struct vlc_http_multi *);
+
+/**
+ * Sets the read offset.
+ *
+ * The data buffered for other offsets is discarded, and the connections
+ * start fetching from the new offset.
+ */
+void vlc_http_multi_seek(struct vlc_http_multi *, uintmax_t offset);
+
+/** @} */
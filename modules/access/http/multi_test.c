@@ -0,0 +1,297 @@
+/*****************************************************************************
+ * multi_test.c: HTTP file read over several connections test
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#undef NDEBUG
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_http.h>
+#include "resource.h"
+#include "file.h"
+#include "multi.h"
+#include "message.h"
+
+const char vlc_module_name[] = "test_http_multi";
+
+static const char url[] = "https://www.example.com:8443/dir/file.ext";
+static const char ua[] = PACKAGE_NAME "/" PACKAGE_VERSION " (test suite)";
+
+/* The server stand-in: every request waits for one round trip, then each
+ * connection is throttled to a fixed throughput. */
+#define FILE_SIZE   (4 << 20)
+#define RANGE_SIZE  (256 << 10)
+#define READ_SIZE   (16 << 10)
+#define RTT         VLC_TICK_FROM_MS(20)
+#define THROUGHPUT  (8 << 20) /* bytes per second and connection */
+
+static bool ranges = true; /* whether the server honours byte ranges */
+static bool weak = false; /* whether the server sends a weak ETag */
+
+static uint8_t file_byte(uintmax_t offset)
+{
+    return (offset * 2654435761u) >> 24;
+}
+
+static vlc_tick_t read_file(struct vlc_http_multi *m, uintmax_t offset)
+{
+    vlc_tick_t start = vlc_tick_now();
+    block_t *block;
+
+    while ((block = vlc_http_multi_read(m)) != NULL)
+    {
+        assert(block != vlc_http_error);
+        for (size_t i = 0; i < block->i_buffer; i++)
+            assert(block->p_buffer[i] == file_byte(offset + i));
+        offset += block->i_buffer;
+        block_Release(block);
+    }
+    assert(offset == FILE_SIZE);
+    return vlc_tick_now() - start;
+}
+
+int main(void)
+{
+    struct vlc_http_resource *f;
+    struct vlc_http_multi *m;
+
+    f = vlc_http_file_create(NULL, url, ua, NULL);
+    assert(f != NULL);
+    assert(vlc_http_file_get_size(f) == FILE_SIZE);
+    assert(vlc_http_file_can_seek(f));
+
+    /* Data comes out in order, with one or several connections */
+    vlc_tick_t serial, parallel;
+
+    m = vlc_http_multi_create(NULL, NULL, f, url, ua, NULL, 1, RANGE_SIZE, 0);
+    assert(m != NULL);
+    serial = read_file(m, 0);
+    vlc_http_multi_destroy(m);
+
+    m = vlc_http_multi_create(NULL, NULL, f, url, ua, NULL, 4, RANGE_SIZE, 0);
+    assert(m != NULL);
+    assert(vlc_http_multi_get_size(m) == FILE_SIZE);
+    parallel = read_file(m, 0);
+    vlc_http_multi_destroy(m);
+
+    fprintf(stderr, "%u KiB at %u KiB/s per connection, %"PRId64" ms RTT: "
+            "%"PRId64" ms with 1 connection, %"PRId64" ms with 4\n",
+            FILE_SIZE >> 10, THROUGHPUT >> 10, MS_FROM_VLC_TICK(RTT),
+            MS_FROM_VLC_TICK(serial), MS_FROM_VLC_TICK(parallel));
+
+    /* Seek, including in the middle of a range, and while fetching */
+    m = vlc_http_multi_create(NULL, NULL, f, url, ua, NULL, 3, RANGE_SIZE,
+                              FILE_SIZE / 2);
+    assert(m != NULL);
+    block_t *block = vlc_http_multi_read(m);
+    assert(block != NULL && block->p_buffer[0] == file_byte(FILE_SIZE / 2));
+    block_Release(block);
+    vlc_http_multi_seek(m, RANGE_SIZE + 12345);
+    read_file(m, RANGE_SIZE + 12345);
+    vlc_http_multi_seek(m, FILE_SIZE);
+    assert(vlc_http_multi_read(m) == NULL);
+    vlc_http_multi_seek(m, 0);
+    block = vlc_http_multi_read(m);
+    assert(block != NULL && block->p_buffer[0] == file_byte(0));
+    block_Release(block);
+    vlc_http_multi_destroy(m); /* with data in flight */
+
+    /* The opened file is only needed to create the reader */
+    m = vlc_http_multi_create(NULL, NULL, f, url, ua, NULL, 2, RANGE_SIZE, 0);
+    assert(m != NULL);
+    vlc_http_file_destroy(f);
+    read_file(m, 0);
+    assert(vlc_http_multi_get_size(m) == FILE_SIZE);
+    vlc_http_multi_destroy(m);
+
+    /* Weak ETag: ranges are still requested, without the weak mark */
+    weak = true;
+    f = vlc_http_file_create(NULL, url, ua, NULL);
+    assert(f != NULL);
+    assert(vlc_http_file_get_size(f) == FILE_SIZE);
+    m = vlc_http_multi_create(NULL, NULL, f, url, ua, NULL, 2, RANGE_SIZE, 0);
+    assert(m != NULL);
+    read_file(m, 0);
+    vlc_http_multi_destroy(m);
+
+    /* Server ignoring byte ranges: error */
+    m = vlc_http_multi_create(NULL, NULL, f, url, ua, NULL, 2, RANGE_SIZE, 0);
+    assert(m != NULL);
+    ranges = false;
+    vlc_http_multi_seek(m, 0);
+    for (;;)
+    {   /* may get whatever was received before */
+        block = vlc_http_multi_read(m);
+        if (block == NULL)
+            break;
+        block_Release(block);
+    }
+    vlc_http_multi_destroy(m);
+
+    vlc_http_file_destroy(f);
+    return 0;
+}
+
+/* Callback for vlc_http_msg_h2_frame */
+#include "h2frame.h"
+
+struct vlc_h2_frame *
+vlc_h2_frame_headers(uint_fast32_t id, uint_fast32_t mtu, bool eos,
+                     unsigned count, const char *const tab[][2])
+{
+    (void) id; (void) mtu; (void) count, (void) tab;
+    assert(!eos);
+    return NULL;
+}
+
+/* Callback for the HTTP request */
+#include "connmgr.h"
+
+struct server_stream
+{
+    struct vlc_http_stream stream;
+    uintmax_t offset;
+    uintmax_t end;
+    bool partial;
+};
+
+static struct vlc_http_msg *stream_read_headers(struct vlc_http_stream *s)
+{
+    struct server_stream *ss = container_of(s, struct server_stream, stream);
+    char *answer;
+    int len;
+
+    vlc_tick_sleep(RTT);
+
+    if (ss->partial)
+        len = asprintf(&answer, "HTTP/1.1 206 Partial Content\r\n"
+                       "Content-Range: bytes %"PRIuMAX"-%"PRIuMAX"/%u\r\n"
+                       "ETag: %s\"foobar42\"\r\n\r\n", ss->offset,
+                       ss->end - 1, FILE_SIZE, weak ? "W/" : "");
+    else
+        len = asprintf(&answer, "HTTP/1.1 200 OK\r\n"
+                       "Content-Length: %u\r\n\r\n", FILE_SIZE);
+    assert(len >= 0);
+
+    struct vlc_http_msg *m = vlc_http_msg_headers(answer);
+    assert(m != NULL);
+    vlc_http_msg_attach(m, s);
+    free(answer);
+    return m;
+}
+
+static struct block_t *stream_read(struct vlc_http_stream *s)
+{
+    struct server_stream *ss = container_of(s, struct server_stream, stream);
+
+    if (ss->offset >= ss->end)
+        return NULL;
+
+    size_t len = READ_SIZE;
+    if (len > ss->end - ss->offset)
+        len = ss->end - ss->offset;
+
+    vlc_tick_sleep(vlc_tick_from_samples(len, THROUGHPUT));
+
+    block_t *block = block_Alloc(len);
+    assert(block != NULL);
+    for (size_t i = 0; i < len; i++)
+        block->p_buffer[i] = file_byte(ss->offset + i);
+    ss->offset += len;
+    return block;
+}
+
+static void stream_close(struct vlc_http_stream *s, bool abort)
+{
+    struct server_stream *ss = container_of(s, struct server_stream, stream);
+
+    (void) abort;
+    free(ss);
+}
+
+static const struct vlc_http_stream_cbs stream_callbacks =
+{
+    stream_read_headers,
+    stream_read,
+    stream_close,
+};
+
+struct vlc_http_msg *vlc_http_mgr_request(struct vlc_http_mgr *mgr, bool https,
+                                          const char *host, unsigned port,
+                                          const struct vlc_http_msg *req)
+{
+    const char *str;
+    uintmax_t start, last = FILE_SIZE - 1;
+
+    (void) mgr;
+    assert(https);
+    assert(!strcmp(host, "www.example.com"));
+    assert(port == 8443);
+
+    str = vlc_http_msg_get_agent(req);
+    assert(!strcmp(str, ua));
+
+    str = vlc_http_msg_get_header(req, "Range");
+    assert(str != NULL);
+    int n = sscanf(str, "bytes=%"SCNuMAX"-%"SCNuMAX, &start, &last);
+    assert(n >= 1 && start <= last && last < FILE_SIZE);
+
+    str = vlc_http_msg_get_header(req, "If-Match");
+    if (start != 0 || n == 2)
+        assert(str != NULL && !strcmp(str, "\"foobar42\""));
+
+    struct server_stream *ss = malloc(sizeof (*ss));
+    assert(ss != NULL);
+    ss->stream.cbs = &stream_callbacks;
+    ss->partial = ranges;
+    ss->offset = ranges ? start : 0;
+    ss->end = ranges ? last + 1 : FILE_SIZE;
+
+    return vlc_http_msg_get_initial(&ss->stream);
+}
+
+struct vlc_http_cookie_jar_t *vlc_http_mgr_get_jar(struct vlc_http_mgr *mgr)
+{
+    (void) mgr;
+    return NULL;
+}
+
+static char manager; /* dummy */
+
+struct vlc_http_mgr *vlc_http_mgr_create(vlc_object_t *obj,
+                                         struct vlc_http_cookie_jar_t *jar)
+{
+    assert(obj == NULL && jar == NULL);
+    return (struct vlc_http_mgr *)&manager;
+}
+
+void vlc_http_mgr_destroy(struct vlc_http_mgr *mgr)
+{
+    assert(mgr == (struct vlc_http_mgr *)&manager);
+}
@@ -192,6 +192,104 @@ static int Seek( sout_access_out_t *p_access, off_t i_pos )
     return lseek(fd, i_pos, SEEK_SET);
 }
 
+#ifdef HAVE_PREAD
+#define COPY_CHUNK      (1 << 20)
+#define COPY_KERNEL_MIN (1 << 16)
+
+/* Copy a block within the file, in the kernel if possible */
+static int CopyBlock(int fd, off_t in, off_t out, size_t len, void *buf,
+                     bool *kernel)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+    while (*kernel && len > 0)
+    {
+        ssize_t val = copy_file_range(fd, &in, fd, &out, len, 0);
+        if (val < 0 && errno == EINTR)
+            continue;
+        if (val < 0)
+        {
+            /* not supported by the file system, copy the rest in
+             * user space */
+            *kernel = false;
+            break;
+        }
+        if (val == 0)
+            return -1; /* end of file */
+        len -= val;
+    }
+#endif
+
+    /* the whole block is read before any of it is written, as it may
+     * overlap its destination */
+    for (size_t done = 0; done < len; )
+    {
+        ssize_t val = pread(fd, (char *)buf + done, len - done, in + done);
+        if (val < 0 && errno == EINTR)
+            continue;
+        if (val <= 0)
+            return -1; /* error, or end of file */
+        done += val;
+    }
+
+    for (size_t done = 0; done < len; )
+    {
+        ssize_t val = pwrite(fd, (char *)buf + done, len - done, out + done);
+        if (val < 0 && errno == EINTR)
+            continue;
+        if (val <= 0)
+            return -1;
+        done += val;
+    }
+    return 0;
+}
+
+/*****************************************************************************
+ * CopyRange: move data within the file, ranges can overlap.
+ *****************************************************************************/
+static int CopyRange(sout_access_out_t *p_access, uint64_t from, uint64_t to,
+                     uint64_t size)
+{
+    int *fdp = p_access->p_sys, fd = *fdp;
+
+    if (p_access->pf_seek == NULL)
+        return VLC_EGENERIC;
+
+    /* a block is never copied over data left to copy */
+    uint64_t dist = from > to ? from - to : to - from;
+    if (dist == 0)
+        return VLC_SUCCESS;
+
+    void *buf = malloc(COPY_CHUNK);
+    if (unlikely(buf == NULL))
+        return VLC_ENOMEM;
+
+    /* the kernel refuses overlapping ranges, so its blocks cannot be longer
+     * than the distance: not worth it for short moves */
+    bool kernel = dist >= COPY_KERNEL_MIN;
+    int ret = VLC_SUCCESS;
+    for (uint64_t done = 0; done < size; )
+    {
+        size_t len = __MIN(kernel ? __MIN(dist, COPY_CHUNK) : COPY_CHUNK,
+                           size - done);
+        /* moving towards the end: last blocks first */
+        uint64_t offset = to > from ? size - done - len : done;
+
+        if (CopyBlock(fd, from + offset, to + offset, len, buf, &kernel))
+        {
+            msg_Err(p_access, "cannot copy: %s", vlc_strerror_c(errno));
+            ret = VLC_EGENERIC;
+            break;
+        }
+        done += len;
+    }
+    free(buf);
+
+    msg_Dbg(p_access, "copied %"PRIu64" bytes%s", size,
+            kernel ? " in the kernel" : "");
+    return ret;
+}
+#endif
+
 static int Control( sout_access_out_t *p_access, int i_query, va_list args )
 {
     switch( i_query )
@@ -210,6 +308,16 @@ static int Control( sout_access_out_t *p_access, int i_query, va_list args )
             break;
         }
 
+#ifdef HAVE_PREAD
+        case ACCESS_OUT_COPY_RANGE:
+        {
+            uint64_t from = va_arg( args, uint64_t );
+            uint64_t to = va_arg( args, uint64_t );
+            uint64_t size = va_arg( args, uint64_t );
+            return CopyRange( p_access, from, to, size );
+        }
+#endif
+
         default:
             return VLC_EGENERIC;
     }
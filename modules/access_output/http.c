@@ -59,6 +59,10 @@ static void Close( vlc_object_t * );
 #define METACUBE_TEXT N_("Metacube")
 #define METACUBE_LONGTEXT N_("Use the Metacube protocol. Needed for streaming " \
                              "to the Cubemap reflector.")
+#define CHUNKED_TEXT N_("Chunked transfer")
+#define CHUNKED_LONGTEXT N_("Send the stream to HTTP/1.1 clients with " \
+                            "chunked transfer encoding, as expected by " \
+                            "low-latency DASH and HLS players.")
 
 
 vlc_module_begin ()
@@ -75,6 +79,8 @@ vlc_module_begin ()
                 MIME_TEXT, MIME_LONGTEXT, true )
     add_bool( SOUT_CFG_PREFIX "metacube", false,
               METACUBE_TEXT, METACUBE_LONGTEXT, true )
+    add_bool( SOUT_CFG_PREFIX "chunked", false,
+              CHUNKED_TEXT, CHUNKED_LONGTEXT, true )
     set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -83,7 +89,7 @@ vlc_module_end ()
  * Exported prototypes
  *****************************************************************************/
 static const char *const ppsz_sout_options[] = {
-    "user", "pwd", "mime", "metacube", NULL
+    "user", "pwd", "mime", "metacube", "chunked", NULL
 };
 
 static ssize_t Write( sout_access_out_t *, block_t * );
@@ -285,6 +291,9 @@ static int Open( vlc_object_t *p_this )
         }
     }
 
+    if( var_GetBool( p_access, SOUT_CFG_PREFIX "chunked" ) )
+        httpd_StreamSetChunked( p_sys->p_httpd_stream, true );
+
     p_sys->i_header_allocated = 1024;
     p_sys->i_header_size      = 0;
     p_sys->p_header           = xmalloc( p_sys->i_header_allocated );
@@ -35,6 +35,9 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
+#ifdef HAVE_SYS_UIO_H
+# include <sys/uio.h>
+#endif
 
 #include <vlc_common.h>
 #include <vlc_plugin.h>
@@ -43,6 +46,8 @@
 #include <vlc_fs.h>
 #include <vlc_strings.h>
 #include <vlc_charset.h>
+#include <vlc_list.h>
+#include <vlc_memstream.h>
 
 #include <gcrypt.h>
 #include <vlc_gcrypt.h>
@@ -54,9 +59,14 @@
 #endif
 
 #define STR_ENDLIST "#EXT-X-ENDLIST\n"
+#define STR_GAP "#EXT-X-GAP\n"
 
 #define MAX_RENAME_RETRIES        10
 
+/* Bytes queued to the writer thread before Write() blocks */
+#define WRITER_MAX_QUEUE          (32 << 20)
+#define WRITER_IOV                64
+
 /*****************************************************************************
  * Module descriptor
  *****************************************************************************/
@@ -102,6 +112,11 @@ static void Close( vlc_object_t * );
 #define RANDOMIV_TEXT N_("Use randomized IV for encryption")
 #define RANDOMIV_LONGTEXT N_("Generate IV instead using segment-number as IV")
 
+#define PARTLEN_TEXT N_("Partial segment length (ms)")
+#define PARTLEN_LONGTEXT N_("Also output Low-Latency HLS partial segments of "\
+                            "about this length. Parts are cut on the same "\
+                            "boundaries as segments. 0 disables them.")
+
 #define INTITIAL_SEG_TEXT N_("Number of first segment")
 #define INITIAL_SEG_LONGTEXT N_("The number of the first segment generated")
 
@@ -115,6 +130,7 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "seglen", 10, SEGLEN_TEXT, SEGLEN_LONGTEXT, false )
     add_integer( SOUT_CFG_PREFIX "numsegs", 0, NUMSEGS_TEXT, NUMSEGS_LONGTEXT, false )
     add_integer( SOUT_CFG_PREFIX "initial-segment-number", 1, INTITIAL_SEG_TEXT, INITIAL_SEG_LONGTEXT, false )
+    add_integer( SOUT_CFG_PREFIX "part-length", 0, PARTLEN_TEXT, PARTLEN_LONGTEXT, true )
     add_bool( SOUT_CFG_PREFIX "splitanywhere", false,
               SPLITANYWHERE_TEXT, SPLITANYWHERE_LONGTEXT, true )
     add_bool( SOUT_CFG_PREFIX "delsegs", true,
@@ -156,6 +172,7 @@ static const char *const ppsz_sout_options[] = {
     "key-loadfile",
     "generate-iv",
     "initial-segment-number",
+    "part-length",
     NULL
 };
 
@@ -171,8 +188,32 @@ typedef struct output_segment
     vlc_tick_t segment_length;
     uint32_t i_segment_number;
     uint8_t aes_ivs[16];
+    vlc_tick_t *p_parts_length;
+    unsigned i_parts;
 } output_segment_t;
 
+/* Segment and index I/O is done by a writer thread, in queue order */
+typedef struct
+{
+    struct vlc_list node;
+    enum
+    {
+        JOB_SEGMENT_OPEN,   /* psz_path, i_segment */
+        JOB_SEGMENT_DATA,   /* p_data, and its part file psz_path if any */
+        JOB_SEGMENT_CLOSE,
+        JOB_INDEX,          /* psz_path, p_data, pi_segments */
+        JOB_FILE,           /* psz_path, p_data */
+        JOB_UNLINK,         /* psz_path */
+    } type;
+    char *psz_path;
+    block_t *p_data;
+    size_t i_size;
+    uint32_t i_segment;
+    /* index: the header block is followed by one block per listed segment */
+    uint32_t *pi_segments;
+    size_t i_entries;
+} writer_job_t;
+
 typedef struct
 {
     char *psz_cursegPath;
@@ -180,14 +221,17 @@ typedef struct
     char *psz_indexUrl;
     char *psz_keyfile;
     vlc_tick_t i_keyfile_modification;
+    char *psz_initUri;
     vlc_tick_t segment_max_length;
     vlc_tick_t current_segment_length;
+    vlc_tick_t part_max_length;
     uint32_t i_segment;
     block_t *full_segments;
     block_t **full_segments_end;
     block_t *ongoing_segment;
     block_t **ongoing_segment_end;
-    int i_handle;
+    bool b_segment_open;
+    bool b_fmp4;
     unsigned i_numsegs;
     unsigned i_initial_segment;
     bool b_delsegs;
@@ -202,13 +246,30 @@ typedef struct
     uint8_t stuffing_bytes[16];
     ssize_t stuffing_size;
     vlc_array_t segments_t;
+
+    vlc_thread_t writer;
+    vlc_mutex_t lock;
+    vlc_cond_t wait;            /* jobs queued or exiting */
+    vlc_cond_t done;            /* queue shrunk */
+    struct vlc_list jobs;
+    size_t i_queued;
+    bool b_exit;
+    /* writer thread only */
+    int i_handle;
+    char *psz_writerPath;
+    uint32_t i_writerSegment;
+    bool b_segment_error;
+    uint32_t *pi_failed;        /* closed segments that could not be written */
+    size_t i_failed;
+    bool b_error;               /* read by Close() once the writer is joined */
 } sout_access_out_sys_t;
 
 static int LoadCryptFile( sout_access_out_t *p_access);
 static int CryptSetup( sout_access_out_t *p_access, char *keyfile );
 static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer );
-static ssize_t writeSegment( sout_access_out_t *p_access );
+static ssize_t writeSegment( sout_access_out_t *p_access, bool b_part );
 static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys );
+static void *writerThread( void * );
 /*****************************************************************************
  * Open: open the file
  *****************************************************************************/
@@ -292,10 +353,47 @@ static int Open( vlc_object_t *p_this )
         return VLC_EGENERIC;
     }
 
-    p_sys->i_handle = -1;
+    p_sys->part_max_length = VLC_TICK_FROM_MS(
+                    var_GetInteger( p_access, SOUT_CFG_PREFIX "part-length" ) );
+    if( p_sys->part_max_length < 0 )
+        p_sys->part_max_length = 0;
+    if( p_sys->part_max_length && p_sys->key_uri )
+    {
+        msg_Warn( p_access, "Partial segments are not supported with encryption" );
+        p_sys->part_max_length = 0;
+    }
+
+    p_sys->b_segment_open = false;
     p_sys->i_segment = p_sys->i_initial_segment-1;
     p_sys->psz_cursegPath = NULL;
 
+    vlc_mutex_init( &p_sys->lock );
+    vlc_cond_init( &p_sys->wait );
+    vlc_cond_init( &p_sys->done );
+    vlc_list_init( &p_sys->jobs );
+    p_sys->i_queued = 0;
+    p_sys->b_exit = false;
+    p_sys->i_handle = -1;
+    p_sys->psz_writerPath = NULL;
+    p_sys->i_writerSegment = 0;
+    p_sys->b_segment_error = false;
+    p_sys->pi_failed = NULL;
+    p_sys->i_failed = 0;
+    p_sys->b_error = false;
+
+    if( vlc_clone( &p_sys->writer, writerThread, p_access, VLC_THREAD_PRIORITY_LOW ) )
+    {
+        if( p_sys->key_uri )
+        {
+            gcry_cipher_close( p_sys->aes_ctx );
+            free( p_sys->key_uri );
+        }
+        free( p_sys->psz_indexUrl );
+        free( p_sys->psz_indexPath );
+        free( p_sys );
+        return VLC_EGENERIC;
+    }
+
     p_access->pf_write = Write;
     p_access->pf_control = Control;
 
@@ -499,15 +597,388 @@ static char *formatSegmentPath( char *psz_path, uint32_t i_seg )
     return psz_result;
 }
 
+/*****************************************************************************
+ * formatInitPath: create init segment path name, "init" replacing the seg #
+ *****************************************************************************/
+static char *formatInitPath( char *psz_path )
+{
+    char *psz_result, *psz_init;
+    int ret;
+
+    if ( ! ( psz_result  = vlc_strftime( psz_path ) ) )
+        return NULL;
+
+    char *psz_firstNumSign = psz_result + strcspn( psz_result, SEG_NUMBER_PLACEHOLDER );
+    if ( *psz_firstNumSign )
+    {
+        int i_cnt = strspn( psz_firstNumSign, SEG_NUMBER_PLACEHOLDER );
+
+        *psz_firstNumSign = '\0';
+        ret = asprintf( &psz_init, "%sinit%s", psz_result, psz_firstNumSign + i_cnt );
+    }
+    else
+        ret = asprintf( &psz_init, "%s.init", psz_result );
+
+    free( psz_result );
+    return ret < 0 ? NULL : psz_init;
+}
+
+static char *formatPartPath( const char *psz_segment, unsigned i_part )
+{
+    char *psz_result;
+
+    if( asprintf( &psz_result, "%s.part%u", psz_segment, i_part ) < 0 )
+        return NULL;
+    return psz_result;
+}
+
 static void destroySegment( output_segment_t *segment )
 {
     free( segment->psz_filename );
     free( segment->psz_duration );
     free( segment->psz_uri );
     free( segment->psz_key_uri );
+    free( segment->p_parts_length );
     free( segment );
 }
 
+/*****************************************************************************
+ * newJob: Create a writer job, taking ownership of path and data
+ *****************************************************************************/
+static writer_job_t *newJob( int i_type, char *psz_path, block_t *p_data )
+{
+    writer_job_t *job = malloc( sizeof( *job ) );
+
+    if( unlikely( !job ) )
+    {
+        free( psz_path );
+        if( p_data )
+            block_ChainRelease( p_data );
+        return NULL;
+    }
+
+    job->type = i_type;
+    job->psz_path = psz_path;
+    job->p_data = p_data;
+    job->i_size = 0;
+    block_ChainProperties( p_data, NULL, &job->i_size, NULL );
+    job->i_segment = 0;
+    job->pi_segments = NULL;
+    job->i_entries = 0;
+    return job;
+}
+
+/*****************************************************************************
+ * queueJob: Hand a job over to the writer thread
+ *****************************************************************************/
+static void queueJob( sout_access_out_t *p_access, writer_job_t *job )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    vlc_mutex_lock( &p_sys->lock );
+    /* let a stalled disk pace the muxer rather than eat memory */
+    while( p_sys->i_queued > WRITER_MAX_QUEUE )
+        vlc_cond_wait( &p_sys->done, &p_sys->lock );
+    vlc_list_append( &job->node, &p_sys->jobs );
+    p_sys->i_queued += job->i_size;
+    vlc_cond_signal( &p_sys->wait );
+    vlc_mutex_unlock( &p_sys->lock );
+}
+
+/*****************************************************************************
+ * pushJob: Queue I/O to the writer thread, taking ownership of path and data
+ *****************************************************************************/
+static int pushJob( sout_access_out_t *p_access, int i_type,
+                    char *psz_path, block_t *p_data )
+{
+    writer_job_t *job = newJob( i_type, psz_path, p_data );
+    if( unlikely( !job ) )
+        return -1;
+    queueJob( p_access, job );
+    return 0;
+}
+
+/*****************************************************************************
+ * writeChain: Write a whole block chain with as few system calls as possible
+ *****************************************************************************/
+static int writeChain( int fd, const block_t *p_chain )
+{
+    size_t i_offset = 0; /* already written from the first block */
+
+    while( p_chain )
+    {
+#ifdef HAVE_SYS_UIO_H
+        struct iovec iov[WRITER_IOV];
+        int i_iov = 0;
+
+        for( const block_t *b = p_chain; b && i_iov < WRITER_IOV; b = b->p_next )
+        {
+            iov[i_iov].iov_base = b->p_buffer + ( i_iov ? 0 : i_offset );
+            iov[i_iov].iov_len = b->i_buffer - ( i_iov ? 0 : i_offset );
+            i_iov++;
+        }
+
+        ssize_t val = writev( fd, iov, i_iov );
+#else
+        ssize_t val = vlc_write( fd, p_chain->p_buffer + i_offset,
+                                 p_chain->i_buffer - i_offset );
+#endif
+        if ( val == -1 )
+        {
+           if ( errno == EINTR )
+              continue;
+           return -1;
+        }
+
+        size_t i_written = val;
+        while( p_chain && i_written >= p_chain->i_buffer - i_offset )
+        {
+            i_written -= p_chain->i_buffer - i_offset;
+            i_offset = 0;
+            p_chain = p_chain->p_next;
+        }
+        i_offset += i_written;
+    }
+    return 0;
+}
+
+/*****************************************************************************
+ * writeFile: Atomically replace a file with the block chain
+ *****************************************************************************/
+static int writeFile( sout_access_out_t *p_access, const char *psz_path,
+                      const block_t *p_data )
+{
+    char *psz_tmp;
+    if ( asprintf( &psz_tmp, "%s.tmp", psz_path ) < 0 )
+        return -1;
+
+    int fd = vlc_open( psz_tmp, O_WRONLY | O_CREAT | O_LARGEFILE | O_TRUNC, 0666 );
+    if ( fd == -1 )
+    {
+        msg_Err( p_access, "cannot open `%s' (%s)", psz_tmp,
+                 vlc_strerror_c(errno) );
+        free( psz_tmp );
+        return -1;
+    }
+
+    int val = writeChain( fd, p_data );
+    vlc_close( fd );
+    if( val == 0 )
+        val = vlc_rename( psz_tmp, psz_path );
+    if( val != 0 )
+    {
+        msg_Err( p_access, "cannot write `%s' (%s)", psz_path,
+                 vlc_strerror_c(errno) );
+        vlc_unlink( psz_tmp );
+    }
+    free( psz_tmp );
+    return val;
+}
+
+/*****************************************************************************
+ * isSegmentFailed: Tell whether the writer could not publish a segment
+ *****************************************************************************/
+static bool isSegmentFailed( sout_access_out_sys_t *p_sys, uint32_t i_segment )
+{
+    for( size_t i = 0; i < p_sys->i_failed; i++ )
+        if( p_sys->pi_failed[i] == i_segment )
+            return true;
+    return false;
+}
+
+/*****************************************************************************
+ * addFailedSegment: Remember a segment the index must not point to
+ *****************************************************************************/
+static void addFailedSegment( sout_access_out_t *p_access, uint32_t i_segment )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    uint32_t *pi_failed = realloc( p_sys->pi_failed,
+                                   ( p_sys->i_failed + 1 ) * sizeof( *pi_failed ) );
+    if( unlikely( !pi_failed ) )
+        return;
+    p_sys->pi_failed = pi_failed;
+    pi_failed[p_sys->i_failed++] = i_segment;
+    msg_Warn( p_access, "segment %"PRIu32" is listed as a gap", i_segment );
+}
+
+/*****************************************************************************
+ * writeIndex: Publish the index, with a gap for every failed segment
+ *****************************************************************************/
+static void writeIndex( sout_access_out_t *p_access, writer_job_t *job )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    block_t **pp_block = &job->p_data->p_next;
+
+    for( size_t i = 0; i < job->i_entries && *pp_block; i++ )
+    {
+        if( isSegmentFailed( p_sys, job->pi_segments[i] ) )
+        {
+            block_t *p_gap = block_Alloc( strlen( STR_GAP ) );
+            if( unlikely( !p_gap ) )
+            {
+                msg_Err( p_access, "not updating the index" );
+                return;
+            }
+            memcpy( p_gap->p_buffer, STR_GAP, strlen( STR_GAP ) );
+            p_gap->p_next = *pp_block;
+            *pp_block = p_gap;
+            pp_block = &p_gap->p_next;
+        }
+        pp_block = &(*pp_block)->p_next;
+    }
+
+    if( writeFile( p_access, job->psz_path, job->p_data ) == 0 )
+        msg_Dbg( p_access, "LiveHttpIndexComplete: %s" , job->psz_path );
+    else
+        msg_Err( p_access, "Error moving LiveHttp index file" );
+
+    /* segments out of the index will not be listed again */
+    if( job->i_entries > 0 )
+    {
+        size_t i_kept = 0;
+        for( size_t i = 0; i < p_sys->i_failed; i++ )
+            if( p_sys->pi_failed[i] >= job->pi_segments[0] )
+                p_sys->pi_failed[i_kept++] = p_sys->pi_failed[i];
+        p_sys->i_failed = i_kept;
+    }
+}
+
+/*****************************************************************************
+ * runJob: Writer side of a job, returns false once a failed segment is closed
+ *****************************************************************************/
+static bool runJob( sout_access_out_t *p_access, writer_job_t *job )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    bool b_ok = true;
+
+    switch( job->type )
+    {
+        case JOB_SEGMENT_OPEN:
+        {
+            /* segments only show up under their name once complete */
+            char *psz_tmp = NULL;
+            p_sys->i_handle = -1;
+            if ( asprintf( &psz_tmp, "%s.tmp", job->psz_path ) >= 0 )
+                p_sys->i_handle = vlc_open( psz_tmp, O_WRONLY | O_CREAT |
+                                            O_LARGEFILE | O_TRUNC, 0666 );
+            else
+                psz_tmp = NULL;
+            if ( p_sys->i_handle == -1 )
+                msg_Err( p_access, "cannot open `%s' (%s)",
+                         psz_tmp ? psz_tmp : job->psz_path,
+                         vlc_strerror_c(errno) );
+            p_sys->b_segment_error = p_sys->i_handle == -1;
+            free( psz_tmp );
+            free( p_sys->psz_writerPath );
+            p_sys->psz_writerPath = job->psz_path;
+            job->psz_path = NULL;
+            p_sys->i_writerSegment = job->i_segment;
+            break;
+        }
+
+        case JOB_SEGMENT_DATA:
+            if( p_sys->i_handle != -1 && writeChain( p_sys->i_handle, job->p_data ) )
+            {
+                msg_Err( p_access, "cannot write segment (%s)", vlc_strerror_c(errno) );
+                p_sys->b_segment_error = true;
+            }
+            if( job->psz_path )
+                writeFile( p_access, job->psz_path, job->p_data );
+            break;
+
+        case JOB_SEGMENT_CLOSE:
+        {
+            if( p_sys->i_handle != -1 )
+            {
+                vlc_close( p_sys->i_handle );
+                p_sys->i_handle = -1;
+
+                /* an incomplete segment is not published */
+                char *psz_tmp;
+                if ( asprintf( &psz_tmp, "%s.tmp", p_sys->psz_writerPath ) < 0 )
+                    p_sys->b_segment_error = true;
+                else
+                {
+                    if( p_sys->b_segment_error )
+                    {
+                        msg_Err( p_access, "dropping incomplete segment `%s'",
+                                 p_sys->psz_writerPath );
+                        vlc_unlink( psz_tmp );
+                    }
+                    else if( vlc_rename( psz_tmp, p_sys->psz_writerPath ) )
+                    {
+                        msg_Err( p_access, "Error moving LiveHttp segment file" );
+                        vlc_unlink( psz_tmp );
+                        p_sys->b_segment_error = true;
+                    }
+                    free( psz_tmp );
+                }
+            }
+            /* the index is published from here on, in queue order, so
+             * it never points to a segment that did not make it */
+            if( p_sys->b_segment_error )
+                addFailedSegment( p_access, p_sys->i_writerSegment );
+            b_ok = !p_sys->b_segment_error;
+            p_sys->b_segment_error = false;
+            break;
+        }
+
+        case JOB_INDEX:
+            writeIndex( p_access, job );
+            break;
+
+        case JOB_FILE:
+            writeFile( p_access, job->psz_path, job->p_data );
+            break;
+
+        case JOB_UNLINK:
+            vlc_unlink( job->psz_path );
+            break;
+    }
+    return b_ok;
+}
+
+static void *writerThread( void *data )
+{
+    sout_access_out_t *p_access = data;
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    vlc_mutex_lock( &p_sys->lock );
+    for( ;; )
+    {
+        while( vlc_list_is_empty( &p_sys->jobs ) && !p_sys->b_exit )
+            vlc_cond_wait( &p_sys->wait, &p_sys->lock );
+
+        writer_job_t *job = vlc_list_first_entry_or_null( &p_sys->jobs,
+                                                          writer_job_t, node );
+        if( !job )
+            break;
+        vlc_list_remove( &job->node );
+        vlc_mutex_unlock( &p_sys->lock );
+
+        bool b_ok = runJob( p_access, job );
+
+        free( job->psz_path );
+        if( job->p_data )
+            block_ChainRelease( job->p_data );
+        free( job->pi_segments );
+        if( !b_ok )
+            p_sys->b_error = true;
+
+        vlc_mutex_lock( &p_sys->lock );
+        p_sys->i_queued -= job->i_size;
+        vlc_cond_signal( &p_sys->done );
+        free( job );
+    }
+    vlc_mutex_unlock( &p_sys->lock );
+
+    if( p_sys->i_handle != -1 )
+        vlc_close( p_sys->i_handle );
+    free( p_sys->psz_writerPath );
+    free( p_sys->pi_failed );
+    return NULL;
+}
+
 /************************************************************************
  * segmentAmountNeeded: check that playlist has atleast 3*p_sys->segment_max_length of segments
  * return how many segments are needed for that (max of p_sys->i_segment )
@@ -551,132 +1022,169 @@ static bool isFirstItemRemovable( sout_access_out_sys_t *p_sys, uint32_t i_first
 }
 
 /************************************************************************
- * updateIndexAndDel: If necessary, update index file & delete old segments
+ * removeSegmentFiles: Have the writer delete a segment and its parts
  ************************************************************************/
-static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
+static void removeSegmentFiles( sout_access_out_t *p_access, output_segment_t *segment )
 {
+    if ( !segment->psz_filename )
+        return;
 
-    uint32_t i_firstseg;
-    unsigned i_index_offset = 0;
-
-    if ( p_sys->i_numsegs == 0 ||
-         p_sys->i_segment < ( p_sys->i_numsegs + p_sys->i_initial_segment ) )
+    for( unsigned i = 0; i < segment->i_parts; i++ )
     {
-        i_firstseg = p_sys->i_initial_segment;
-    }
-    else
-    {
-        unsigned numsegs = segmentAmountNeeded( p_sys );
-        i_firstseg = ( p_sys->i_segment - numsegs ) + 1;
-        i_index_offset = vlc_array_count( &p_sys->segments_t ) - numsegs;
+        char *psz_part = formatPartPath( segment->psz_filename, i );
+        if( psz_part )
+            pushJob( p_access, JOB_UNLINK, psz_part, NULL );
     }
+    char *psz_filename = strdup( segment->psz_filename );
+    if( psz_filename )
+        pushJob( p_access, JOB_UNLINK, psz_filename, NULL );
+}
 
-    // First update index
-    if ( p_sys->psz_indexPath )
-    {
-        int val;
-        FILE *fp;
-        char *psz_idxTmp;
-        if ( asprintf( &psz_idxTmp, "%s.tmp", p_sys->psz_indexPath ) < 0)
-            return -1;
+/************************************************************************
+ * appendIndexPart: Close the index text so far and append it as a block
+ ************************************************************************/
+static int appendIndexPart( block_t ***ppp_end, struct vlc_memstream *ms )
+{
+    if ( vlc_memstream_close( ms ) )
+        return -1;
 
-        fp = vlc_fopen( psz_idxTmp, "wt");
-        if ( !fp )
-        {
-            msg_Err( p_access, "cannot open index file `%s'", psz_idxTmp );
-            free( psz_idxTmp );
-            return -1;
-        }
+    block_t *p_part = block_heap_Alloc( ms->ptr, ms->length );
+    if ( !p_part )
+        return -1;
+    block_ChainLastAppend( ppp_end, p_part );
+    return 0;
+}
 
-        if ( fprintf( fp, "#EXTM3U\n#EXT-X-TARGETDURATION:%.0f\n#EXT-X-VERSION:3\n#EXT-X-ALLOW-CACHE:%s"
-                          "%s\n#EXT-X-MEDIA-SEQUENCE:%"PRIu32"\n%s", ceil(secf_from_vlc_tick( p_sys->segment_max_length )) ,
-                          p_sys->b_caching ? "YES" : "NO",
-                          p_sys->i_numsegs > 0 ? "" : b_isend ? "\n#EXT-X-PLAYLIST-TYPE:VOD" : "\n#EXT-X-PLAYLIST-TYPE:EVENT",
-                          i_firstseg, ((p_sys->i_initial_segment > 1) && (p_sys->i_initial_segment == i_firstseg)) ? "#EXT-X-DISCONTINUITY\n" : ""
-                          ) < 0 )
-        {
-            free( psz_idxTmp );
-            fclose( fp );
-            return -1;
-        }
-        char *psz_current_uri=NULL;
+/************************************************************************
+ * pushIndex: Queue the index, the writer marks the segments it lost as gaps
+ ************************************************************************/
+static int pushIndex( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys,
+                      uint32_t i_firstseg, unsigned i_index_offset, bool b_isend )
+{
+    /* one block per listed segment, see writeIndex() */
+    writer_job_t *job = newJob( JOB_INDEX, strdup( p_sys->psz_indexPath ), NULL );
+    if ( !job )
+        return -1;
+    job->i_entries = p_sys->i_segment + 1 - i_firstseg;
+    job->pi_segments = vlc_alloc( job->i_entries, sizeof( *job->pi_segments ) );
+
+    block_t *p_idx = NULL, **pp_idx_end = &p_idx;
+    struct vlc_memstream ms;
+    if ( !job->psz_path || ( job->i_entries && !job->pi_segments ) ||
+         vlc_memstream_open( &ms ) )
+        goto error;
+
+    vlc_memstream_printf( &ms, "#EXTM3U\n#EXT-X-TARGETDURATION:%.0f\n#EXT-X-VERSION:%d\n#EXT-X-ALLOW-CACHE:%s"
+                      "%s\n", ceil(secf_from_vlc_tick( p_sys->segment_max_length )),
+                      ( p_sys->b_fmp4 || p_sys->part_max_length ) ? 6 : 3,
+                      p_sys->b_caching ? "YES" : "NO",
+                      p_sys->i_numsegs > 0 ? "" : b_isend ? "\n#EXT-X-PLAYLIST-TYPE:VOD" : "\n#EXT-X-PLAYLIST-TYPE:EVENT" );
+    if ( p_sys->part_max_length )
+        vlc_memstream_printf( &ms, "#EXT-X-SERVER-CONTROL:PART-HOLD-BACK=%.3f\n"
+                              "#EXT-X-PART-INF:PART-TARGET=%.3f\n",
+                              3 * secf_from_vlc_tick( p_sys->part_max_length ),
+                              secf_from_vlc_tick( p_sys->part_max_length ) );
+    vlc_memstream_printf( &ms, "#EXT-X-MEDIA-SEQUENCE:%"PRIu32"\n", i_firstseg );
+    if ( p_sys->psz_initUri )
+        vlc_memstream_printf( &ms, "#EXT-X-MAP:URI=\"%s\"\n", p_sys->psz_initUri );
+    if ( (p_sys->i_initial_segment > 1) && (p_sys->i_initial_segment == i_firstseg) )
+        vlc_memstream_puts( &ms, "#EXT-X-DISCONTINUITY\n" );
+
+    const char *psz_current_uri = NULL;
+
+    for ( uint32_t i = i_firstseg; i <= p_sys->i_segment; i++ )
+    {
+        if ( appendIndexPart( &pp_idx_end, &ms ) || vlc_memstream_open( &ms ) )
+            goto error;
 
+        //scale to i_index_offset..numsegs + i_index_offset
+        uint32_t index = i - i_firstseg + i_index_offset;
 
-        for ( uint32_t i = i_firstseg; i <= p_sys->i_segment; i++ )
+        output_segment_t *segment = vlc_array_item_at_index( &p_sys->segments_t, index );
+        job->pi_segments[i - i_firstseg] = i;
+        if( p_sys->key_uri &&
+            ( !psz_current_uri ||  strcmp( psz_current_uri, segment->psz_key_uri ) )
+          )
         {
-            //scale to i_index_offset..numsegs + i_index_offset
-            uint32_t index = i - i_firstseg + i_index_offset;
-
-            output_segment_t *segment = vlc_array_item_at_index( &p_sys->segments_t, index );
-            if( p_sys->key_uri &&
-                ( !psz_current_uri ||  strcmp( psz_current_uri, segment->psz_key_uri ) )
-              )
+            psz_current_uri = segment->psz_key_uri;
+            if( p_sys->b_generate_iv )
             {
-                int ret = 0;
-                free( psz_current_uri );
-                psz_current_uri = strdup( segment->psz_key_uri );
-                if( p_sys->b_generate_iv )
+                unsigned long long iv_hi = segment->aes_ivs[0];
+                unsigned long long iv_lo = segment->aes_ivs[8];
+                for( unsigned short j = 1; j < 8; j++ )
                 {
-                    unsigned long long iv_hi = segment->aes_ivs[0];
-                    unsigned long long iv_lo = segment->aes_ivs[8];
-                    for( unsigned short j = 1; j < 8; j++ )
-                    {
-                        iv_hi <<= 8;
-                        iv_hi |= segment->aes_ivs[j] & 0xff;
-                        iv_lo <<= 8;
-                        iv_lo |= segment->aes_ivs[8+j] & 0xff;
-                    }
-                    ret = fprintf( fp, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\",IV=0X%16.16llx%16.16llx\n",
-                                   segment->psz_key_uri, iv_hi, iv_lo );
-
-                } else {
-                    ret = fprintf( fp, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"\n", segment->psz_key_uri );
+                    iv_hi <<= 8;
+                    iv_hi |= segment->aes_ivs[j] & 0xff;
+                    iv_lo <<= 8;
+                    iv_lo |= segment->aes_ivs[8+j] & 0xff;
                 }
-                if( ret < 0 )
-                {
-                    free( psz_current_uri );
-                    free( psz_idxTmp );
-                    fclose( fp );
-                    return -1;
-                }
-            }
+                vlc_memstream_printf( &ms, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\",IV=0X%16.16llx%16.16llx\n",
+                                      segment->psz_key_uri, iv_hi, iv_lo );
 
-            val = fprintf( fp, "#EXTINF:%s,\n%s\n", segment->psz_duration, segment->psz_uri);
-            if ( val < 0 )
-            {
-                free( psz_current_uri );
-                free( psz_idxTmp );
-                fclose( fp );
-                return -1;
+            } else {
+                vlc_memstream_printf( &ms, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s\"\n", segment->psz_key_uri );
             }
         }
-        free( psz_current_uri );
 
-        if ( b_isend )
+        /* Only the last two segments advertise their parts */
+        if ( i + 1 >= p_sys->i_segment )
         {
-            if ( fputs ( STR_ENDLIST, fp ) < 0)
-            {
-                free( psz_idxTmp );
-                fclose( fp ) ;
-                return -1;
-            }
-
+            for( unsigned j = 0; j < segment->i_parts; j++ )
+                vlc_memstream_printf( &ms, "#EXT-X-PART:DURATION=%.3f,URI=\"%s.part%u\"\n",
+                                      secf_from_vlc_tick( segment->p_parts_length[j] ),
+                                      segment->psz_uri, j );
         }
-        fclose( fp );
 
-        val = vlc_rename ( psz_idxTmp, p_sys->psz_indexPath);
+        /* the ongoing segment only has parts so far */
+        if ( segment->psz_duration )
+            vlc_memstream_printf( &ms, "#EXTINF:%s,\n%s\n", segment->psz_duration, segment->psz_uri );
+    }
 
-        if ( val < 0 )
-        {
-            vlc_unlink( psz_idxTmp );
-            msg_Err( p_access, "Error moving LiveHttp index file" );
-        }
-        else
-            msg_Dbg( p_access, "LiveHttpIndexComplete: %s" , p_sys->psz_indexPath );
+    if ( b_isend )
+        vlc_memstream_puts( &ms, STR_ENDLIST );
 
-        free( psz_idxTmp );
+    if ( appendIndexPart( &pp_idx_end, &ms ) )
+        goto error;
+
+    job->p_data = p_idx;
+    block_ChainProperties( p_idx, NULL, &job->i_size, NULL );
+    queueJob( p_access, job );
+    return 0;
+
+error:
+    if( p_idx )
+        block_ChainRelease( p_idx );
+    free( job->pi_segments );
+    free( job->psz_path );
+    free( job );
+    return -1;
+}
+
+/************************************************************************
+ * updateIndexAndDel: If necessary, update index file & delete old segments
+ ************************************************************************/
+static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
+{
+    uint32_t i_firstseg;
+    unsigned i_index_offset = 0;
+
+    if ( p_sys->i_numsegs == 0 ||
+         p_sys->i_segment < ( p_sys->i_numsegs + p_sys->i_initial_segment ) )
+    {
+        i_firstseg = p_sys->i_initial_segment;
+    }
+    else
+    {
+        unsigned numsegs = segmentAmountNeeded( p_sys );
+        i_firstseg = ( p_sys->i_segment - numsegs ) + 1;
+        i_index_offset = vlc_array_count( &p_sys->segments_t ) - numsegs;
     }
 
+    // First update index
+    if ( p_sys->psz_indexPath &&
+         pushIndex( p_access, p_sys, i_firstseg, i_index_offset, b_isend ) )
+        return -1;
+
     // Then take care of deletion
     // Try to follow pantos draft 11 section 6.2.2
     while( p_sys->b_delsegs && p_sys->i_numsegs &&
@@ -687,11 +1195,7 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
          msg_Dbg( p_access, "Removing segment number %d", segment->i_segment_number );
          vlc_array_remove( &p_sys->segments_t, 0 );
 
-         if ( segment->psz_filename )
-         {
-             vlc_unlink( segment->psz_filename );
-         }
-
+         removeSegmentFiles( p_access, segment );
          destroySegment( segment );
          i_index_offset -=1;
     }
@@ -703,9 +1207,9 @@ static int updateIndexAndDel( sout_access_out_t *p_access, sout_access_out_sys_t
 /*****************************************************************************
  * closeCurrentSegment: Close the segment file
  *****************************************************************************/
-static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
+static int closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys, bool b_isend )
 {
-    if ( p_sys->i_handle >= 0 )
+    if ( p_sys->b_segment_open )
     {
         output_segment_t *segment = vlc_array_item_at_index( &p_sys->segments_t, vlc_array_count( &p_sys->segments_t ) - 1 );
 
@@ -719,21 +1223,26 @@ static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sy
                msg_Err( p_access, "Couldn't encrypt 16 bytes: %s", gpg_strerror(err) );
             } else {
 
-            int ret = vlc_write( p_sys->i_handle, p_sys->stuffing_bytes, 16 );
-            if( ret != 16 )
+            block_t *p_pad = block_Alloc( 16 );
+            if( p_pad )
+            {
+                memcpy( p_pad->p_buffer, p_sys->stuffing_bytes, 16 );
+                pushJob( p_access, JOB_SEGMENT_DATA, NULL, p_pad );
+            }
+            else
                 msg_Err( p_access, "Couldn't write 16 bytes" );
             }
             p_sys->stuffing_size = 0;
         }
 
 
-        vlc_close( p_sys->i_handle );
-        p_sys->i_handle = -1;
+        pushJob( p_access, JOB_SEGMENT_CLOSE, NULL, NULL );
+        p_sys->b_segment_open = false;
 
         if( ! ( us_asprintf( &segment->psz_duration, "%.2f", secf_from_vlc_tick( p_sys->current_segment_length )) ) )
         {
             msg_Err( p_access, "Couldn't set duration on closed segment");
-            return;
+            return -1;
         }
         segment->segment_length = p_sys->current_segment_length;
 
@@ -744,9 +1253,10 @@ static void closeCurrentSegment( sout_access_out_t *p_access, sout_access_out_sy
             msg_Dbg( p_access, "LiveHttpSegmentComplete: %s (%"PRIu32")" , p_sys->psz_cursegPath, p_sys->i_segment );
             free( p_sys->psz_cursegPath );
             p_sys->psz_cursegPath = 0;
-            updateIndexAndDel( p_access, p_sys, b_isend );
+            return updateIndexAndDel( p_access, p_sys, b_isend );
         }
     }
+    return 0;
 }
 
 /*****************************************************************************
@@ -781,7 +1291,8 @@ static void Close( vlc_object_t * p_this )
         p_sys->ongoing_segment_end = &p_sys->ongoing_segment;
     }
 
-    ssize_t writevalue = writeSegment( p_access );
+    ssize_t writevalue = writeSegment( p_access, p_sys->part_max_length > 0 &&
+                                                 p_sys->b_segment_open );
     msg_Dbg( p_access, "Writing.. %zd", writevalue );
     if( unlikely( writevalue < 0 ) )
     {
@@ -806,12 +1317,22 @@ static void Close( vlc_object_t * p_this )
         if( p_sys->b_delsegs && p_sys->i_numsegs && segment->psz_filename )
         {
             msg_Dbg( p_access, "Removing segment number %d name %s", segment->i_segment_number, segment->psz_filename );
-            vlc_unlink( segment->psz_filename );
+            removeSegmentFiles( p_access, segment );
         }
 
         destroySegment( segment );
     }
 
+    /* Let the writer finish everything queued */
+    vlc_mutex_lock( &p_sys->lock );
+    p_sys->b_exit = true;
+    vlc_cond_signal( &p_sys->wait );
+    vlc_mutex_unlock( &p_sys->lock );
+    vlc_join( p_sys->writer, NULL );
+    if( p_sys->b_error )
+        msg_Err( p_access, "some LiveHttp segments could not be written" );
+
+    free( p_sys->psz_initUri );
     free( p_sys->psz_indexUrl );
     free( p_sys->psz_indexPath );
     free( p_sys );
@@ -844,8 +1365,6 @@ static int Control( sout_access_out_t *p_access, int i_query, va_list args )
  *****************************************************************************/
 static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t *p_sys )
 {
-    int fd;
-
     uint32_t i_newseg = p_sys->i_segment + 1;
 
     /* Create segment and fill it info that we can (everything excluding duration */
@@ -865,15 +1384,15 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
         return -1;
     }
 
-    fd = vlc_open( segment->psz_filename, O_WRONLY | O_CREAT | O_LARGEFILE |
-                     O_TRUNC, 0666 );
-    if ( fd == -1 )
+    writer_job_t *job = newJob( JOB_SEGMENT_OPEN, strdup( segment->psz_filename ), NULL );
+    if ( unlikely( !job ) || unlikely( !job->psz_path ) )
     {
-        msg_Err( p_access, "cannot open `%s' (%s)", segment->psz_filename,
-                 vlc_strerror_c(errno) );
+        free( job );
         destroySegment( segment );
         return -1;
     }
+    job->i_segment = i_newseg;
+    queueJob( p_access, job );
 
     vlc_array_append_or_abort( &p_sys->segments_t, segment );
 
@@ -892,10 +1411,11 @@ static ssize_t openNextFile( sout_access_out_t *p_access, sout_access_out_sys_t
     msg_Dbg( p_access, "Successfully opened livehttp file: %s (%"PRIu32")" , segment->psz_filename, i_newseg );
 
     p_sys->psz_cursegPath = strdup(segment->psz_filename);
-    p_sys->i_handle = fd;
+    p_sys->b_segment_open = true;
+    p_sys->current_segment_length = 0;
     p_sys->i_segment = i_newseg;
     p_sys->b_segment_has_data = false;
-    return fd;
+    return 0;
 }
 /*****************************************************************************
  * CheckSegmentChange: Check if segment needs to be closed and new opened
@@ -911,20 +1431,25 @@ static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer )
     block_ChainProperties( p_sys->full_segments, NULL, NULL, &current_length );
     block_ChainProperties( p_sys->ongoing_segment, NULL, NULL, &ongoing_length );
 
-    if( p_sys->i_handle > 0 &&
-       (( p_buffer->i_length + current_length + ongoing_length ) >= p_sys->segment_max_length ) )
+    if( p_sys->b_segment_open &&
+       (( p_buffer->i_length + p_sys->current_segment_length +
+          current_length + ongoing_length ) >= p_sys->segment_max_length ) )
     {
-        writevalue = writeSegment( p_access );
+        writevalue = writeSegment( p_access, p_sys->part_max_length > 0 );
         if( unlikely( writevalue < 0 ) )
         {
             block_ChainRelease ( p_buffer );
             return -1;
         }
-        closeCurrentSegment( p_access, p_sys, false );
+        if( closeCurrentSegment( p_access, p_sys, false ) )
+        {
+            block_ChainRelease ( p_buffer );
+            return -1;
+        }
         return writevalue;
     }
 
-    if ( unlikely( p_sys->i_handle < 0 ) )
+    if ( unlikely( !p_sys->b_segment_open ) )
     {
         if ( openNextFile( p_access, p_sys ) < 0 )
            return -1;
@@ -932,7 +1457,62 @@ static int CheckSegmentChange( sout_access_out_t *p_access, block_t *p_buffer )
     return writevalue;
 }
 
-static ssize_t writeSegment( sout_access_out_t *p_access )
+/*****************************************************************************
+ * cryptSegmentData: Encrypt a whole chain at once, keeping the unaligned tail
+ *****************************************************************************/
+static void cryptAppend( sout_access_out_sys_t *p_sys, block_t *p_out, size_t *pi_pos,
+                         const uint8_t *p_src, size_t i_src )
+{
+    size_t i_copy = __MIN( i_src, p_out->i_buffer - *pi_pos );
+
+    memcpy( &p_out->p_buffer[*pi_pos], p_src, i_copy );
+    *pi_pos += i_copy;
+    /* less than a cipher block is left over */
+    memcpy( &p_sys->stuffing_bytes[p_sys->stuffing_size], &p_src[i_copy], i_src - i_copy );
+    p_sys->stuffing_size += i_src - i_copy;
+}
+
+static block_t *cryptSegmentData( sout_access_out_t *p_access, block_t *p_chain )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+    size_t i_size;
+
+    block_ChainProperties( p_chain, NULL, &i_size, NULL );
+    i_size += p_sys->stuffing_size;
+
+    block_t *p_crypted = block_Alloc( i_size & ~15 );
+    if( unlikely( !p_crypted ) )
+    {
+        block_ChainRelease( p_chain );
+        return NULL;
+    }
+
+    uint8_t stuffing[16];
+    size_t i_pos = 0;
+    size_t i_stuffing = p_sys->stuffing_size;
+
+    memcpy( stuffing, p_sys->stuffing_bytes, i_stuffing );
+    p_sys->stuffing_size = 0;
+    cryptAppend( p_sys, p_crypted, &i_pos, stuffing, i_stuffing );
+    for( const block_t *b = p_chain; b; b = b->p_next )
+        cryptAppend( p_sys, p_crypted, &i_pos, b->p_buffer, b->i_buffer );
+    block_ChainRelease( p_chain );
+
+    gcry_error_t err = gcry_cipher_encrypt( p_sys->aes_ctx,
+                        p_crypted->p_buffer, p_crypted->i_buffer, NULL, 0 );
+    if( err )
+    {
+        msg_Err( p_access, "Encryption failure: %s ", gpg_strerror(err) );
+        block_Release( p_crypted );
+        return NULL;
+    }
+    return p_crypted;
+}
+
+/*****************************************************************************
+ * writeSegment: Queue full segments to the current segment, or as a new part
+ *****************************************************************************/
+static ssize_t writeSegment( sout_access_out_t *p_access, bool b_part )
 {
     sout_access_out_sys_t *p_sys = p_access->p_sys;
     msg_Dbg( p_access, "Writing all full segments" );
@@ -941,69 +1521,75 @@ static ssize_t writeSegment( sout_access_out_t *p_access )
     p_sys->full_segments = NULL;
     p_sys->full_segments_end = &p_sys->full_segments;
 
+    if( !output )
+        return 0;
+
     vlc_tick_t current_length = 0;
     block_ChainProperties( output, NULL, NULL, &current_length );
+    p_sys->current_segment_length += current_length;
 
-    ssize_t i_write=0;
-    bool crypted = false;
-    p_sys->current_segment_length = current_length;
-    while( output )
+    char *psz_part = NULL;
+    if( b_part )
     {
-        if( p_sys->key_uri && !crypted )
+        output_segment_t *segment = vlc_array_item_at_index( &p_sys->segments_t, vlc_array_count( &p_sys->segments_t ) - 1 );
+        vlc_tick_t *p_parts_length = realloc( segment->p_parts_length,
+                                              ( segment->i_parts + 1 ) * sizeof( *p_parts_length ) );
+        if( unlikely( !p_parts_length ) )
         {
-            if( p_sys->stuffing_size )
-            {
-                output = block_Realloc( output, p_sys->stuffing_size, output->i_buffer );
-                if( unlikely(!output ) )
-                    return VLC_ENOMEM;
-                memcpy( output->p_buffer, p_sys->stuffing_bytes, p_sys->stuffing_size );
-                p_sys->stuffing_size = 0;
-            }
-            size_t original = output->i_buffer;
-            size_t padded = (output->i_buffer + 15 ) & ~15;
-            size_t pad = padded - original;
-            if( pad )
-            {
-                p_sys->stuffing_size = 16-pad;
-                output->i_buffer -= p_sys->stuffing_size;
-                memcpy(p_sys->stuffing_bytes, &output->p_buffer[output->i_buffer], p_sys->stuffing_size);
-            }
-
-            gcry_error_t err = gcry_cipher_encrypt( p_sys->aes_ctx,
-                                output->p_buffer, output->i_buffer, NULL, 0 );
-            if( err )
-            {
-                msg_Err( p_access, "Encryption failure: %s ", gpg_strerror(err) );
-                return -1;
-            }
-            crypted=true;
-
+            block_ChainRelease( output );
+            return -1;
         }
-
-        ssize_t val = vlc_write( p_sys->i_handle, output->p_buffer, output->i_buffer );
-        if ( val == -1 )
+        segment->p_parts_length = p_parts_length;
+        psz_part = formatPartPath( segment->psz_filename, segment->i_parts );
+        if( unlikely( !psz_part ) )
         {
-           if ( errno == EINTR )
-              continue;
-           return -1;
+            block_ChainRelease( output );
+            return -1;
         }
+        p_parts_length[segment->i_parts++] = current_length;
+    }
 
+    if( p_sys->key_uri )
+    {
+        output = cryptSegmentData( p_access, output );
+        if( unlikely( !output ) )
+            return -1;
+    }
 
-        if ( (size_t)val >= output->i_buffer )
-        {
-           block_t *p_next = output->p_next;
-           block_Release (output);
-           output = p_next;
-           crypted=false;
-        }
-        else
+    size_t i_write;
+    block_ChainProperties( output, NULL, &i_write, NULL );
+    if( pushJob( p_access, JOB_SEGMENT_DATA, psz_part, output ) )
+        return -1;
+    return i_write;
+}
+
+/*****************************************************************************
+ * writeInitSegment: Store the fMP4 initialization section on its own
+ *****************************************************************************/
+static int writeInitSegment( sout_access_out_t *p_access, block_t *p_init )
+{
+    sout_access_out_sys_t *p_sys = p_access->p_sys;
+
+    if( !p_sys->b_fmp4 )
+    {
+        char *psz_idxFormat = p_sys->psz_indexUrl ? p_sys->psz_indexUrl : p_access->psz_path;
+        p_sys->psz_initUri = formatInitPath( psz_idxFormat );
+        if( unlikely( !p_sys->psz_initUri ) )
         {
-           output->p_buffer += val;
-           output->i_buffer -= val;
+            block_Release( p_init );
+            return -1;
         }
-        i_write += val;
+        p_sys->b_fmp4 = true;
     }
-    return i_write;
+
+    char *psz_init = formatInitPath( p_access->psz_path );
+    if( unlikely( !psz_init ) )
+    {
+        block_Release( p_init );
+        return -1;
+    }
+    msg_Dbg( p_access, "Writing init segment %s", psz_init );
+    return pushJob( p_access, JOB_FILE, psz_init, p_init );
 }
 
 /*****************************************************************************
@@ -1015,11 +1601,53 @@ static ssize_t Write( sout_access_out_t *p_access, block_t *p_buffer )
     sout_access_out_sys_t *p_sys = p_access->p_sys;
     while( p_buffer )
     {
+        /* fragmented MP4 header goes into the initialization section */
+        if( ( p_buffer->i_flags & BLOCK_FLAG_HEADER ) && p_buffer->i_buffer >= 8 &&
+            !memcmp( &p_buffer->p_buffer[4], "ftyp", 4 ) )
+        {
+            block_t *p_temp = p_buffer->p_next;
+            p_buffer->p_next = NULL;
+            if( writeInitSegment( p_access, p_buffer ) )
+            {
+                block_ChainRelease( p_temp );
+                return -1;
+            }
+            p_buffer = p_temp;
+            continue;
+        }
+
+        /* fragments start with a keyframe flagged moof */
+        const uint32_t i_split_flag = p_sys->b_fmp4 ? BLOCK_FLAG_TYPE_I : BLOCK_FLAG_HEADER;
+
         /* Check if current block is already past segment-length
             and we want to write gathered blocks into segment
             and update playlist */
-        if( p_sys->ongoing_segment && ( p_sys->b_splitanywhere  || ( p_buffer->i_flags & BLOCK_FLAG_HEADER ) ) )
+        if( p_sys->ongoing_segment && ( p_sys->b_splitanywhere  || ( p_buffer->i_flags & i_split_flag ) ) )
         {
+            if( p_sys->part_max_length && p_sys->full_segments && p_sys->b_segment_open )
+            {
+                vlc_tick_t full_length, ongoing_length;
+                block_ChainProperties( p_sys->full_segments, NULL, NULL, &full_length );
+                block_ChainProperties( p_sys->ongoing_segment, NULL, NULL, &ongoing_length );
+
+                /* publish what we have before the part gets too long */
+                if( full_length + ongoing_length > p_sys->part_max_length )
+                {
+                    ssize_t ret = writeSegment( p_access, true );
+                    if( ret < 0 )
+                    {
+                        block_ChainRelease( p_buffer );
+                        return ret;
+                    }
+                    i_write += ret;
+                    if( updateIndexAndDel( p_access, p_sys, false ) )
+                    {
+                        block_ChainRelease( p_buffer );
+                        return -1;
+                    }
+                }
+            }
+
             msg_Dbg( p_access, "Moving ongoing segment to full segments-queue" );
             block_ChainLastAppend( &p_sys->full_segments_end, p_sys->ongoing_segment );
             p_sys->ongoing_segment = NULL;
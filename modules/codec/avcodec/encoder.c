@@ -143,6 +143,8 @@ typedef struct
     int        i_aac_profile; /* AAC profile to use.*/
 
     AVFrame    *frame;
+
+    vlc_cpu_quota_t *cpu_quota; /* threads granted by the CPU budget */
 } encoder_sys_t;
 
 
@@ -865,7 +867,9 @@ int InitVideoEnc( vlc_object_t *p_this )
     if( p_enc->i_threads >= 1)
         p_context->thread_count = p_enc->i_threads;
     else
-        p_context->thread_count = vlc_GetCPUCount();
+        p_context->thread_count =
+            vlc_cpu_quota_Acquire( p_enc, vlc_GetCPUCount(),
+                                   &p_sys->cpu_quota );
 
     int ret;
     char *psz_opts = var_InheritString(p_enc, ENC_CFG_PREFIX "options");
@@ -968,6 +972,9 @@ errmsg:
 
     av_dict_free(&options);
 
+    vlc_cpu_quota_Use( p_sys->cpu_quota, p_context->active_thread_type ?
+                                         p_context->thread_count : 1 );
+
     if( i_codec_id == AV_CODEC_ID_FLAC )
     {
         p_enc->fmt_out.i_extra = 4 + 1 + 3 + p_context->extradata_size;
@@ -1056,6 +1063,7 @@ error:
     av_free( p_sys->p_buffer );
     av_free( p_sys->p_interleave_buf );
     avcodec_free_context( &p_context );
+    vlc_cpu_quota_Release( p_sys->cpu_quota );
     free( p_sys );
     return VLC_ENOMEM;
 }
@@ -1136,7 +1144,8 @@ static void check_hurry_up( encoder_sys_t *p_sys, AVFrame *frame, encoder_t *p_e
         }
     }
 
-    if ( current_date + HURRY_UP_GUARD1 > FROM_AV_TS(frame->pts) )
+    if ( current_date + HURRY_UP_GUARD1 > FROM_AV_TS(frame->pts)
+      && frame->pict_type != AV_PICTURE_TYPE_I )
     {
         frame->pict_type = AV_PICTURE_TYPE_P;
         /* msg_Dbg( p_enc, "hurry up mode 1 %lld", current_date + HURRY_UP_GUARD1 - frame.pts ); */
@@ -1193,8 +1202,9 @@ static block_t *EncodeVideo( encoder_t *p_enc, picture_t *p_pict )
             p_sys->frame->linesize[i_plane] = p_pict->p[i_plane].i_pitch;
         }
 
-        /* Let libavcodec select the frame type */
-        frame->pict_type = 0;
+        /* Let libavcodec select the frame type, unless a keyframe is
+         * requested */
+        frame->pict_type = p_pict->b_keyframe ? AV_PICTURE_TYPE_I : 0;
 
         frame->repeat_pict = p_pict->i_nb_fields - 2;
         frame->interlaced_frame = !p_pict->b_progressive;
@@ -1478,5 +1488,6 @@ void EndVideoEnc( vlc_object_t *p_this )
     av_free( p_sys->p_interleave_buf );
     av_free( p_sys->p_buffer );
 
+    vlc_cpu_quota_Release( p_sys->cpu_quota );
     free( p_sys );
 }
@@ -114,6 +114,9 @@ typedef struct
     /* Protect dec->fmt_out, decoder_Update*() and decoder_NewPicture()
      * functions */
     vlc_mutex_t lock;
+
+    /* threads granted by the CPU budget, NULL if set by the user */
+    vlc_cpu_quota_t *cpu_quota;
 } decoder_sys_t;
 
 /*****************************************************************************
@@ -517,6 +520,8 @@ static int OpenVideoCodec( decoder_t *p_dec )
                       ctx->thread_count );
             break;
     }
+    vlc_cpu_quota_Use( p_sys->cpu_quota,
+                       ctx->active_thread_type ? ctx->thread_count : 1 );
     return 0;
 }
 
@@ -617,7 +622,8 @@ int InitVideoDec( vlc_object_t *obj )
     p_context->reordered_opaque = 0;
 
     int i_thread_count = var_InheritInteger( p_dec, "avcodec-threads" );
-    if( i_thread_count <= 0 )
+    const bool b_auto_threads = i_thread_count <= 0;
+    if( b_auto_threads )
     {
         i_thread_count = vlc_GetCPUCount();
         if( i_thread_count > 1 )
@@ -631,6 +637,10 @@ int InitVideoDec( vlc_object_t *obj )
 #endif
     }
     i_thread_count = __MIN( i_thread_count, p_codec->id == AV_CODEC_ID_HEVC ? 32 : 16 );
+    /* only book the threads the codec will run */
+    if( b_auto_threads )
+        i_thread_count = vlc_cpu_quota_Acquire( p_dec, i_thread_count,
+                                                &p_sys->cpu_quota );
     msg_Dbg( p_dec, "allowing %d thread(s) for decoding", i_thread_count );
     p_context->thread_count = i_thread_count;
     p_context->thread_safe_callbacks = true;
@@ -690,6 +700,7 @@ int InitVideoDec( vlc_object_t *obj )
     /* ***** Open the codec ***** */
     if( OpenVideoCodec( p_dec ) < 0 )
     {
+        vlc_cpu_quota_Release( p_sys->cpu_quota );
         free( p_sys );
         avcodec_free_context( &p_context );
         return VLC_EGENERIC;
@@ -1388,6 +1399,7 @@ void EndVideoDec( vlc_object_t *obj )
     if( p_sys->p_va )
         vlc_va_Delete( p_sys->p_va );
 
+    vlc_cpu_quota_Release( p_sys->cpu_quota );
     free( p_sys );
 }
 
@@ -32,6 +32,7 @@
 #include <vlc_common.h>
 #include <vlc_plugin.h>
 #include <vlc_codec.h>
+#include <vlc_cpu.h>
 #include <vlc_timestamp_helper.h>
 
 #include <errno.h>
@@ -78,6 +79,7 @@ typedef struct
     Dav1dSettings s;
     Dav1dContext *c;
     cc_data_t cc;
+    vlc_cpu_quota_t *cpu_quota;
 } decoder_sys_t;
 
 struct user_data_s
@@ -385,8 +387,16 @@ static int OpenDecoder(vlc_object_t *p_this)
     if (p_sys->s.n_tile_threads == 0)
         p_sys->s.n_tile_threads = VLC_CLIP(vlc_GetCPUCount(), 1, 4);
     p_sys->s.n_frame_threads = var_InheritInteger(p_this, "dav1d-thread-frames");
+    p_sys->cpu_quota = NULL;
     if (p_sys->s.n_frame_threads == 0)
-        p_sys->s.n_frame_threads = __MAX(1, vlc_GetCPUCount());
+    {
+        p_sys->s.n_frame_threads =
+            vlc_cpu_quota_Acquire(dec, __MAX(1, vlc_GetCPUCount()),
+                                  &p_sys->cpu_quota);
+        if (p_sys->cpu_quota != NULL)
+            p_sys->s.n_tile_threads = __MIN(p_sys->s.n_tile_threads,
+                                            p_sys->s.n_frame_threads);
+    }
     p_sys->s.allocator.cookie = dec;
     p_sys->s.allocator.alloc_picture_callback = NewPicture;
     p_sys->s.allocator.release_picture_callback = FreePicture;
@@ -394,6 +404,7 @@ static int OpenDecoder(vlc_object_t *p_this)
     if (dav1d_open(&p_sys->c, &p_sys->s) < 0)
     {
         msg_Err(p_this, "Could not open the Dav1d decoder");
+        vlc_cpu_quota_Release(p_sys->cpu_quota);
         return VLC_EGENERIC;
     }
 
@@ -437,5 +448,6 @@ static void CloseDecoder(vlc_object_t *p_this)
     FlushDecoder(dec);
 
     dav1d_close(&p_sys->c);
+    vlc_cpu_quota_Release(p_sys->cpu_quota);
 }
 
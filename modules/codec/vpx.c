@@ -482,6 +482,8 @@ static block_t *Encode(encoder_t *p_enc, picture_t *p_pict)
     }
 
     int flags = 0;
+    if (p_pict->b_keyframe)
+        flags |= VPX_EFLAG_FORCE_KF;
 
     vpx_codec_err_t res = vpx_codec_encode(ctx, &img, p_pict->date, 1,
      flags, p_sys->quality);
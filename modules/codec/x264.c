@@ -765,6 +765,7 @@ typedef struct
     int             i_sei_size;
     uint32_t         i_colorspace;
     uint8_t         *p_sei;
+    vlc_cpu_quota_t *cpu_quota;
 } encoder_sys_t;
 
 #ifdef PTW32_STATIC_LIB
@@ -813,6 +814,7 @@ static int  Open ( vlc_object_t *p_this )
     p_enc->p_sys = p_sys = vlc_obj_malloc( p_this, sizeof( encoder_sys_t ) );
     if( !p_sys )
         return VLC_ENOMEM;
+    p_sys->cpu_quota = NULL;
 
     fullrange = var_GetBool( p_enc, SOUT_CFG_PREFIX "fullrange" );
     fullrange |= p_enc->fmt_in.video.color_range == COLOR_RANGE_FULL;
@@ -1329,6 +1331,11 @@ static int  Open ( vlc_object_t *p_this )
        threads = 1, however VLC usage differs and uses threads = 0 (auto) by
        default unless ofcourse transcode threads is explicitly specified.. */
     p_sys->param.i_threads = p_enc->i_threads;
+    if( p_sys->param.i_threads == 0 )
+        /* same as the automatic value, within the CPU budget */
+        p_sys->param.i_threads =
+            vlc_cpu_quota_Acquire( p_enc, vlc_GetCPUCount() * 3 / 2,
+                                   &p_sys->cpu_quota );
 
     psz_val = var_GetString( p_enc, SOUT_CFG_PREFIX "stats" );
     if( psz_val )
@@ -1490,6 +1497,9 @@ static block_t *Encode( encoder_t *p_enc, picture_t *p_pict )
     x264_picture_init( &pic );
     if( likely(p_pict) ) {
        pic.i_pts = p_pict->date;
+       /* requested keyframes start segments, even with open GOPs */
+       if( p_pict->b_keyframe )
+           pic.i_type = X264_TYPE_IDR;
        pic.img.i_csp = p_sys->i_colorspace;
        pic.img.i_plane = p_pict->i_planes;
        for( i = 0; i < p_pict->i_planes; i++ )
@@ -1569,6 +1579,7 @@ static void Close( vlc_object_t *p_this )
         msg_Dbg( p_enc, "framecount still in libx264 buffer: %d", x264_encoder_delayed_frames( p_sys->h ) );
         x264_encoder_close( p_sys->h );
     }
+    vlc_cpu_quota_Release( p_sys->cpu_quota );
 
 #ifdef PTW32_STATIC_LIB
     vlc_mutex_lock( &pthread_win32_mutex );
@@ -33,6 +33,7 @@
 #include <vlc_threads.h>
 #include <vlc_sout.h>
 #include <vlc_codec.h>
+#include <vlc_cpu.h>
 
 #include <x265.h>
 
@@ -55,6 +56,8 @@ typedef struct
     x265_encoder    *h;
     x265_param      param;
 
+    vlc_cpu_quota_t *cpu_quota;
+
     unsigned        frame_count;
     vlc_tick_t      initial_date;
 #ifndef NDEBUG
@@ -153,7 +156,6 @@ static int  Open (vlc_object_t *p_this)
     x265_param *param = &p_sys->param;
     x265_param_default(param);
 
-    param->frameNumThreads = vlc_GetCPUCount();
     param->bEnableWavefront = 0; // buggy in x265, use frame threading for now
     param->maxCUSize = 16; /* use smaller macroblock */
 
@@ -192,9 +194,15 @@ static int  Open (vlc_object_t *p_this)
         param->rc.rateControlMode = X265_RC_ABR;
     }
 
+    param->frameNumThreads =
+        vlc_cpu_quota_Acquire(p_enc, __MIN(vlc_GetCPUCount(),
+                                           X265_MAX_FRAME_THREADS),
+                              &p_sys->cpu_quota);
+
     p_sys->h = x265_encoder_open(param);
     if (p_sys->h == NULL) {
         msg_Err(p_enc, "cannot open x265 encoder");
+        vlc_cpu_quota_Release(p_sys->cpu_quota);
         free(p_sys);
         return VLC_EGENERIC;
     }
@@ -240,5 +248,6 @@ static void Close(vlc_object_t *p_this)
 
     x265_encoder_close(p_sys->h);
 
+    vlc_cpu_quota_Release(p_sys->cpu_quota);
     free(p_sys);
 }
@@ -24,6 +24,7 @@
 #include "SharedResources.hpp"
 #include "http/AuthStorage.hpp"
 #include "http/HTTPConnectionManager.h"
+#include "http/SegmentCache.hpp"
 #include "encryption/Keyring.hpp"
 
 #include <vlc_common.h>
@@ -38,11 +39,18 @@ SharedResources::SharedResources(vlc_object_t *obj, bool local)
     if(m && local)
         m->setLocalConnectionsAllowed();
     connManager = m;
+
+    size_t cachesize = var_InheritInteger(obj, "adaptive-cache-size") * 1024 * 1024;
+    char *psz_cachedir = var_InheritString(obj, "adaptive-cache-dir");
+    segmentCache = new SegmentCache(obj, cachesize,
+                                    psz_cachedir ? psz_cachedir : std::string());
+    free(psz_cachedir);
 }
 
 SharedResources::~SharedResources()
 {
     delete connManager;
+    delete segmentCache;
     delete encryptionKeyring;
     delete authStorage;
 }
@@ -61,3 +69,8 @@ AbstractConnectionManager * SharedResources::getConnManager()
 {
     return connManager;
 }
+
+SegmentCache * SharedResources::getSegmentCache()
+{
+    return segmentCache;
+}
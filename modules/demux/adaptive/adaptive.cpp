@@ -82,6 +82,15 @@ static void Close   (vlc_object_t *);
 #define ADAPT_ACCESS_TEXT N_("Use regular HTTP modules")
 #define ADAPT_ACCESS_LONGTEXT N_("Connect using HTTP access instead of custom HTTP code")
 
+#define ADAPT_CACHESIZE_TEXT N_("Segments cache size (MiB)")
+#define ADAPT_CACHESIZE_LONGTEXT N_("Completed segments are kept up to this size " \
+    "so seeking back does not download them again. Segments of live " \
+    "playlists are not cached. 0 disables the cache.")
+
+#define ADAPT_CACHEDIR_TEXT N_("Segments cache directory")
+#define ADAPT_CACHEDIR_LONGTEXT N_("Stores cached segments as files in this " \
+    "directory instead of memory.")
+
 #define ADAPT_LOWLATENCY_TEXT N_("Low latency")
 #define ADAPT_LOWLATENCY_LONGTEXT N_("Overrides low latency parameters")
 
@@ -89,6 +98,7 @@ static const AbstractAdaptationLogic::LogicType pi_logics[] = {
                                 AbstractAdaptationLogic::Default,
                                 AbstractAdaptationLogic::Predictive,
                                 AbstractAdaptationLogic::NearOptimal,
+                                AbstractAdaptationLogic::Hybrid,
                                 AbstractAdaptationLogic::RateBased,
                                 AbstractAdaptationLogic::FixedRate,
                                 AbstractAdaptationLogic::AlwaysLowest,
@@ -98,6 +108,7 @@ static const char *const ppsz_logics_values[] = {
                                 "",
                                 "predictive",
                                 "nearoptimal",
+                                "hybrid",
                                 "rate",
                                 "fixedrate",
                                 "lowest",
@@ -106,6 +117,7 @@ static const char *const ppsz_logics_values[] = {
 static const char *const ppsz_logics[] = { N_("Default"),
                                            N_("Predictive"),
                                            N_("Near Optimal"),
+                                           N_("Throughput and Buffer Hybrid"),
                                            N_("Bandwidth Adaptive"),
                                            N_("Fixed Bandwidth"),
                                            N_("Lowest Bandwidth/Quality"),
@@ -145,6 +157,9 @@ vlc_module_begin ()
                      ADAPT_MAXBUFFER_TEXT, NULL, true );
         add_integer( "adaptive-lowlatency", -1, ADAPT_LOWLATENCY_TEXT, ADAPT_LOWLATENCY_LONGTEXT, true );
             change_integer_list(rgi_latency, ppsz_latency)
+        add_integer( "adaptive-cache-size", 0, ADAPT_CACHESIZE_TEXT, ADAPT_CACHESIZE_LONGTEXT, true )
+            change_integer_range( 0, 4096 )
+        add_directory( "adaptive-cache-dir", NULL, ADAPT_CACHEDIR_TEXT, ADAPT_CACHEDIR_LONGTEXT )
         set_callbacks( Open, Close )
 vlc_module_end ()
 
@@ -29,6 +29,7 @@
 #include "HTTPConnection.hpp"
 #include "HTTPConnectionManager.h"
 #include "Downloader.hpp"
+#include "SegmentCache.hpp"
 
 #include <vlc_common.h>
 #include <vlc_block.h>
@@ -303,6 +304,10 @@ HTTPChunkBufferedSource::HTTPChunkBufferedSource(const std::string& url, Abstrac
     eof = false;
     held = false;
     downloadstart = 0;
+    cache = NULL;
+    p_record = NULL;
+    pp_recordtail = &p_record;
+    recorded = 0;
 }
 
 HTTPChunkBufferedSource::~HTTPChunkBufferedSource()
@@ -322,6 +327,8 @@ HTTPChunkBufferedSource::~HTTPChunkBufferedSource()
         pp_tail = &p_head;
     }
     buffered = 0;
+    if(p_record)
+        block_ChainRelease(p_record);
     vlc_mutex_unlock(&lock);
 }
 
@@ -344,6 +351,61 @@ void HTTPChunkBufferedSource::release()
     vlc_cond_signal(&avail);
 }
 
+void HTTPChunkBufferedSource::setCache(SegmentCache *c, const std::string &url)
+{
+    vlc_mutex_locker locker( &lock );
+    if(c && c->isEnabled())
+    {
+        cache = c;
+        cacheurl = url;
+    }
+}
+
+/* Must be called with lock held */
+void HTTPChunkBufferedSource::record(const block_t *p_block, bool b_done)
+{
+    if(!cache)
+        return;
+
+    if(p_block)
+    {
+        block_t *p_dup = NULL;
+        if(cache->accepts(recorded + p_block->i_buffer) &&
+           (p_dup = block_Duplicate(p_block)))
+        {
+            recorded += p_dup->i_buffer;
+            block_ChainLastAppend(&pp_recordtail, p_dup);
+        }
+        else /* can't be cached */
+        {
+            cache = NULL;
+        }
+    }
+
+    if(cache && b_done)
+    {
+        /* only store complete downloads */
+        if(p_record && requeststatus == RequestStatus::Success &&
+           contentLength && recorded == contentLength)
+        {
+            block_t *p_gathered = block_ChainGather(p_record);
+            p_record = NULL;
+            if(p_gathered)
+                cache->put(cacheurl, bytesRange, connection->getContentType(),
+                           p_gathered);
+        }
+        cache = NULL;
+    }
+
+    if(!cache && p_record)
+    {
+        block_ChainRelease(p_record);
+        p_record = NULL;
+        pp_recordtail = &p_record;
+        recorded = 0;
+    }
+}
+
 void HTTPChunkBufferedSource::bufferize(size_t readsize)
 {
     vlc_mutex_lock(&lock);
@@ -387,12 +449,14 @@ void HTTPChunkBufferedSource::bufferize(size_t readsize)
         rate.size = buffered + consumed;
         rate.time = vlc_tick_now() - downloadstart;
         downloadstart = 0;
+        record(NULL, true);
     }
     else
     {
         p_block->i_buffer = (size_t) ret;
         vlc_mutex_locker locker( &lock );
         buffered += p_block->i_buffer;
+        record(p_block, false);
         block_ChainLastAppend(&pp_tail, p_block);
         if((size_t) ret < readsize)
         {
@@ -400,6 +464,7 @@ void HTTPChunkBufferedSource::bufferize(size_t readsize)
             rate.size = buffered + consumed;
             rate.time = vlc_tick_now() - downloadstart;
             downloadstart = 0;
+            record(NULL, true);
         }
     }
 
@@ -41,6 +41,7 @@ namespace adaptive
         class AbstractConnection;
         class AbstractConnectionManager;
         class AbstractChunk;
+        class SegmentCache;
 
         class AbstractChunkSource
         {
@@ -128,11 +129,13 @@ namespace adaptive
                 virtual bool       hasMoreData     () const; /* impl */
                 void               hold();
                 void               release();
+                void               setCache(SegmentCache *, const std::string &);
 
             protected:
                 virtual bool       prepare(); /* reimpl */
                 void               bufferize(size_t);
                 bool               isDone() const;
+                void               record(const block_t *, bool);
 
             private:
                 block_t            *p_head; /* read cache buffer */
@@ -143,6 +146,11 @@ namespace adaptive
                 vlc_tick_t          downloadstart;
                 vlc_cond_t          avail;
                 bool                held;
+                SegmentCache       *cache;
+                std::string         cacheurl;
+                block_t            *p_record; /* copy of downloaded data for cache */
+                block_t           **pp_recordtail;
+                size_t              recorded;
         };
 
         class HTTPChunk : public AbstractChunk
@@ -0,0 +1,375 @@
+/*
+ * SegmentCache.cpp
+ *****************************************************************************
+ * Copyright (C) 2020 - VideoLAN Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "SegmentCache.hpp"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_fs.h>
+
+#include <algorithm>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace adaptive::http;
+
+SegmentCache::Data::Data(block_t *p_block_)
+{
+    p_block = p_block_;
+}
+
+SegmentCache::Data::Data(const std::string &path_)
+{
+    p_block = NULL;
+    path = path_;
+}
+
+SegmentCache::Data::~Data()
+{
+    if(p_block)
+        block_Release(p_block);
+    if(!path.empty())
+        vlc_unlink(path.c_str());
+}
+
+block_t * SegmentCache::Data::read(size_t offset, size_t length) const
+{
+    block_t *p_ret = block_Alloc(length);
+    if(!p_ret)
+        return NULL;
+
+    if(p_block)
+    {
+        memcpy(p_ret->p_buffer, &p_block->p_buffer[offset], length);
+        return p_ret;
+    }
+
+    size_t total = 0;
+    int fd = vlc_open(path.c_str(), O_RDONLY);
+    if(fd != -1)
+    {
+        if(lseek(fd, offset, SEEK_SET) == (off_t) offset)
+        {
+            while(total < length)
+            {
+                ssize_t ret = ::read(fd, &p_ret->p_buffer[total], length - total);
+                if(ret <= 0)
+                    break;
+                total += ret;
+            }
+        }
+        vlc_close(fd);
+    }
+    if(total != length)
+    {
+        block_Release(p_ret);
+        p_ret = NULL;
+    }
+    return p_ret;
+}
+
+bool SegmentCache::Entry::contains(size_t start_, size_t size_, bool toEnd_) const
+{
+    if(start_ < start)
+        return false;
+    if(toEnd_)
+        return toEnd && start_ < start + size;
+    return start_ + size_ <= start + size;
+}
+
+SegmentCache::SegmentCache(vlc_object_t *obj, size_t size, const std::string &dir_)
+{
+    p_obj = obj;
+    maxsize = size;
+    dir = dir_;
+    totalsize = 0;
+    filecount = 0;
+    vlc_mutex_init(&lock);
+}
+
+SegmentCache::~SegmentCache()
+{
+    index.clear();
+    entries.clear();
+}
+
+bool SegmentCache::isEnabled() const
+{
+    return maxsize > 0;
+}
+
+bool SegmentCache::accepts(size_t size) const
+{
+    /* Don't let a single entry flush the whole cache */
+    return size > 0 && size <= maxsize / 4;
+}
+
+void SegmentCache::getExtent(const BytesRange &range, size_t *start,
+                             size_t *size, bool *toEnd)
+{
+    /* an end byte of 0 requests up to the end */
+    if(range.isValid() && range.getEndByte())
+    {
+        *start = range.getStartByte();
+        *size = range.getEndByte() - range.getStartByte() + 1;
+        *toEnd = false;
+    }
+    else
+    {
+        *start = range.isValid() ? range.getStartByte() : 0;
+        *size = 0;
+        *toEnd = true;
+    }
+}
+
+/* Must be called with lock held */
+SegmentCache::EntryIterator SegmentCache::find(const std::string &url, size_t start,
+                                               size_t size, bool toEnd)
+{
+    std::pair<std::multimap<std::string, EntryIterator>::iterator,
+              std::multimap<std::string, EntryIterator>::iterator> range =
+        index.equal_range(url);
+    for(std::multimap<std::string, EntryIterator>::iterator it = range.first;
+        it != range.second; ++it)
+    {
+        if((*it).second->contains(start, size, toEnd))
+            return (*it).second;
+    }
+    return entries.end();
+}
+
+/* Must be called with lock held. The data is released by the caller once
+ * unlocked, or by the last reader */
+void SegmentCache::remove(EntryIterator entry, std::vector<std::shared_ptr<Data>> &dropped)
+{
+    std::pair<std::multimap<std::string, EntryIterator>::iterator,
+              std::multimap<std::string, EntryIterator>::iterator> range =
+        index.equal_range((*entry).url);
+    for(std::multimap<std::string, EntryIterator>::iterator it = range.first;
+        it != range.second; ++it)
+    {
+        if((*it).second == entry)
+        {
+            index.erase(it);
+            break;
+        }
+    }
+    totalsize -= (*entry).size;
+    dropped.push_back((*entry).data);
+    entries.erase(entry);
+}
+
+/* Must be called with lock held */
+void SegmentCache::evict(size_t needed, std::vector<std::shared_ptr<Data>> &dropped)
+{
+    while(!entries.empty() && totalsize + needed > maxsize)
+        remove(--entries.end(), dropped);
+}
+
+std::shared_ptr<SegmentCache::Data> SegmentCache::store(block_t *p_block, unsigned number)
+{
+    Data *data;
+
+    if(dir.empty())
+    {
+        data = new (std::nothrow) Data(p_block);
+        if(!data)
+            block_Release(p_block);
+        return std::shared_ptr<Data>(data);
+    }
+
+    std::stringstream ss;
+    ss.imbue(std::locale("C"));
+    ss << dir << DIR_SEP << "vlc-adaptive-" << getpid() << "-"
+       << (void *) this << "-" << number << ".seg";
+    const std::string path = ss.str();
+
+    bool b_ret = false;
+    int fd = vlc_open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if(fd != -1)
+    {
+        b_ret = (vlc_write(fd, p_block->p_buffer, p_block->i_buffer) ==
+                 (ssize_t) p_block->i_buffer);
+        vlc_close(fd);
+        if(!b_ret)
+            vlc_unlink(path.c_str());
+    }
+    block_Release(p_block);
+    if(!b_ret)
+    {
+        msg_Warn(p_obj, "cannot write cache file %s", path.c_str());
+        return std::shared_ptr<Data>();
+    }
+
+    data = new (std::nothrow) Data(path);
+    if(!data)
+        vlc_unlink(path.c_str());
+    return std::shared_ptr<Data>(data);
+}
+
+block_t * SegmentCache::get(const std::string &url, const BytesRange &range,
+                            std::string *contentType)
+{
+    if(!isEnabled())
+        return NULL;
+
+    size_t start, size;
+    bool toEnd;
+    getExtent(range, &start, &size, &toEnd);
+
+    std::shared_ptr<Data> data;
+    std::string type;
+    size_t offset;
+    {
+        vlc_mutex_locker locker(&lock);
+        EntryIterator entry = find(url, start, size, toEnd);
+        if(entry == entries.end())
+            return NULL;
+
+        /* move to front */
+        entries.splice(entries.begin(), entries, entry);
+
+        data = (*entry).data;
+        type = (*entry).contentType;
+        offset = start - (*entry).start;
+        if(toEnd)
+            size = (*entry).size - offset;
+    }
+
+    /* read without holding the lock, the data can't go away meanwhile */
+    block_t *p_block = data->read(offset, size);
+    if(p_block && contentType)
+        *contentType = type;
+    return p_block;
+}
+
+void SegmentCache::put(const std::string &url, const BytesRange &range,
+                       const std::string &contentType, block_t *p_block)
+{
+    if(!isEnabled() || !accepts(p_block->i_buffer))
+    {
+        block_Release(p_block);
+        return;
+    }
+
+    Entry entry;
+    entry.url = url;
+    entry.contentType = contentType;
+    getExtent(range, &entry.start, &entry.size, &entry.toEnd);
+    entry.size = p_block->i_buffer;
+
+    unsigned number;
+    {
+        vlc_mutex_locker locker(&lock);
+        /* already served by a cached range */
+        if(find(url, entry.start, entry.size, entry.toEnd) != entries.end())
+        {
+            block_Release(p_block);
+            return;
+        }
+        number = filecount++;
+    }
+
+    /* write without holding the lock */
+    entry.data = store(p_block, number);
+    if(!entry.data)
+        return;
+
+    /* released after unlocking, as entry */
+    std::vector<std::shared_ptr<Data>> dropped;
+
+    vlc_mutex_locker locker(&lock);
+
+    /* stored by another download meanwhile */
+    if(find(url, entry.start, entry.size, entry.toEnd) != entries.end())
+        return;
+
+    /* the ranges within this one are served from it from now on */
+    std::pair<std::multimap<std::string, EntryIterator>::iterator,
+              std::multimap<std::string, EntryIterator>::iterator> others =
+        index.equal_range(url);
+    for(std::multimap<std::string, EntryIterator>::iterator it = others.first;
+        it != others.second;)
+    {
+        EntryIterator other = (*it).second;
+        ++it;
+        if(entry.contains((*other).start, (*other).size, (*other).toEnd))
+            remove(other, dropped);
+    }
+
+    evict(entry.size, dropped);
+
+    entries.push_front(entry);
+    index.insert(std::make_pair(url, entries.begin()));
+    totalsize += entry.size;
+}
+
+CachedChunkSource::CachedChunkSource(block_t *p_block_, const std::string &type)
+    : AbstractChunkSource()
+{
+    p_block = p_block_;
+    contentType = type;
+    contentLength = p_block->i_buffer;
+}
+
+CachedChunkSource::~CachedChunkSource()
+{
+    if(p_block)
+        block_Release(p_block);
+}
+
+block_t * CachedChunkSource::readBlock()
+{
+    block_t *p_ret = p_block;
+    p_block = NULL;
+    return p_ret;
+}
+
+block_t * CachedChunkSource::read(size_t size)
+{
+    if(!p_block || !size)
+        return NULL;
+
+    if(size >= p_block->i_buffer)
+        return readBlock();
+
+    block_t *p_ret = block_Alloc(size);
+    if(p_ret)
+    {
+        memcpy(p_ret->p_buffer, p_block->p_buffer, size);
+        p_block->p_buffer += size;
+        p_block->i_buffer -= size;
+    }
+    return p_ret;
+}
+
+bool CachedChunkSource::hasMoreData() const
+{
+    return p_block && p_block->i_buffer;
+}
+
+std::string CachedChunkSource::getContentType() const
+{
+    return contentType;
+}
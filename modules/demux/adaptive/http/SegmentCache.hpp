@@ -0,0 +1,119 @@
+/*
+ * SegmentCache.hpp
+ *****************************************************************************
+ * Copyright (C) 2020 - VideoLAN Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef SEGMENTCACHE_HPP
+#define SEGMENTCACHE_HPP
+
+#include "Chunk.h"
+
+#include <vlc_common.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace adaptive
+{
+    namespace http
+    {
+        /* Completed downloads, keyed by url and bytes range, so seeking
+         * back or switching back to a representation does not refetch.
+         * Entries are kept in memory, or as files in a cache directory.
+         * A range within a cached download is served from it. */
+        class SegmentCache
+        {
+            public:
+                SegmentCache(vlc_object_t *, size_t, const std::string & = std::string());
+                ~SegmentCache();
+
+                bool      isEnabled() const;
+                bool      accepts(size_t) const;
+                block_t * get(const std::string &, const BytesRange &, std::string *);
+                void      put(const std::string &, const BytesRange &,
+                              const std::string &, block_t *);
+
+            private:
+                /* Cached bytes, shared with the readers so that files are
+                 * read and removed without holding the cache lock */
+                class Data
+                {
+                    public:
+                        Data(block_t *);
+                        Data(const std::string &);
+                        ~Data();
+                        block_t * read(size_t, size_t) const;
+
+                    private:
+                        block_t    *p_block;
+                        std::string path;
+                };
+
+                class Entry
+                {
+                    public:
+                        std::string url;
+                        std::string contentType;
+                        size_t      start; /* offset in the resource */
+                        size_t      size;
+                        bool        toEnd; /* up to the end of the resource */
+                        std::shared_ptr<Data> data;
+
+                        bool        contains(size_t, size_t, bool) const;
+                };
+
+                typedef std::list<Entry>::iterator EntryIterator;
+
+                static void   getExtent(const BytesRange &, size_t *, size_t *, bool *);
+                EntryIterator find(const std::string &, size_t, size_t, bool);
+                void          remove(EntryIterator, std::vector<std::shared_ptr<Data>> &);
+                void          evict(size_t, std::vector<std::shared_ptr<Data>> &);
+                std::shared_ptr<Data> store(block_t *, unsigned);
+
+                vlc_object_t *p_obj;
+                std::list<Entry> entries; /* most recently used first */
+                std::multimap<std::string, EntryIterator> index; /* by url */
+                size_t      totalsize;
+                size_t      maxsize;
+                std::string dir;
+                unsigned    filecount;
+                vlc_mutex_t lock;
+        };
+
+        /* Serves a previously cached download */
+        class CachedChunkSource : public AbstractChunkSource
+        {
+            public:
+                CachedChunkSource(block_t *, const std::string &);
+                virtual ~CachedChunkSource();
+
+                virtual block_t *   readBlock       (); /* impl */
+                virtual block_t *   read            (size_t); /* impl */
+                virtual bool        hasMoreData     () const; /* impl */
+                virtual std::string getContentType  () const; /* reimpl */
+
+            private:
+                block_t    *p_block;
+                std::string contentType;
+        };
+    }
+}
+
+#endif // SEGMENTCACHE_HPP
@@ -0,0 +1,130 @@
+/*
+ * BandwidthEstimators.cpp
+ *****************************************************************************
+ * Copyright (C) 2020 - VideoLAN Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "BandwidthEstimators.hpp"
+
+#include <climits>
+#include <new>
+
+using namespace adaptive::logic;
+
+AbstractBandwidthEstimator * AbstractBandwidthEstimator::create(EstimatorType type)
+{
+    switch(type)
+    {
+        case VHFMovingAverage:
+            return new (std::nothrow) MovingAverageBandwidthEstimator();
+        case SlidingWindow:
+        default:
+            return new (std::nothrow) SlidingWindowBandwidthEstimator();
+    }
+}
+
+SlidingWindowBandwidthEstimator::SlidingWindowBandwidthEstimator(unsigned count,
+                                                                 vlc_tick_t duration)
+    : maxsamples( count ? count : 1 )
+    , maxduration( duration )
+    , totalsize( 0 )
+    , totalduration( 0 )
+{
+}
+
+AbstractBandwidthEstimator * SlidingWindowBandwidthEstimator::clone() const
+{
+    return new (std::nothrow) SlidingWindowBandwidthEstimator(*this);
+}
+
+void SlidingWindowBandwidthEstimator::push(size_t size, vlc_tick_t time)
+{
+    if(unlikely(time <= 0))
+        return;
+
+    samples.push_back(std::pair<size_t, vlc_tick_t>(size, time));
+    totalsize += size;
+    totalduration += time;
+
+    /* always keep the last observation, even if longer than the window */
+    while(samples.size() > 1 &&
+          (samples.size() > maxsamples || totalduration - samples.front().second >= maxduration))
+    {
+        totalsize -= samples.front().first;
+        totalduration -= samples.front().second;
+        samples.pop_front();
+    }
+}
+
+unsigned SlidingWindowBandwidthEstimator::getBandwidth() const
+{
+    if(totalduration <= 0)
+        return 0;
+    uint64_t bps = CLOCK_FREQ * totalsize * 8 / totalduration;
+    return bps > UINT_MAX ? UINT_MAX : bps;
+}
+
+size_t SlidingWindowBandwidthEstimator::getObservationsCount() const
+{
+    return samples.size();
+}
+
+void SlidingWindowBandwidthEstimator::reset()
+{
+    samples.clear();
+    totalsize = 0;
+    totalduration = 0;
+}
+
+MovingAverageBandwidthEstimator::MovingAverageBandwidthEstimator()
+    : bps( 0 )
+    , count( 0 )
+{
+}
+
+AbstractBandwidthEstimator * MovingAverageBandwidthEstimator::clone() const
+{
+    return new (std::nothrow) MovingAverageBandwidthEstimator(*this);
+}
+
+void MovingAverageBandwidthEstimator::push(size_t size, vlc_tick_t time)
+{
+    if(unlikely(time <= 0))
+        return;
+    bps = average.push(CLOCK_FREQ * size * 8 / time);
+    count++;
+}
+
+unsigned MovingAverageBandwidthEstimator::getBandwidth() const
+{
+    return bps;
+}
+
+size_t MovingAverageBandwidthEstimator::getObservationsCount() const
+{
+    return count;
+}
+
+void MovingAverageBandwidthEstimator::reset()
+{
+    average = MovingAverage<unsigned>();
+    bps = 0;
+    count = 0;
+}
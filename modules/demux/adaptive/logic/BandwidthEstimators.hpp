@@ -0,0 +1,92 @@
+/*
+ * BandwidthEstimators.hpp
+ *****************************************************************************
+ * Copyright (C) 2020 - VideoLAN Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef BANDWIDTHESTIMATORS_HPP
+#define BANDWIDTHESTIMATORS_HPP
+
+#include "../tools/MovingAverage.hpp"
+
+#include <vlc_common.h>
+#include <deque>
+
+namespace adaptive
+{
+    namespace logic
+    {
+        class AbstractBandwidthEstimator
+        {
+            public:
+                virtual ~AbstractBandwidthEstimator() {}
+                virtual AbstractBandwidthEstimator * clone() const = 0;
+                virtual void     push(size_t, vlc_tick_t) = 0;
+                virtual unsigned getBandwidth() const = 0; /* bps */
+                virtual size_t   getObservationsCount() const = 0;
+                virtual void     reset() = 0;
+
+                enum EstimatorType
+                {
+                    SlidingWindow = 0,
+                    VHFMovingAverage,
+                };
+                static AbstractBandwidthEstimator * create(EstimatorType);
+        };
+
+        /* Throughput over the last downloads, bounded in both count and time.
+         * Computing total bytes / total time gives the duration weighted
+         * harmonic mean, which won't overshoot on a single fast segment. */
+        class SlidingWindowBandwidthEstimator : public AbstractBandwidthEstimator
+        {
+            public:
+                SlidingWindowBandwidthEstimator(unsigned = 8,
+                                                vlc_tick_t = VLC_TICK_FROM_SEC(20));
+                virtual AbstractBandwidthEstimator * clone() const; /* impl */
+                virtual void     push(size_t, vlc_tick_t); /* impl */
+                virtual unsigned getBandwidth() const; /* impl */
+                virtual size_t   getObservationsCount() const; /* impl */
+                virtual void     reset(); /* impl */
+
+            private:
+                std::deque<std::pair<size_t, vlc_tick_t> > samples;
+                unsigned   maxsamples;
+                vlc_tick_t maxduration;
+                uint64_t   totalsize;
+                vlc_tick_t totalduration;
+        };
+
+        /* Legacy VHF smoothed rate, as used by the Predictive and
+         * NearOptimal logics */
+        class MovingAverageBandwidthEstimator : public AbstractBandwidthEstimator
+        {
+            public:
+                MovingAverageBandwidthEstimator();
+                virtual AbstractBandwidthEstimator * clone() const; /* impl */
+                virtual void     push(size_t, vlc_tick_t); /* impl */
+                virtual unsigned getBandwidth() const; /* impl */
+                virtual size_t   getObservationsCount() const; /* impl */
+                virtual void     reset(); /* impl */
+
+            private:
+                MovingAverage<unsigned> average;
+                unsigned bps;
+                size_t   count;
+        };
+    }
+}
+
+#endif // BANDWIDTHESTIMATORS_HPP
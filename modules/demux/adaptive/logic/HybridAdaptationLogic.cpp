@@ -0,0 +1,298 @@
+/*
+ * HybridAdaptationLogic.cpp
+ *****************************************************************************
+ * Copyright (C) 2020 - VideoLAN Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "HybridAdaptationLogic.hpp"
+
+#include "../playlist/BaseAdaptationSet.h"
+#include "../playlist/BaseRepresentation.h"
+#include "../tools/Debug.hpp"
+
+#include <cmath>
+#include <new>
+
+using namespace adaptive::logic;
+using namespace adaptive;
+
+/*
+ * Throughput rule while the buffer is filling up, buffer occupancy rule
+ * (BOLA) once it is above the safety threshold, with hysteresis between
+ * both modes. Same approach as the dash.js DYNAMIC strategy.
+ * BOLA: Near-Optimal Bitrate Adaptation for Online Videos
+ * http://arxiv.org/abs/1601.06748
+ */
+
+#define minimumBufferS      VLC_TICK_FROM_SEC(6)  /* Qmin fallback */
+#define bufferTargetS       VLC_TICK_FROM_SEC(30) /* Qmax fallback */
+#define THROUGHPUT_SAFETY   0.9
+#define STARTUP_SAMPLES     2
+
+HybridContext::HybridContext(const AbstractBandwidthEstimator *proto)
+    : estimator( proto ? proto->clone() : NULL )
+    , buffering_min( minimumBufferS )
+    , buffering_level( 0 )
+    , buffering_target( bufferTargetS )
+    , last_duration( 0 )
+    , bufferbased( false )
+{ }
+
+HybridContext::HybridContext(const HybridContext &other)
+    : estimator( other.estimator ? other.estimator->clone() : NULL )
+    , buffering_min( other.buffering_min )
+    , buffering_level( other.buffering_level )
+    , buffering_target( other.buffering_target )
+    , last_duration( other.last_duration )
+    , bufferbased( other.bufferbased )
+{ }
+
+HybridContext::~HybridContext()
+{
+    delete estimator;
+}
+
+HybridAdaptationLogic::HybridAdaptationLogic(vlc_object_t *obj,
+                                             AbstractBandwidthEstimator *est)
+    : AbstractAdaptationLogic(obj)
+    , estimator( est )
+    , currentBps( 0 )
+    , usedBps( 0 )
+{
+    if(!estimator)
+        estimator = new (std::nothrow) SlidingWindowBandwidthEstimator();
+    vlc_mutex_init(&lock);
+}
+
+HybridAdaptationLogic::~HybridAdaptationLogic()
+{
+    delete estimator;
+}
+
+BaseRepresentation *
+HybridAdaptationLogic::getBufferBasedRepresentation(BaseAdaptationSet *adaptSet,
+                                                    RepresentationSelector &selector,
+                                                    vlc_tick_t i_min, vlc_tick_t i_level,
+                                                    vlc_tick_t i_target) const
+{
+    BaseRepresentation *lowest = selector.lowest(adaptSet);
+    BaseRepresentation *highest = selector.highest(adaptSet);
+    if(!lowest || !highest || lowest->getBandwidth() == 0)
+        return lowest;
+
+    /* utilities are log(S/Smin) + 1, so lowest quality is always 1 */
+    const float umax = std::log((float)highest->getBandwidth() / lowest->getBandwidth()) + 1.0;
+    const float Qmin = secf_from_vlc_tick(i_min);
+    float Qmax = secf_from_vlc_tick(i_target);
+    if(Qmax <= Qmin)
+        Qmax = Qmin + 1.0;
+    const float gammaP = (umax - 1.0) / (Qmax / Qmin - 1.0);
+    if(gammaP <= 0.0)
+        return lowest;
+    const float Vp = Qmin / gammaP;
+    const float Q = secf_from_vlc_tick(i_level);
+
+    BaseRepresentation *ret = NULL;
+    BaseRepresentation *prev = NULL;
+    float argmax = 0;
+    for(BaseRepresentation *rep = lowest; rep && rep != prev;
+                            rep = selector.higher(adaptSet, rep))
+    {
+        const float u = std::log((float)rep->getBandwidth() / lowest->getBandwidth()) + 1.0;
+        const float arg = (Vp * (u + gammaP) - Q) / rep->getBandwidth();
+        if(ret == NULL || argmax <= arg)
+        {
+            ret = rep;
+            argmax = arg;
+        }
+        prev = rep;
+    }
+    return ret;
+}
+
+BaseRepresentation *HybridAdaptationLogic::getNextRepresentation(BaseAdaptationSet *adaptSet, BaseRepresentation *prevRep)
+{
+    RepresentationSelector selector(maxwidth, maxheight);
+
+    vlc_mutex_lock(&lock);
+
+    std::map<ID, HybridContext>::iterator it = streams.find(adaptSet->getID());
+    if(it == streams.end())
+    {
+        vlc_mutex_unlock(&lock);
+        return selector.lowest(adaptSet);
+    }
+
+    HybridContext &ctx = (*it).second;
+
+    /* mode switch with hysteresis to avoid flip-flopping between rules */
+    const vlc_tick_t enter = ctx.buffering_min + std::max(ctx.last_duration, VLC_TICK_FROM_SEC(2));
+    if(!ctx.bufferbased && ctx.buffering_level >= enter)
+        ctx.bufferbased = true;
+    else if(ctx.bufferbased && ctx.buffering_level < ctx.buffering_min / 2)
+        ctx.bufferbased = false;
+
+    const bool starting = !ctx.estimator ||
+                          ctx.estimator->getObservationsCount() < STARTUP_SAMPLES;
+    const unsigned bps = getAvailableBw(currentBps, prevRep);
+
+    const bool bufferbased = ctx.bufferbased;
+    const vlc_tick_t i_min = ctx.buffering_min;
+    const vlc_tick_t i_level = ctx.buffering_level;
+    const vlc_tick_t i_target = ctx.buffering_target;
+
+    vlc_mutex_unlock(&lock);
+
+    BaseRepresentation *tput = selector.select(adaptSet, bps * THROUGHPUT_SAFETY);
+
+    BaseRepresentation *rep;
+    if(prevRep == NULL || starting || !bufferbased)
+    {
+        rep = tput;
+    }
+    else
+    {
+        rep = getBufferBasedRepresentation(adaptSet, selector, i_min, i_level, i_target);
+        /* BOLA-O: never step up above what we could actually sustain */
+        if(rep && tput && rep->getBandwidth() > prevRep->getBandwidth() &&
+           rep->getBandwidth() > tput->getBandwidth())
+        {
+            rep = (tput->getBandwidth() > prevRep->getBandwidth()) ? tput : prevRep;
+        }
+    }
+
+    BwDebug( msg_Info(p_obj, "Stream %s %s rule, buffering level %.2f%% rep %" PRIu64 " kBps, avail %u kBps",
+             adaptSet->getID().str().c_str(), bufferbased ? "buffer" : "throughput",
+             (float) 100 * i_level / i_target,
+             rep ? rep->getBandwidth() / 8000 : 0, bps / 8000); );
+
+    return rep;
+}
+
+unsigned HybridAdaptationLogic::getAvailableBw(unsigned i_bw, const BaseRepresentation *curRep) const
+{
+    unsigned i_remain = i_bw;
+    if(i_remain > usedBps)
+        i_remain -= usedBps;
+    else
+        i_remain = 0;
+    if(curRep)
+        i_remain += curRep->getBandwidth();
+    return i_remain > i_bw ? i_bw : i_remain;
+}
+
+unsigned HybridAdaptationLogic::getMaxCurrentBw() const
+{
+    unsigned i_max_bitrate = 0;
+    for(std::map<ID, HybridContext>::const_iterator it = streams.begin();
+                                                    it != streams.end(); ++it)
+    {
+        const HybridContext &ctx = (*it).second;
+        if(ctx.estimator)
+            i_max_bitrate = std::max(i_max_bitrate, ctx.estimator->getBandwidth());
+    }
+    return i_max_bitrate;
+}
+
+void HybridAdaptationLogic::updateDownloadRate(const ID &id, size_t dlsize, vlc_tick_t time)
+{
+    if(unlikely(time == 0))
+        return;
+    vlc_mutex_lock(&lock);
+    std::map<ID, HybridContext>::iterator it = streams.find(id);
+    if(it != streams.end())
+    {
+        HybridContext &ctx = (*it).second;
+        if(ctx.estimator)
+            ctx.estimator->push(dlsize, time);
+    }
+    currentBps = getMaxCurrentBw();
+    vlc_mutex_unlock(&lock);
+}
+
+void HybridAdaptationLogic::trackerEvent(const SegmentTrackerEvent &event)
+{
+    switch(event.type)
+    {
+    case SegmentTrackerEvent::SWITCHING:
+        {
+            vlc_mutex_lock(&lock);
+            if(event.u.switching.prev)
+                usedBps -= event.u.switching.prev->getBandwidth();
+            if(event.u.switching.next)
+                usedBps += event.u.switching.next->getBandwidth();
+            BwDebug(msg_Info(p_obj, "New total bandwidth usage %u kBps", (usedBps / 8000)));
+            vlc_mutex_unlock(&lock);
+        }
+        break;
+
+    case SegmentTrackerEvent::BUFFERING_STATE:
+        {
+            const ID &id = *event.u.buffering.id;
+            vlc_mutex_lock(&lock);
+            if(event.u.buffering.enabled)
+            {
+                if(streams.find(id) == streams.end())
+                    streams.insert(std::pair<ID, HybridContext>(id, HybridContext(estimator)));
+            }
+            else
+            {
+                std::map<ID, HybridContext>::iterator it = streams.find(id);
+                if(it != streams.end())
+                    streams.erase(it);
+            }
+            vlc_mutex_unlock(&lock);
+            BwDebug(msg_Info(p_obj, "Stream %s is now known %sactive", id.str().c_str(),
+                         (event.u.buffering.enabled) ? "" : "in"));
+        }
+        break;
+
+    case SegmentTrackerEvent::BUFFERING_LEVEL_CHANGE:
+        {
+            const ID &id = *event.u.buffering_level.id;
+            vlc_mutex_lock(&lock);
+            std::map<ID, HybridContext>::iterator it = streams.find(id);
+            if(it != streams.end())
+            {
+                HybridContext &ctx = (*it).second;
+                if(event.u.buffering_level.minimum > 0)
+                    ctx.buffering_min = event.u.buffering_level.minimum;
+                ctx.buffering_level = event.u.buffering_level.current;
+                ctx.buffering_target = event.u.buffering_level.target;
+            }
+            vlc_mutex_unlock(&lock);
+        }
+        break;
+
+    case SegmentTrackerEvent::SEGMENT_CHANGE:
+        {
+            const ID &id = *event.u.segment.id;
+            vlc_mutex_lock(&lock);
+            std::map<ID, HybridContext>::iterator it = streams.find(id);
+            if(it != streams.end())
+                (*it).second.last_duration = event.u.segment.duration;
+            vlc_mutex_unlock(&lock);
+        }
+        break;
+
+    default:
+            break;
+    }
+}
@@ -34,6 +34,11 @@
 #include "../http/BytesRange.hpp"
 #include "../http/HTTPConnectionManager.h"
 #include "../http/Downloader.hpp"
+#include "../http/SegmentCache.hpp"
+#include "../SharedResources.hpp"
+
+#include <vlc_block.h>
+
 #include <cassert>
 
 using namespace adaptive::http;
@@ -82,12 +87,49 @@ SegmentChunk* ISegment::toChunk(SharedResources *res, AbstractConnectionManager
                                 size_t index, BaseRepresentation *rep)
 {
     const std::string url = getUrlSegment().toString(index, rep);
+    const BytesRange range = (startByte != endByte) ? BytesRange(startByte, endByte)
+                                                    : BytesRange();
+
+    /* live segments are not requested again */
+    SegmentCache *cache = res ? res->getSegmentCache() : NULL;
+    if(cache && rep->getPlaylist()->isLive())
+        cache = NULL;
+    if(cache)
+    {
+        std::string contentType;
+        block_t *p_cached = cache->get(url, range, &contentType);
+        if(p_cached)
+        {
+            CachedChunkSource *cachedsource = new (std::nothrow) CachedChunkSource(p_cached, contentType);
+            if(!cachedsource)
+            {
+                block_Release(p_cached);
+                return NULL;
+            }
+            cachedsource->setBytesRange(range);
+            SegmentChunk *chunk = createChunk(cachedsource, rep);
+            if(!chunk)
+            {
+                delete cachedsource;
+                return NULL;
+            }
+            chunk->discontinuity = discontinuity;
+            if(!prepareChunk(res, chunk, rep))
+            {
+                delete chunk;
+                return NULL;
+            }
+            return chunk;
+        }
+    }
+
     HTTPChunkBufferedSource *source = new (std::nothrow) HTTPChunkBufferedSource(url, connManager,
                                                                                  rep->getAdaptationSet()->getID());
     if( source )
     {
         if(startByte != endByte)
-            source->setBytesRange(BytesRange(startByte, endByte));
+            source->setBytesRange(range);
+        source->setCache(cache, url);
 
         SegmentChunk *chunk = createChunk(source, rep);
         if(chunk)
@@ -0,0 +1,360 @@
+/*****************************************************************************
+ * logic_simulator.cpp: trace driven adaptation logics simulator
+ *****************************************************************************
+ * Copyright (C) 2020 - VideoLAN Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*
+ * Replays bandwidth traces against every adaptation logic and reports
+ * startup delay, rebuffering, average bitrate and switches.
+ *
+ * usage: adaptive_logic_simulator [trace file]...
+ *
+ * Trace files contain one "<duration ms> <kbps>" pair per line, looped
+ * until the whole content is fetched. Lines starting with # are ignored.
+ * Without arguments, a set of built-in synthetic traces is used.
+ *
+ * Built by "make check" but not run: the figures are compared by hand, it
+ * only fails if a logic gets nothing through.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../playlist/AbstractPlaylist.hpp"
+#include "../playlist/BasePeriod.h"
+#include "../playlist/BaseAdaptationSet.h"
+#include "../playlist/BaseRepresentation.h"
+#include "../logic/AbstractAdaptationLogic.h"
+#include "../logic/AlwaysBestAdaptationLogic.h"
+#include "../logic/AlwaysLowestAdaptationLogic.hpp"
+#include "../logic/RateBasedAdaptationLogic.h"
+#include "../logic/PredictiveAdaptationLogic.hpp"
+#include "../logic/NearOptimalAdaptationLogic.hpp"
+#include "../logic/HybridAdaptationLogic.hpp"
+#include "../SegmentTracker.hpp"
+#include "../ID.hpp"
+
+#include <vlc_common.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace adaptive;
+using namespace adaptive::playlist;
+using namespace adaptive::logic;
+
+#define SEGMENT_DURATION    VLC_TICK_FROM_SEC(2)
+#define CONTENT_DURATION    VLC_TICK_FROM_SEC(600)
+#define MIN_BUFFERING       VLC_TICK_FROM_SEC(6)
+#define MAX_BUFFERING       VLC_TICK_FROM_SEC(30)
+
+static const uint64_t ladder[] = { 235000, 375000, 750000, 1750000,
+                                   3000000, 4300000, 5800000, 8000000 };
+
+namespace
+{
+    class SimPlaylist : public AbstractPlaylist
+    {
+        public:
+            SimPlaylist() : AbstractPlaylist(NULL) {}
+            virtual bool isLive() const { return false; }
+            virtual void debug() {}
+    };
+
+    struct TracePoint
+    {
+        vlc_tick_t duration;
+        uint64_t   bps;
+    };
+
+    struct Trace
+    {
+        std::string name;
+        std::vector<TracePoint> points;
+
+        /* time to transfer size bytes starting at now, looping the trace */
+        vlc_tick_t transfer(vlc_tick_t now, uint64_t size) const
+        {
+            vlc_tick_t cycle = 0;
+            uint64_t cyclebps = 0;
+            for(size_t i=0; i<points.size(); i++)
+            {
+                cycle += points[i].duration;
+                cyclebps |= points[i].bps;
+            }
+            if(cyclebps == 0)
+                return CONTENT_DURATION;
+
+            vlc_tick_t total = 0;
+            for(;;)
+            {
+                vlc_tick_t pos = (now + total) % cycle;
+                size_t i = 0;
+                for(; pos >= points[i].duration; i++)
+                    pos -= points[i].duration;
+                const TracePoint &p = points[i];
+                const vlc_tick_t remain = p.duration - pos;
+                const uint64_t cansend = p.bps * remain / 8 / CLOCK_FREQ;
+                if(cansend >= size)
+                {
+                    total += size * 8 * CLOCK_FREQ / p.bps;
+                    break;
+                }
+                total += remain;
+                size -= cansend;
+            }
+            return total ? total : 1;
+        }
+    };
+
+    struct Results
+    {
+        vlc_tick_t startup;
+        vlc_tick_t rebuffering;
+        unsigned   stalls;
+        unsigned   switches;
+        uint64_t   bitrate;
+    };
+}
+
+static Results Simulate(AbstractAdaptationLogic *logic, BaseAdaptationSet *set,
+                        const Trace &trace)
+{
+    Results res;
+    memset(&res, 0, sizeof(res));
+
+    const ID &id = set->getID();
+    logic->trackerEvent(SegmentTrackerEvent(id, true));
+
+    vlc_tick_t now = 0;
+    vlc_tick_t level = 0;
+    bool playing = false;
+    uint64_t bitratesum = 0;
+    unsigned segments = 0;
+    BaseRepresentation *prev = NULL;
+
+    for(vlc_tick_t fetched = 0; fetched < CONTENT_DURATION; fetched += SEGMENT_DURATION)
+    {
+        BaseRepresentation *rep = logic->getNextRepresentation(set, prev);
+        if(!rep)
+            break;
+        if(rep != prev)
+        {
+            logic->trackerEvent(SegmentTrackerEvent(prev, rep));
+            if(prev)
+                res.switches++;
+            prev = rep;
+        }
+        logic->trackerEvent(SegmentTrackerEvent(id, SEGMENT_DURATION));
+
+        const uint64_t size = rep->getBandwidth() * SEGMENT_DURATION / 8 / CLOCK_FREQ;
+        const vlc_tick_t dltime = trace.transfer(now, size);
+        now += dltime;
+
+        if(playing)
+        {
+            if(dltime > level)
+            {
+                res.rebuffering += dltime - level;
+                res.stalls++;
+                level = 0;
+                playing = false;
+            }
+            else level -= dltime;
+        }
+
+        level += SEGMENT_DURATION;
+        bitratesum += rep->getBandwidth();
+        segments++;
+
+        if(!playing && (level >= MIN_BUFFERING || fetched + SEGMENT_DURATION >= CONTENT_DURATION))
+        {
+            if(res.startup == 0)
+                res.startup = now;
+            playing = true;
+        }
+
+        logic->updateDownloadRate(id, size, dltime);
+        logic->trackerEvent(SegmentTrackerEvent(id, MIN_BUFFERING, level, MAX_BUFFERING));
+
+        /* buffer full, wait for playback to drain a segment */
+        if(playing && level > MAX_BUFFERING - SEGMENT_DURATION)
+        {
+            const vlc_tick_t wait = level - (MAX_BUFFERING - SEGMENT_DURATION);
+            now += wait;
+            level -= wait;
+            logic->trackerEvent(SegmentTrackerEvent(id, MIN_BUFFERING, level, MAX_BUFFERING));
+        }
+    }
+
+    logic->trackerEvent(SegmentTrackerEvent(prev, NULL));
+    logic->trackerEvent(SegmentTrackerEvent(id, false));
+
+    res.bitrate = segments ? bitratesum / segments : 0;
+    return res;
+}
+
+static bool LoadTrace(const char *psz_file, Trace &trace)
+{
+    std::ifstream in(psz_file);
+    if(!in.is_open())
+        return false;
+    trace.name = psz_file;
+    std::string line;
+    while(std::getline(in, line))
+    {
+        if(line.empty() || line[0] == '#')
+            continue;
+        std::istringstream ss(line);
+        unsigned ms;
+        uint64_t kbps;
+        if(!(ss >> ms >> kbps) || ms == 0)
+            continue;
+        TracePoint p = { VLC_TICK_FROM_MS(ms), kbps * 1000 };
+        trace.points.push_back(p);
+    }
+    return !trace.points.empty();
+}
+
+static void BuiltinTraces(std::vector<Trace> &traces)
+{
+    const struct
+    {
+        const char *name;
+        unsigned ms[8];
+        unsigned kbps[8];
+    } builtins[] = {
+        { "constant 5M",   { 1000 },                     { 5000 } },
+        { "step down",     { 120000, 120000, 120000 },   { 8000, 2000, 600 } },
+        { "step up",       { 60000, 60000, 60000 },      { 500, 2500, 9000 } },
+        { "oscillating",   { 8000, 8000 },               { 6000, 900 } },
+        { "cellular",      { 3000, 2000, 4000, 1000, 5000, 2500, 1500, 6000 },
+                           { 3100, 1200, 4500, 300, 2200, 7000, 800, 1900 } },
+        { "outages",       { 20000, 3000, 25000, 6000 }, { 4000, 0, 3500, 50 } },
+    };
+
+    for(size_t i=0; i<ARRAY_SIZE(builtins); i++)
+    {
+        Trace trace;
+        trace.name = builtins[i].name;
+        for(size_t j=0; j<ARRAY_SIZE(builtins[i].ms) && builtins[i].ms[j]; j++)
+        {
+            TracePoint p = { VLC_TICK_FROM_MS(builtins[i].ms[j]),
+                             (uint64_t) builtins[i].kbps[j] * 1000 };
+            trace.points.push_back(p);
+        }
+        traces.push_back(trace);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<Trace> traces;
+    for(int i=1; i<argc; i++)
+    {
+        Trace trace;
+        if(!LoadTrace(argv[i], trace))
+        {
+            fprintf(stderr, "cannot load trace %s\n", argv[i]);
+            return 1;
+        }
+        traces.push_back(trace);
+    }
+    if(traces.empty())
+        BuiltinTraces(traces);
+
+    SimPlaylist *playlist = new SimPlaylist();
+    BasePeriod *period = new BasePeriod(playlist);
+    playlist->addPeriod(period);
+    BaseAdaptationSet *set = new BaseAdaptationSet(period);
+    set->setID(ID("video"));
+    for(size_t i=0; i<ARRAY_SIZE(ladder); i++)
+    {
+        BaseRepresentation *rep = new BaseRepresentation(set);
+        rep->setBandwidth(ladder[i]);
+        set->addRepresentation(rep);
+    }
+    period->addAdaptationSet(set);
+
+    static const struct
+    {
+        const char *name;
+        AbstractAdaptationLogic::LogicType type;
+        AbstractBandwidthEstimator::EstimatorType estimator;
+    } logics[] = {
+        { "lowest",        AbstractAdaptationLogic::AlwaysLowest, AbstractBandwidthEstimator::SlidingWindow },
+        { "highest",       AbstractAdaptationLogic::AlwaysBest,   AbstractBandwidthEstimator::SlidingWindow },
+        { "rate",          AbstractAdaptationLogic::RateBased,    AbstractBandwidthEstimator::SlidingWindow },
+        { "predictive",    AbstractAdaptationLogic::Predictive,   AbstractBandwidthEstimator::SlidingWindow },
+        { "nearoptimal",   AbstractAdaptationLogic::NearOptimal,  AbstractBandwidthEstimator::SlidingWindow },
+        { "hybrid",        AbstractAdaptationLogic::Hybrid,       AbstractBandwidthEstimator::SlidingWindow },
+        { "hybrid (vhf)",  AbstractAdaptationLogic::Hybrid,       AbstractBandwidthEstimator::VHFMovingAverage },
+    };
+
+    int ret = 0;
+    for(size_t t=0; t<traces.size(); t++)
+    {
+        printf("trace: %s\n", traces[t].name.c_str());
+        printf("  %-14s %10s %10s %7s %9s %12s\n",
+               "logic", "startup s", "rebuffer s", "stalls", "switches", "avg kbps");
+        for(size_t l=0; l<ARRAY_SIZE(logics); l++)
+        {
+            AbstractAdaptationLogic *logic = NULL;
+            switch(logics[l].type)
+            {
+                case AbstractAdaptationLogic::AlwaysLowest:
+                    logic = new AlwaysLowestAdaptationLogic(NULL);
+                    break;
+                case AbstractAdaptationLogic::AlwaysBest:
+                    logic = new AlwaysBestAdaptationLogic(NULL);
+                    break;
+                case AbstractAdaptationLogic::RateBased:
+                    logic = new RateBasedAdaptationLogic(NULL);
+                    break;
+                case AbstractAdaptationLogic::Predictive:
+                    logic = new PredictiveAdaptationLogic(NULL);
+                    break;
+                case AbstractAdaptationLogic::NearOptimal:
+                    logic = new NearOptimalAdaptationLogic(NULL);
+                    break;
+                case AbstractAdaptationLogic::Hybrid:
+                    logic = new HybridAdaptationLogic(NULL,
+                                AbstractBandwidthEstimator::create(logics[l].estimator));
+                    break;
+                default:
+                    vlc_assert_unreachable();
+            }
+
+            Results res = Simulate(logic, set, traces[t]);
+            printf("  %-14s %10.2f %10.2f %7u %9u %12" PRIu64 "\n", logics[l].name,
+                   secf_from_vlc_tick(res.startup), secf_from_vlc_tick(res.rebuffering),
+                   res.stalls, res.switches, res.bitrate / 1000);
+            if(res.bitrate == 0)
+                ret = 1;
+            delete logic;
+        }
+    }
+
+    delete playlist;
+    return ret;
+}
@@ -0,0 +1,162 @@
+/*****************************************************************************
+ * segment_cache.cpp: adaptive segments cache tests
+ *****************************************************************************
+ * Copyright (C) 2020 - VideoLAN Authors
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../http/SegmentCache.hpp"
+#include "../http/BytesRange.hpp"
+
+#include <vlc_common.h>
+#include <vlc_block.h>
+#include <vlc_fs.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+using namespace adaptive::http;
+
+#define ENTRY_SIZE 1000
+#define CACHE_SIZE (4 * ENTRY_SIZE) /* 4 entries at most */
+
+#define ASSERT(a) do {\
+    if(!(a)) { \
+        fprintf(stderr, "failed line %d\n", __LINE__); \
+        return 1; } \
+    } while(0)
+
+/* Each byte tells its offset in the resource and the resource */
+static block_t * Resource(char name, size_t start, size_t size)
+{
+    block_t *p_block = block_Alloc(size);
+    if(p_block)
+        for(size_t i=0; i<size; i++)
+            p_block->p_buffer[i] = name + (start + i) % 100;
+    return p_block;
+}
+
+static bool IsResource(block_t *p_block, char name, size_t start, size_t size)
+{
+    bool b_ret = p_block && p_block->i_buffer == size;
+    for(size_t i=0; b_ret && i<size; i++)
+        b_ret = p_block->p_buffer[i] == (uint8_t)(name + (start + i) % 100);
+    if(p_block)
+        block_Release(p_block);
+    return b_ret;
+}
+
+static void Put(SegmentCache &cache, char name, const BytesRange &range, size_t size)
+{
+    const size_t start = range.isValid() ? range.getStartByte() : 0;
+    cache.put(std::string("http://host/") + name, range, "video/mp2t",
+              Resource(name, start, size));
+}
+
+static block_t * Get(SegmentCache &cache, char name, const BytesRange &range,
+                     std::string *type = NULL)
+{
+    return cache.get(std::string("http://host/") + name, range, type);
+}
+
+static int TestCache(const std::string &dir)
+{
+    SegmentCache cache(NULL, CACHE_SIZE, dir);
+    std::string type;
+
+    /* miss */
+    ASSERT(cache.isEnabled());
+    ASSERT(Get(cache, 'a', BytesRange()) == NULL);
+
+    /* hit */
+    Put(cache, 'a', BytesRange(), ENTRY_SIZE);
+    ASSERT(IsResource(Get(cache, 'a', BytesRange(), &type), 'a', 0, ENTRY_SIZE));
+    ASSERT(type == "video/mp2t");
+
+    /* ranges within a cached download */
+    ASSERT(IsResource(Get(cache, 'a', BytesRange(100, 199)), 'a', 100, 100));
+    ASSERT(IsResource(Get(cache, 'a', BytesRange(900, 0)), 'a', 900, 100));
+    ASSERT(Get(cache, 'a', BytesRange(900, ENTRY_SIZE)) == NULL);
+
+    /* a range containing a cached one replaces it */
+    Put(cache, 'b', BytesRange(200, 299), 100);
+    ASSERT(IsResource(Get(cache, 'b', BytesRange(200, 299)), 'b', 200, 100));
+    ASSERT(Get(cache, 'b', BytesRange()) == NULL);
+    Put(cache, 'b', BytesRange(100, 0), ENTRY_SIZE - 100);
+    ASSERT(IsResource(Get(cache, 'b', BytesRange(200, 299)), 'b', 200, 100));
+    ASSERT(Get(cache, 'b', BytesRange(0, 99)) == NULL);
+
+    /* too large for the cache */
+    Put(cache, 'z', BytesRange(), CACHE_SIZE / 4 + 1);
+    ASSERT(Get(cache, 'z', BytesRange()) == NULL);
+
+    /* a, b, c, d, e fill the cache, unless the range of b is stored twice */
+    Put(cache, 'c', BytesRange(), ENTRY_SIZE);
+    Put(cache, 'd', BytesRange(), 100);
+    ASSERT(IsResource(Get(cache, 'a', BytesRange(0, 9)), 'a', 0, 10));
+    ASSERT(IsResource(Get(cache, 'b', BytesRange(100, 0)), 'b', 100, ENTRY_SIZE - 100));
+    ASSERT(IsResource(Get(cache, 'b', BytesRange(200, 299)), 'b', 200, 100));
+    ASSERT(IsResource(Get(cache, 'c', BytesRange()), 'c', 0, ENTRY_SIZE));
+    Put(cache, 'e', BytesRange(), ENTRY_SIZE);
+    ASSERT(IsResource(Get(cache, 'd', BytesRange()), 'd', 0, 100));
+    ASSERT(IsResource(Get(cache, 'a', BytesRange()), 'a', 0, ENTRY_SIZE));
+
+    /* eviction of the least recently used ones, b then c */
+    Put(cache, 'f', BytesRange(), ENTRY_SIZE);
+    ASSERT(Get(cache, 'b', BytesRange(100, 0)) == NULL);
+    ASSERT(Get(cache, 'c', BytesRange()) == NULL);
+    ASSERT(IsResource(Get(cache, 'a', BytesRange()), 'a', 0, ENTRY_SIZE));
+    ASSERT(IsResource(Get(cache, 'd', BytesRange()), 'd', 0, 100));
+    ASSERT(IsResource(Get(cache, 'e', BytesRange()), 'e', 0, ENTRY_SIZE));
+    ASSERT(IsResource(Get(cache, 'f', BytesRange()), 'f', 0, ENTRY_SIZE));
+    return 0;
+}
+
+static int TestDisabled()
+{
+    SegmentCache cache(NULL, 0);
+
+    ASSERT(!cache.isEnabled());
+    Put(cache, 'a', BytesRange(), 10);
+    ASSERT(Get(cache, 'a', BytesRange()) == NULL);
+    return 0;
+}
+
+int main()
+{
+    char dir[] = "/tmp/vlc-adaptive-XXXXXX";
+
+    if(TestDisabled() || TestCache(std::string()))
+        return 1;
+
+    /* same with files, all removed with the cache */
+    if(mkdtemp(dir) == NULL)
+        return 77;
+    int ret = TestCache(dir);
+    if(rmdir(dir) != 0)
+    {
+        fprintf(stderr, "cache files left in %s\n", dir);
+        ret = 1;
+    }
+    return ret;
+}
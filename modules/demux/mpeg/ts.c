@@ -46,6 +46,7 @@
 #include "ts_hotfixes.h"
 #include "ts_sl.h"
 #include "ts_metadata.h"
+#include "ts_workers.h"
 #include "sections.h"
 #include "pes.h"
 #include "timestamps.h"
@@ -120,6 +121,12 @@ static void Close ( vlc_object_t * );
 #define TS_OFFSETFIX_TEXT   "Try to fix too early PCR (or late DTS)"
 #define TS_GENERATED_PCR_OFFSET_TEXT "Offset in ms for generated PCR"
 
+#define THREADS_TEXT N_("Program output threads")
+#define THREADS_LONGTEXT N_( \
+    "Number of threads reassembling and sending the selected programs " \
+    "elementary streams (0 to demux everything on the input thread). " \
+    "Useful when recording or monitoring many programs of a multiplex." )
+
 #define PCR_TEXT N_("Trust in-stream PCR")
 #define PCR_LONGTEXT N_("Use the stream PCR as a reference.")
 
@@ -163,6 +170,8 @@ vlc_module_begin ()
     add_bool( "ts-pcr-offsetfix", true, TS_OFFSETFIX_TEXT, NULL, true )
     add_integer_with_range( "ts-generated-pcr-offset", 120, 0, 500,
                             TS_GENERATED_PCR_OFFSET_TEXT, NULL, true )
+    add_integer_with_range( "ts-program-threads", 0, 0, 32,
+                            THREADS_TEXT, THREADS_LONGTEXT, true )
 
     add_obsolete_bool( "ts-silent" );
 
@@ -199,6 +208,8 @@ static block_t* ReadTSPacket( demux_t *p_demux );
 static int SeekToTime( demux_t *p_demux, const ts_pmt_t *, stime_t time );
 static void ReadyQueuesPostSeek( demux_t *p_demux );
 static void PCRHandle( demux_t *p_demux, ts_pid_t *, stime_t );
+static void PCRHandleProgram( demux_t *p_demux, ts_pmt_t *, ts_pid_t *, stime_t );
+static void WorkerHandle( demux_t *p_demux, unsigned i_worker, const ts_work_t * );
 static void PCRFixHandle( demux_t *, ts_pmt_t *, block_t * );
 
 #define TS_PACKET_SIZE_188 188
@@ -533,6 +544,19 @@ static int Open( vlc_object_t *p_this )
     else
         p_sys->es_creation = CREATE_ES;
 
+    p_sys->p_workers = NULL;
+    atomic_init( &p_sys->b_update_filters, false );
+    atomic_init( &p_sys->b_update_sl, false );
+    int i_threads = var_InheritInteger( p_demux, "ts-program-threads" );
+    if( i_threads > 0 && !p_demux->b_preparsing )
+    {
+        p_sys->p_workers = ts_workers_New( p_demux, i_threads, WorkerHandle );
+        if( p_sys->p_workers )
+            msg_Dbg( p_demux, "using %d program output threads", i_threads );
+        else
+            msg_Warn( p_demux, "cannot create program output threads" );
+    }
+
     /* Preparse time */
     if( p_demux->b_preparsing && p_sys->b_canseek )
     {
@@ -558,6 +582,9 @@ static void Close( vlc_object_t *p_this )
     demux_t     *p_demux = (demux_t*)p_this;
     demux_sys_t *p_sys = p_demux->p_sys;
 
+    if( p_sys->p_workers )
+        ts_workers_Delete( p_sys->p_workers );
+
     PIDRelease( p_demux, GetPID(p_sys, 0) );
 
     vlc_mutex_lock( &p_sys->csa_lock );
@@ -629,6 +656,18 @@ static int Demux( demux_t *p_demux )
         GetPID(p_sys, 0)->u.p_pat->b_generated = true;
     }
 
+    if( p_sys->p_workers && atomic_exchange( &p_sys->b_update_sl, false ) )
+    {
+        DrainWorkers( p_sys );
+        SLPackets_Update( p_demux );
+    }
+
+    if( p_sys->p_workers && atomic_exchange( &p_sys->b_update_filters, false ) )
+    {
+        DrainWorkers( p_sys );
+        UpdatePESFilters( p_demux, p_sys->seltype == PROGRAM_ALL );
+    }
+
     /* We read at most 100 TS packet or until a frame is completed */
     for( unsigned i_pkt = 0; i_pkt < p_sys->i_ts_read; i_pkt++ )
     {
@@ -637,6 +676,8 @@ static int Demux( demux_t *p_demux )
         block_t     *p_pkt;
         if( !(p_pkt = ReadTSPacket( p_demux )) )
         {
+            if( p_sys->p_workers )
+                ts_workers_Flush( p_sys->p_workers );
             return VLC_DEMUXER_EOF;
         }
 
@@ -668,6 +709,7 @@ static int Demux( demux_t *p_demux )
         ts_pid_t *p_pid = GetPID( p_sys, PIDGet( p_pkt ) );
         if( !SEEN(p_pid) )
         {
+            DrainWorkers( p_sys );
             if( p_pid->type == TYPE_FREE )
                 msg_Dbg( p_demux, "pid[%d] unknown", p_pid->i_pid );
             p_pid->i_flags |= FLAG_SEEN;
@@ -682,6 +724,7 @@ static int Demux( demux_t *p_demux )
 
         if( !SCRAMBLED(*p_pid) != !(p_pkt->i_flags & BLOCK_FLAG_SCRAMBLED) )
         {
+            DrainWorkers( p_sys );
             UpdatePIDScrambledState( p_demux, p_pid, p_pkt->i_flags & BLOCK_FLAG_SCRAMBLED );
         }
 
@@ -715,6 +758,7 @@ static int Demux( demux_t *p_demux )
             if( p_sys->es_creation == DELAY_ES ) /* No longer delay ES since that pid's program sends data */
             {
                 msg_Dbg( p_demux, "Creating delayed ES" );
+                DrainWorkers( p_sys );
                 AddAndCreateES( p_demux, p_pid, true );
                 UpdatePESFilters( p_demux, p_sys->seltype == PROGRAM_ALL );
             }
@@ -727,7 +771,17 @@ static int Demux( demux_t *p_demux )
                 continue;
             }
 
-            if( p_pid->u.p_stream->transport == TS_TRANSPORT_PES )
+            if( p_sys->p_workers && p_pid->u.p_stream->p_es->p_program )
+            {
+                /* Reassembly and output is done by the program's thread */
+                const ts_work_t work = { .p_pid = p_pid, .p_pkt = p_pkt,
+                                         .i_pcr = -1, .i_header = i_header };
+                const uint16_t i_program = p_pid->u.p_stream->p_es->p_program->i_number;
+                ts_workers_Push( p_sys->p_workers,
+                                 ts_workers_ProgramWorker( p_sys->p_workers, i_program ),
+                                 &work );
+            }
+            else if( p_pid->u.p_stream->transport == TS_TRANSPORT_PES )
             {
                 b_frame = GatherPESData( p_demux, p_pid, p_pkt, i_header );
             }
@@ -765,6 +819,9 @@ static int Demux( demux_t *p_demux )
             break;
     }
 
+    if( p_sys->p_workers )
+        ts_workers_Flush( p_sys->p_workers );
+
     demux_UpdateTitleFromStream( p_demux );
     return VLC_DEMUXER_SUCCESS;
 }
@@ -806,6 +863,12 @@ static inline void HasSelectedES( es_out_t *out, const ts_es_t *p_es,
     }
 }
 
+void DrainWorkers( demux_sys_t *p_sys )
+{
+    if( p_sys->p_workers )
+        ts_workers_Drain( p_sys->p_workers );
+}
+
 void UpdatePESFilters( demux_t *p_demux, bool b_all )
 {
     demux_sys_t *p_sys = p_demux->p_sys;
@@ -897,6 +960,9 @@ static int Control( demux_t *p_demux, int i_query, va_list args )
     const ts_pmt_t *p_pmt = NULL;
     const ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
 
+    /* Every query reads or changes programs state */
+    DrainWorkers( p_sys );
+
     for( int i=0; i<p_pat->programs.i_size && !p_pmt; i++ )
     {
         if( p_pat->programs.p_elems[i]->u.p_pmt->b_selected )
@@ -2218,6 +2284,9 @@ static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_pmt, stime_t i_pcr )
         for( int i=0; i< p_pat->programs.i_size; i++ )
         {
             ts_pmt_t *p_opmt = p_pat->programs.p_elems[i]->u.p_pmt;
+            /* other programs queues belong to other threads */
+            if( p_sys->p_workers && p_opmt != p_pmt )
+                continue;
             for( int j=0; j<p_opmt->e_streams.i_size; j++ )
             {
                 ts_pid_t *p_pid = p_opmt->e_streams.p_elems[j];
@@ -2247,8 +2316,9 @@ static void ProgramSetPCR( demux_t *p_demux, ts_pmt_t *p_pmt, stime_t i_pcr )
     if ( p_sys->i_pmt_es )
     {
         es_out_Control( p_demux->out, ES_OUT_SET_GROUP_PCR, p_pmt->i_number, FROM_SCALE(i_pcr) );
-        /* growing files/named fifo handling */
-        if( p_sys->b_access_control == false &&
+        /* growing files/named fifo handling
+         * (not from output threads, as the stream belongs to the input one) */
+        if( p_sys->b_access_control == false && !p_sys->p_workers &&
             vlc_stream_Tell( p_sys->stream ) > p_pmt->i_last_dts_byte )
         {
             if( p_pmt->i_last_dts_byte == 0 ) /* first run */
@@ -2362,35 +2432,72 @@ static void PCRHandle( demux_t *p_demux, ts_pid_t *pid, stime_t i_pcr )
     if(unlikely(GetPID(p_sys, 0)->type != TYPE_PAT))
         return;
 
+    if( p_sys->p_workers )
+    {
+        /* Each thread will look for its own programs referencing that pid */
+        const ts_work_t work = { .p_pid = pid, .p_pkt = NULL,
+                                 .i_pcr = i_pcr, .i_header = 0 };
+        for( unsigned i = 0; i < ts_workers_Count( p_sys->p_workers ); i++ )
+            ts_workers_Push( p_sys->p_workers, i, &work );
+        return;
+    }
+
     /* Search program and set the PCR */
     ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
     for( int i = 0; i < p_pat->programs.i_size; i++ )
-    {
-        ts_pmt_t *p_pmt = p_pat->programs.p_elems[i]->u.p_pmt;
-        if( p_pmt->pcr.b_disable )
-            continue;
-        stime_t i_program_pcr = TimeStampWrapAround( p_pmt->pcr.i_first, i_pcr );
+        PCRHandleProgram( p_demux, p_pat->programs.p_elems[i]->u.p_pmt, pid, i_pcr );
+}
+
+static void PCRHandleProgram( demux_t *p_demux, ts_pmt_t *p_pmt, ts_pid_t *pid, stime_t i_pcr )
+{
+    if( p_pmt->pcr.b_disable )
+        return;
+    stime_t i_program_pcr = TimeStampWrapAround( p_pmt->pcr.i_first, i_pcr );
 
-        if( p_pmt->i_pid_pcr == 0x1FFF ) /* That program has no dedicated PCR pid ISO/IEC 13818-1 2.4.4.9 */
+    if( p_pmt->i_pid_pcr == 0x1FFF ) /* That program has no dedicated PCR pid ISO/IEC 13818-1 2.4.4.9 */
+    {
+        if( PIDReferencedByProgram( p_pmt, pid->i_pid ) ) /* PCR shall be on pid itself */
         {
-            if( PIDReferencedByProgram( p_pmt, pid->i_pid ) ) /* PCR shall be on pid itself */
-            {
-                /* ? update PCR for the whole group program ? */
-                ProgramSetPCR( p_demux, p_pmt, i_program_pcr );
-            }
+            /* ? update PCR for the whole group program ? */
+            ProgramSetPCR( p_demux, p_pmt, i_program_pcr );
         }
-        else /* set PCR provided by current pid to program(s) referencing it */
+    }
+    else /* set PCR provided by current pid to program(s) referencing it */
+    {
+        /* Can be dedicated PCR pid (no owned then) or another pid (owner == pmt) */
+        if( p_pmt->i_pid_pcr == pid->i_pid ) /* If that program references current pid as PCR */
         {
-            /* Can be dedicated PCR pid (no owned then) or another pid (owner == pmt) */
-            if( p_pmt->i_pid_pcr == pid->i_pid ) /* If that program references current pid as PCR */
-            {
-                /* We've found a target group for update */
-                PCRCheckDTS( p_demux, p_pmt, i_pcr );
-                ProgramSetPCR( p_demux, p_pmt, i_program_pcr );
-            }
+            /* We've found a target group for update */
+            PCRCheckDTS( p_demux, p_pmt, i_pcr );
+            ProgramSetPCR( p_demux, p_pmt, i_program_pcr );
         }
+    }
+}
 
+/* Runs on a program output thread */
+static void WorkerHandle( demux_t *p_demux, unsigned i_worker, const ts_work_t *p_work )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    ts_pid_t *p_pid = p_work->p_pid;
+
+    if( p_work->p_pkt == NULL )
+    {
+        ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
+        for( int i = 0; i < p_pat->programs.i_size; i++ )
+        {
+            ts_pmt_t *p_pmt = p_pat->programs.p_elems[i]->u.p_pmt;
+            if( ts_workers_ProgramWorker( p_sys->p_workers, p_pmt->i_number ) == i_worker )
+                PCRHandleProgram( p_demux, p_pmt, p_pid, p_work->i_pcr );
+        }
+        return;
     }
+
+    if( p_pid->u.p_stream->transport == TS_TRANSPORT_PES )
+        GatherPESData( p_demux, p_pid, p_work->p_pkt, p_work->i_header );
+    else if( p_pid->u.p_stream->transport == TS_TRANSPORT_SECTIONS )
+        GatherSectionsData( p_demux, p_pid, p_work->p_pkt, p_work->i_header );
+    else
+        block_Release( p_work->p_pkt );
 }
 
 int FindPCRCandidate( ts_pmt_t *p_pmt )
@@ -2460,7 +2567,10 @@ static void PCRFixHandle( demux_t *p_demux, ts_pmt_t *p_pmt, block_t *p_block )
                 p_pmt->pcr.b_disable = true;
             msg_Warn( p_demux, "No PCR received for program %d, set up workaround using pid %d",
                       p_pmt->i_number, i_cand );
-            UpdatePESFilters( p_demux, p_sys->seltype == PROGRAM_ALL );
+            if( p_sys->p_workers ) /* filters are owned by the input thread */
+                atomic_store( &p_sys->b_update_filters, true );
+            else
+                UpdatePESFilters( p_demux, p_sys->seltype == PROGRAM_ALL );
         }
         p_pmt->pcr.b_fix_done = true;
     }
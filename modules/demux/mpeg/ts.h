@@ -24,6 +24,7 @@
     typedef struct arib_instance_t arib_instance_t;
 #endif
 typedef struct csa_t csa_t;
+typedef struct ts_workers_t ts_workers_t;
 
 #define TS_USER_PMT_NUMBER (0)
 
@@ -142,6 +143,11 @@ struct demux_sys_t
 
     /* */
     bool        b_start_record;
+
+    /* per program output threads, NULL if demuxing on the input thread */
+    ts_workers_t *p_workers;
+    atomic_bool   b_update_filters; /* PES filters update requested by a worker */
+    atomic_bool   b_update_sl; /* SL object descriptors received by a worker */
 };
 
 void TsChangeStandard( demux_sys_t *, ts_standards_e );
@@ -149,6 +155,7 @@ void TsChangeStandard( demux_sys_t *, ts_standards_e );
 bool ProgramIsSelected( demux_sys_t *, uint16_t i_pgrm );
 
 void UpdatePESFilters( demux_t *p_demux, bool b_all );
+void DrainWorkers( demux_sys_t * );
 
 int ProbeStart( demux_t *p_demux, int i_program );
 int ProbeEnd( demux_t *p_demux, int i_program );
@@ -53,17 +53,14 @@ enum
 
 struct ts_pid_t
 {
+    /* hot fields, accessed for every packet */
     uint16_t    i_pid;
 
     uint8_t     i_flags;
     uint8_t     i_cc;   /* countinuity counter */
     uint8_t     i_dup;  /* duplicate counter */
     uint8_t     type;
-    uint8_t     prevpktbytes[PREVPKTKEEPBYTES];
 
-    uint16_t    i_refcount;
-
-    /* */
     union
     {
         ts_pat_t    *p_pat;
@@ -73,6 +70,11 @@ struct ts_pid_t
         ts_psip_t   *p_psip;
     } u;
 
+    uint8_t     prevpktbytes[PREVPKTKEEPBYTES]; /* duplicates detection */
+
+    /* cold fields, only used on setup and while probing */
+    uint16_t    i_refcount;
+
     struct
     {
         vlc_fourcc_t i_fourcc;
@@ -84,27 +86,36 @@ struct ts_pid_t
 
 };
 
+#define TS_PID_COUNT 8192
+
 struct ts_pid_list_t
 {
     ts_pid_t   pat;
     ts_pid_t   dummy;
     ts_pid_t   base_si;
-    /* all non commons ones, dynamically allocated */
+    /* all non commons ones, dynamically allocated, sorted by pid */
     ts_pid_t **pp_all;
     int        i_all;
     int        i_all_alloc;
-    /* last recently used */
-    uint16_t   i_last_pid;
-    ts_pid_t  *p_last;
-
+    /* direct lookup by pid, including common ones */
+    ts_pid_t  *pp_table[TS_PID_COUNT];
 };
 
 /* opacified pid list */
 void ts_pid_list_Init( ts_pid_list_t * );
 void ts_pid_list_Release( demux_t *, ts_pid_list_t * );
 
+/* creates missing pid */
+ts_pid_t * ts_pid_New( ts_pid_list_t *, uint16_t i_pid );
+
 /* creates missing pid on the fly */
-ts_pid_t * ts_pid_Get( ts_pid_list_t *, uint16_t i_pid );
+static inline ts_pid_t * ts_pid_Get( ts_pid_list_t *p_list, uint16_t i_pid )
+{
+    ts_pid_t *p_pid = p_list->pp_table[i_pid & (TS_PID_COUNT - 1)];
+    if( likely(p_pid) )
+        return p_pid;
+    return ts_pid_New( p_list, i_pid & (TS_PID_COUNT - 1) );
+}
 
 /* returns NULL on end. requires context */
 typedef struct
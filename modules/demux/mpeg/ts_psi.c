@@ -90,6 +90,9 @@ static void PATCallBack( void *data, dvbpsi_pat_t *p_dvbpsipat )
     ts_pid_t             *patpid = GetPID(p_sys, 0);
     ts_pat_t             *p_pat = GetPID(p_sys, 0)->u.p_pat;
 
+    /* Programs are going to change */
+    DrainWorkers( p_sys );
+
     patpid->i_flags |= FLAG_SEEN;
 
     msg_Dbg( p_demux, "PATCallBack called" );
@@ -1813,6 +1816,9 @@ static void PMTCallBack( void *data, dvbpsi_pmt_t *p_dvbpsipmt )
 
     msg_Dbg( p_demux, "PMTCallBack called for program %d", p_dvbpsipmt->i_program_number );
 
+    /* Streams are going to change */
+    DrainWorkers( p_sys );
+
     if (unlikely(GetPID(p_sys, 0)->type != TYPE_PAT))
     {
         assert(GetPID(p_sys, 0)->type == TYPE_PAT);
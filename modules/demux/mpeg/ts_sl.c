@@ -133,6 +133,65 @@ bool SetupISO14496LogicalStream( demux_t *p_demux, const decoder_config_descript
     return true;
 }
 
+/* Updates the ES described by the program object descriptors */
+static bool SLPackets_UpdateES( demux_t *p_demux, ts_pmt_t *p_pmt )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    od_descriptors_t *p_ods = &p_pmt->od;
+    bool b_changed = false;
+
+    for( int i=0; i<p_ods->objects.i_size; i++ )
+    {
+        od_descriptor_t *p_od = p_ods->objects.p_elems[i];
+        for( int j = 0; j < ES_DESCRIPTOR_COUNT && p_od->es_descr[j].b_ok; j++ )
+        {
+            const es_mpeg4_descriptor_t *p_mpeg4desc = &p_od->es_descr[j];
+            ts_es_t *p_es = GetPMTESBySLEsId( p_pmt, p_mpeg4desc->i_es_id );
+            es_format_t fmt;
+            es_format_Init( &fmt, UNKNOWN_ES, 0 );
+
+            if ( p_mpeg4desc && p_mpeg4desc->b_ok && p_es &&
+                 SetupISO14496LogicalStream( p_demux, &p_mpeg4desc->dec_descr, &fmt ) &&
+                 !es_format_IsSimilar( &fmt, &p_es->fmt ) )
+            {
+                fmt.i_id = p_es->fmt.i_id;
+                fmt.i_group = p_es->fmt.i_group;
+                es_format_Clean( &p_es->fmt );
+                p_es->fmt = fmt;
+
+                if( p_es->id )
+                {
+                    es_out_Del( p_demux->out, p_es->id );
+                    p_sys->i_pmt_es--;
+                }
+                p_es->fmt.b_packetized = true; /* Split by access unit, no sync code */
+                p_es->id = es_out_Add( p_demux->out, &p_es->fmt );
+                if( p_es->id )
+                    p_sys->i_pmt_es++;
+                b_changed = true;
+            }
+            else
+                es_format_Clean( &fmt );
+        }
+    }
+
+    return b_changed;
+}
+
+void SLPackets_Update( demux_t *p_demux )
+{
+    demux_sys_t *p_sys = p_demux->p_sys;
+    const ts_pat_t *p_pat = GetPID(p_sys, 0)->u.p_pat;
+    bool b_changed = false;
+
+    for( int i = 0; i < p_pat->programs.i_size; i++ )
+        b_changed |= SLPackets_UpdateES( p_demux,
+                                         p_pat->programs.p_elems[i]->u.p_pmt );
+
+    if( b_changed )
+        UpdatePESFilters( p_demux, p_sys->seltype == PROGRAM_ALL );
+}
+
 /* Object stream SL in table sections */
 void SLPackets_Section_Handler( demux_t *p_demux,
                                 const uint8_t *p_sectiondata, size_t i_sectiondata,
@@ -155,44 +214,12 @@ void SLPackets_Section_Handler( demux_t *p_demux,
         sl_header_data header = DecodeSLHeader( i_data, p_data, &p_mpeg4desc->sl_descr );
 
         DecodeODCommand( VLC_OBJECT(p_demux), p_ods, i_data - header.i_size, &p_data[header.i_size] );
-        bool b_changed = false;
-
-        for( int i=0; i<p_ods->objects.i_size; i++ )
-        {
-            od_descriptor_t *p_od = p_ods->objects.p_elems[i];
-            for( int j = 0; j < ES_DESCRIPTOR_COUNT && p_od->es_descr[j].b_ok; j++ )
-            {
-                p_mpeg4desc = &p_od->es_descr[j];
-                ts_es_t *p_es = GetPMTESBySLEsId( p_pmt, p_mpeg4desc->i_es_id );
-                es_format_t fmt;
-                es_format_Init( &fmt, UNKNOWN_ES, 0 );
-
-                if ( p_mpeg4desc && p_mpeg4desc->b_ok && p_es &&
-                     SetupISO14496LogicalStream( p_demux, &p_mpeg4desc->dec_descr, &fmt ) &&
-                     !es_format_IsSimilar( &fmt, &p_es->fmt ) )
-                {
-                    fmt.i_id = p_es->fmt.i_id;
-                    fmt.i_group = p_es->fmt.i_group;
-                    es_format_Clean( &p_es->fmt );
-                    p_es->fmt = fmt;
-
-                    if( p_es->id )
-                    {
-                        es_out_Del( p_demux->out, p_es->id );
-                        p_sys->i_pmt_es--;
-                    }
-                    p_es->fmt.b_packetized = true; /* Split by access unit, no sync code */
-                    p_es->id = es_out_Add( p_demux->out, &p_es->fmt );
-                    if( p_es->id )
-                        p_sys->i_pmt_es++;
-                    b_changed = true;
-                }
-                else
-                    es_format_Clean( &fmt );
-            }
-        }
 
-        if( b_changed )
+        /* On a program output thread, the ES and the filters are changed
+         * later by the input thread, see SLPackets_Update() */
+        if( p_sys->p_workers )
+            atomic_store( &p_sys->b_update_sl, true );
+        else if( SLPackets_UpdateES( p_demux, p_pmt ) )
             UpdatePESFilters( p_demux, p_sys->seltype == PROGRAM_ALL );
     }
 }
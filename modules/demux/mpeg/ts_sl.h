@@ -27,6 +27,8 @@ void SLPackets_Section_Handler( demux_t *p_demux,
                                 const uint8_t *, size_t,
                                 const uint8_t *, size_t,
                                 void * );
+/* Applies the object descriptors received by the program output threads */
+void SLPackets_Update( demux_t * );
 bool SetupISO14496LogicalStream( demux_t *, const decoder_config_descriptor_t *,
                                   es_format_t * );
 
@@ -0,0 +1,228 @@
+/*****************************************************************************
+ * ts_workers.c: Transport Stream per program output threads
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+
+#include "timestamps.h"
+#include "ts_workers.h"
+
+#include <assert.h>
+
+/* Packets waiting on the input thread side before being handed over,
+ * so we don't take the worker lock for every single packet */
+#define TS_WORK_BATCH   64
+/* Maximum packets queued to a single worker (~750KB of TS) */
+#define TS_WORK_QUEUE   4096
+
+typedef struct
+{
+    ts_workers_t *p_owner;
+    unsigned      i_index;
+    vlc_thread_t  thread;
+
+    vlc_mutex_t   lock;
+    vlc_cond_t    wait;     /* work available or exiting */
+    vlc_cond_t    done;     /* space available or idle */
+    ts_work_t     queue[TS_WORK_QUEUE];
+    size_t        i_first;
+    size_t        i_count;
+    bool          b_busy;
+    bool          b_exit;
+
+    /* input thread only */
+    ts_work_t     pending[TS_WORK_BATCH];
+    size_t        i_pending;
+} ts_worker_t;
+
+struct ts_workers_t
+{
+    demux_t        *p_demux;
+    ts_work_handler pf_handler;
+    unsigned        i_count;
+    ts_worker_t    *p_workers[];
+};
+
+static void *Run( void *p_data )
+{
+    ts_worker_t *p_worker = p_data;
+    ts_workers_t *p_owner = p_worker->p_owner;
+    ts_work_t batch[TS_WORK_BATCH];
+
+    vlc_mutex_lock( &p_worker->lock );
+    for( ;; )
+    {
+        while( p_worker->i_count == 0 && !p_worker->b_exit )
+            vlc_cond_wait( &p_worker->wait, &p_worker->lock );
+
+        if( p_worker->i_count == 0 )
+            break;
+
+        size_t i_batch = __MIN( p_worker->i_count, TS_WORK_BATCH );
+        for( size_t i=0; i<i_batch; i++ )
+            batch[i] = p_worker->queue[(p_worker->i_first + i) % TS_WORK_QUEUE];
+        p_worker->i_first = (p_worker->i_first + i_batch) % TS_WORK_QUEUE;
+        p_worker->i_count -= i_batch;
+        p_worker->b_busy = true;
+        vlc_cond_signal( &p_worker->done );
+        vlc_mutex_unlock( &p_worker->lock );
+
+        for( size_t i=0; i<i_batch; i++ )
+            p_owner->pf_handler( p_owner->p_demux, p_worker->i_index, &batch[i] );
+
+        vlc_mutex_lock( &p_worker->lock );
+        p_worker->b_busy = false;
+        vlc_cond_signal( &p_worker->done );
+    }
+    vlc_mutex_unlock( &p_worker->lock );
+
+    return NULL;
+}
+
+static void WorkerFlush( ts_worker_t *p_worker )
+{
+    size_t i_done = 0;
+
+    if( p_worker->i_pending == 0 )
+        return;
+
+    vlc_mutex_lock( &p_worker->lock );
+    while( i_done < p_worker->i_pending )
+    {
+        while( p_worker->i_count == TS_WORK_QUEUE )
+            vlc_cond_wait( &p_worker->done, &p_worker->lock );
+
+        while( i_done < p_worker->i_pending && p_worker->i_count < TS_WORK_QUEUE )
+        {
+            size_t i_pos = (p_worker->i_first + p_worker->i_count) % TS_WORK_QUEUE;
+            p_worker->queue[i_pos] = p_worker->pending[i_done++];
+            p_worker->i_count++;
+        }
+        vlc_cond_signal( &p_worker->wait );
+    }
+    vlc_mutex_unlock( &p_worker->lock );
+
+    p_worker->i_pending = 0;
+}
+
+static void WorkerDelete( ts_worker_t *p_worker )
+{
+    vlc_mutex_lock( &p_worker->lock );
+    p_worker->b_exit = true;
+    vlc_cond_signal( &p_worker->wait );
+    vlc_mutex_unlock( &p_worker->lock );
+
+    vlc_join( p_worker->thread, NULL );
+    free( p_worker );
+}
+
+ts_workers_t * ts_workers_New( demux_t *p_demux, unsigned i_count,
+                               ts_work_handler pf_handler )
+{
+    assert( i_count > 0 );
+
+    ts_workers_t *p_workers = malloc( sizeof(*p_workers) +
+                                      sizeof(p_workers->p_workers[0]) * i_count );
+    if( !p_workers )
+        return NULL;
+
+    p_workers->p_demux = p_demux;
+    p_workers->pf_handler = pf_handler;
+    p_workers->i_count = 0;
+
+    for( unsigned i=0; i<i_count; i++ )
+    {
+        ts_worker_t *p_worker = malloc( sizeof(*p_worker) );
+        if( !p_worker )
+            break;
+
+        p_worker->p_owner = p_workers;
+        p_worker->i_index = i;
+        vlc_mutex_init( &p_worker->lock );
+        vlc_cond_init( &p_worker->wait );
+        vlc_cond_init( &p_worker->done );
+        p_worker->i_first = 0;
+        p_worker->i_count = 0;
+        p_worker->b_busy = false;
+        p_worker->b_exit = false;
+        p_worker->i_pending = 0;
+
+        if( vlc_clone( &p_worker->thread, Run, p_worker, VLC_THREAD_PRIORITY_INPUT ) )
+        {
+            free( p_worker );
+            break;
+        }
+        p_workers->p_workers[p_workers->i_count++] = p_worker;
+    }
+
+    if( p_workers->i_count < i_count )
+    {
+        ts_workers_Delete( p_workers );
+        return NULL;
+    }
+
+    return p_workers;
+}
+
+void ts_workers_Delete( ts_workers_t *p_workers )
+{
+    ts_workers_Drain( p_workers );
+    for( unsigned i=0; i<p_workers->i_count; i++ )
+        WorkerDelete( p_workers->p_workers[i] );
+    free( p_workers );
+}
+
+unsigned ts_workers_Count( const ts_workers_t *p_workers )
+{
+    return p_workers->i_count;
+}
+
+void ts_workers_Push( ts_workers_t *p_workers, unsigned i_worker, const ts_work_t *p_work )
+{
+    assert( i_worker < p_workers->i_count );
+    ts_worker_t *p_worker = p_workers->p_workers[i_worker];
+
+    p_worker->pending[p_worker->i_pending++] = *p_work;
+    if( p_worker->i_pending == TS_WORK_BATCH )
+        WorkerFlush( p_worker );
+}
+
+void ts_workers_Flush( ts_workers_t *p_workers )
+{
+    for( unsigned i=0; i<p_workers->i_count; i++ )
+        WorkerFlush( p_workers->p_workers[i] );
+}
+
+void ts_workers_Drain( ts_workers_t *p_workers )
+{
+    ts_workers_Flush( p_workers );
+
+    for( unsigned i=0; i<p_workers->i_count; i++ )
+    {
+        ts_worker_t *p_worker = p_workers->p_workers[i];
+        vlc_mutex_lock( &p_worker->lock );
+        while( p_worker->i_count > 0 || p_worker->b_busy )
+            vlc_cond_wait( &p_worker->done, &p_worker->lock );
+        vlc_mutex_unlock( &p_worker->lock );
+    }
+}
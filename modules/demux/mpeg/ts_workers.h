@@ -0,0 +1,59 @@
+/*****************************************************************************
+ * ts_workers.h: Transport Stream per program output threads
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef VLC_TS_WORKERS_H
+#define VLC_TS_WORKERS_H
+
+#include "ts_pid_fwd.h"
+
+typedef struct ts_workers_t ts_workers_t;
+
+/* Once synced, CC checked and descrambled, packets for a program are handed
+ * to the worker owning that program. A worker runs PCR handling, PES
+ * reassembly and ES output for its programs in stream order.
+ * Everything else (PSI, SI, filters, control) stays on the input thread,
+ * which must drain the workers before touching any program state. */
+typedef struct
+{
+    ts_pid_t *p_pid;
+    block_t  *p_pkt;    /* NULL when only carrying PCR */
+    stime_t   i_pcr;    /* -1 if none */
+    int       i_header;
+} ts_work_t;
+
+typedef void (*ts_work_handler)( demux_t *, unsigned i_worker, const ts_work_t * );
+
+ts_workers_t * ts_workers_New( demux_t *, unsigned i_count, ts_work_handler );
+void ts_workers_Delete( ts_workers_t * );
+
+unsigned ts_workers_Count( const ts_workers_t * );
+static inline unsigned ts_workers_ProgramWorker( const ts_workers_t *p_workers,
+                                                 uint16_t i_program )
+{
+    return i_program % ts_workers_Count( p_workers );
+}
+
+/* Queues work, blocking while that worker is too late */
+void ts_workers_Push( ts_workers_t *, unsigned i_worker, const ts_work_t * );
+/* Hands all queued work to the threads */
+void ts_workers_Flush( ts_workers_t * );
+/* Returns once all work has been processed and every worker is idle */
+void ts_workers_Drain( ts_workers_t * );
+
+#endif
@@ -179,6 +179,24 @@ static bool request_metadata_sync( libvlc_int_t *libvlc, input_item_t *media,
 void
 SDDirectory::read() const
 {
+    /* Local directories are listed directly, and cached */
+    if (!m_fs.isNetworkFileSystem())
+    {
+        auto snapshot = m_fs.snapshot(m_mrl);
+        if (snapshot == nullptr)
+            throw medialibrary::fs::errors::System( EIO,
+                "Failed to read local directory" );
+
+        for (const auto &file : snapshot->files)
+            m_files.push_back(std::make_shared<SDFile>(file.mrl, file.mtime,
+                                                       file.size));
+        for (const auto &dir : snapshot->dirs)
+            m_dirs.push_back(std::make_shared<SDDirectory>(dir, m_fs));
+
+        m_read_done = true;
+        return;
+    }
+
     auto media = vlc::wrap_cptr( input_item_New(m_mrl.c_str(), m_mrl.c_str()),
                                  &input_item_Release );
     if (!media)
@@ -35,6 +35,14 @@ SDFile::SDFile(const std::string &mrl)
 {
 }
 
+SDFile::SDFile(const std::string &mrl, unsigned int lastModificationDate,
+               int64_t size)
+    : SDFile(mrl)
+{
+    m_lastModificationDate = lastModificationDate;
+    m_size = size;
+}
+
 const std::string &
 SDFile::mrl() const
 {
@@ -56,13 +64,13 @@ SDFile::extension() const
 unsigned int
 SDFile::lastModificationDate() const
 {
-    return 0;
+    return m_lastModificationDate;
 }
 
 int64_t
 SDFile::size() const
 {
-    return 0;
+    return m_size;
 }
 
   } /* namespace medialibrary */
@@ -32,6 +32,8 @@ class SDFile : public IFile
 {
 public:
     explicit SDFile(const std::string &mrl);
+    SDFile(const std::string &mrl, unsigned int lastModificationDate,
+           int64_t size);
     virtual ~SDFile() = default;
     const std::string& mrl() const override;
     const std::string& name() const override;
@@ -44,6 +46,8 @@ private:
     std::string m_mrl;
     std::string m_name;
     std::string m_extension;
+    unsigned int m_lastModificationDate = 0;
+    int64_t m_size = 0;
 };
 
   } /* namespace medialibrary */
@@ -27,6 +27,8 @@
 #include <medialibrary/IDeviceLister.h>
 #include <medialibrary/filesystem/IDevice.h>
 #include <medialibrary/IMediaLibrary.h>
+#include <medialibrary/IFolder.h>
+#include <medialibrary/filesystem/Errors.h>
 
 #include "device.h"
 #include "directory.h"
@@ -49,6 +51,8 @@ SDFileSystemFactory::SDFileSystemFactory(vlc_object_t *parent,
 {
     m_isNetwork = strncasecmp( m_scheme.c_str(), "file://",
                                m_scheme.length() ) != 0;
+    if ( !m_isNetwork )
+        m_snapshots.reset( new SnapshotCache( parent ) );
 }
 
 std::shared_ptr<fs::IDirectory>
@@ -113,6 +117,22 @@ SDFileSystemFactory::start(IFileSystemFactoryCb *callbacks)
 {
     assert( isStarted() == false );
     m_callbacks = callbacks;
+    if ( m_snapshots )
+    {
+        /* Rescan only the entry points that changed */
+        m_watcher.reset( new DirectoryWatcher( m_parent, *m_snapshots,
+            [this]( const std::unordered_set<std::string>& mrls ) {
+                if ( mrls.empty() )
+                {
+                    m_ml->reload();
+                    return;
+                }
+                for ( const auto& entryPoint : entryPoints( mrls ) )
+                    m_ml->reload( entryPoint );
+            } ) );
+        if ( !m_watcher->start() )
+            m_watcher.reset();
+    }
     return m_deviceLister->start( this );
 }
 
@@ -120,6 +140,7 @@ void
 SDFileSystemFactory::stop()
 {
     assert( isStarted() == true );
+    m_watcher.reset();
     m_deviceLister->stop();
     m_callbacks = nullptr;
 }
@@ -130,6 +151,53 @@ SDFileSystemFactory::libvlc() const
     return vlc_object_instance(m_parent);
 }
 
+std::unordered_set<std::string>
+SDFileSystemFactory::entryPoints(const std::unordered_set<std::string> &mrls)
+{
+    /* The media library only reloads entry points, not their subfolders */
+    std::vector<std::pair<std::string, std::string>> roots; /* prefix, mrl */
+    for ( const auto& folder : m_ml->entryPoints()->all() )
+    {
+        try
+        {
+            std::string mrl = folder->mrl();
+            std::string prefix = mrl;
+            if ( prefix.empty() == false && *prefix.crbegin() != '/' )
+                prefix += '/';
+            roots.emplace_back( std::move( prefix ), std::move( mrl ) );
+        }
+        catch ( const medialibrary::fs::errors::DeviceRemoved& )
+        {
+        }
+    }
+
+    std::unordered_set<std::string> res;
+    for ( const auto& mrl : mrls )
+    {
+        /* the innermost entry point holding the directory */
+        const std::pair<std::string, std::string>* best = nullptr;
+        for ( const auto& root : roots )
+            if ( mrl.compare( 0, root.first.length(), root.first ) == 0 &&
+                 ( best == nullptr ||
+                   root.first.length() > best->first.length() ) )
+                best = &root;
+        if ( best != nullptr )
+            res.insert( best->second );
+    }
+    return res;
+}
+
+std::shared_ptr<const DirectorySnapshot>
+SDFileSystemFactory::snapshot(const std::string &mrl)
+{
+    if ( !m_snapshots )
+        return nullptr;
+    /* Watch first, so that no change is missed while reading */
+    if ( m_watcher )
+        m_watcher->watch( mrl );
+    return m_snapshots->get( mrl );
+}
+
 void SDFileSystemFactory::onDeviceMounted(const std::string& uuid,
                                           const std::string& mountpoint,
                                           bool removable)
@@ -29,6 +29,9 @@
 #include <medialibrary/filesystem/IFileSystemFactory.h>
 #include <medialibrary/IDeviceLister.h>
 
+#include "snapshot.h"
+#include "watcher.h"
+
 struct libvlc_int_t;
 
 namespace medialibrary {
@@ -81,6 +84,20 @@ public:
     libvlc_int_t *
     libvlc() const;
 
+    /**
+     * Returns the cached listing of a local directory, and watches it
+     *
+     * \return the listing, or nullptr for network file systems
+     */
+    std::shared_ptr<const DirectorySnapshot>
+    snapshot(const std::string &mrl);
+
+    /**
+     * Returns the entry points holding the given local directories
+     */
+    std::unordered_set<std::string>
+    entryPoints(const std::unordered_set<std::string> &mrls);
+
     void
     onDeviceMounted(const std::string& uuid, const std::string& mountpoint, bool removable) override;
 
@@ -105,6 +122,10 @@ private:
 
     vlc::threads::mutex m_mutex;
     std::vector<std::shared_ptr<IDevice>> m_devices;
+
+    /* local file systems only */
+    std::unique_ptr<SnapshotCache> m_snapshots;
+    std::unique_ptr<DirectoryWatcher> m_watcher;
 };
 
   } /* namespace medialibrary */
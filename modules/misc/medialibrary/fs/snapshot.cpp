@@ -0,0 +1,284 @@
+/*****************************************************************************
+ * snapshot.cpp: Media library local directory listings cache
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors, VideoLAN and VideoLabs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+#include <vlc_fs.h>
+#include <vlc_url.h>
+#include <vlc_variables.h>
+
+namespace vlc {
+  namespace medialibrary {
+
+SnapshotCache::SnapshotCache(vlc_object_t *parent)
+    : m_parent(parent)
+    , m_showHidden(var_InheritBool(parent, "show-hiddenfiles"))
+{
+    auto exts = vlc::wrap_cptr(var_InheritString(parent, "ignore-filetypes"));
+    if (exts)
+        m_ignoredExts = exts.get();
+}
+
+/* Same rules as the directory access */
+bool
+SnapshotCache::isIgnored(const char *name) const
+{
+    if (name[0] == '\0' || !strcmp(name, ".") || !strcmp(name, ".."))
+        return true;
+    if (!m_showHidden && name[0] == '.')
+        return true;
+
+    const char *ext = strrchr(name, '.');
+    if (ext == nullptr || m_ignoredExts.empty())
+        return false;
+    size_t extlen = strlen(++ext);
+
+    for (size_t pos = 0; pos < m_ignoredExts.length(); )
+    {
+        size_t end = m_ignoredExts.find(',', pos);
+        if (end == std::string::npos)
+            end = m_ignoredExts.length();
+        if (end - pos == extlen &&
+            !strncasecmp(ext, m_ignoredExts.c_str() + pos, extlen))
+            return true;
+        pos = end + 1;
+    }
+    return false;
+}
+
+static int
+statEntry(DIR *dir, const std::string &path, const char *name, struct stat *st)
+{
+#ifdef HAVE_FSTATAT
+    (void) path;
+    return fstatat(dirfd(dir), name, st, 0);
+#else
+    (void) dir;
+    return vlc_stat((path + DIR_SEP + name).c_str(), st);
+#endif
+}
+
+std::shared_ptr<DirectorySnapshot>
+SnapshotCache::read(const std::string &mrl, const std::string &path) const
+{
+    DIR *dir = vlc_opendir(path.c_str());
+    if (dir == nullptr)
+        return nullptr;
+
+    auto snapshot = std::make_shared<DirectorySnapshot>();
+    snapshot->path = path;
+
+    struct stat st;
+    /* stat the directory before reading it, so that later updates show */
+    if (fstat(dirfd(dir), &st))
+    {
+        closedir(dir);
+        return nullptr;
+    }
+    snapshot->mtime = st.st_mtime;
+    snapshot->stable = st.st_mtime < time(nullptr) - 1;
+
+    const char *name;
+    while ((name = vlc_readdir(dir)) != nullptr)
+    {
+        if (isIgnored(name) || statEntry(dir, path, name, &st))
+            continue;
+        if (!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode))
+            continue;
+
+        auto encoded = vlc::wrap_cptr(vlc_uri_encode(name));
+        if (!encoded)
+        {
+            closedir(dir);
+            throw std::bad_alloc();
+        }
+
+        if (S_ISDIR(st.st_mode))
+            snapshot->dirs.push_back(mrl + encoded.get());
+        else
+            snapshot->files.push_back({ name, mrl + encoded.get(),
+                                        st.st_mtime, st.st_size });
+    }
+    closedir(dir);
+
+    msg_Dbg(m_parent, "listed %s: %zu files, %zu directories", mrl.c_str(),
+            snapshot->files.size(), snapshot->dirs.size());
+    return snapshot;
+}
+
+/* The entries did not change, their dates and sizes may have */
+std::shared_ptr<DirectorySnapshot>
+SnapshotCache::refresh(const DirectorySnapshot &old) const
+{
+    auto snapshot = std::make_shared<DirectorySnapshot>(old);
+    DIR *dir = vlc_opendir(old.path.c_str());
+    if (dir == nullptr)
+        return nullptr;
+
+    auto it = snapshot->files.begin();
+    while (it != snapshot->files.end())
+    {
+        struct stat st;
+        if (statEntry(dir, old.path, it->name.c_str(), &st) ||
+            !S_ISREG(st.st_mode))
+        {
+            it = snapshot->files.erase(it);
+            continue;
+        }
+        it->mtime = st.st_mtime;
+        it->size = st.st_size;
+        ++it;
+    }
+    closedir(dir);
+    return snapshot;
+}
+
+SnapshotCache::Entry &
+SnapshotCache::entryLocked(const std::string &mrl)
+{
+    auto it = m_entries.find(mrl);
+    if (it != m_entries.end())
+        return it->second;
+
+    /* never reuse the generation of a removed entry */
+    auto &entry = m_entries[mrl];
+    entry.generation = m_generation++;
+    return entry;
+}
+
+/* Forgets the unwatched subdirectories gone since the previous listing, the
+ * watched ones are removed by the watcher */
+void
+SnapshotCache::pruneLocked(const DirectorySnapshot &old,
+                           const DirectorySnapshot &snapshot)
+{
+    for (const auto &dir : old.dirs)
+    {
+        if (std::find(snapshot.dirs.begin(), snapshot.dirs.end(), dir) !=
+            snapshot.dirs.end())
+            continue;
+
+        const std::string prefix = dir + '/';
+        for (auto it = m_entries.begin(); it != m_entries.end(); )
+        {
+            if (!it->second.watched &&
+                !it->first.compare(0, prefix.length(), prefix))
+                it = m_entries.erase(it);
+            else
+                ++it;
+        }
+    }
+}
+
+std::shared_ptr<const DirectorySnapshot>
+SnapshotCache::get(const std::string &mrl)
+{
+    std::shared_ptr<const DirectorySnapshot> old;
+    unsigned generation;
+    {
+        vlc::threads::mutex_locker lock(m_mutex);
+        auto &entry = entryLocked(mrl);
+        if (entry.watched && entry.valid)
+            return entry.snapshot;
+        old = entry.snapshot;
+        generation = entry.generation;
+    }
+
+    auto path = vlc::wrap_cptr(vlc_uri2path(mrl.c_str()));
+    std::shared_ptr<DirectorySnapshot> snapshot;
+    if (path)
+    {
+        struct stat st;
+        if (old != nullptr && old->stable && vlc_stat(path.get(), &st) == 0 &&
+            st.st_mtime == old->mtime)
+            snapshot = refresh(*old);
+        else
+            snapshot = read(mrl, path.get());
+    }
+
+    vlc::threads::mutex_locker lock(m_mutex);
+    auto it = m_entries.find(mrl);
+    /* if invalidated meanwhile, the listing may miss the last updates */
+    if (it == m_entries.end() || it->second.generation != generation)
+        return snapshot;
+
+    if (snapshot == nullptr)
+    {
+        /* unreadable, most likely removed */
+        if (!it->second.watched)
+            m_entries.erase(it);
+        return nullptr;
+    }
+    it->second.snapshot = snapshot;
+    it->second.valid = true;
+    if (old != nullptr)
+        pruneLocked(*old, *snapshot);
+    return snapshot;
+}
+
+void
+SnapshotCache::setWatched(const std::string &mrl, bool watched)
+{
+    vlc::threads::mutex_locker lock(m_mutex);
+    auto &entry = entryLocked(mrl);
+    entry.watched = watched;
+    if (!watched)
+        entry.valid = false;
+}
+
+void
+SnapshotCache::invalidate(const std::string &mrl)
+{
+    vlc::threads::mutex_locker lock(m_mutex);
+    auto it = m_entries.find(mrl);
+    if (it == m_entries.end())
+        return;
+    /* the next listing is read again anyway */
+    it->second.snapshot.reset();
+    it->second.valid = false;
+    it->second.generation = m_generation++;
+}
+
+void
+SnapshotCache::remove(const std::string &mrl)
+{
+    vlc::threads::mutex_locker lock(m_mutex);
+    m_entries.erase(mrl);
+}
+
+size_t
+SnapshotCache::size()
+{
+    vlc::threads::mutex_locker lock(m_mutex);
+    return m_entries.size();
+}
+
+  } /* namespace medialibrary */
+} /* namespace vlc */
@@ -0,0 +1,119 @@
+/*****************************************************************************
+ * snapshot.h: Media library local directory listings cache
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors, VideoLAN and VideoLabs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef SD_SNAPSHOT_H
+#define SD_SNAPSHOT_H
+
+#include <ctime>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vlc_common.h>
+#include <vlc_threads.h>
+#include <vlc_cxx_helpers.hpp>
+
+namespace vlc {
+  namespace medialibrary {
+
+/**
+ * Listing of a local directory, with the file dates and sizes the media
+ * library uses to detect changes
+ */
+struct DirectorySnapshot
+{
+    struct File
+    {
+        std::string name;
+        std::string mrl;
+        time_t mtime;
+        int64_t size;
+    };
+
+    std::string path;
+    time_t mtime; /**< of the directory itself, changed by entries updates */
+    bool stable; /**< mtime is old enough to reveal any later update */
+    std::vector<File> files;
+    std::vector<std::string> dirs; /**< mrls */
+};
+
+/**
+ * Caches the listings of local directories between rescans
+ *
+ * A listing is reused as is while the directory is watched for changes, see
+ * DirectoryWatcher. Otherwise, the directory is read again only if its own
+ * modification date changed, else only its files are stat'ed again.
+ */
+class SnapshotCache
+{
+public:
+    explicit SnapshotCache(vlc_object_t *parent);
+
+    /**
+     * Returns the listing of a local directory
+     *
+     * \param mrl the directory mrl, ending with a '/'
+     * \return the listing, or nullptr if the directory cannot be read
+     */
+    std::shared_ptr<const DirectorySnapshot> get(const std::string &mrl);
+
+    /** Marks a directory as watched: its listing is kept until invalidated */
+    void setWatched(const std::string &mrl, bool watched);
+
+    /** Drops the listing of a directory */
+    void invalidate(const std::string &mrl);
+
+    /** Forgets a removed directory */
+    void remove(const std::string &mrl);
+
+    /** Returns the number of directories known to the cache */
+    size_t size();
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const DirectorySnapshot> snapshot;
+        bool watched = false;
+        bool valid = false;
+        unsigned generation; /**< changed by invalidate() */
+    };
+
+    Entry &entryLocked(const std::string &mrl);
+    void pruneLocked(const DirectorySnapshot &old,
+                     const DirectorySnapshot &snapshot);
+    bool isIgnored(const char *name) const;
+    std::shared_ptr<DirectorySnapshot> read(const std::string &mrl,
+                                            const std::string &path) const;
+    std::shared_ptr<DirectorySnapshot> refresh(const DirectorySnapshot &old) const;
+
+    vlc_object_t *const m_parent;
+    const bool m_showHidden;
+    std::string m_ignoredExts;
+
+    vlc::threads::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries;
+    unsigned m_generation = 0;
+};
+
+  } /* namespace medialibrary */
+} /* namespace vlc */
+
+#endif
@@ -0,0 +1,281 @@
+/*****************************************************************************
+ * watcher.cpp: Media library local directories change notifications
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors, VideoLAN and VideoLabs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "watcher.h"
+
+#include <cassert>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
+
+#include <vlc_fs.h>
+#include <vlc_url.h>
+
+/* quiet period before reporting the changes of a directory */
+#define WATCH_DELAY VLC_TICK_FROM_SEC(2)
+
+namespace vlc {
+  namespace medialibrary {
+
+DirectoryWatcher::DirectoryWatcher(vlc_object_t *parent, SnapshotCache &cache,
+                                   Callback onChanged)
+    : m_parent(parent)
+    , m_cache(cache)
+    , m_onChanged(std::move(onChanged))
+{
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    stop();
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                      IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | \
+                      IN_MOVE_SELF | IN_ONLYDIR)
+
+bool
+DirectoryWatcher::start()
+{
+    assert(!m_started);
+
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd == -1)
+    {
+        msg_Warn(m_parent, "cannot watch directories: %s",
+                 vlc_strerror_c(errno));
+        return false;
+    }
+    if (vlc_pipe(m_wakeup))
+    {
+        vlc_close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    if (vlc_clone(&m_thread, threadEntry, this, VLC_THREAD_PRIORITY_LOW))
+    {
+        vlc_close(m_wakeup[0]);
+        vlc_close(m_wakeup[1]);
+        vlc_close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_started = true;
+    return true;
+}
+
+void
+DirectoryWatcher::stop()
+{
+    if (!m_started)
+        return;
+
+    /* the thread wakes up on the hang-up */
+    vlc_close(m_wakeup[1]);
+    vlc_join(m_thread, nullptr);
+    m_started = false;
+
+    vlc_close(m_wakeup[0]);
+    vlc_close(m_fd); /* removes all the watches */
+    m_fd = -1;
+
+    vlc::threads::mutex_locker lock(m_mutex);
+    for (const auto &mrl : m_watched)
+        m_cache.setWatched(mrl, false);
+    m_watches.clear();
+    m_watched.clear();
+}
+
+void
+DirectoryWatcher::watch(const std::string &mrl)
+{
+    vlc::threads::mutex_locker lock(m_mutex);
+    if (!m_started || m_exhausted || m_watched.count(mrl) > 0)
+        return;
+
+    auto path = vlc::wrap_cptr(vlc_uri2path(mrl.c_str()));
+    if (!path)
+        return;
+
+    int wd = inotify_add_watch(m_fd, path.get(), WATCH_EVENTS);
+    if (wd == -1)
+    {
+        if (errno == ENOSPC)
+        {
+            /* fs.inotify.max_user_watches: the other directories will be
+             * checked by their modification dates */
+            msg_Warn(m_parent, "too many watched directories, "
+                     "not watching %s and the next ones", mrl.c_str());
+            m_exhausted = true;
+        }
+        return;
+    }
+    /* renamed directories keep their descriptor */
+    m_watches[wd] = mrl;
+    m_watched.insert(mrl);
+    m_cache.setWatched(mrl, true);
+}
+
+void
+DirectoryWatcher::handleEvents(std::unordered_set<std::string> &changed,
+                               bool &lost)
+{
+    alignas(struct inotify_event) char buf[4096];
+
+    for (;;)
+    {
+        ssize_t len = read(m_fd, buf, sizeof(buf));
+        if (len <= 0)
+            break;
+
+        vlc::threads::mutex_locker lock(m_mutex);
+        for (ssize_t offset = 0; offset < len; )
+        {
+            const struct inotify_event *ev =
+                reinterpret_cast<const struct inotify_event *>(buf + offset);
+            offset += sizeof(*ev) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW)
+            {
+                for (const auto &mrl : m_watched)
+                    m_cache.invalidate(mrl);
+                lost = true;
+                continue;
+            }
+
+            auto it = m_watches.find(ev->wd);
+            if (it == m_watches.end())
+                continue;
+            const std::string mrl = it->second;
+
+            if (ev->mask & IN_IGNORED)
+            {
+                /* removed, or on an unmounted file system */
+                m_cache.remove(mrl);
+                m_watched.erase(mrl);
+                m_watches.erase(it);
+            }
+            else
+            {
+                m_cache.invalidate(mrl);
+                if (ev->mask & IN_MOVE_SELF)
+                    /* the watch now points to an unknown mrl */
+                    inotify_rm_watch(m_fd, ev->wd);
+            }
+            changed.insert(mrl);
+        }
+    }
+}
+
+void
+DirectoryWatcher::run()
+{
+    std::unordered_set<std::string> changed;
+    bool lost = false;
+    vlc_tick_t deadline = VLC_TICK_INVALID;
+
+    for (;;)
+    {
+        struct pollfd ufd[2] = {
+            { m_fd, POLLIN, 0 },
+            { m_wakeup[0], POLLIN, 0 },
+        };
+        int timeout = -1;
+        if (deadline != VLC_TICK_INVALID)
+        {
+            vlc_tick_t delay = deadline - vlc_tick_now();
+            timeout = delay > 0 ? MS_FROM_VLC_TICK(delay) + 1 : 0;
+        }
+
+        int val = poll(ufd, 2, timeout);
+        if (val < 0 && errno != EINTR)
+            break;
+        if (ufd[1].revents)
+            break;
+
+        if (ufd[0].revents)
+        {
+            handleEvents(changed, lost);
+            if (lost || !changed.empty())
+                deadline = vlc_tick_now() + WATCH_DELAY;
+            continue;
+        }
+
+        if (deadline == VLC_TICK_INVALID || vlc_tick_now() < deadline)
+            continue;
+
+        /* quiet for long enough */
+        if (lost)
+            changed.clear();
+        m_onChanged(changed);
+        changed.clear();
+        lost = false;
+        deadline = VLC_TICK_INVALID;
+    }
+}
+
+#else /* !HAVE_SYS_INOTIFY_H */
+
+bool
+DirectoryWatcher::start()
+{
+    return false;
+}
+
+void
+DirectoryWatcher::stop()
+{
+}
+
+void
+DirectoryWatcher::watch(const std::string &)
+{
+}
+
+void
+DirectoryWatcher::handleEvents(std::unordered_set<std::string> &, bool &)
+{
+}
+
+void
+DirectoryWatcher::run()
+{
+}
+
+#endif
+
+void *
+DirectoryWatcher::threadEntry(void *data)
+{
+    static_cast<DirectoryWatcher *>(data)->run();
+    return nullptr;
+}
+
+  } /* namespace medialibrary */
+} /* namespace vlc */
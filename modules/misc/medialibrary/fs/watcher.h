@@ -0,0 +1,90 @@
+/*****************************************************************************
+ * watcher.h: Media library local directories change notifications
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors, VideoLAN and VideoLabs
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef SD_WATCHER_H
+#define SD_WATCHER_H
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <vlc_common.h>
+#include <vlc_threads.h>
+#include <vlc_cxx_helpers.hpp>
+
+#include "snapshot.h"
+
+namespace vlc {
+  namespace medialibrary {
+
+/**
+ * Watches the local directories read by the media library (inotify)
+ *
+ * Changes invalidate the cached listings of the directories, then, once the
+ * directory has been quiet for a while, are reported through the callback so
+ * that only the changed directories get rescanned.
+ */
+class DirectoryWatcher
+{
+public:
+    /** Called with the changed directories mrls, or none if changes were
+     * lost */
+    using Callback =
+        std::function<void(const std::unordered_set<std::string> &mrls)>;
+
+    DirectoryWatcher(vlc_object_t *parent, SnapshotCache &cache,
+                     Callback onChanged);
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    /** Returns false if change notifications are not available */
+    bool start();
+    void stop();
+
+    /** Watches a directory, unless already watched */
+    void watch(const std::string &mrl);
+
+private:
+    static void *threadEntry(void *data);
+    void run();
+    void handleEvents(std::unordered_set<std::string> &changed, bool &lost);
+
+    vlc_object_t *const m_parent;
+    SnapshotCache &m_cache;
+    const Callback m_onChanged;
+
+    int m_fd = -1;
+    int m_wakeup[2] = { -1, -1 };
+    vlc_thread_t m_thread;
+    bool m_started = false;
+
+    vlc::threads::mutex m_mutex;
+    std::unordered_map<int, std::string> m_watches; /**< mrls by descriptor */
+    std::unordered_set<std::string> m_watched;
+    bool m_exhausted = false; /**< the watches limit was reached */
+};
+
+  } /* namespace medialibrary */
+} /* namespace vlc */
+
+#endif
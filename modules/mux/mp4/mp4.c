@@ -53,6 +53,16 @@
     "Create \"Fast Start\" files. " \
     "\"Fast Start\" files are optimized for downloads and allow the user " \
     "to start previewing the file while it is downloading.")
+#define MOOV_RESERVE_TEXT N_("Space reserved for the index (kB)")
+#define MOOV_RESERVE_LONGTEXT N_(\
+    "Reserve space for the index (moov) at the start of the file, so that " \
+    "it can be written there when closing, without moving the media data. " \
+    "About 10 bytes per sample and per track are needed.")
+#define CHUNK_LENGTH_TEXT N_("CMAF chunk duration (ms)")
+#define CHUNK_LENGTH_LONGTEXT N_(\
+    "Write a fragment every given duration instead of every 1.5 seconds, " \
+    "as CMAF chunks. Only the chunks starting with a keyframe are flagged " \
+    "as random access points for the outputs. 0 disables CMAF chunking.")
 
 static int  Open   (vlc_object_t *);
 static void Close  (vlc_object_t *);
@@ -60,6 +70,8 @@ static void CloseFrag  (vlc_object_t *);
 
 #define SOUT_CFG_PREFIX "sout-mp4-"
 
+#define FRAGMENT_LENGTH  VLC_TICK_FROM_MS(1500)
+
 vlc_module_begin ()
     set_description(N_("MP4/MOV muxer"))
     set_category(CAT_SOUT)
@@ -69,6 +81,9 @@ vlc_module_begin ()
     add_bool(SOUT_CFG_PREFIX "faststart", false,
               FASTSTART_TEXT, FASTSTART_LONGTEXT,
               true)
+    add_integer(SOUT_CFG_PREFIX "moov-reserve", 0,
+                MOOV_RESERVE_TEXT, MOOV_RESERVE_LONGTEXT, true)
+        change_integer_range(0, 65536)
     set_capability("sout mux", 5)
     add_shortcut("mp4", "mov", "3gp")
     set_callbacks(Open, Close)
@@ -79,6 +94,9 @@ add_submodule ()
     set_subcategory(SUBCAT_SOUT_MUX)
     set_shortname("MP4 Frag")
     add_shortcut("mp4frag", "mp4stream")
+    add_integer(SOUT_CFG_PREFIX "chunk-length", 0,
+                CHUNK_LENGTH_TEXT, CHUNK_LENGTH_LONGTEXT, true)
+        change_integer_range(0, 10000)
     set_capability("sout mux", 0)
     set_callbacks(Open, CloseFrag)
 
@@ -88,7 +106,7 @@ vlc_module_end ()
  * Exported prototypes
  *****************************************************************************/
 static const char *const ppsz_sout_options[] = {
-    "faststart", NULL
+    "faststart", "moov-reserve", "chunk-length", NULL
 };
 
 static int Control(sout_mux_t *, int, va_list);
@@ -164,6 +182,8 @@ typedef struct
 
     uint64_t i_mdat_pos;
     uint64_t i_pos;
+    uint64_t i_moov_reserve; /* size of the free box reserved for moov */
+    uint64_t i_moov_reserve_pos;
     vlc_tick_t  i_read_duration;
     vlc_tick_t  i_start_dts;
 
@@ -173,6 +193,8 @@ typedef struct
 
     /* mp4frag */
     vlc_tick_t     i_written_duration;
+    vlc_tick_t     i_fragment_length;
+    bool           b_chunked; /* CMAF chunks, not all starting on a keyframe */
     uint32_t       i_mfhd_sequence;
 } sout_mux_sys_t;
 
@@ -241,6 +263,22 @@ static int WriteSlowStartHeader(sout_mux_t *p_mux)
         box_send(p_mux, box);
     }
 
+    if (p_sys->i_moov_reserve > 0)
+    {
+        /* Free box, overwritten by moov when closing if large enough */
+        block_t *p_free = block_Alloc(p_sys->i_moov_reserve);
+        if(!p_free)
+            return VLC_ENOMEM;
+        memset(p_free->p_buffer, 0, p_free->i_buffer);
+        SetDWBE(p_free->p_buffer, p_sys->i_moov_reserve);
+        memcpy(&p_free->p_buffer[4], "free", 4);
+
+        p_sys->i_moov_reserve_pos = p_sys->i_pos;
+        p_sys->i_pos += p_free->i_buffer;
+        p_sys->i_mdat_pos = p_sys->i_pos;
+        sout_AccessOutWrite(p_mux->p_access, p_free);
+    }
+
     /* Now add mdat header */
     box = box_new("mdat");
     if(!box)
@@ -286,12 +324,29 @@ static int Open(vlc_object_t *p_this)
     p_sys->i_nb_streams = 0;
     p_sys->pp_streams   = NULL;
     p_sys->i_mdat_pos   = 0;
+    p_sys->i_moov_reserve = 0;
+    p_sys->i_moov_reserve_pos = 0;
     p_sys->b_header_sent = false;
 
     p_sys->i_read_duration   = 0;
     p_sys->i_written_duration= 0;
     p_sys->i_start_dts = VLC_TICK_INVALID;
     p_sys->i_mfhd_sequence = 1;
+    p_sys->i_fragment_length = FRAGMENT_LENGTH;
+    p_sys->b_chunked = false;
+
+    if (!(options & FRAGMENTED))
+        p_sys->i_moov_reserve =
+            (uint64_t)var_GetInteger(p_mux, SOUT_CFG_PREFIX "moov-reserve") * 1024;
+    else
+    {
+        int64_t i_chunk = var_GetInteger(p_mux, SOUT_CFG_PREFIX "chunk-length");
+        if (i_chunk > 0)
+        {
+            p_sys->i_fragment_length = VLC_TICK_FROM_MS(i_chunk);
+            p_sys->b_chunked = true;
+        }
+    }
 
     p_mux->p_sys        = p_sys;
     p_mux->pf_control   = Control;
@@ -307,6 +362,11 @@ static int Open(vlc_object_t *p_this)
     else
     {
         mp4mux_SetBrand(p_sys->muxh, BRAND_isom, 0x0);
+        if (p_sys->b_chunked)
+        {
+            mp4mux_AddExtraBrand(p_sys->muxh, BRAND_iso6);
+            mp4mux_AddExtraBrand(p_sys->muxh, BRAND_cmfc);
+        }
     }
 
     return VLC_SUCCESS;
@@ -347,10 +407,31 @@ static void Close(vlc_object_t *p_this)
         mp4mux_Set64BitExt(p_sys->muxh);
 
     uint64_t i_moov_pos = p_sys->i_pos;
+    uint64_t i_free = 0; /* free box following moov */
     bo_t *moov = mp4mux_GetMoov(p_sys->muxh, VLC_OBJECT(p_mux), 0);
 
     /* Check we need to create "fast start" files */
     p_sys->b_fast_start = var_GetBool(p_this, SOUT_CFG_PREFIX "faststart");
+
+    /* Fill the reserved space in place, the remainder staying a free box */
+    const uint64_t i_reserve = p_sys->i_moov_reserve;
+    if (i_reserve > 0 && moov && moov->b)
+    {
+        uint64_t i_moov_size = bo_size(moov);
+        msg_Dbg(p_this, "moov is %"PRIu64" bytes, %"PRIu64" reserved",
+                i_moov_size, i_reserve);
+        if (i_moov_size == i_reserve || i_moov_size + 8 <= i_reserve)
+        {
+            i_moov_pos = p_sys->i_moov_reserve_pos;
+            i_free = i_reserve - i_moov_size;
+            p_sys->b_fast_start = false;
+        }
+        else
+            msg_Warn(p_this, "space reserved for moov is too small, %s",
+                     p_sys->b_fast_start ? "moving data"
+                                         : "writing it at the end");
+    }
+
     while (p_sys->b_fast_start && moov && moov->b)
     {
         /* Move data to the end of the file so we can fit the moov header
@@ -358,7 +439,7 @@ static void Close(vlc_object_t *p_this)
         uint64_t i_mdatsize = p_sys->i_pos - p_sys->i_mdat_pos;
 
         /* moving samples will need new moov with 64bit atoms ? */
-        if(!b_64bitext && p_sys->i_pos + bo_size(moov) > UINT32_MAX)
+        if(!b_64bitext && p_sys->i_pos + bo_size(moov) + 8 > UINT32_MAX)
         {
             mp4mux_Set64BitExt(p_sys->muxh);
             b_64bitext = true;
@@ -370,11 +451,15 @@ static void Close(vlc_object_t *p_this)
                 moov = moov64;
             }
         }
-        /* We now know our final MOOV size */
+        /* We now know our final MOOV size: the data moves by what the
+         * reserved space lacks, plus a free box for the remainder */
+        uint64_t i_shift = bo_size(moov);
+        if (i_reserve > 0)
+            i_shift += 8 - i_reserve;
 
         /* Fix-up samples to chunks table in MOOV header to they point to next MDAT location */
-        mp4mux_ShiftSamples(p_sys->muxh, bo_size(moov));
-        msg_Dbg(p_this,"Moving data by %"PRIu64, (uint64_t)bo_size(moov));
+        mp4mux_ShiftSamples(p_sys->muxh, i_shift);
+        msg_Dbg(p_this,"Moving data by %"PRIu64, i_shift);
         bo_t *shifted = mp4mux_GetMoov(p_sys->muxh, VLC_OBJECT(p_mux), 0);
         if(!shifted)
         {
@@ -386,7 +471,26 @@ static void Close(vlc_object_t *p_this)
         bo_free(moov);
         moov = shifted;
 
-        /* Make space, move MDAT data by moov size towards the end */
+        /* Make space, move MDAT data by moov size towards the end, within
+         * the output if it can, otherwise through read/write */
+        if (sout_AccessOutControl(p_mux->p_access, ACCESS_OUT_COPY_RANGE,
+                                  (uint64_t)0, (uint64_t)0,
+                                  (uint64_t)0) == VLC_SUCCESS)
+        {
+            if (sout_AccessOutControl(p_mux->p_access, ACCESS_OUT_COPY_RANGE,
+                                      p_sys->i_mdat_pos,
+                                      p_sys->i_mdat_pos + i_shift,
+                                      i_mdatsize) != VLC_SUCCESS)
+            {
+                /* Part of the data may be overwritten already: copying it
+                 * again through read/write would only hide the damage */
+                msg_Err(p_this, "cannot move data, the file is corrupted");
+                bo_free(moov);
+                goto cleanup;
+            }
+            i_mdatsize = 0;
+        }
+
         while (i_mdatsize > 0)
         {
             size_t i_chunk = __MIN(32768, i_mdatsize);
@@ -402,7 +506,7 @@ static void Close(vlc_object_t *p_this)
                 break;
             }
             sout_AccessOutSeek(p_mux->p_access, p_sys->i_mdat_pos + i_mdatsize +
-                               bo_size(moov) - i_chunk);
+                               i_shift - i_chunk);
             sout_AccessOutWrite(p_mux->p_access, p_buf);
             i_mdatsize -= i_chunk;
         }
@@ -411,8 +515,14 @@ static void Close(vlc_object_t *p_this)
             continue;
 
         /* Update pos pointers */
-        i_moov_pos = p_sys->i_mdat_pos;
-        p_sys->i_mdat_pos += bo_size(moov);
+        if (i_reserve > 0)
+        {
+            i_moov_pos = p_sys->i_moov_reserve_pos;
+            i_free = 8;
+        }
+        else
+            i_moov_pos = p_sys->i_mdat_pos;
+        p_sys->i_mdat_pos += i_shift;
 
         p_sys->b_fast_start = false;
     }
@@ -422,6 +532,17 @@ static void Close(vlc_object_t *p_this)
     if (moov != NULL)
         box_send(p_mux, moov);
 
+    if (i_free > 0)
+    {
+        block_t *p_free = block_Alloc(8);
+        if (p_free)
+        {
+            SetDWBE(p_free->p_buffer, i_free);
+            memcpy(&p_free->p_buffer[4], "free", 4);
+            sout_AccessOutWrite(p_mux->p_access, p_free);
+        }
+    }
+
 cleanup:
     /* Clean-up */
     for (unsigned int i_trak = 0; i_trak < p_sys->i_nb_streams; i_trak++)
@@ -901,8 +1022,6 @@ static void box_send(sout_mux_t *p_mux,  bo_t *box)
 /***************************************************************************
     MP4 Live submodule
 ****************************************************************************/
-#define FRAGMENT_LENGTH  VLC_TICK_FROM_MS(1500)
-
 #define ENQUEUE_ENTRY(object, entry) \
     do {\
         if (object.p_last)\
@@ -967,6 +1086,8 @@ static bo_t *GetMoofBox(sout_mux_t *p_mux, size_t *pi_mdat_total_size,
 
     bo_t            *moof, *mfhd;
     size_t           i_fixupoffset = 0;
+    vlc_tick_t       i_fragment_length = 0;
+    bool             b_sync = true;
 
     *pi_mdat_total_size = 0;
 
@@ -1070,7 +1191,10 @@ static bo_t *GetMoofBox(sout_mux_t *p_mux, size_t *pi_mdat_total_size,
             uint32_t i_trun_flags = 0x0;
 
             if (p_stream->b_hasiframes && !(p_stream->read.p_first->p_block->i_flags & BLOCK_FLAG_TYPE_I))
+            {
                 i_trun_flags |= MP4_TRUN_FIRST_FLAGS;
+                b_sync = false;
+            }
 
             if (!b_allsamelength ||
                 ( !(i_tfhd_flags & MP4_TFHD_DFLT_SAMPLE_DURATION) &&
@@ -1157,6 +1281,9 @@ static bo_t *GetMoofBox(sout_mux_t *p_mux, size_t *pi_mdat_total_size,
                 i_time += p_entry->p_block->i_length;
             }
 
+            if (i_time - p_stream->i_written_duration > i_fragment_length)
+                i_fragment_length = i_time - p_stream->i_written_duration;
+
             box_gather(traf, trun);
         }
 
@@ -1178,8 +1305,12 @@ static bo_t *GetMoofBox(sout_mux_t *p_mux, size_t *pi_mdat_total_size,
         bo_set_32be(moof, i_fixupoffset, bo_size(moof) + 8);
     }
 
-    /* set iframe flag, so the streaming server always starts from moof */
-    moof->b->i_flags |= BLOCK_FLAG_TYPE_I;
+    /* set iframe flag, so the streaming server always starts from moof,
+     * and with CMAF chunks, from one starting with a keyframe */
+    if (b_sync || !p_sys->b_chunked)
+        moof->b->i_flags |= BLOCK_FLAG_TYPE_I;
+    /* and its duration, so segmenters can cut on fragments */
+    moof->b->i_length = i_fragment_length;
 
     return moof;
 }
@@ -1211,6 +1342,7 @@ static void WriteFragmentMDAT(sout_mux_t *p_mux, size_t i_total_size)
             p_stream->i_written_duration += p_entry->p_block->i_length;
 
             p_entry->p_block->i_flags &= ~BLOCK_FLAG_TYPE_I; // clear flag for http stream
+            p_entry->p_block->i_length = 0; // already accounted by the moof
             sout_AccessOutWrite(p_mux->p_access, p_entry->p_block);
 
             p_stream->towrite.p_first = p_entry->p_next;
@@ -1288,7 +1420,7 @@ static void WriteFragments(sout_mux_t *p_mux, bool b_flush)
 {
     sout_mux_sys_t *p_sys = (sout_mux_sys_t*) p_mux->p_sys;
     bo_t *moof = NULL;
-    vlc_tick_t i_barrier_time = p_sys->i_written_duration + FRAGMENT_LENGTH;
+    vlc_tick_t i_barrier_time = p_sys->i_written_duration + p_sys->i_fragment_length;
     size_t i_mdat_size = 0;
     bool b_has_samples = false;
 
@@ -1336,7 +1468,7 @@ static void WriteFragments(sout_mux_t *p_mux, bool b_flush)
     {
         msg_Dbg(p_mux, "writing moof @ %"PRId64, p_sys->i_pos);
         p_sys->i_pos += bo_size(moof);
-        assert(moof->b->i_flags & BLOCK_FLAG_TYPE_I); /* http sout */
+        assert(p_sys->b_chunked || (moof->b->i_flags & BLOCK_FLAG_TYPE_I)); /* http sout */
         box_send(p_mux, moof);
         msg_Dbg(p_mux, "writing mdat @ %"PRId64, p_sys->i_pos);
         WriteFragmentMDAT(p_mux, i_mdat_size);
@@ -1476,7 +1608,7 @@ static int MuxFrag(sout_mux_t *p_mux)
         p_stream->p_held_entry = NULL;
 
         if (p_stream->b_hasiframes && (p_heldblock->i_flags & BLOCK_FLAG_TYPE_I) &&
-            mp4mux_track_GetDuration(p_stream->tinfo) - p_sys->i_written_duration < FRAGMENT_LENGTH)
+            mp4mux_track_GetDuration(p_stream->tinfo) - p_sys->i_written_duration < p_sys->i_fragment_length)
         {
             /* Flag the last iframe time, we'll use it as boundary so it will start
                next fragment */
@@ -1529,7 +1661,8 @@ static int MuxFrag(sout_mux_t *p_mux)
     p_sys->i_written_duration = i_min_written_duration;
 
     /* we have prerolled enough to know all streams, and have enough date to create a fragment */
-    if (p_stream->read.p_first && p_sys->i_read_duration - p_sys->i_written_duration >= FRAGMENT_LENGTH)
+    if (p_stream->read.p_first &&
+        p_sys->i_read_duration - p_sys->i_written_duration >= p_sys->i_fragment_length)
         WriteFragments(p_mux, false);
 
     return VLC_SUCCESS;
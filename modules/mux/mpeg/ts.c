@@ -182,6 +182,10 @@ static const char *const ts_standards_list_text[] =
 #define CU_LONGTEXT N_("CSA encryption key used. It can be the odd/first/1 " \
   "(default) or the even/second/2 one.")
 
+#define THREADS_TEXT N_("Packetization threads")
+#define THREADS_LONGTEXT N_("Number of threads filling TS packets payload " \
+  "(0 to do it in the muxer thread). Useful with many or high bitrate streams.")
+
 #define CPKT_TEXT N_("Packet size in bytes to encrypt")
 #define CPKT_LONGTEXT N_("Size of the TS packet to encrypt. " \
     "The encryption routines subtract the TS-header from the value before " \
@@ -229,6 +233,8 @@ vlc_module_begin ()
     add_integer( SOUT_CFG_PREFIX "bmin", 0, BMIN_TEXT, BMIN_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "bmax", 0, BMAX_TEXT, BMAX_LONGTEXT, true)
     add_integer( SOUT_CFG_PREFIX "dts-delay", 400, DTS_TEXT, DTS_LONGTEXT, true)
+    add_integer_with_range( SOUT_CFG_PREFIX "threads", 0, 0, 16,
+                            THREADS_TEXT, THREADS_LONGTEXT, true )
 
     add_bool( SOUT_CFG_PREFIX "crypt-audio", true, ACRYPT_TEXT, ACRYPT_LONGTEXT, true)
     add_bool( SOUT_CFG_PREFIX "crypt-video", true, VCRYPT_TEXT, VCRYPT_LONGTEXT, true)
@@ -249,7 +255,7 @@ static const char *const ppsz_sout_options[] = {
     "netid", "sdtdesc",
     "es-id-pid", "shaping", "pcr", "bmin", "bmax", "use-key-frames",
     "dts-delay", "csa-ck", "csa2-ck", "csa-use", "csa-pkt", "crypt-audio", "crypt-video",
-    "muxpmt", "program-pmt", "alignment",
+    "muxpmt", "program-pmt", "alignment", "threads",
     NULL
 };
 
@@ -323,6 +329,198 @@ static inline void BufferChainClean( sout_buffer_chain_t *c )
     BufferChainInit( c );
 }
 
+/* TS packets of a mux interval are carved from a single allocation.
+ * Headers are written while scheduling, payloads are copied afterwards,
+ * possibly from several threads, and the storage is freed once every
+ * packet has been released by the access output. */
+typedef struct ts_arena_t ts_arena_t;
+
+typedef struct
+{
+    block_t        self;
+    ts_arena_t    *p_arena;
+    const uint8_t *p_src;   /* payload to copy at the end of the packet */
+    int            i_src;
+    uint8_t        p_data[188];
+} ts_slot_t;
+
+struct ts_arena_t
+{
+    atomic_uint i_refs;
+    unsigned    i_count;
+    unsigned    i_used;
+    ts_slot_t   slots[];
+};
+
+#define TS_FILL_MIN_PACKETS 1024 /* per thread */
+
+static void ArenaRelease( ts_arena_t *p_arena )
+{
+    if( atomic_fetch_sub_explicit( &p_arena->i_refs, 1, memory_order_acq_rel ) == 1 )
+        free( p_arena );
+}
+
+static void ArenaSlotRelease( block_t *p_block )
+{
+    ts_slot_t *p_slot = container_of( p_block, ts_slot_t, self );
+    ArenaRelease( p_slot->p_arena );
+}
+
+static const struct vlc_block_callbacks ts_slot_cbs =
+{
+    ArenaSlotRelease,
+};
+
+static ts_arena_t *ArenaNew( unsigned i_count )
+{
+    ts_arena_t *p_arena = malloc( sizeof(*p_arena) + sizeof(ts_slot_t) * i_count );
+    if( p_arena )
+    {
+        atomic_init( &p_arena->i_refs, 1 );
+        p_arena->i_count = i_count;
+        p_arena->i_used = 0;
+    }
+    return p_arena;
+}
+
+static block_t *ArenaGet( ts_arena_t *p_arena )
+{
+    if( p_arena->i_used == p_arena->i_count )
+        return NULL;
+
+    ts_slot_t *p_slot = &p_arena->slots[p_arena->i_used++];
+    p_slot->p_arena = p_arena;
+    p_slot->p_src = NULL;
+    p_slot->i_src = 0;
+    atomic_fetch_add_explicit( &p_arena->i_refs, 1, memory_order_relaxed );
+    return block_Init( &p_slot->self, &ts_slot_cbs, p_slot->p_data, 188 );
+}
+
+static void ArenaFillRange( ts_arena_t *p_arena, unsigned i_start, unsigned i_end )
+{
+    for( unsigned i = i_start; i < i_end; i++ )
+    {
+        ts_slot_t *p_slot = &p_arena->slots[i];
+        memcpy( &p_slot->p_data[188 - p_slot->i_src], p_slot->p_src, p_slot->i_src );
+    }
+}
+
+/* Threads copying payloads along with the muxer thread, started by Open() */
+typedef struct
+{
+    vlc_mutex_t lock;
+    vlc_cond_t  wait_work;  /* ranges to fill, or closing (threads) */
+    vlc_cond_t  wait_done;  /* all ranges filled (muxer) */
+    ts_arena_t *p_arena;    /* arena being filled, or NULL */
+    unsigned    i_jobs;
+    unsigned    i_next;
+    unsigned    i_done;
+    bool        b_closing;
+
+    unsigned     i_threads;
+    vlc_thread_t threads[];
+} ts_fill_pool_t;
+
+/* Fills the ranges left, with the pool lock held */
+static void FillPoolRun( ts_fill_pool_t *p_pool )
+{
+    while( p_pool->p_arena && p_pool->i_next < p_pool->i_jobs )
+    {
+        ts_arena_t *p_arena = p_pool->p_arena;
+        unsigned i = p_pool->i_next++;
+        unsigned i_start = p_arena->i_used * i / p_pool->i_jobs;
+        unsigned i_end = p_arena->i_used * (i + 1) / p_pool->i_jobs;
+
+        vlc_mutex_unlock( &p_pool->lock );
+        ArenaFillRange( p_arena, i_start, i_end );
+        vlc_mutex_lock( &p_pool->lock );
+
+        if( ++p_pool->i_done == p_pool->i_jobs )
+            vlc_cond_signal( &p_pool->wait_done );
+    }
+}
+
+static void *FillPoolThread( void *p_data )
+{
+    ts_fill_pool_t *p_pool = p_data;
+
+    vlc_mutex_lock( &p_pool->lock );
+    while( !p_pool->b_closing )
+    {
+        if( p_pool->p_arena && p_pool->i_next < p_pool->i_jobs )
+            FillPoolRun( p_pool );
+        else
+            vlc_cond_wait( &p_pool->wait_work, &p_pool->lock );
+    }
+    vlc_mutex_unlock( &p_pool->lock );
+    return NULL;
+}
+
+static void FillPoolDelete( ts_fill_pool_t *p_pool )
+{
+    vlc_mutex_lock( &p_pool->lock );
+    p_pool->b_closing = true;
+    vlc_cond_broadcast( &p_pool->wait_work );
+    vlc_mutex_unlock( &p_pool->lock );
+
+    for( unsigned i = 0; i < p_pool->i_threads; i++ )
+        vlc_join( p_pool->threads[i], NULL );
+    free( p_pool );
+}
+
+static ts_fill_pool_t *FillPoolNew( unsigned i_threads )
+{
+    ts_fill_pool_t *p_pool = malloc( sizeof(*p_pool) + sizeof(vlc_thread_t) * i_threads );
+    if( !p_pool )
+        return NULL;
+
+    vlc_mutex_init( &p_pool->lock );
+    vlc_cond_init( &p_pool->wait_work );
+    vlc_cond_init( &p_pool->wait_done );
+    p_pool->p_arena = NULL;
+    p_pool->i_jobs = p_pool->i_next = p_pool->i_done = 0;
+    p_pool->b_closing = false;
+    p_pool->i_threads = 0;
+
+    while( p_pool->i_threads < i_threads )
+    {
+        if( vlc_clone( &p_pool->threads[p_pool->i_threads], FillPoolThread,
+                       p_pool, VLC_THREAD_PRIORITY_OUTPUT ) )
+        {
+            FillPoolDelete( p_pool );
+            return NULL;
+        }
+        p_pool->i_threads++;
+    }
+    return p_pool;
+}
+
+/* Copies all payloads, sharing the work with the pool threads if any */
+static void ArenaFill( ts_arena_t *p_arena, ts_fill_pool_t *p_pool )
+{
+    unsigned i_jobs = p_pool ? p_pool->i_threads + 1 : 1;
+    i_jobs = __MIN( i_jobs, p_arena->i_used / TS_FILL_MIN_PACKETS );
+    if( i_jobs < 2 )
+    {
+        ArenaFillRange( p_arena, 0, p_arena->i_used );
+        return;
+    }
+
+    vlc_mutex_lock( &p_pool->lock );
+    p_pool->p_arena = p_arena;
+    p_pool->i_jobs = i_jobs;
+    p_pool->i_next = 0;
+    p_pool->i_done = 0;
+    vlc_cond_broadcast( &p_pool->wait_work );
+
+    /* the muxer thread takes its share */
+    FillPoolRun( p_pool );
+    while( p_pool->i_done < p_pool->i_jobs )
+        vlc_cond_wait( &p_pool->wait_done, &p_pool->lock );
+    p_pool->p_arena = NULL;
+    vlc_mutex_unlock( &p_pool->lock );
+}
+
 typedef struct
 {
     sout_buffer_chain_t chain_pes;
@@ -385,6 +583,8 @@ typedef struct
     int             i_csa_pkt_size;
     bool            b_crypt_audio;
     bool            b_crypt_video;
+
+    ts_fill_pool_t  *p_fill_pool;
 } sout_mux_sys_t;
 
 
@@ -480,7 +680,8 @@ static void TSDate      ( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
 static void GetPAT( sout_mux_t *p_mux, sout_buffer_chain_t *c );
 static void GetPMT( sout_mux_t *p_mux, sout_buffer_chain_t *c );
 
-static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream, bool b_pcr );
+static block_t *TSNew( ts_arena_t *, sout_buffer_chain_t *p_done,
+                       sout_input_sys_t *p_stream, bool b_pcr );
 static void TSSetPCR( block_t *p_ts, vlc_tick_t i_dts );
 
 static csa_t *csaSetup( vlc_object_t *p_this )
@@ -740,6 +941,16 @@ static int Open( vlc_object_t *p_this )
 
     p_sys->b_use_key_frames = var_GetBool( p_mux, SOUT_CFG_PREFIX "use-key-frames" );
 
+    unsigned i_threads = var_GetInteger( p_mux, SOUT_CFG_PREFIX "threads" );
+    if( i_threads > 1 )
+    {
+        /* the muxer thread is one of them */
+        p_sys->p_fill_pool = FillPoolNew( i_threads - 1 );
+        if( !p_sys->p_fill_pool )
+            msg_Warn( p_mux, "cannot start threads, packetizing from the "
+                             "muxer thread" );
+    }
+
     p_mux->p_sys        = p_sys;
 
     p_sys->csa = csaSetup(p_this);
@@ -777,6 +988,9 @@ static void Close( vlc_object_t * p_this )
         free( p_sys->sdt.desc[i].psz_provider );
     }
 
+    if( p_sys->p_fill_pool )
+        FillPoolDelete( p_sys->p_fill_pool );
+
     free( p_sys );
 }
 
@@ -1484,6 +1698,23 @@ static bool MuxStreams(sout_mux_t *p_mux )
     /* add overhead for PCR (not really exact) */
     i_packet_count += (8 * i_pcr_length / p_sys->i_pcr_delay + 175) / 176;
 
+    /* upper bound for the packets storage: every queued PES fully sent
+     * with smallest (PCR) payloads */
+    unsigned i_packet_max = 0;
+    for (int i = 0; i < p_mux->i_nb_inputs; i++ )
+    {
+        sout_input_sys_t *p_stream = (sout_input_sys_t*)p_mux->pp_inputs[i]->p_sys;
+        for (block_t *p_pes = p_stream->state.chain_pes.p_first; p_pes != NULL;
+             p_pes = p_pes->p_next )
+            i_packet_max += 1 + p_pes->i_buffer / 176;
+    }
+
+    ts_arena_t *p_arena = ArenaNew( i_packet_max );
+    if( unlikely(!p_arena) )
+        return true;
+    sout_buffer_chain_t chain_done;
+    BufferChainInit( &chain_done );
+
     /* 3: mux PES into TS */
     BufferChainInit( &chain_ts );
     /* append PAT/PMT  -> FIXME with big pcr delay it won't have enough pat/pmt */
@@ -1536,7 +1767,9 @@ static bool MuxStreams(sout_mux_t *p_mux )
         }
 
         /* Build the TS packet */
-        block_t *p_ts = TSNew( p_mux, p_stream, b_pcr );
+        block_t *p_ts = TSNew( p_arena, &chain_done, p_stream, b_pcr );
+        if( unlikely(!p_ts) )
+            break;
         if( p_sys->csa != NULL &&
              (p_input->p_fmt->i_cat != AUDIO_ES || p_sys->b_crypt_audio) &&
              (p_input->p_fmt->i_cat != VIDEO_ES || p_sys->b_crypt_video) )
@@ -1569,7 +1802,12 @@ static bool MuxStreams(sout_mux_t *p_mux )
         BufferChainAppend( &chain_ts, p_ts );
     }
 
-    /* 4: date and send */
+    /* 4: copy payloads, now that all PES have been laid out */
+    ArenaFill( p_arena, p_sys->p_fill_pool );
+    BufferChainClean( &chain_done );
+    ArenaRelease( p_arena );
+
+    /* 5: date and send */
     TSSchedule( p_mux, &chain_ts, i_pcr_length, i_pcr_dts );
     return false;
 }
@@ -1811,10 +2049,9 @@ static void TSDate( sout_mux_t *p_mux, sout_buffer_chain_t *p_chain_ts,
     }
 }
 
-static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
-                       bool b_pcr )
+static block_t *TSNew( ts_arena_t *p_arena, sout_buffer_chain_t *p_done,
+                       sout_input_sys_t *p_stream, bool b_pcr )
 {
-    VLC_UNUSED(p_mux);
     block_t *p_pes = p_stream->state.chain_pes.p_first;
 
     bool b_new_pes = false;
@@ -1834,7 +2071,9 @@ static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
         b_adaptation_field = true;
     }
 
-    block_t *p_ts = block_Alloc( 188 );
+    block_t *p_ts = ArenaGet( p_arena );
+    if( unlikely(!p_ts) )
+        return NULL;
 
     if (b_new_pes && !(p_pes->i_flags & BLOCK_FLAG_NO_KEYFRAME) && p_pes->i_flags & BLOCK_FLAG_TYPE_I)
     {
@@ -1880,9 +2119,10 @@ static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
         }
     }
 
-    /* copy payload */
-    memcpy( &p_ts->p_buffer[188 - i_payload],
-            &p_pes->p_buffer[p_stream->state.i_pes_used], i_payload );
+    /* payload is copied by ArenaFill() */
+    ts_slot_t *p_slot = container_of( p_ts, ts_slot_t, self );
+    p_slot->p_src = &p_pes->p_buffer[p_stream->state.i_pes_used];
+    p_slot->i_src = i_payload;
 
     p_stream->state.i_pes_used += i_payload;
     p_stream->state.i_pes_dts = p_pes->i_dts + p_pes->i_length *
@@ -1891,7 +2131,8 @@ static block_t *TSNew( sout_mux_t *p_mux, sout_input_sys_t *p_stream,
 
     if( p_stream->state.i_pes_used >= (int)p_pes->i_buffer )
     {
-        block_Release(BufferChainGet( &p_stream->state.chain_pes ));
+        /* still referenced by the packets until filled */
+        BufferChainAppend( p_done, BufferChainGet( &p_stream->state.chain_pes ) );
 
         p_pes = p_stream->state.chain_pes.p_first;
         p_stream->state.i_pes_length = 0;
@@ -35,6 +35,13 @@
 #include <vlc_fs.h>
 #include <vlc_interrupt.h>
 
+/* Reads are sized to about this much of the source throughput */
+#define PREFETCH_READ_PERIOD   VLC_TICK_FROM_MS(100)
+#define PREFETCH_READ_MIN      (16 << 10)
+/* The buffer aims at holding this long of consumed data, plus a few reads */
+#define PREFETCH_TARGET        VLC_TICK_FROM_SEC(2)
+#define PREFETCH_RATE_PERIOD   VLC_TICK_FROM_SEC(1)
+
 struct stream_ctrl
 {
     struct stream_ctrl *next;
@@ -75,9 +82,27 @@ typedef struct
     char        *buffer;
     size_t       seek_threshold;
 
+    /* adaptation, protected by the lock */
+    size_t       buffer_max;
+    size_t       read_size;
+    uint64_t     input_rate;   /* bytes per second, smoothed */
+    uint64_t     output_rate;  /* bytes per second, smoothed */
+    vlc_tick_t   latency;      /* per read, smoothed */
+    uint64_t     output_bytes; /* consumed since output_date */
+    vlc_tick_t   output_date;
+    unsigned     stalls;
+    unsigned     adapted_stalls; /* stalls seen by the last adaptation */
+    bool         consumed;     /* data was read since opening or seeking */
+    unsigned     resizes;
+
     struct stream_ctrl *controls;
 } stream_sys_t;
 
+static uint64_t Smooth(uint64_t avg, uint64_t sample)
+{
+    return avg ? (avg * 7 + sample) / 8 : sample;
+}
+
 static ssize_t ThreadRead(stream_t *stream, void *buf, size_t length)
 {
     stream_sys_t *sys = stream->p_sys;
@@ -85,12 +110,103 @@ static ssize_t ThreadRead(stream_t *stream, void *buf, size_t length)
     vlc_mutex_unlock(&sys->lock);
     assert(length > 0);
 
+    vlc_tick_t start = vlc_tick_now();
     ssize_t val = vlc_stream_ReadPartial(stream->s, buf, length);
+    vlc_tick_t duration = vlc_tick_now() - start;
 
     vlc_mutex_lock(&sys->lock);
+    if (val > 0)
+    {
+        sys->latency = Smooth(sys->latency, duration);
+        if (duration > 0)
+            sys->input_rate = Smooth(sys->input_rate,
+                                     val * CLOCK_FREQ / duration);
+    }
     return val;
 }
 
+/**
+ * Moves the buffered data to a larger buffer, at the same offsets modulo its
+ * size.
+ */
+static int BufferResize(stream_t *stream, size_t size)
+{
+    stream_sys_t *sys = stream->p_sys;
+
+    assert(size >= sys->buffer_length);
+
+    char *buf = malloc(size);
+    if (unlikely(buf == NULL))
+        return -1;
+
+    for (size_t done = 0; done < sys->buffer_length;)
+    {
+        uint64_t pos = sys->buffer_offset + done;
+        size_t from = pos % sys->buffer_size;
+        size_t to = pos % size;
+        size_t len = sys->buffer_length - done;
+
+        if (len > sys->buffer_size - from)
+            len = sys->buffer_size - from;
+        if (len > size - to)
+            len = size - to;
+        memcpy(buf + to, sys->buffer + from, len);
+        done += len;
+    }
+
+    free(sys->buffer);
+    sys->buffer = buf;
+    sys->buffer_size = size;
+    return 0;
+}
+
+/**
+ * Sizes the reads after the source throughput, and grows the buffer to hold
+ * a few seconds of consumed data, or more if the reader had to wait.
+ */
+static void ThreadAdapt(stream_t *stream)
+{
+    stream_sys_t *sys = stream->p_sys;
+
+    size_t read_size = sys->input_rate * PREFETCH_READ_PERIOD / CLOCK_FREQ;
+    if (read_size < PREFETCH_READ_MIN)
+        read_size = PREFETCH_READ_MIN;
+    if (read_size > sys->buffer_size / 4)
+        read_size = sys->buffer_size / 4;
+    sys->read_size = read_size;
+
+    if (sys->buffer_size >= sys->buffer_max)
+        return;
+
+    /* enough to ride over a few slow reads, at the consumption rate */
+    uint64_t target = sys->output_rate
+                    * (PREFETCH_TARGET + 4 * sys->latency) / CLOCK_FREQ
+                    + 4 * sys->read_size;
+    if (sys->stalls != sys->adapted_stalls)
+    {   /* the reader waited for data: the buffer was too short */
+        sys->adapted_stalls = sys->stalls;
+        if (target < 2 * sys->buffer_size)
+            target = 2 * sys->buffer_size;
+    }
+
+    /* grow by large steps only, it takes a copy */
+    if (target <= sys->buffer_size + sys->buffer_size / 4)
+        return;
+    if (target > sys->buffer_max)
+        target = sys->buffer_max;
+
+    if (BufferResize(stream, target) == 0)
+    {
+        sys->resizes++;
+        msg_Dbg(stream, "buffer grown to %zu bytes (in: %"PRIu64" B/s, "
+                "out: %"PRIu64" B/s, latency: %"PRId64" us, stalls: %u)",
+                sys->buffer_size, sys->input_rate, sys->output_rate,
+                US_FROM_VLC_TICK(sys->latency), sys->stalls);
+    }
+    else
+        sys->buffer_max = sys->buffer_size; /* give up */
+}
+
 static int ThreadSeek(stream_t *stream, uint64_t seek_offset)
 {
     stream_sys_t *sys = stream->p_sys;
@@ -241,6 +357,9 @@ static void *Thread(void *data)
          /* Do not step past the sharp edge of the circular buffer */
         if (offset + len > sys->buffer_size)
             len = sys->buffer_size - offset;
+        /* Smaller reads hand data to the reader earlier */
+        if (len > sys->read_size)
+            len = sys->read_size;
 
         ssize_t val = ThreadRead(stream, sys->buffer + offset, len);
         if (val < 0)
@@ -258,6 +377,7 @@ static void *Thread(void *data)
         //msg_Dbg(stream, "buffer: %zu/%zu", sys->buffer_length,
         //        sys->buffer_size);
         vlc_cond_signal(&sys->wait_data);
+        ThreadAdapt(stream);
     }
 
     sys->error = true;
@@ -273,6 +393,7 @@ static int Seek(stream_t *stream, uint64_t offset)
     vlc_mutex_lock(&sys->lock);
     sys->stream_offset = offset;
     sys->error = false;
+    sys->consumed = false;
     vlc_cond_signal(&sys->wait_space);
     vlc_mutex_unlock(&sys->lock);
     return 0;
@@ -311,6 +432,8 @@ static ssize_t Read(stream_t *stream, void *buf, size_t buflen)
         vlc_cond_signal(&sys->wait_space);
     }
 
+    bool stalled = false;
+
     while ((copy = BufferLevel(stream, &eof)) == 0 && !eof)
     {
         void *data[2];
@@ -321,6 +444,16 @@ static ssize_t Read(stream_t *stream, void *buf, size_t buflen)
             return 0;
         }
 
+        if (!stalled)
+        {
+            stalled = true;
+            /* Only an empty buffer drained by the reader means it was too
+             * short, not one yet to be filled after opening or seeking. */
+            if (sys->consumed)
+                sys->stalls++;
+            vlc_cond_signal(&sys->wait_space);
+        }
+
         vlc_interrupt_forward_start(sys->interrupt, data);
         vlc_cond_wait(&sys->wait_data, &sys->lock);
         vlc_interrupt_forward_stop(data);
@@ -335,6 +468,18 @@ static ssize_t Read(stream_t *stream, void *buf, size_t buflen)
 
     memcpy(buf, sys->buffer + offset, copy);
     sys->stream_offset += copy;
+    sys->consumed = true;
+
+    /* measure the consumption rate over periods of about a second */
+    vlc_tick_t now = vlc_tick_now();
+    sys->output_bytes += copy;
+    if (now - sys->output_date >= PREFETCH_RATE_PERIOD)
+    {
+        sys->output_rate = Smooth(sys->output_rate, sys->output_bytes
+                                  * CLOCK_FREQ / (now - sys->output_date));
+        sys->output_bytes = 0;
+        sys->output_date = now;
+    }
     vlc_cond_signal(&sys->wait_space);
     vlc_mutex_unlock(&sys->lock);
     return copy;
@@ -379,6 +524,25 @@ static int Control(stream_t *stream, int query, va_list args)
         case STREAM_GET_SIGNAL:
         case STREAM_GET_TAGS:
             return VLC_EGENERIC;
+        case STREAM_GET_BUFFER_STATS:
+        {
+            struct vlc_stream_buffer_stats *stats =
+                va_arg(args, struct vlc_stream_buffer_stats *);
+            bool eof;
+
+            vlc_mutex_lock(&sys->lock);
+            stats->size = sys->buffer_size;
+            stats->max_size = sys->buffer_max;
+            stats->fill = BufferLevel(stream, &eof);
+            stats->read_size = sys->read_size;
+            stats->input_rate = sys->input_rate;
+            stats->output_rate = sys->output_rate;
+            stats->latency = sys->latency;
+            stats->stalls = sys->stalls;
+            stats->resizes = sys->resizes;
+            vlc_mutex_unlock(&sys->lock);
+            break;
+        }
         case STREAM_SET_PAUSE_STATE:
         {
             bool paused = va_arg(args, unsigned);
@@ -463,6 +627,7 @@ static int Open(vlc_object_t *obj)
     sys->stream_offset = 0;
     sys->buffer_length = 0;
     sys->buffer_size = var_InheritInteger(obj, "prefetch-buffer-size") << 10u;
+    sys->buffer_max = var_InheritInteger(obj, "prefetch-max-buffer-size") << 10u;
     sys->seek_threshold = var_InheritInteger(obj, "prefetch-seek-threshold");
     sys->controls = NULL;
 
@@ -471,7 +636,22 @@ static int Open(vlc_object_t *obj)
     {   /* No point allocating a buffer larger than the source stream */
         if (sys->buffer_size > size)
             sys->buffer_size = size;
+        if (sys->buffer_max > size)
+            sys->buffer_max = size;
     }
+    if (sys->buffer_max < sys->buffer_size)
+        sys->buffer_max = sys->buffer_size;
+
+    sys->read_size = sys->buffer_size;
+    sys->input_rate = 0;
+    sys->output_rate = 0;
+    sys->latency = 0;
+    sys->output_bytes = 0;
+    sys->output_date = vlc_tick_now();
+    sys->stalls = 0;
+    sys->adapted_stalls = 0;
+    sys->consumed = false;
+    sys->resizes = 0;
 
     sys->buffer = malloc(sys->buffer_size);
     if (sys->buffer == NULL)
@@ -545,6 +725,10 @@ vlc_module_begin()
     add_integer("prefetch-buffer-size", 1 << 14, N_("Buffer size"),
                 N_("Prefetch buffer size (KiB)"), false)
         change_integer_range(4, 1 << 20)
+    add_integer("prefetch-max-buffer-size", 1 << 16, N_("Maximum buffer size"),
+                N_("The buffer grows up to this size (KiB) when the data "
+                   "is consumed faster than the source latency allows"), true)
+        change_integer_range(4, 1 << 20)
     add_obsolete_integer("prefetch-read-size") /* since 4.0.0 */
     add_integer("prefetch-seek-threshold", 1 << 14, N_("Seek threshold"),
                 N_("Prefetch forward seek threshold (bytes)"), true)
@@ -288,23 +288,26 @@ int transcode_audio_process( sout_stream_t *p_stream,
                 vlc_mutex_unlock(&id->fifo.lock);
                 goto error;
             }
+        }
 
-            if( !id->downstream_id )
-                id->downstream_id =
-                    id->pf_transcode_downstream_add( p_stream,
-                                                     &id->p_decoder->fmt_in,
-                                                     transcode_encoder_format_out( id->encoder ) );
+        vlc_mutex_unlock(&id->fifo.lock);
+
+        /* Not under the fifo lock: it may wait for the thread feeding the
+         * stream, which reads the drift under that lock */
+        if( !id->downstream_id )
+        {
+            id->downstream_id =
+                id->pf_transcode_downstream_add( p_stream, id,
+                                                 &id->p_decoder->fmt_in,
+                                                 transcode_encoder_format_out( id->encoder ) );
             if( !id->downstream_id )
             {
                 msg_Err( p_stream, "cannot output transcoded stream %4.4s",
                                    (char *) &id->p_enccfg->i_codec );
-                vlc_mutex_unlock(&id->fifo.lock);
                 goto error;
             }
         }
 
-        vlc_mutex_unlock(&id->fifo.lock);
-
         if( id->pf_drift_validate )
         {
             vlc_tick_t i_pts = date_Get( &id->next_input_pts );
@@ -45,6 +45,12 @@ typedef struct
                 int          i_priority;
                 uint32_t     pool_size;
             } threads;
+            struct
+            {
+                unsigned int i_depth; /* pictures, 0 to disable */
+                unsigned int i_threshold;
+                vlc_tick_t   i_segment;
+            } lookahead;
         } video;
         struct
         {
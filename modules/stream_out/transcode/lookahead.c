@@ -0,0 +1,386 @@
+/*****************************************************************************
+ * lookahead.c: transcoding keyframe placement
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_picture.h>
+#include "lookahead.h"
+
+/* Each thumbnail pixel is the average of a block of luma pixels */
+#define LOOKAHEAD_BLOCK 8
+/* Minimum number of pictures between two scene cut keyframes */
+#define LOOKAHEAD_MIN_DISTANCE 8
+/* Differences are in 1/16th of a luma level */
+#define LOOKAHEAD_SCALE 16
+/* Difference with no previous picture to compare with */
+#define LOOKAHEAD_UNKNOWN UINT_MAX
+
+struct lookahead_entry
+{
+    picture_t *p_pic;
+    unsigned i_diff;  /**< with the previous picture */
+    unsigned i_diff2; /**< with the picture before the previous one */
+};
+
+struct transcode_lookahead_t
+{
+    vlc_object_t *p_obj;
+    unsigned i_depth;
+    unsigned i_threshold;
+    vlc_tick_t i_segment;
+
+    vlc_thread_t thread;
+    vlc_mutex_t lock;
+    vlc_cond_t wait_request; /**< picture queued or closing (analysis) */
+    vlc_cond_t wait_result;  /**< picture analysed (encoding) */
+    bool b_closing;
+
+    /* Ring of queued pictures, the first i_analysed ones being analysed */
+    struct lookahead_entry *p_queue;
+    unsigned i_size;
+    unsigned i_first;
+    unsigned i_count;
+    unsigned i_analysed;
+
+    /* Analysis thread state: thumbnails of the last 3 pictures, the most
+     * recent first, all within p_thumbs */
+    uint8_t *p_thumbs;
+    uint8_t *pp_thumb[3];
+    uint16_t *p_columns;
+    unsigned i_thumb_width;
+    unsigned i_thumb_height;
+    unsigned i_history;
+
+    /* Encoding thread state */
+    unsigned i_average;
+    unsigned i_distance;
+    vlc_tick_t i_origin;
+    vlc_tick_t i_boundary;
+};
+
+static bool IsAnalysable( const picture_t *p_pic )
+{
+    const vlc_chroma_description_t *p_dsc =
+        vlc_fourcc_GetChromaDescription( p_pic->format.i_chroma );
+
+    /* 8 bits planar and semi-planar YUV, where the first plane is luma */
+    return p_dsc != NULL && p_dsc->plane_count >= 2 && p_dsc->pixel_size == 1
+        && vlc_fourcc_IsYUV( p_pic->format.i_chroma )
+        && p_pic->p[0].p_pixels != NULL;
+}
+
+static void Thumbnail( uint8_t *restrict p_thumb, uint16_t *restrict p_columns,
+                       const plane_t *p_luma, unsigned i_width,
+                       unsigned i_height )
+{
+    const unsigned i_columns = i_width * LOOKAHEAD_BLOCK;
+    const uint8_t *p_line = p_luma->p_pixels;
+
+    for( unsigned y = 0; y < i_height; y++ )
+    {
+        /* Sum the columns of a row of blocks, then the columns of each block */
+        memset( p_columns, 0, i_columns * sizeof(*p_columns) );
+        for( unsigned j = 0; j < LOOKAHEAD_BLOCK; j++ )
+        {
+            for( unsigned x = 0; x < i_columns; x++ )
+                p_columns[x] += p_line[x];
+            p_line += p_luma->i_pitch;
+        }
+
+        for( unsigned x = 0; x < i_width; x++ )
+        {
+            unsigned i_sum = 0;
+            for( unsigned j = 0; j < LOOKAHEAD_BLOCK; j++ )
+                i_sum += p_columns[x * LOOKAHEAD_BLOCK + j];
+            p_thumb[x] = ( i_sum + LOOKAHEAD_BLOCK * LOOKAHEAD_BLOCK / 2 )
+                       / ( LOOKAHEAD_BLOCK * LOOKAHEAD_BLOCK );
+        }
+        p_thumb += i_width;
+    }
+}
+
+static unsigned Difference( const uint8_t *restrict p_a,
+                            const uint8_t *restrict p_b, size_t i_size )
+{
+    uint_fast32_t i_sad = 0;
+
+    for( size_t i = 0; i < i_size; i++ )
+        i_sad += abs( p_a[i] - p_b[i] );
+    return (uint64_t)i_sad * LOOKAHEAD_SCALE / i_size;
+}
+
+static void Analyse( transcode_lookahead_t *p_la, const picture_t *p_pic,
+                     struct lookahead_entry *p_result )
+{
+    const plane_t *p_luma = &p_pic->p[0];
+
+    p_result->i_diff = 0;
+    p_result->i_diff2 = LOOKAHEAD_UNKNOWN;
+
+    if( !IsAnalysable( p_pic ) )
+    {
+        p_la->i_history = 0;
+        return;
+    }
+
+    unsigned i_width = p_luma->i_visible_pitch / LOOKAHEAD_BLOCK;
+    unsigned i_height = p_luma->i_visible_lines / LOOKAHEAD_BLOCK;
+    size_t i_size = (size_t)i_width * i_height;
+
+    if( i_width != p_la->i_thumb_width || i_height != p_la->i_thumb_height )
+    {
+        free( p_la->p_thumbs );
+        free( p_la->p_columns );
+        p_la->p_thumbs = malloc( 3 * i_size );
+        p_la->p_columns = vlc_alloc( i_width * LOOKAHEAD_BLOCK,
+                                     sizeof(*p_la->p_columns) );
+        if( unlikely(p_la->p_thumbs == NULL || p_la->p_columns == NULL) )
+        {
+            free( p_la->p_thumbs );
+            free( p_la->p_columns );
+            p_la->p_thumbs = NULL;
+            p_la->p_columns = NULL;
+            i_width = i_height = 0;
+        }
+        else
+        {
+            for( unsigned i = 0; i < 3; i++ )
+                p_la->pp_thumb[i] = p_la->p_thumbs + i * i_size;
+        }
+        p_la->i_thumb_width = i_width;
+        p_la->i_thumb_height = i_height;
+        p_la->i_history = 0;
+    }
+    if( i_size == 0 || p_la->p_thumbs == NULL )
+        return;
+
+    /* Recycle the oldest thumbnail */
+    uint8_t *p_thumb = p_la->pp_thumb[2];
+    p_la->pp_thumb[2] = p_la->pp_thumb[1];
+    p_la->pp_thumb[1] = p_la->pp_thumb[0];
+    p_la->pp_thumb[0] = p_thumb;
+
+    Thumbnail( p_thumb, p_la->p_columns, p_luma, i_width, i_height );
+
+    if( p_la->i_history >= 1 )
+        p_result->i_diff = Difference( p_thumb, p_la->pp_thumb[1], i_size );
+    if( p_la->i_history >= 2 )
+        p_result->i_diff2 = Difference( p_thumb, p_la->pp_thumb[2], i_size );
+    else
+        p_la->i_history++;
+}
+
+static void *Thread( void *data )
+{
+    transcode_lookahead_t *p_la = data;
+
+    vlc_mutex_lock( &p_la->lock );
+    for( ;; )
+    {
+        while( !p_la->b_closing && p_la->i_analysed == p_la->i_count )
+            vlc_cond_wait( &p_la->wait_request, &p_la->lock );
+        if( p_la->b_closing )
+            break;
+
+        /* Not dequeued until analysed */
+        struct lookahead_entry *p_entry =
+            &p_la->p_queue[(p_la->i_first + p_la->i_analysed) % p_la->i_size];
+        vlc_mutex_unlock( &p_la->lock );
+
+        struct lookahead_entry result;
+        Analyse( p_la, p_entry->p_pic, &result );
+
+        vlc_mutex_lock( &p_la->lock );
+        p_entry->i_diff = result.i_diff;
+        p_entry->i_diff2 = result.i_diff2;
+        p_la->i_analysed++;
+        vlc_cond_signal( &p_la->wait_result );
+    }
+    vlc_mutex_unlock( &p_la->lock );
+    return NULL;
+}
+
+static bool IsSceneCut( const transcode_lookahead_t *p_la,
+                        const struct lookahead_entry *p_entry,
+                        const struct lookahead_entry *p_next )
+{
+    if( p_entry->i_diff < p_la->i_threshold * LOOKAHEAD_SCALE )
+        return false;
+    /* Sustained motion rather than a cut */
+    if( p_entry->i_diff < 3 * p_la->i_average )
+        return false;
+    /* Flash: the next picture looks like the previous one again */
+    if( p_next != NULL && p_next->i_diff2 != LOOKAHEAD_UNKNOWN &&
+        2 * p_next->i_diff2 < p_entry->i_diff )
+        return false;
+    /* End of a flash: back to the picture before the previous one */
+    if( p_entry->i_diff2 != LOOKAHEAD_UNKNOWN &&
+        2 * p_entry->i_diff2 < p_entry->i_diff )
+        return false;
+    return true;
+}
+
+transcode_lookahead_t * transcode_lookahead_New( vlc_object_t *p_obj,
+                                                 unsigned i_depth,
+                                                 unsigned i_threshold,
+                                                 vlc_tick_t i_segment )
+{
+    transcode_lookahead_t *p_la = calloc( 1, sizeof(*p_la) );
+    if( unlikely(p_la == NULL) )
+        return NULL;
+
+    p_la->p_obj = p_obj;
+    p_la->i_depth = i_threshold > 0 ? i_depth : 0;
+    p_la->i_threshold = i_threshold;
+    p_la->i_segment = i_segment;
+    p_la->i_size = p_la->i_depth + 1;
+    p_la->i_origin = VLC_TICK_INVALID;
+
+    p_la->p_queue = vlc_alloc( p_la->i_size, sizeof(*p_la->p_queue) );
+    if( unlikely(p_la->p_queue == NULL) )
+    {
+        free( p_la );
+        return NULL;
+    }
+
+    vlc_mutex_init( &p_la->lock );
+    vlc_cond_init( &p_la->wait_request );
+    vlc_cond_init( &p_la->wait_result );
+
+    if( p_la->i_depth > 0 &&
+        vlc_clone( &p_la->thread, Thread, p_la, VLC_THREAD_PRIORITY_LOW ) )
+    {
+        free( p_la->p_queue );
+        free( p_la );
+        return NULL;
+    }
+
+    msg_Dbg( p_obj, "keyframe lookahead of %u pictures, segments of %"PRId64
+             " ms", p_la->i_depth, MS_FROM_VLC_TICK(i_segment) );
+    return p_la;
+}
+
+void transcode_lookahead_Delete( transcode_lookahead_t *p_la )
+{
+    if( p_la->i_depth > 0 )
+    {
+        vlc_mutex_lock( &p_la->lock );
+        p_la->b_closing = true;
+        vlc_cond_signal( &p_la->wait_request );
+        vlc_mutex_unlock( &p_la->lock );
+        vlc_join( p_la->thread, NULL );
+    }
+
+    for( unsigned i = 0; i < p_la->i_count; i++ )
+        picture_Release( p_la->p_queue[(p_la->i_first + i) % p_la->i_size].p_pic );
+
+    free( p_la->p_thumbs );
+    free( p_la->p_columns );
+    free( p_la->p_queue );
+    free( p_la );
+}
+
+void transcode_lookahead_Push( transcode_lookahead_t *p_la, picture_t *p_pic )
+{
+    vlc_mutex_lock( &p_la->lock );
+    assert( p_la->i_count < p_la->i_size );
+    struct lookahead_entry *p_entry =
+        &p_la->p_queue[(p_la->i_first + p_la->i_count) % p_la->i_size];
+    p_entry->p_pic = p_pic;
+    p_entry->i_diff = 0;
+    p_entry->i_diff2 = LOOKAHEAD_UNKNOWN;
+    p_la->i_count++;
+    vlc_cond_signal( &p_la->wait_request );
+    vlc_mutex_unlock( &p_la->lock );
+}
+
+picture_t * transcode_lookahead_Pop( transcode_lookahead_t *p_la, bool b_drain )
+{
+    bool b_cut = false;
+
+    vlc_mutex_lock( &p_la->lock );
+    if( p_la->i_count == 0 || ( !b_drain && p_la->i_count <= p_la->i_depth ) )
+    {
+        vlc_mutex_unlock( &p_la->lock );
+        return NULL;
+    }
+
+    if( p_la->i_depth > 0 )
+    {
+        /* The next picture, if any, tells flashes from cuts */
+        unsigned i_needed = __MIN( p_la->i_count, 2 );
+        while( p_la->i_analysed < i_needed )
+            vlc_cond_wait( &p_la->wait_result, &p_la->lock );
+    }
+
+    const struct lookahead_entry *p_entry = &p_la->p_queue[p_la->i_first];
+    const struct lookahead_entry *p_next = p_la->i_count > 1
+        ? &p_la->p_queue[(p_la->i_first + 1) % p_la->i_size] : NULL;
+    picture_t *p_pic = p_entry->p_pic;
+
+    if( p_la->i_depth > 0 )
+    {
+        b_cut = p_la->i_distance >= LOOKAHEAD_MIN_DISTANCE &&
+                IsSceneCut( p_la, p_entry, p_next );
+        if( !b_cut )
+            p_la->i_average = ( 7 * p_la->i_average + p_entry->i_diff ) / 8;
+        p_la->i_analysed--;
+    }
+
+    p_la->i_first = ( p_la->i_first + 1 ) % p_la->i_size;
+    p_la->i_count--;
+    vlc_mutex_unlock( &p_la->lock );
+
+    bool b_keyframe = b_cut;
+    if( b_cut )
+        msg_Dbg( p_la->p_obj, "scene cut at %"PRId64, p_pic->date );
+
+    if( p_la->i_segment > 0 && p_pic->date != VLC_TICK_INVALID )
+    {
+        if( p_la->i_origin == VLC_TICK_INVALID )
+        {
+            p_la->i_origin = p_pic->date;
+            p_la->i_boundary = p_pic->date + p_la->i_segment;
+        }
+        else if( p_pic->date >= p_la->i_boundary )
+        {
+            /* Boundaries stay multiples of the segment duration */
+            b_keyframe = true;
+            p_la->i_boundary = p_la->i_origin + p_la->i_segment *
+                ( ( p_pic->date - p_la->i_origin ) / p_la->i_segment + 1 );
+        }
+    }
+
+    if( b_keyframe )
+    {
+        p_pic->b_keyframe = true;
+        p_la->i_distance = 0;
+    }
+    else
+        p_la->i_distance++;
+    return p_pic;
+}
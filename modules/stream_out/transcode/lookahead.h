@@ -0,0 +1,58 @@
+/*****************************************************************************
+ * lookahead.h: transcoding keyframe placement header
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+/*
+ * The lookahead delays the pictures on their way to the encoder, and flags
+ * those which should be coded as keyframes (picture_t.b_keyframe):
+ *  - scene cuts, detected from the difference between downscaled luma planes
+ *    of consecutive pictures, computed by a separate thread,
+ *  - the first picture at or after each segment boundary, counted from the
+ *    date of the first picture.
+ */
+typedef struct transcode_lookahead_t transcode_lookahead_t;
+
+/**
+ * Creates a lookahead.
+ *
+ * @param i_depth pictures delayed for the scene cut detection
+ *                (0 to disable the detection)
+ * @param i_threshold minimum mean luma difference (0-255) of a scene cut
+ * @param i_segment segment duration (0 if not segmented)
+ */
+transcode_lookahead_t * transcode_lookahead_New( vlc_object_t *,
+                                                 unsigned i_depth,
+                                                 unsigned i_threshold,
+                                                 vlc_tick_t i_segment );
+void transcode_lookahead_Delete( transcode_lookahead_t * );
+
+/**
+ * Queues a picture. Must be followed by calls to transcode_lookahead_Pop()
+ * until it returns NULL.
+ */
+void transcode_lookahead_Push( transcode_lookahead_t *, picture_t * );
+
+/**
+ * Dequeues the next picture to encode.
+ *
+ * @param b_drain whether to return all the queued pictures (before draining
+ *                the encoder)
+ * @return the picture, or NULL if none is ready
+ */
+picture_t * transcode_lookahead_Pop( transcode_lookahead_t *, bool b_drain );
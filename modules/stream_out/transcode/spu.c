@@ -134,7 +134,7 @@ int transcode_spu_init( sout_stream_t *p_stream, const es_format_t *p_fmt,
 
         /* open output stream */
         id->downstream_id =
-                id->pf_transcode_downstream_add( p_stream,
+                id->pf_transcode_downstream_add( p_stream, id,
                                                  &id->p_decoder->fmt_in,
                                                  transcode_encoder_format_out( id->encoder ) );
         if( !id->downstream_id )
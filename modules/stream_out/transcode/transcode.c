@@ -126,6 +126,32 @@
 #define HP_LONGTEXT N_( \
     "Runs the optional encoder thread at the OUTPUT priority instead of " \
     "VIDEO." )
+#define ES_THREADS_TEXT N_("One thread per stream")
+#define ES_THREADS_LONGTEXT N_( \
+    "Decodes, filters and encodes each audio and video stream in its own " \
+    "thread, so that streams do not wait for each other. The encoded data " \
+    "of a stream is only forwarded when its next input comes, which adds " \
+    "latency to sparse streams." )
+#define RENDITIONS_TEXT N_("Other video renditions")
+#define RENDITIONS_LONGTEXT N_( \
+    "Comma-separated list of WIDTHxHEIGHT@BITRATE video renditions encoded " \
+    "with the same codec from the same decoded pictures, for instance " \
+    "\"1280x720@3000,0x360@800\" (a null dimension keeps the aspect ratio). " \
+    "The Nth rendition is output with the ES ID of the source plus N times " \
+    "10000. Video filters and overlays only apply to the main rendition." )
+#define LOOKAHEAD_TEXT N_("Keyframe lookahead")
+#define LOOKAHEAD_LONGTEXT N_( \
+    "Number of pictures delayed before the video encoder to detect scene " \
+    "cuts, where keyframes are forced. This is useful for encoders without " \
+    "their own scene cut detection. 0 disables it." )
+#define SCENECUT_TEXT N_("Scene cut threshold")
+#define SCENECUT_LONGTEXT N_( \
+    "Minimum average luma difference (0-255) between two pictures to detect " \
+    "a scene cut." )
+#define SEGLEN_TEXT N_("Segment length")
+#define SEGLEN_LONGTEXT N_( \
+    "Forces a video keyframe at every multiple of this duration (seconds), " \
+    "so that segments can start on a keyframe. 0 disables it." )
 #define POOL_TEXT N_("Picture pool size")
 #define POOL_LONGTEXT N_( "Defines how many pictures we allow to be in pool "\
     "between decoder/encoder threads when threads > 0" )
@@ -177,6 +203,16 @@ vlc_module_begin ()
                  MAXHEIGHT_LONGTEXT, true )
     add_module_list(SOUT_CFG_PREFIX "vfilter", "video filter", NULL,
                     VFILTER_TEXT, VFILTER_LONGTEXT)
+    add_string( SOUT_CFG_PREFIX "renditions", NULL, RENDITIONS_TEXT,
+                RENDITIONS_LONGTEXT, true )
+    add_integer( SOUT_CFG_PREFIX "lookahead", 0, LOOKAHEAD_TEXT,
+                 LOOKAHEAD_LONGTEXT, true )
+        change_integer_range( 0, 250 )
+    add_integer( SOUT_CFG_PREFIX "scenecut", 30, SCENECUT_TEXT,
+                 SCENECUT_LONGTEXT, true )
+        change_integer_range( 1, 255 )
+    add_float( SOUT_CFG_PREFIX "seglen", 0., SEGLEN_TEXT,
+               SEGLEN_LONGTEXT, true )
 
     set_section( N_("Audio"), NULL )
     add_module(SOUT_CFG_PREFIX "aenc", "encoder", NULL,
@@ -215,6 +251,8 @@ vlc_module_begin ()
         change_integer_range( 1, 1000 )
     add_bool( SOUT_CFG_PREFIX "high-priority", false, HP_TEXT, HP_LONGTEXT,
               true )
+    add_bool( SOUT_CFG_PREFIX "es-threads", false, ES_THREADS_TEXT,
+              ES_THREADS_LONGTEXT, true )
 
 vlc_module_end ()
 
@@ -224,7 +262,7 @@ static const char *const ppsz_sout_options[] = {
     "deinterlace-module", "threads", "aenc", "acodec", "ab", "alang",
     "afilter", "samplerate", "channels", "senc", "scodec", "soverlay",
     "sfilter", "high-priority", "maxwidth", "maxheight", "pool-size",
-    NULL
+    "es-threads", "lookahead", "scenecut", "seglen", "renditions", NULL
 };
 
 /*****************************************************************************
@@ -233,6 +271,7 @@ static const char *const ppsz_sout_options[] = {
 static void *Add( sout_stream_t *, const es_format_t * );
 static void  Del( sout_stream_t *, void * );
 static int   Send( sout_stream_t *, void *, block_t * );
+static bool  transcode_workers_Flush( sout_stream_t * );
 
 static void SetAudioEncoderConfig( sout_stream_t *p_stream, transcode_encoder_config_t *p_cfg )
 {
@@ -326,12 +365,60 @@ static void SetVideoEncoderConfig( sout_stream_t *p_stream, transcode_encoder_co
     p_cfg->video.threads.i_count = var_GetInteger( p_stream, SOUT_CFG_PREFIX "threads" );
     p_cfg->video.threads.pool_size = var_GetInteger( p_stream, SOUT_CFG_PREFIX "pool-size" );
 
+    p_cfg->video.lookahead.i_depth = var_GetInteger( p_stream, SOUT_CFG_PREFIX "lookahead" );
+    p_cfg->video.lookahead.i_threshold = var_GetInteger( p_stream, SOUT_CFG_PREFIX "scenecut" );
+    float f_seglen = var_GetFloat( p_stream, SOUT_CFG_PREFIX "seglen" );
+    p_cfg->video.lookahead.i_segment = f_seglen > 0.f ? vlc_tick_from_sec( f_seglen ) : 0;
+
     if( var_GetBool( p_stream, SOUT_CFG_PREFIX "high-priority" ) )
         p_cfg->video.threads.i_priority = VLC_THREAD_PRIORITY_OUTPUT;
     else
         p_cfg->video.threads.i_priority = VLC_THREAD_PRIORITY_VIDEO;
 }
 
+static void SetVideoRenditionsConfig( sout_stream_t *p_stream, sout_stream_sys_t *p_sys )
+{
+    char *psz_string = var_GetString( p_stream, SOUT_CFG_PREFIX "renditions" );
+    if( !psz_string )
+        return;
+
+    char *psz_save;
+    for( char *psz = strtok_r( psz_string, ",", &psz_save ); psz != NULL;
+         psz = strtok_r( NULL, ",", &psz_save ) )
+    {
+        unsigned i_width, i_height, i_bitrate;
+        if( sscanf( psz, "%ux%u@%u", &i_width, &i_height, &i_bitrate ) != 3 ||
+            ( i_width == 0 && i_height == 0 ) )
+        {
+            msg_Warn( p_stream, "ignoring invalid video rendition \"%s\"", psz );
+            continue;
+        }
+
+        transcode_encoder_config_t *p_cfgs =
+            realloc( p_sys->p_renditions_cfg,
+                     ( p_sys->i_renditions + 1 ) * sizeof( *p_cfgs ) );
+        if( !p_cfgs )
+            break;
+        p_sys->p_renditions_cfg = p_cfgs;
+
+        /* Same encoder and settings as the main rendition, which owns the
+         * strings and the configuration chain */
+        transcode_encoder_config_t *p_cfg = &p_cfgs[p_sys->i_renditions++];
+        *p_cfg = p_sys->venc_cfg;
+        p_cfg->video.i_bitrate = i_bitrate < 16000 ? i_bitrate * 1000 : i_bitrate;
+        p_cfg->video.f_scale = 0.f;
+        p_cfg->video.i_width = i_width;
+        p_cfg->video.i_height = i_height;
+        p_cfg->video.i_maxwidth = p_cfg->video.i_maxheight = 0;
+        p_cfg->video.lookahead.i_depth = 0;
+        p_cfg->video.lookahead.i_segment = 0;
+
+        msg_Dbg( p_stream, "video rendition %ux%u %ukb/s", i_width, i_height,
+                 p_cfg->video.i_bitrate / 1000 );
+    }
+    free( psz_string );
+}
+
 static void SetSPUEncoderConfig( sout_stream_t *p_stream, transcode_encoder_config_t *p_cfg )
 {
     char *psz_string = var_GetString( p_stream, SOUT_CFG_PREFIX "senc" );
@@ -363,6 +450,12 @@ static int Control( sout_stream_t *p_stream, int i_query, va_list args )
     switch( i_query )
     {
         case SOUT_STREAM_EMPTY:
+            /* the threads may still hold data */
+            if( !transcode_workers_Flush( p_stream ) )
+            {
+                *va_arg( args, bool * ) = false;
+                return VLC_SUCCESS;
+            }
             return sout_StreamControlVa( p_stream->p_next, i_query, args );
 
         case SOUT_STREAM_ID_SPU_HIGHLIGHT:
@@ -418,6 +511,7 @@ static int Open( vlc_object_t *p_this )
                  p_sys->venc_cfg.video.i_height,
                  p_sys->venc_cfg.video.f_scale,
                  p_sys->venc_cfg.video.i_bitrate / 1000 );
+        SetVideoRenditionsConfig( p_stream, p_sys );
     }
 
     /* Video Filter Parameters */
@@ -454,6 +548,8 @@ static int Open( vlc_object_t *p_this )
         msg_Dbg( p_stream, "codec spu=%4.4s", (char *)&p_sys->senc_cfg.i_codec );
 
     p_sys->b_soverlay = var_GetBool( p_stream, SOUT_CFG_PREFIX "soverlay" );
+    p_sys->b_es_threads = var_GetBool( p_stream, SOUT_CFG_PREFIX "es-threads" );
+    vlc_list_init( &p_sys->workers );
     /* Set default size for TEXT spu non overlay conversion / updater */
     p_sys->senc_cfg.spu.i_width = (p_sys->venc_cfg.video.i_width) ? p_sys->venc_cfg.video.i_width : 1280;
     p_sys->senc_cfg.spu.i_height = (p_sys->venc_cfg.video.i_height) ? p_sys->venc_cfg.video.i_height : 720;
@@ -480,6 +576,7 @@ static void Close( vlc_object_t * p_this )
     sout_stream_t       *p_stream = (sout_stream_t*)p_this;
     sout_stream_sys_t   *p_sys = p_stream->p_sys;
 
+    free( p_sys->p_renditions_cfg );
     transcode_encoder_config_clean( &p_sys->venc_cfg );
     sout_filters_config_clean( &p_sys->vfilters_cfg );
 
@@ -528,7 +625,12 @@ static vlc_tick_t GetMasterDrift( void *cbdata )
     vlc_mutex_lock( &p_sys->lock );
     vlc_tick_t drift = 0;
     if( p_sys->id_master_sync )
-        drift = p_sys->id_master_sync->i_drift;
+    {
+        sout_stream_id_sys_t *id = p_sys->id_master_sync;
+        vlc_mutex_lock( &id->fifo.lock );
+        drift = id->i_drift;
+        vlc_mutex_unlock( &id->fifo.lock );
+    }
     vlc_mutex_unlock( &p_sys->lock );
     return drift;
 }
@@ -547,10 +649,12 @@ static int ValidateDrift( void *cbdata, vlc_tick_t i_drift )
 }
 
 static void *transcode_downstream_Add( sout_stream_t *p_stream,
+                                       sout_stream_id_sys_t *id,
                                        const es_format_t *fmt_orig,
                                        const es_format_t *fmt)
 {
     sout_stream_sys_t *p_sys = p_stream->p_sys;
+    VLC_UNUSED(id);
 
     es_format_t tmp;
     es_format_Init( &tmp, fmt->i_cat, fmt->i_codec );
@@ -574,6 +678,303 @@ static void *transcode_downstream_Add( sout_stream_t *p_stream,
     return downstream;
 }
 
+/*****************************************************************************
+ * Per stream threads:
+ *
+ * The worker thread runs the decoder, the filters and the encoder of one
+ * stream. The next stream output may only be called by the thread feeding
+ * this one (with the sout lock held), so the encoded blocks and the
+ * creation of the output stream are handed back to Send() and Control().
+ *****************************************************************************/
+#define TRANSCODE_WORKER_QUEUE 16
+
+struct transcode_worker
+{
+    sout_stream_t *p_stream;
+    sout_stream_id_sys_t *id;
+    struct vlc_list node;
+    vlc_thread_t thread;
+
+    vlc_mutex_t lock;
+    vlc_cond_t wait_input;  /**< input queued, drain or close (worker) */
+    vlc_cond_t wait_output; /**< output, room, request or drained (feeder) */
+    vlc_cond_t wait_add;    /**< output stream created (worker) */
+
+    block_t *p_in;
+    block_t **pp_in_last;
+    unsigned i_in;
+    block_t *p_out;
+    block_t **pp_out_last;
+    bool b_busy;
+    bool b_draining;
+    bool b_error;
+    bool b_closing;
+
+    /* Output stream creation, requested by the worker */
+    bool b_add;
+    const es_format_t *p_add_orig;
+    const es_format_t *p_add_fmt;
+    void *p_add_id;
+};
+
+static int transcode_es_process( sout_stream_t *p_stream,
+                                 sout_stream_id_sys_t *id,
+                                 block_t *p_buffer, block_t **pp_out )
+{
+    switch( id->p_decoder->fmt_in.i_cat )
+    {
+    case AUDIO_ES:
+        return transcode_audio_process( p_stream, id, p_buffer, pp_out );
+    case VIDEO_ES:
+        return transcode_video_process( p_stream, id, p_buffer, pp_out );
+    case SPU_ES:
+        return transcode_spu_process( p_stream, id, p_buffer, pp_out );
+    default:
+        if( p_buffer )
+            block_Release( p_buffer );
+        return VLC_EGENERIC;
+    }
+}
+
+static void *transcode_worker_Thread( void *data )
+{
+    struct transcode_worker *w = data;
+
+    vlc_mutex_lock( &w->lock );
+    for( ;; )
+    {
+        while( !w->b_closing && w->p_in == NULL && !w->b_draining )
+            vlc_cond_wait( &w->wait_input, &w->lock );
+        if( w->b_closing )
+            break;
+
+        /* NULL once the queue is empty if draining */
+        block_t *p_in = w->p_in;
+        if( p_in )
+        {
+            w->p_in = p_in->p_next;
+            if( w->p_in == NULL )
+                w->pp_in_last = &w->p_in;
+            p_in->p_next = NULL;
+            w->i_in--;
+        }
+        w->b_busy = true;
+        bool b_error = w->b_error;
+        vlc_cond_signal( &w->wait_output );
+        vlc_mutex_unlock( &w->lock );
+
+        block_t *p_out = NULL;
+        int i_ret = VLC_EGENERIC;
+
+        if( !b_error )
+            i_ret = transcode_es_process( w->p_stream, w->id, p_in, &p_out );
+        else if( p_in )
+            block_Release( p_in );
+
+        vlc_mutex_lock( &w->lock );
+        w->b_busy = false;
+        if( i_ret != VLC_SUCCESS )
+            w->b_error = true;
+        if( p_out )
+            block_ChainLastAppend( &w->pp_out_last, p_out );
+        if( p_in == NULL )
+            w->b_draining = false;
+        vlc_cond_signal( &w->wait_output );
+    }
+    vlc_mutex_unlock( &w->lock );
+    return NULL;
+}
+
+/* Called by the worker, instead of transcode_downstream_Add() */
+static void *transcode_worker_downstream_Add( sout_stream_t *p_stream,
+                                              sout_stream_id_sys_t *id,
+                                              const es_format_t *fmt_orig,
+                                              const es_format_t *fmt )
+{
+    struct transcode_worker *w = id->worker;
+    void *p_downstream = NULL;
+    VLC_UNUSED(p_stream);
+
+    vlc_mutex_lock( &w->lock );
+    w->p_add_orig = fmt_orig;
+    w->p_add_fmt = fmt;
+    w->p_add_id = NULL;
+    w->b_add = true;
+    vlc_cond_signal( &w->wait_output );
+
+    while( w->b_add && !w->b_closing )
+        vlc_cond_wait( &w->wait_add, &w->lock );
+    if( !w->b_add )
+        p_downstream = w->p_add_id;
+    w->b_add = false;
+    vlc_mutex_unlock( &w->lock );
+    return p_downstream;
+}
+
+/* Serves the worker requests, and takes its output. Called by the thread
+ * feeding the stream, with the worker lock held. */
+static block_t *transcode_worker_Serve( struct transcode_worker *w )
+{
+    if( w->b_add )
+    {
+        w->p_add_id = transcode_downstream_Add( w->p_stream, w->id,
+                                                w->p_add_orig, w->p_add_fmt );
+        w->b_add = false;
+        vlc_cond_signal( &w->wait_add );
+    }
+
+    block_t *p_out = w->p_out;
+    w->p_out = NULL;
+    w->pp_out_last = &w->p_out;
+    return p_out;
+}
+
+static int transcode_worker_Output( sout_stream_t *p_stream,
+                                    sout_stream_id_sys_t *id, block_t *p_out )
+{
+    if( id->p_decoder->fmt_in.i_cat == VIDEO_ES )
+        transcode_video_renditions_output( p_stream, id );
+
+    /* the output stream exists if there is any output */
+    if( p_out &&
+        sout_StreamIdSend( p_stream->p_next, id->downstream_id, p_out ) )
+        return VLC_EGENERIC;
+    return VLC_SUCCESS;
+}
+
+static int transcode_worker_Send( sout_stream_t *p_stream,
+                                  sout_stream_id_sys_t *id, block_t *p_buffer )
+{
+    struct transcode_worker *w = id->worker;
+    block_t *p_out = NULL;
+
+    vlc_mutex_lock( &w->lock );
+    block_ChainAppend( &p_out, transcode_worker_Serve( w ) );
+
+    if( p_buffer )
+    {   /* bounded queue: slow down the input to the pace of the stream */
+        while( w->i_in >= TRANSCODE_WORKER_QUEUE && !w->b_error )
+        {
+            vlc_cond_wait( &w->wait_output, &w->lock );
+            block_ChainAppend( &p_out, transcode_worker_Serve( w ) );
+        }
+
+        if( w->b_error )
+            block_Release( p_buffer );
+        else
+        {
+            *w->pp_in_last = p_buffer;
+            w->pp_in_last = &p_buffer->p_next;
+            w->i_in++;
+            vlc_cond_signal( &w->wait_input );
+        }
+    }
+    else
+    {   /* drain: wait for the queued input and the decoder delay */
+        w->b_draining = true;
+        vlc_cond_signal( &w->wait_input );
+        while( w->b_draining || w->b_add )
+        {
+            vlc_cond_wait( &w->wait_output, &w->lock );
+            block_ChainAppend( &p_out, transcode_worker_Serve( w ) );
+        }
+        block_ChainAppend( &p_out, transcode_worker_Serve( w ) );
+    }
+
+    int i_ret = w->b_error ? VLC_EGENERIC : VLC_SUCCESS;
+    vlc_mutex_unlock( &w->lock );
+
+    if( transcode_worker_Output( p_stream, id, p_out ) )
+        i_ret = VLC_EGENERIC;
+    return i_ret;
+}
+
+/* Forwards the pending output, and tells whether the worker is idle */
+static bool transcode_worker_Flush( sout_stream_t *p_stream,
+                                    struct transcode_worker *w )
+{
+    vlc_mutex_lock( &w->lock );
+    block_t *p_out = transcode_worker_Serve( w );
+    bool b_idle = w->p_in == NULL && !w->b_busy && !w->b_draining;
+    vlc_mutex_unlock( &w->lock );
+
+    transcode_worker_Output( p_stream, w->id, p_out );
+    return b_idle;
+}
+
+static bool transcode_workers_Flush( sout_stream_t *p_stream )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    struct transcode_worker *w;
+    bool b_idle = true;
+
+    vlc_list_foreach( w, &p_sys->workers, node )
+        if( !transcode_worker_Flush( p_stream, w ) )
+            b_idle = false;
+    return b_idle;
+}
+
+static int transcode_worker_Start( sout_stream_t *p_stream,
+                                   sout_stream_id_sys_t *id )
+{
+    sout_stream_sys_t *p_sys = p_stream->p_sys;
+    struct transcode_worker *w = malloc( sizeof( *w ) );
+    if( !w )
+        return VLC_ENOMEM;
+
+    w->p_stream = p_stream;
+    w->id = id;
+    vlc_mutex_init( &w->lock );
+    vlc_cond_init( &w->wait_input );
+    vlc_cond_init( &w->wait_output );
+    vlc_cond_init( &w->wait_add );
+    w->p_in = NULL;
+    w->pp_in_last = &w->p_in;
+    w->i_in = 0;
+    w->p_out = NULL;
+    w->pp_out_last = &w->p_out;
+    w->b_busy = false;
+    w->b_draining = false;
+    w->b_error = false;
+    w->b_closing = false;
+    w->b_add = false;
+
+    id->worker = w;
+    id->pf_transcode_downstream_add = transcode_worker_downstream_Add;
+
+    int i_priority = id->p_decoder->fmt_in.i_cat == AUDIO_ES
+                   ? VLC_THREAD_PRIORITY_AUDIO : VLC_THREAD_PRIORITY_VIDEO;
+    if( vlc_clone( &w->thread, transcode_worker_Thread, w, i_priority ) )
+    {
+        id->worker = NULL;
+        id->pf_transcode_downstream_add = transcode_downstream_Add;
+        free( w );
+        return VLC_EGENERIC;
+    }
+
+    vlc_list_append( &w->node, &p_sys->workers );
+    return VLC_SUCCESS;
+}
+
+static void transcode_worker_Stop( sout_stream_id_sys_t *id )
+{
+    struct transcode_worker *w = id->worker;
+
+    vlc_mutex_lock( &w->lock );
+    w->b_closing = true;
+    vlc_cond_signal( &w->wait_input );
+    vlc_cond_signal( &w->wait_add );
+    vlc_mutex_unlock( &w->lock );
+
+    vlc_join( w->thread, NULL );
+    vlc_list_remove( &w->node );
+
+    block_ChainRelease( w->p_in );
+    block_ChainRelease( w->p_out );
+    free( w );
+    id->worker = NULL;
+}
+
 static void *Add( sout_stream_t *p_stream, const es_format_t *p_fmt )
 {
     sout_stream_sys_t *p_sys = p_stream->p_sys;
@@ -611,6 +1012,8 @@ static void *Add( sout_stream_t *p_stream, const es_format_t *p_fmt )
         case VIDEO_ES:
             id->p_filterscfg = &p_sys->vfilters_cfg;
             id->p_enccfg = &p_sys->venc_cfg;
+            id->p_renditions_cfg = p_sys->p_renditions_cfg;
+            id->i_renditions = p_sys->i_renditions;
             break;
         case SPU_ES:
             id->p_filterscfg = NULL;
@@ -650,7 +1053,7 @@ static void *Add( sout_stream_t *p_stream, const es_format_t *p_fmt )
     {
         msg_Dbg( p_stream, "not transcoding a stream (fcc=`%4.4s')",
                  (char*)&p_fmt->i_codec );
-        id->downstream_id = transcode_downstream_Add( p_stream, p_fmt, p_fmt );
+        id->downstream_id = transcode_downstream_Add( p_stream, id, p_fmt, p_fmt );
         id->b_transcode = false;
 
         success = id->downstream_id;
@@ -659,6 +1062,12 @@ static void *Add( sout_stream_t *p_stream, const es_format_t *p_fmt )
     if(!success)
         goto error;
 
+    if( id->b_transcode && p_sys->b_es_threads &&
+        ( p_fmt->i_cat == AUDIO_ES || p_fmt->i_cat == VIDEO_ES ) &&
+        transcode_worker_Start( p_stream, id ) )
+        msg_Warn( p_stream, "cannot start thread, transcoding from the "
+                            "input thread" );
+
     return id;
 
 error:
@@ -679,6 +1088,8 @@ static void Del( sout_stream_t *p_stream, void *_id )
         {
         case AUDIO_ES:
             Send( p_stream, id, NULL );
+            if( id->worker )
+                transcode_worker_Stop( id );
             decoder_Destroy( id->p_decoder );
             vlc_mutex_lock( &p_sys->lock );
             if( id == p_sys->id_master_sync )
@@ -688,11 +1099,14 @@ static void Del( sout_stream_t *p_stream, void *_id )
             break;
         case VIDEO_ES:
             Send( p_stream, id, NULL );
+            if( id->worker )
+                transcode_worker_Stop( id );
             decoder_Destroy( id->p_decoder );
             vlc_mutex_lock( &p_sys->lock );
             if( id == p_sys->id_video )
                 p_sys->id_video = NULL;
             vlc_mutex_unlock( &p_sys->lock );
+            transcode_video_renditions_del( p_stream, id );
             transcode_video_clean( id );
             break;
         case SPU_ES:
@@ -715,6 +1129,10 @@ static int Send( sout_stream_t *p_stream, void *_id, block_t *p_buffer )
     sout_stream_id_sys_t *id = (sout_stream_id_sys_t *)_id;
     block_t *p_out = NULL;
 
+    /* the worker owns the other fields */
+    if( id->worker )
+        return transcode_worker_Send( p_stream, id, p_buffer );
+
     if( id->b_error )
         goto error;
 
@@ -726,24 +1144,10 @@ static int Send( sout_stream_t *p_stream, void *_id, block_t *p_buffer )
             goto error;
     }
 
-    int i_ret;
-    switch( id->p_decoder->fmt_in.i_cat )
-    {
-    case AUDIO_ES:
-        i_ret = transcode_audio_process( p_stream, id, p_buffer, &p_out );
-        break;
+    int i_ret = transcode_es_process( p_stream, id, p_buffer, &p_out );
 
-    case VIDEO_ES:
-        i_ret = transcode_video_process( p_stream, id, p_buffer, &p_out );
-        break;
-
-    case SPU_ES:
-        i_ret = transcode_spu_process( p_stream, id, p_buffer, &p_out );
-        break;
-
-    default:
-        goto error;
-    }
+    if( id->p_decoder->fmt_in.i_cat == VIDEO_ES )
+        transcode_video_renditions_output( p_stream, id );
 
     if( p_out &&
         sout_StreamIdSend( p_stream->p_next, id->downstream_id, p_out ) )
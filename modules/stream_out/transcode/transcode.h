@@ -1,7 +1,9 @@
 #include <vlc_picture_fifo.h>
 #include <vlc_filter.h>
 #include <vlc_codec.h>
+#include <vlc_list.h>
 #include "encoder/encoder.h"
+#include "lookahead.h"
 
 /*100ms is around the limit where people are noticing lipsync issues*/
 #define MASTER_SYNC_MAX_DRIFT VLC_TICK_FROM_MS(100)
@@ -40,10 +42,12 @@ void sout_filters_config_clean( sout_filters_config_t *p_cfg )
 }
 
 typedef struct sout_stream_id_sys_t sout_stream_id_sys_t;
+struct transcode_worker;
 
 typedef struct
 {
     bool                  b_soverlay;
+    bool                  b_es_threads;
 
     /* Audio */
     transcode_encoder_config_t aenc_cfg;
@@ -52,6 +56,9 @@ typedef struct
     /* Video */
     transcode_encoder_config_t venc_cfg;
     sout_filters_config_t vfilters_cfg;
+    /* Other video renditions, encoded from the same decoded pictures */
+    transcode_encoder_config_t *p_renditions_cfg;
+    unsigned        i_renditions;
 
     /* SPU */
     transcode_encoder_config_t senc_cfg;
@@ -64,9 +71,13 @@ typedef struct
     /* Spu's video */
     sout_stream_id_sys_t *id_video;
 
+    /* ES processed by their own thread */
+    struct vlc_list workers;
+
 } sout_stream_sys_t;
 
 struct aout_filters;
+struct transcode_rendition;
 
 struct sout_stream_id_sys_t
 {
@@ -76,9 +87,14 @@ struct sout_stream_id_sys_t
     /* id of the out stream */
     void *downstream_id;
     void *(*pf_transcode_downstream_add)( sout_stream_t *,
+                                          sout_stream_id_sys_t *,
                                           const es_format_t *orig,
                                           const es_format_t *current );
 
+    /* Thread running decoding, filtering and encoding, or NULL if done by
+     * the caller of Send() */
+    struct transcode_worker *worker;
+
     /* Decoder */
     decoder_t       *p_decoder;
 
@@ -130,6 +146,10 @@ struct sout_stream_id_sys_t
              spu_t           *p_spu;
              vlc_decoder_device *dec_dev;
              vlc_video_context *enc_vctx_in;
+             transcode_lookahead_t *p_lookahead;
+             const transcode_encoder_config_t *p_renditions_cfg;
+             struct transcode_rendition *p_renditions;
+             unsigned        i_renditions;
          };
          struct
          {
@@ -213,5 +233,7 @@ int  transcode_video_process( sout_stream_t *, sout_stream_id_sys_t *,
 int transcode_video_get_output_dimensions( sout_stream_id_sys_t *,
                                            unsigned *w, unsigned *h );
 void transcode_video_push_spu( sout_stream_t *, sout_stream_id_sys_t *, subpicture_t * );
+void transcode_video_renditions_output( sout_stream_t *, sout_stream_id_sys_t * );
+void transcode_video_renditions_del( sout_stream_t *, sout_stream_id_sys_t * );
 int  transcode_video_init    ( sout_stream_t *, const es_format_t *,
                                sout_stream_id_sys_t *);
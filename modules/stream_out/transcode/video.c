@@ -46,6 +46,22 @@ struct encoder_owner
     sout_stream_id_sys_t *id;
 };
 
+/* The Nth other rendition uses the source ES ID plus N times this */
+#define TRANSCODE_RENDITION_ID_OFFSET 10000
+
+/* Other rendition of a video stream, encoded from the same decoded pictures,
+ * before the video filters and overlays of the main rendition */
+struct transcode_rendition
+{
+    transcode_encoder_config_t cfg;
+    transcode_encoder_t *encoder;
+    filter_chain_t *p_conv; /**< scaling and chroma conversion */
+    void *downstream_id;
+    block_t *p_out;         /**< not sent yet (fifo.lock) */
+    block_t **pp_out_last;
+    bool b_error;
+};
+
 static vlc_decoder_device *TranscodeHoldDecoderDevice(vlc_object_t *o, sout_stream_id_sys_t *id)
 {
     if (id->dec_dev == NULL)
@@ -167,6 +183,49 @@ static picture_t *transcode_dequeue_all_pics( sout_stream_id_sys_t *id )
     return p_pics;
 }
 
+/* Creates the encoders of the other renditions, opened with the first
+ * picture like the main one */
+static void transcode_video_renditions_init( sout_stream_t *p_stream,
+                                             sout_stream_id_sys_t *id,
+                                             const es_format_t *p_fmt_in )
+{
+    if( id->i_renditions == 0 )
+        return;
+
+    id->p_renditions = vlc_alloc( id->i_renditions, sizeof(*id->p_renditions) );
+    if( !id->p_renditions )
+    {
+        id->i_renditions = 0;
+        return;
+    }
+
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        struct transcode_rendition *r = &id->p_renditions[i];
+
+        r->cfg = id->p_renditions_cfg[i];
+        r->encoder = NULL;
+        r->p_conv = NULL;
+        r->downstream_id = NULL;
+        r->p_out = NULL;
+        r->pp_out_last = &r->p_out;
+        r->b_error = true;
+
+        struct encoder_owner *p_enc_owner = (struct encoder_owner *)
+            sout_EncoderCreate( p_stream, sizeof(struct encoder_owner) );
+        if( unlikely(p_enc_owner == NULL) )
+            continue;
+        p_enc_owner->id = id;
+        p_enc_owner->enc.cbs = &encoder_video_transcode_cbs;
+
+        r->encoder = transcode_encoder_new( &p_enc_owner->enc, p_fmt_in );
+        if( !r->encoder )
+            continue;
+        transcode_encoder_update_format_in( r->encoder, p_fmt_in );
+        r->b_error = false;
+    }
+}
+
 int transcode_video_init( sout_stream_t *p_stream, const es_format_t *p_fmt,
                           sout_stream_id_sys_t *id )
 {
@@ -252,8 +311,19 @@ int transcode_video_init( sout_stream_t *p_stream, const es_format_t *p_fmt,
     /* Will use this format as encoder input for now */
     transcode_encoder_update_format_in( id->encoder, &encoder_tested_fmt_in );
 
+    transcode_video_renditions_init( p_stream, id, &encoder_tested_fmt_in );
+
     es_format_Clean( &encoder_tested_fmt_in );
 
+    id->p_lookahead = NULL;
+    if( id->p_enccfg->video.lookahead.i_depth > 0 ||
+        id->p_enccfg->video.lookahead.i_segment > 0 )
+        id->p_lookahead =
+            transcode_lookahead_New( VLC_OBJECT(p_stream),
+                                     id->p_enccfg->video.lookahead.i_depth,
+                                     id->p_enccfg->video.lookahead.i_threshold,
+                                     id->p_enccfg->video.lookahead.i_segment );
+
     return VLC_SUCCESS;
 
 error:
@@ -398,8 +468,14 @@ static int transcode_video_filters_init( sout_stream_t *p_stream,
     /* SPU Sources */
     if( p_cfg->video.psz_spu_sources )
     {
-        if( id->p_spu || (id->p_spu = spu_Create( p_stream, NULL )) )
-            spu_ChangeSources( id->p_spu, p_cfg->video.psz_spu_sources );
+        vlc_mutex_lock( &id->fifo.lock );
+        if( !id->p_spu )
+            id->p_spu = spu_Create( p_stream, NULL );
+        spu_t *p_spu = id->p_spu;
+        vlc_mutex_unlock( &id->fifo.lock );
+
+        if( p_spu )
+            spu_ChangeSources( p_spu, p_cfg->video.psz_spu_sources );
     }
 
     return VLC_SUCCESS;
@@ -407,6 +483,22 @@ static int transcode_video_filters_init( sout_stream_t *p_stream,
 
 void transcode_video_clean( sout_stream_id_sys_t *id )
 {
+    if( id->p_lookahead )
+        transcode_lookahead_Delete( id->p_lookahead );
+
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        struct transcode_rendition *r = &id->p_renditions[i];
+        if( r->encoder )
+        {
+            transcode_encoder_close( r->encoder );
+            transcode_encoder_delete( r->encoder );
+        }
+        transcode_remove_filters( &r->p_conv );
+        block_ChainRelease( r->p_out );
+    }
+    free( id->p_renditions );
+
     /* Close encoder */
     transcode_encoder_close( id->encoder );
     transcode_encoder_delete( id->encoder );
@@ -430,12 +522,17 @@ void transcode_video_clean( sout_stream_id_sys_t *id )
 void transcode_video_push_spu( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
                                subpicture_t *p_subpicture )
 {
+    /* The video may be processed by another thread */
+    vlc_mutex_lock( &id->fifo.lock );
     if( !id->p_spu )
         id->p_spu = spu_Create( p_stream, NULL );
-    if( !id->p_spu )
+    spu_t *p_spu = id->p_spu;
+    vlc_mutex_unlock( &id->fifo.lock );
+
+    if( !p_spu )
         subpicture_Delete( p_subpicture );
     else
-        spu_PutSubpicture( id->p_spu, p_subpicture );
+        spu_PutSubpicture( p_spu, p_subpicture );
 }
 
 int transcode_video_get_output_dimensions( sout_stream_id_sys_t *id,
@@ -450,7 +547,11 @@ int transcode_video_get_output_dimensions( sout_stream_id_sys_t *id,
 
 static picture_t * RenderSubpictures( sout_stream_id_sys_t *id, picture_t *p_pic )
 {
-    if( !id->p_spu )
+    vlc_mutex_lock( &id->fifo.lock );
+    spu_t *p_spu = id->p_spu;
+    vlc_mutex_unlock( &id->fifo.lock );
+
+    if( !p_spu )
         return p_pic;
 
     /* Check if we have a subpicture to overlay */
@@ -467,14 +568,14 @@ static picture_t * RenderSubpictures( sout_stream_id_sys_t *id, picture_t *p_pic
         fmt.i_y_offset       = 0;
     }
 
-    subpicture_t *p_subpic = spu_Render( id->p_spu, NULL, &fmt,
+    subpicture_t *p_subpic = spu_Render( p_spu, NULL, &fmt,
                                          &outfmt, vlc_tick_now(), p_pic->date,
                                          false, false );
 
     /* Overlay subpicture */
     if( p_subpic )
     {
-        if( filter_chain_IsEmpty( id->p_f_chain ) )
+        if( filter_chain_IsEmpty( id->p_f_chain ) || id->i_renditions > 0 )
         {
             /* We can't modify the picture, we need to duplicate it,
                  * in this point the picture is already p_encoder->fmt.in format*/
@@ -487,7 +588,7 @@ static picture_t * RenderSubpictures( sout_stream_id_sys_t *id, picture_t *p_pic
             }
         }
         if( unlikely( !id->p_spu_blender ) )
-            id->p_spu_blender = filter_NewBlend( VLC_OBJECT( id->p_spu ), &fmt );
+            id->p_spu_blender = filter_NewBlend( VLC_OBJECT( p_spu ), &fmt );
         if( likely( id->p_spu_blender ) )
             picture_BlendSubpicture( p_pic, id->p_spu_blender, p_subpic );
         subpicture_Delete( p_subpic );
@@ -509,6 +610,263 @@ static void tag_last_block_with_flag( block_t **out, int i_flag )
     }
 }
 
+static void transcode_video_rendition_queue( sout_stream_id_sys_t *id,
+                                             struct transcode_rendition *r,
+                                             block_t *p_out )
+{
+    if( !p_out )
+        return;
+    vlc_mutex_lock( &id->fifo.lock );
+    block_ChainLastAppend( &r->pp_out_last, p_out );
+    vlc_mutex_unlock( &id->fifo.lock );
+}
+
+static int transcode_video_rendition_open( sout_stream_t *p_stream,
+                                           sout_stream_id_sys_t *id,
+                                           unsigned i_rendition,
+                                           picture_t *p_pic )
+{
+    struct transcode_rendition *r = &id->p_renditions[i_rendition];
+
+    if( !transcode_encoder_opened( r->encoder ) )
+    {
+        /* Keep the display aspect ratio for the missing dimension */
+        const video_format_t *p_src = &p_pic->format;
+        uint64_t i_display_width = (uint64_t)p_src->i_visible_width *
+                                   __MAX(p_src->i_sar_num, 1) /
+                                   __MAX(p_src->i_sar_den, 1);
+        if( r->cfg.video.i_width == 0 && p_src->i_visible_height )
+            r->cfg.video.i_width = ( r->cfg.video.i_height * i_display_width /
+                                     p_src->i_visible_height + 1 ) & ~1;
+        else if( r->cfg.video.i_height == 0 && i_display_width )
+            r->cfg.video.i_height = ( r->cfg.video.i_width *
+                                      (uint64_t)p_src->i_visible_height /
+                                      i_display_width + 1 ) & ~1;
+
+        transcode_encoder_video_configure( VLC_OBJECT(p_stream),
+                                           &id->p_decoder->fmt_out.video,
+                                           &r->cfg, p_src,
+                                           picture_GetVideoContext( p_pic ),
+                                           r->encoder );
+        if( transcode_encoder_open( r->encoder, &r->cfg ) != VLC_SUCCESS )
+        {
+            msg_Err( p_stream, "cannot open the encoder of rendition %u",
+                     i_rendition + 1 );
+            return VLC_EGENERIC;
+        }
+    }
+
+    if( !r->p_conv )
+    {
+        filter_owner_t owner = {
+            .video = &transcode_filter_video_cbs,
+            .sys = id,
+        };
+        const es_format_t *p_src = filter_chain_GetFmtOut( id->p_f_chain );
+        const es_format_t *p_dst = transcode_encoder_format_in( r->encoder );
+
+        r->p_conv = filter_chain_NewVideo( p_stream, false, &owner );
+        if( !r->p_conv )
+            return VLC_EGENERIC;
+        filter_chain_Reset( r->p_conv, p_src,
+                            filter_chain_GetVideoCtxOut( id->p_f_chain ), p_dst );
+
+        if( ( p_src->video.i_width != p_dst->video.i_width ||
+              p_src->video.i_height != p_dst->video.i_height ||
+              p_src->video.i_chroma != p_dst->video.i_chroma ) &&
+            filter_chain_AppendConverter( r->p_conv, p_dst ) != VLC_SUCCESS )
+        {
+            msg_Err( p_stream, "cannot convert pictures for rendition %u",
+                     i_rendition + 1 );
+            return VLC_EGENERIC;
+        }
+    }
+
+    if( !r->downstream_id )
+    {
+        es_format_t fmt_orig;
+        es_format_Copy( &fmt_orig, &id->p_decoder->fmt_in );
+        fmt_orig.i_id += TRANSCODE_RENDITION_ID_OFFSET * ( i_rendition + 1 );
+
+        void *downstream_id =
+            id->pf_transcode_downstream_add( p_stream, id, &fmt_orig,
+                                             transcode_encoder_format_out( r->encoder ) );
+        es_format_Clean( &fmt_orig );
+        if( !downstream_id )
+        {
+            msg_Err( p_stream, "cannot output rendition %u", i_rendition + 1 );
+            return VLC_EGENERIC;
+        }
+
+        vlc_mutex_lock( &id->fifo.lock );
+        r->downstream_id = downstream_id;
+        vlc_mutex_unlock( &id->fifo.lock );
+    }
+
+    return VLC_SUCCESS;
+}
+
+static void transcode_video_rendition_encode( sout_stream_t *p_stream,
+                                              sout_stream_id_sys_t *id,
+                                              unsigned i_rendition,
+                                              picture_t *p_pic )
+{
+    struct transcode_rendition *r = &id->p_renditions[i_rendition];
+    block_t *p_out = NULL;
+
+    if( r->b_error ||
+        transcode_video_rendition_open( p_stream, id, i_rendition, p_pic ) )
+    {
+        r->b_error = true;
+        picture_Release( p_pic );
+        return;
+    }
+
+    p_pic = filter_chain_VideoFilter( r->p_conv, p_pic );
+    if( p_pic )
+    {
+        block_ChainAppend( &p_out, transcode_encoder_encode( r->encoder, p_pic ) );
+        picture_Release( p_pic );
+    }
+
+    if( r->cfg.video.threads.i_count >= 1 )
+        block_ChainAppend( &p_out, transcode_encoder_get_output_async( r->encoder ) );
+
+    transcode_video_rendition_queue( id, r, p_out );
+}
+
+/* Drains the encoders of the other renditions, and closes them on EOS */
+static void transcode_video_renditions_drain( sout_stream_id_sys_t *id,
+                                              bool b_eos )
+{
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        struct transcode_rendition *r = &id->p_renditions[i];
+        block_t *p_out = NULL;
+
+        if( !r->b_error && transcode_encoder_opened( r->encoder ) )
+        {
+            if( transcode_encoder_drain( r->encoder, &p_out ) != VLC_SUCCESS )
+                r->b_error = true;
+            if( b_eos )
+            {
+                transcode_encoder_close( r->encoder );
+                tag_last_block_with_flag( &p_out, BLOCK_FLAG_END_OF_SEQUENCE );
+            }
+        }
+        if( b_eos )
+            transcode_remove_filters( &r->p_conv );
+
+        transcode_video_rendition_queue( id, r, p_out );
+    }
+}
+
+void transcode_video_renditions_output( sout_stream_t *p_stream,
+                                        sout_stream_id_sys_t *id )
+{
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        struct transcode_rendition *r = &id->p_renditions[i];
+
+        vlc_mutex_lock( &id->fifo.lock );
+        block_t *p_out = r->p_out;
+        void *downstream_id = r->downstream_id;
+        r->p_out = NULL;
+        r->pp_out_last = &r->p_out;
+        vlc_mutex_unlock( &id->fifo.lock );
+
+        /* the output stream exists if there is any output */
+        if( p_out )
+            sout_StreamIdSend( p_stream->p_next, downstream_id, p_out );
+    }
+}
+
+void transcode_video_renditions_del( sout_stream_t *p_stream,
+                                     sout_stream_id_sys_t *id )
+{
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+    {
+        struct transcode_rendition *r = &id->p_renditions[i];
+        if( r->downstream_id )
+            sout_StreamIdDel( p_stream->p_next, r->downstream_id );
+        r->downstream_id = NULL;
+    }
+}
+
+static void transcode_video_encode( sout_stream_t *p_stream,
+                                    sout_stream_id_sys_t *id,
+                                    picture_t *p_in, block_t **out )
+{
+    /* The other renditions share the decoded picture */
+    for( unsigned i = 0; i < id->i_renditions; i++ )
+        transcode_video_rendition_encode( p_stream, id, i, picture_Hold( p_in ) );
+
+    /* Run conversion chains */
+    filter_chain_t * primary_chains[] = { id->p_conv_nonstatic,
+                                          id->p_conv_static };
+    for( size_t i=0; p_in && i<ARRAY_SIZE(primary_chains); i++ )
+    {
+        if( !primary_chains[i] )
+            continue;
+        p_in = filter_chain_VideoFilter( primary_chains[i], p_in );
+    }
+
+    if( !p_in )
+        return;
+
+    /* Run the user specified filter chains first with the picture, and then
+     * with NULL as many times as we need until they stop outputting frames.
+     */
+    for ( ;; p_in = NULL /* drain second time */ )
+    {
+        filter_chain_t * secondary_chains[] = { id->p_uf_chain,
+                                                id->p_final_conv_static };
+        for( size_t i=0; i<ARRAY_SIZE(secondary_chains); i++ )
+        {
+            if( !secondary_chains[i] )
+                continue;
+            /* a NULL picture pulls the pictures pending in the chain */
+            p_in = filter_chain_VideoFilter( secondary_chains[i], p_in );
+            if( !p_in )
+                break;
+        }
+
+        if( !p_in )
+            break;
+
+        /* Blend subpictures */
+        p_in = RenderSubpictures( id, p_in );
+
+        if( p_in )
+        {
+            block_t *p_encoded = transcode_encoder_encode( id->encoder, p_in );
+            if( p_encoded )
+                block_ChainAppend( out, p_encoded );
+            picture_Release( p_in );
+        }
+    }
+}
+
+/* Encodes the pictures leaving the lookahead, all of them if p_pic is NULL */
+static void transcode_video_lookahead( sout_stream_t *p_stream,
+                                       sout_stream_id_sys_t *id,
+                                       picture_t *p_pic, block_t **out )
+{
+    const bool b_drain = p_pic == NULL;
+
+    if( !id->p_lookahead )
+    {
+        if( p_pic )
+            transcode_video_encode( p_stream, id, p_pic, out );
+        return;
+    }
+
+    if( p_pic )
+        transcode_lookahead_Push( id->p_lookahead, p_pic );
+    while( ( p_pic = transcode_lookahead_Pop( id->p_lookahead, b_drain ) ) )
+        transcode_video_encode( p_stream, id, p_pic, out );
+}
+
 int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
                                     block_t *in, block_t **out )
 {
@@ -566,6 +924,8 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
                 if( id->p_spu_blender )
                     filter_DeleteBlend( id->p_spu_blender );
                 id->p_spu_blender = NULL;
+                for( unsigned i = 0; i < id->i_renditions; i++ )
+                    transcode_remove_filters( &id->p_renditions[i].p_conv );
 
                 video_format_Clean( &id->decoder_out.video );
             }
@@ -631,7 +991,7 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
 
             if( !id->downstream_id )
                 id->downstream_id =
-                    id->pf_transcode_downstream_add( p_stream,
+                    id->pf_transcode_downstream_add( p_stream, id,
                                                      &id->p_decoder->fmt_in,
                                                      transcode_encoder_format_out( id->encoder ) );
             if( !id->downstream_id )
@@ -642,57 +1002,28 @@ int transcode_video_process( sout_stream_t *p_stream, sout_stream_id_sys_t *id,
             }
         }
 
-        /* Run the filter and output chains; first with the picture,
-         * and then with NULL as many times as we need until they
-         * stop outputting frames.
+        /* Run the decoding filter chain (deinterlacing, frame rate), then
+         * the lookahead, the renditions and the output chains; first with
+         * the picture, and then with NULL as many times as we need until
+         * they stop outputting frames.
          */
         for ( picture_t *p_in = p_pic; ; p_in = NULL /* drain second time */ )
         {
             /* Run filter chain */
-            filter_chain_t * primary_chains[] = { id->p_f_chain,
-                                                  id->p_conv_nonstatic,
-                                                  id->p_conv_static };
-            for( size_t i=0; p_in && i<ARRAY_SIZE(primary_chains); i++ )
-            {
-                if( !primary_chains[i] )
-                    continue;
-                p_in = filter_chain_VideoFilter( primary_chains[i], p_in );
-            }
+            if( id->p_f_chain )
+                p_in = filter_chain_VideoFilter( id->p_f_chain, p_in );
 
             if( !p_in )
                 break;
 
-            for ( ;; p_in = NULL /* drain second time */ )
-            {
-                /* Run user specified filter chain */
-                filter_chain_t * secondary_chains[] = { id->p_uf_chain,
-                                                        id->p_final_conv_static };
-                for( size_t i=0; p_in && i<ARRAY_SIZE(secondary_chains); i++ )
-                {
-                    if( !secondary_chains[i] )
-                        continue;
-                    p_in = filter_chain_VideoFilter( secondary_chains[i], p_in );
-                }
-
-                if( !p_in )
-                    break;
-
-                /* Blend subpictures */
-                p_in = RenderSubpictures( id, p_in );
-
-                if( p_in )
-                {
-                    block_t *p_encoded = transcode_encoder_encode( id->encoder, p_in );
-                    if( p_encoded )
-                        block_ChainAppend( out, p_encoded );
-                    picture_Release( p_in );
-                }
-            }
+            transcode_video_lookahead( p_stream, id, p_in, out );
         }
 
         if( b_eos )
         {
             msg_Info( p_stream, "Drain/restart on EOS" );
+            transcode_video_lookahead( p_stream, id, NULL, out );
+            transcode_video_renditions_drain( id, true );
             if( transcode_encoder_drain( id->encoder, out ) != VLC_SUCCESS )
                 goto error;
             transcode_encoder_close( id->encoder );
@@ -723,6 +1054,8 @@ error:
     if( unlikely( !id->b_error && in == NULL ) && transcode_encoder_opened( id->encoder ) )
     {
         msg_Dbg( p_stream, "Flushing thread and waiting that");
+        transcode_video_lookahead( p_stream, id, NULL, out );
+        transcode_video_renditions_drain( id, false );
         if( transcode_encoder_drain( id->encoder, out ) == VLC_SUCCESS )
             msg_Dbg( p_stream, "Flushing done");
         else
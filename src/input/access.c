@@ -329,7 +329,12 @@ stream_t *stream_AccessNew(vlc_object_t *parent, input_thread_t *input,
         s->pf_control = AStreamControl;
         s->p_sys = access;
 
-        s = stream_FilterChainNew(s, "prefetch,cache");
+        /* Blocks of a memory mapped access are peeked in place, caching
+         * them would only add copies */
+        bool mapped;
+        if (vlc_stream_Control(access, STREAM_IS_MEMORY_MAPPED,
+                               &mapped) != VLC_SUCCESS || !mapped)
+            s = stream_FilterChainNew(s, "prefetch,cache");
     }
     else
         s = access;
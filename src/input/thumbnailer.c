@@ -34,26 +34,33 @@ struct vlc_thumbnailer_t
     struct background_worker* worker;
 };
 
-typedef struct vlc_thumbnailer_params_t
+struct thumbnailer_target
 {
     union
     {
         vlc_tick_t time;
         float pos;
     };
+    size_t index; /**< index in the caller's list */
+};
+
+typedef struct vlc_thumbnailer_params_t
+{
     enum
     {
         VLC_THUMBNAILER_SEEK_TIME,
         VLC_THUMBNAILER_SEEK_POS,
     } type;
-    bool fast_seek;
+    enum vlc_thumbnailer_seek_speed speed;
     input_item_t* input_item;
     /**
      * A positive value will be used as the timeout duration
      * VLC_TICK_INVALID means no timeout
      */
     vlc_tick_t timeout;
+    /* Exactly one of the callbacks is set */
     vlc_thumbnailer_cb cb;
+    vlc_thumbnailer_batch_cb batch_cb;
     void* user_data;
 } vlc_thumbnailer_params_t;
 
@@ -66,8 +73,44 @@ struct vlc_thumbnailer_request_t
 
     vlc_mutex_t lock;
     bool done;
+
+    /* Sorted, so that the single input only seeks forward */
+    size_t count;
+    size_t next; /**< first target without a thumbnail */
+    struct thumbnailer_target targets[];
 };
 
+/* Must be called with the request lock held */
+static void thumbnailer_request_Notify( vlc_thumbnailer_request_t* request,
+                                        picture_t* pic )
+{
+    vlc_mutex_assert( &request->lock );
+    assert( request->next < request->count );
+
+    size_t index = request->targets[request->next++].index;
+    if ( request->params.cb )
+    {
+        request->params.cb( request->params.user_data, pic );
+        request->params.cb = NULL;
+    }
+    else if ( request->params.batch_cb )
+        request->params.batch_cb( request->params.user_data, index, pic );
+}
+
+static void thumbnailer_request_Seek( vlc_thumbnailer_request_t* request )
+{
+    const struct thumbnailer_target *target = &request->targets[request->next];
+    bool fast_seek = request->params.speed != VLC_THUMBNAILER_SEEK_PRECISE;
+
+    if ( request->params.type == VLC_THUMBNAILER_SEEK_TIME )
+        input_SetTime( request->input_thread, target->time, fast_seek );
+    else
+    {
+        assert( request->params.type == VLC_THUMBNAILER_SEEK_POS );
+        input_SetPosition( request->input_thread, target->pos, fast_seek );
+    }
+}
+
 static void
 on_thumbnailer_input_event( input_thread_t *input,
                             const struct vlc_input_event *event, void *userdata )
@@ -79,28 +122,39 @@ on_thumbnailer_input_event( input_thread_t *input,
          return;
 
     vlc_thumbnailer_request_t* request = userdata;
-    picture_t *pic = NULL;
 
+    vlc_mutex_lock( &request->lock );
+    if ( request->done )
+    {
+        vlc_mutex_unlock( &request->lock );
+        return;
+    }
     if ( event->type == INPUT_EVENT_THUMBNAIL_READY )
     {
+        thumbnailer_request_Notify( request, event->thumbnail );
+        /*
+         * Seeking flushes the decoder, which will then output the thumbnail
+         * for the next target, from the same input.
+         */
+        if ( request->next < request->count )
+        {
+            thumbnailer_request_Seek( request );
+            vlc_mutex_unlock( &request->lock );
+            return;
+        }
         /*
          * Stop the input thread ASAP, delegate its release to
          * thumbnailer_request_Release
          */
         input_Stop( request->input_thread );
-        pic = event->thumbnail;
     }
-    vlc_mutex_lock( &request->lock );
-    request->done = true;
     /*
      * If the request has not been cancelled, we can invoke the completion
-     * callback.
+     * callback for the targets left.
      */
-    if ( request->params.cb )
-    {
-        request->params.cb( request->params.user_data, pic );
-        request->params.cb = NULL;
-    }
+    while ( request->next < request->count )
+        thumbnailer_request_Notify( request, NULL );
+    request->done = true;
     vlc_mutex_unlock( &request->lock );
     background_worker_RequestProbe( request->thumbnailer->worker );
 }
@@ -120,6 +174,14 @@ static void thumbnailer_request_Release( void* data )
     free( request );
 }
 
+static void thumbnailer_request_Fail( vlc_thumbnailer_request_t* request )
+{
+    vlc_mutex_lock( &request->lock );
+    while ( request->next < request->count )
+        thumbnailer_request_Notify( request, NULL );
+    vlc_mutex_unlock( &request->lock );
+}
+
 static int thumbnailer_request_Start( void* owner, void* entity, void** out )
 {
     vlc_thumbnailer_t* thumbnailer = owner;
@@ -130,23 +192,19 @@ static int thumbnailer_request_Start( void* owner, void* entity, void** out )
                                      request->params.input_item );
     if ( unlikely( input == NULL ) )
     {
-        request->params.cb( request->params.user_data, NULL );
+        thumbnailer_request_Fail( request );
         return VLC_EGENERIC;
     }
-    if ( request->params.type == VLC_THUMBNAILER_SEEK_TIME )
-    {
-        input_SetTime( input, request->params.time,
-                       request->params.fast_seek );
-    }
-    else
+    if ( request->params.speed == VLC_THUMBNAILER_SEEK_KEYFRAME )
     {
-        assert( request->params.type == VLC_THUMBNAILER_SEEK_POS );
-        input_SetPosition( input, request->params.pos,
-                       request->params.fast_seek );
+        /* Inherited by the decoders: skip all but the key frames */
+        var_Create( input, "avcodec-skip-frame", VLC_VAR_INTEGER );
+        var_SetInteger( input, "avcodec-skip-frame", 3 );
     }
+    thumbnailer_request_Seek( request );
     if ( input_Start( input ) != VLC_SUCCESS )
     {
-        request->params.cb( request->params.user_data, NULL );
+        thumbnailer_request_Fail( request );
         return VLC_EGENERIC;
     }
     *out = request;
@@ -160,14 +218,12 @@ static void thumbnailer_request_Stop( void* owner, void* handle )
     vlc_thumbnailer_request_t *request = handle;
     vlc_mutex_lock( &request->lock );
     /*
-     * If the callback hasn't been invoked yet, we assume a timeout and
-     * signal it back to the user
+     * If the callback hasn't been invoked for all the targets yet, we assume
+     * a timeout and signal it back to the user
      */
-    if ( request->params.cb != NULL )
-    {
-        request->params.cb( request->params.user_data, NULL );
-        request->params.cb = NULL;
-    }
+    while ( request->next < request->count )
+        thumbnailer_request_Notify( request, NULL );
+    request->done = true;
     vlc_mutex_unlock( &request->lock );
     assert( request->input_thread != NULL );
     input_Stop( request->input_thread );
@@ -183,17 +239,56 @@ static int thumbnailer_request_Probe( void* owner, void* handle )
     return res;
 }
 
+static int target_CompareTime( const void* a, const void* b )
+{
+    const struct thumbnailer_target *ta = a, *tb = b;
+    if ( ta->time != tb->time )
+        return ta->time < tb->time ? -1 : 1;
+    return ta->index < tb->index ? -1 : ta->index > tb->index;
+}
+
+static int target_ComparePos( const void* a, const void* b )
+{
+    const struct thumbnailer_target *ta = a, *tb = b;
+    if ( ta->pos != tb->pos )
+        return ta->pos < tb->pos ? -1 : 1;
+    return ta->index < tb->index ? -1 : ta->index > tb->index;
+}
+
 static vlc_thumbnailer_request_t*
 thumbnailer_RequestCommon( vlc_thumbnailer_t* thumbnailer,
-                           const vlc_thumbnailer_params_t* params )
+                           const vlc_thumbnailer_params_t* params,
+                           const vlc_tick_t* times, const float* positions,
+                           size_t count )
 {
-    vlc_thumbnailer_request_t *request = malloc( sizeof( *request ) );
+    assert( count > 0 );
+    assert( ( params->cb != NULL ) != ( params->batch_cb != NULL ) );
+
+    vlc_thumbnailer_request_t *request;
+    size_t size;
+    if ( mul_overflow( count, sizeof( request->targets[0] ), &size ) ||
+         add_overflow( size, sizeof( *request ), &size ) )
+        return NULL;
+    request = malloc( size );
     if ( unlikely( request == NULL ) )
         return NULL;
     request->thumbnailer = thumbnailer;
     request->input_thread = NULL;
     request->params = *(vlc_thumbnailer_params_t*)params;
     request->done = false;
+    request->count = count;
+    request->next = 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        if ( params->type == VLC_THUMBNAILER_SEEK_TIME )
+            request->targets[i].time = times[i];
+        else
+            request->targets[i].pos = positions[i];
+        request->targets[i].index = i;
+    }
+    qsort( request->targets, count, sizeof( request->targets[0] ),
+           params->type == VLC_THUMBNAILER_SEEK_TIME ?
+           target_CompareTime : target_ComparePos );
     input_item_Hold( request->params.input_item );
     vlc_mutex_init( &request->lock );
 
@@ -217,14 +312,13 @@ vlc_thumbnailer_RequestByTime( vlc_thumbnailer_t *thumbnailer,
 {
     return thumbnailer_RequestCommon( thumbnailer,
             &(const vlc_thumbnailer_params_t){
-                .time = time,
                 .type = VLC_THUMBNAILER_SEEK_TIME,
-                .fast_seek = speed == VLC_THUMBNAILER_SEEK_FAST,
+                .speed = speed,
                 .input_item = input_item,
                 .timeout = timeout,
                 .cb = cb,
                 .user_data = user_data,
-        });
+        }, &time, NULL, 1 );
 }
 
 vlc_thumbnailer_request_t*
@@ -235,22 +329,76 @@ vlc_thumbnailer_RequestByPos( vlc_thumbnailer_t *thumbnailer,
 {
     return thumbnailer_RequestCommon( thumbnailer,
             &(const vlc_thumbnailer_params_t){
-                .pos = pos,
                 .type = VLC_THUMBNAILER_SEEK_POS,
-                .fast_seek = speed == VLC_THUMBNAILER_SEEK_FAST,
+                .speed = speed,
                 .input_item = input_item,
                 .timeout = timeout,
                 .cb = cb,
                 .user_data = user_data,
-        });
+        }, NULL, &pos, 1 );
+}
+
+vlc_thumbnailer_request_t*
+vlc_thumbnailer_RequestBatchByTime( vlc_thumbnailer_t *thumbnailer,
+                                    const vlc_tick_t *times, size_t count,
+                                    enum vlc_thumbnailer_seek_speed speed,
+                                    input_item_t *input_item,
+                                    vlc_tick_t timeout,
+                                    vlc_thumbnailer_batch_cb cb,
+                                    void* user_data )
+{
+    if ( count == 0 )
+        return NULL;
+    return thumbnailer_RequestCommon( thumbnailer,
+            &(const vlc_thumbnailer_params_t){
+                .type = VLC_THUMBNAILER_SEEK_TIME,
+                .speed = speed,
+                .input_item = input_item,
+                .timeout = timeout,
+                .batch_cb = cb,
+                .user_data = user_data,
+        }, times, NULL, count );
+}
+
+vlc_thumbnailer_request_t*
+vlc_thumbnailer_RequestBatchByPos( vlc_thumbnailer_t *thumbnailer,
+                                   size_t count,
+                                   enum vlc_thumbnailer_seek_speed speed,
+                                   input_item_t *input_item,
+                                   vlc_tick_t timeout,
+                                   vlc_thumbnailer_batch_cb cb,
+                                   void* user_data )
+{
+    if ( count == 0 )
+        return NULL;
+
+    float *positions = vlc_alloc( count, sizeof( *positions ) );
+    if ( unlikely( positions == NULL ) )
+        return NULL;
+    /* Evenly spaced, neither the first nor the last frame */
+    for ( size_t i = 0; i < count; ++i )
+        positions[i] = (float)( i + 1 ) / ( count + 1 );
+
+    vlc_thumbnailer_request_t *request = thumbnailer_RequestCommon( thumbnailer,
+            &(const vlc_thumbnailer_params_t){
+                .type = VLC_THUMBNAILER_SEEK_POS,
+                .speed = speed,
+                .input_item = input_item,
+                .timeout = timeout,
+                .batch_cb = cb,
+                .user_data = user_data,
+        }, NULL, positions, count );
+    free( positions );
+    return request;
 }
 
 void vlc_thumbnailer_Cancel( vlc_thumbnailer_t* thumbnailer,
                              vlc_thumbnailer_request_t* req )
 {
     vlc_mutex_lock( &req->lock );
-    /* Ensure we won't invoke the callback if the input was running. */
+    /* Ensure we won't invoke the callbacks if the input was running. */
     req->params.cb = NULL;
+    req->params.batch_cb = NULL;
     vlc_mutex_unlock( &req->lock );
     background_worker_Cancel( thumbnailer->worker, req );
 }
@@ -264,13 +412,15 @@ vlc_thumbnailer_t *vlc_thumbnailer_Create( vlc_object_t* parent)
     struct background_worker_config cfg = {
         .default_timeout = -1,
         .max_threads = 1,
+        .priority = VLC_EXECUTOR_PRIORITY_HIGH,
         .pf_release = thumbnailer_request_Release,
         .pf_hold = thumbnailer_request_Hold,
         .pf_start = thumbnailer_request_Start,
         .pf_probe = thumbnailer_request_Probe,
         .pf_stop = thumbnailer_request_Stop,
     };
-    thumbnailer->worker = background_worker_New( thumbnailer, &cfg );
+    thumbnailer->worker = background_worker_New( thumbnailer,
+        libvlc_priv( vlc_object_instance(parent) )->executor, &cfg );
     if ( unlikely( thumbnailer->worker == NULL ) )
     {
         free( thumbnailer );
@@ -876,6 +876,12 @@ static const char *const ppsz_prefres[] = {
     "Specify an IP address (e.g. ::1 or 127.0.0.1) or a host name " \
     "(e.g. localhost) to restrict them to a specific network interface." )
 
+#define HTTP_THREADS_TEXT N_( "HTTP server threads" )
+#define HTTP_THREADS_LONGTEXT N_( \
+    "Number of threads serving the clients of the built-in HTTP and RTSP " \
+    "servers. Clients are spread evenly over the threads. " \
+    "0 picks a value from the number of CPUs." )
+
 #define HTTP_PORT_TEXT N_( "HTTP server port" )
 #define HTTP_PORT_LONGTEXT N_( \
     "The HTTP server will listen on this TCP port. " \
@@ -1134,6 +1140,13 @@ static const char *const ppsz_prefres[] = {
 #define ONEINSTANCEWHENSTARTEDFROMFILE_TEXT N_( \
     "Use only one instance when started from file manager")
 
+#define CPU_BUDGET_TEXT N_("Codec CPU budget")
+#define CPU_BUDGET_LONGTEXT N_( \
+    "Number of cores shared by the decoders and encoders using threads. " \
+    "Each one gets a part of them, depending on the number of streams, " \
+    "when it starts: running codecs keep their threads. " \
+    "0 uses as many cores as available.")
+
 #define HPRIORITY_TEXT N_("Increase the priority of the process")
 #define HPRIORITY_LONGTEXT N_( \
     "Increasing the priority of the process will very likely improve your " \
@@ -1192,11 +1205,17 @@ static const char *const clock_sources_text[] = {
 
 #define PREPARSE_THREADS_TEXT N_( "Preparsing threads" )
 #define PREPARSE_THREADS_LONGTEXT N_( \
-    "Maximum number of threads used to preparse items" )
+    "Maximum number of items preparsed at once, 0 for one per CPU core" )
+
+#define PREPARSE_FAST_TEXT N_( "Fast local files preparsing" )
+#define PREPARSE_FAST_LONGTEXT N_( \
+    "Preparse local files by only reading their headers, without starting " \
+    "an input. Files needing an input (playlists...) are still preparsed " \
+    "normally." )
 
 #define FETCH_ART_THREADS_TEXT N_( "Fetch-art threads" )
 #define FETCH_ART_THREADS_LONGTEXT N_( \
-    "Maximum number of threads used to fetch art" )
+    "Maximum number of items fetching art at once" )
 
 #define METADATA_NETWORK_TEXT N_( "Allow metadata network access" )
 
@@ -1899,6 +1918,9 @@ vlc_module_begin ()
         change_integer_range( 1, 65535 )
     add_integer( "https-port", 8443, HTTPS_PORT_TEXT, HTTPS_PORT_LONGTEXT, true )
         change_integer_range( 1, 65535 )
+    add_integer( "http-threads", 0, HTTP_THREADS_TEXT,
+                 HTTP_THREADS_LONGTEXT, true )
+        change_integer_range( 0, 64 )
     add_string( "rtsp-host", NULL, RTSP_HOST_TEXT, RTSP_HOST_LONGTEXT, true )
     add_integer( "rtsp-port", 554, RTSP_PORT_TEXT, RTSP_PORT_LONGTEXT, true )
         change_integer_range( 1, 65535 )
@@ -2145,6 +2167,9 @@ vlc_module_begin ()
 
     set_section( N_("Performance options"), NULL )
 
+    add_integer( "cpu-budget", 0, CPU_BUDGET_TEXT, CPU_BUDGET_LONGTEXT, true )
+        change_integer_range( 0, 1024 )
+
 #if defined (LIBVLC_USE_PTHREAD)
     add_obsolete_bool( "rt-priority" ) /* since 4.0.0 */
     add_obsolete_integer( "rt-offset" ) /* since 4.0.0 */
@@ -2212,9 +2237,12 @@ vlc_module_begin ()
     add_integer( "preparse-timeout", 5000, PREPARSE_TIMEOUT_TEXT,
                  PREPARSE_TIMEOUT_LONGTEXT, false )
 
-    add_integer( "preparse-threads", 1, PREPARSE_THREADS_TEXT,
+    add_integer( "preparse-threads", 0, PREPARSE_THREADS_TEXT,
                  PREPARSE_THREADS_LONGTEXT, false )
 
+    add_bool( "preparse-fast", false, PREPARSE_FAST_TEXT,
+              PREPARSE_FAST_LONGTEXT, false )
+
     add_integer( "fetch-art-threads", 1, FETCH_ART_THREADS_TEXT,
                  FETCH_ART_THREADS_LONGTEXT, false )
 
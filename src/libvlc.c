@@ -41,6 +41,8 @@
 #include "modules/modules.h"
 #include "config/configuration.h"
 #include "preparser/preparser.h"
+#include "misc/executor.h"
+#include "misc/cpu_budget.h"
 #include "media_source/media_source.h"
 
 #include <stdio.h>                                              /* sprintf() */
@@ -95,6 +97,8 @@ libvlc_int_t * libvlc_InternalCreate( void )
     priv->main_playlist = NULL;
     priv->p_vlm = NULL;
     priv->media_source_provider = NULL;
+    priv->executor = NULL;
+    priv->cpu_budget = NULL;
 
     vlc_ExitInit( &priv->exit );
 
@@ -205,6 +209,17 @@ int libvlc_InternalInit( libvlc_int_t *p_libvlc, int i_argc,
 
     vlc_CPU_dump( VLC_OBJECT(p_libvlc) );
 
+    /* Threads for the preparser, the art fetcher and the thumbnailer,
+     * started on demand */
+    priv->executor = vlc_executor_New( 0, VLC_TICK_FROM_SEC(5) );
+    if( !priv->executor )
+        goto error;
+
+    priv->cpu_budget = vlc_cpu_budget_New( var_InheritInteger( p_libvlc,
+                                                               "cpu-budget" ) );
+    if( !priv->cpu_budget )
+        goto error;
+
     if( var_InheritBool( p_libvlc, "media-library") )
     {
         priv->p_media_library = libvlc_MlCreate( p_libvlc );
@@ -387,6 +402,27 @@ void libvlc_InternalCleanup( libvlc_int_t *p_libvlc )
 
     libvlc_InternalActionsClean( p_libvlc );
 
+    if( priv->executor )
+    {
+        struct vlc_executor_stats stats;
+        vlc_executor_GetStats( priv->executor, &stats );
+        msg_Dbg( p_libvlc, "background jobs: %"PRIu64" run by %u threads "
+                 "(%"PRIu64" stolen, %"PRIu64" canceled), %"PRId64" ms busy, "
+                 "%"PRId64" ms queued", stats.executed, stats.threads,
+                 stats.stolen, stats.canceled, MS_FROM_VLC_TICK(stats.busy),
+                 MS_FROM_VLC_TICK(stats.waited) );
+        vlc_executor_Delete( priv->executor );
+    }
+
+    if( priv->cpu_budget )
+    {
+        struct vlc_cpu_budget_stats stats;
+        vlc_cpu_budget_Read( priv->cpu_budget, &stats );
+        msg_Dbg( p_libvlc, "codec threads: %u core(s) budget, %u%% average "
+                 "process load", stats.budget, stats.load );
+        vlc_cpu_budget_Delete( priv->cpu_budget );
+    }
+
     /* Save the configuration */
     if( !var_InheritBool( p_libvlc, "ignore-config" ) )
         config_AutoSaveConfigFile( VLC_OBJECT(p_libvlc) );
@@ -190,6 +190,8 @@ typedef struct libvlc_priv_t
     intf_thread_t *interfaces;  ///< Linked-list of interfaces
     vlc_playlist_t *main_playlist;
     struct input_preparser_t *parser; ///< Input item meta data handler
+    struct vlc_executor *executor; ///< Threads shared by background tasks
+    struct vlc_cpu_budget *cpu_budget; ///< Cores shared by the codecs
     vlc_media_source_provider_t *media_source_provider;
     vlc_actions_t *actions; ///< Hotkeys handler
     struct vlc_medialibrary_t *p_media_library; ///< Media library instance
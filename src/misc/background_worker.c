@@ -28,38 +28,43 @@
 #include "libvlc.h"
 #include "background_worker.h"
 
+/*
+ * Tasks do not own a thread: pf_start, pf_probe and pf_stop are called from
+ * short jobs run by the shared executor, so that waiting for a running task
+ * does not hold any thread.
+ */
 struct task {
-    struct vlc_list node;
+    struct background_worker *worker;
+    struct vlc_list node; /**< in the queue or in the running list */
+    struct vlc_executor_job job; /**< start, then check the task */
     void* id; /**< id associated with entity */
     void* entity; /**< the entity to process */
     vlc_tick_t timeout; /**< timeout duration in vlc_tick_t */
-};
-
-struct background_worker;
-
-struct background_thread {
-    struct background_worker *owner;
-    vlc_cond_t probe_cancel_wait; /**< wait for probe request or cancelation */
-    bool probe; /**< true if a probe is requested */
-    bool cancel; /**< true if a cancel is requested */
-    struct task *task; /**< current task */
-    struct vlc_list node;
+    void *handle; /**< handle returned by pf_start */
+    vlc_timer_t timer; /**< fires on timeout */
+    bool has_timer;
+
+    /* protected by the worker lock */
+    bool started; /**< pf_start succeeded */
+    bool canceled; /**< cancellation token, checked before each step */
+    bool expired; /**< timeout reached */
+    bool probe; /**< a probe is requested */
+    bool checking; /**< a check job is queued or running */
+    unsigned long runner; /**< thread running a step of the task, or 0 */
 };
 
 struct background_worker {
     void* owner;
+    vlc_executor_t *executor;
     struct background_worker_config conf;
+    int max_tasks;
 
     vlc_mutex_t lock;
 
-    int uncompleted; /**< number of tasks requested but not completed */
-    int nthreads; /**< number of threads in the threads list */
-    struct vlc_list threads; /**< list of active background_thread instances */
-
-    struct vlc_list queue; /**< queue of tasks */
-    vlc_cond_t queue_wait; /**< wait for the queue to be non-empty */
-
-    vlc_cond_t nothreads_wait; /**< wait for nthreads == 0 */
+    struct vlc_list queue; /**< tasks waiting for a slot */
+    struct vlc_list running; /**< tasks started or being started */
+    int nrunning; /**< number of tasks in the running list */
+    vlc_cond_t finish_wait; /**< signaled when a running task finishes */
     bool closing; /**< true if background worker deletion is requested */
 };
 
@@ -70,9 +75,19 @@ static struct task *task_Create(struct background_worker *worker, void *id,
     if (unlikely(!task))
         return NULL;
 
+    task->worker = worker;
     task->id = id;
     task->entity = entity;
     task->timeout = timeout < 0 ? worker->conf.default_timeout : VLC_TICK_FROM_MS(timeout);
+    task->handle = NULL;
+    task->has_timer = false;
+    task->started = false;
+    task->canceled = false;
+    task->expired = false;
+    task->probe = false;
+    task->checking = false;
+    task->runner = 0;
+    task->job.priority = worker->conf.priority;
     worker->conf.pf_hold(task->entity);
     return task;
 }
@@ -83,209 +98,188 @@ static void task_Destroy(struct background_worker *worker, struct task *task)
     free(task);
 }
 
-static struct task *QueueTake(struct background_worker *worker, int timeout_ms)
+static void TasksDestroy(struct background_worker *worker,
+                         struct vlc_list *tasks)
 {
-    vlc_mutex_assert(&worker->lock);
-
-    vlc_tick_t deadline = vlc_tick_now() + VLC_TICK_FROM_MS(timeout_ms);
-    bool timeout = false;
-    while (!timeout && !worker->closing && vlc_list_is_empty(&worker->queue))
-        timeout = vlc_cond_timedwait(&worker->queue_wait,
-                                     &worker->lock, deadline) != 0;
-
-    if (worker->closing || timeout)
-        return NULL;
-
-    struct task *task = vlc_list_first_entry_or_null(&worker->queue,
-                                                     struct task, node);
-    assert(task);
-    vlc_list_remove(&task->node);
-
-    return task;
+    struct task *task;
+    vlc_list_foreach(task, tasks, node)
+        task_Destroy(worker, task);
 }
 
-static void QueuePush(struct background_worker *worker, struct task *task)
-{
-    vlc_mutex_assert(&worker->lock);
-    vlc_list_append(&task->node, &worker->queue);
-    vlc_cond_signal(&worker->queue_wait);
-}
+static void StartJob(struct vlc_executor_job *job);
+static void CheckJob(struct vlc_executor_job *job);
 
-static void QueueRemoveAll(struct background_worker *worker, void *id)
+static void StartNextLocked(struct background_worker *worker)
 {
     vlc_mutex_assert(&worker->lock);
-    struct task *task;
-    vlc_list_foreach(task, &worker->queue, node)
+
+    while (worker->nrunning < worker->max_tasks && !worker->closing)
     {
-        if (!id || task->id == id)
-        {
-            vlc_list_remove(&task->node);
-            task_Destroy(worker, task);
-        }
+        struct task *task = vlc_list_first_entry_or_null(&worker->queue,
+                                                         struct task, node);
+        if (!task)
+            break;
+
+        vlc_list_remove(&task->node);
+        vlc_list_append(&task->node, &worker->running);
+        worker->nrunning++;
+
+        task->job.run = StartJob;
+        vlc_executor_Submit(worker->executor, &task->job);
     }
 }
 
-static struct background_thread *
-background_thread_Create(struct background_worker *owner)
+/* Remove a task from the running list, starting the next one */
+static void Finish(struct task *task)
 {
-    struct background_thread *thread = malloc(sizeof(*thread));
-    if (!thread)
-        return NULL;
+    struct background_worker *worker = task->worker;
 
-    vlc_cond_init(&thread->probe_cancel_wait);
-    thread->probe = false;
-    thread->cancel = false;
-    thread->task = NULL;
-    thread->owner = owner;
-    return thread;
-}
+    if (task->has_timer)
+        vlc_timer_destroy(task->timer);
 
-static void background_thread_Destroy(struct background_thread *thread)
-{
-    free(thread);
+    vlc_mutex_lock(&worker->lock);
+    vlc_list_remove(&task->node);
+    vlc_mutex_unlock(&worker->lock);
+
+    task_Destroy(worker, task);
+
+    /* the worker may be deleted as soon as the last task is finished */
+    vlc_mutex_lock(&worker->lock);
+    worker->nrunning--;
+    assert(worker->nrunning >= 0);
+    StartNextLocked(worker);
+    vlc_cond_broadcast(&worker->finish_wait);
+    vlc_mutex_unlock(&worker->lock);
 }
 
-static struct background_worker *background_worker_Create(void *owner,
-                                         struct background_worker_config *conf)
+static void Stop(struct task *task)
 {
-    struct background_worker* worker = malloc(sizeof(*worker));
-    if (unlikely(!worker))
-        return NULL;
-
-    worker->conf = *conf;
-    worker->owner = owner;
+    struct background_worker *worker = task->worker;
 
-    vlc_mutex_init(&worker->lock);
-    worker->uncompleted = 0;
-    worker->nthreads = 0;
-    vlc_list_init(&worker->threads);
-    vlc_list_init(&worker->queue);
-    vlc_cond_init(&worker->queue_wait);
-    vlc_cond_init(&worker->nothreads_wait);
-    worker->closing = false;
-    return worker;
+    worker->conf.pf_stop(worker->owner, task->handle);
+    Finish(task);
 }
 
-static void background_worker_Destroy(struct background_worker *worker)
+static void RequestCheckLocked(struct task *task)
 {
-    free(worker);
+    struct background_worker *worker = task->worker;
+    vlc_mutex_assert(&worker->lock);
+
+    task->probe = true;
+    /* until started, the start job takes care of the request */
+    if (task->started && !task->checking)
+    {
+        task->checking = true;
+        task->job.run = CheckJob;
+        vlc_executor_Submit(worker->executor, &task->job);
+    }
 }
 
-static void TerminateTask(struct background_thread *thread, struct task *task)
+static void OnTimeout(void *data)
 {
-    struct background_worker *worker = thread->owner;
+    struct task *task = data;
+    struct background_worker *worker = task->worker;
 
     vlc_mutex_lock(&worker->lock);
-    thread->task = NULL;
-    worker->uncompleted--;
-    assert(worker->uncompleted >= 0);
+    task->expired = true;
+    RequestCheckLocked(task);
     vlc_mutex_unlock(&worker->lock);
-
-    task_Destroy(worker, task);
 }
 
-static void RemoveThread(struct background_thread *thread)
+static void StartJob(struct vlc_executor_job *job)
 {
-    struct background_worker *worker = thread->owner;
+    struct task *task = container_of(job, struct task, job);
+    struct background_worker *worker = task->worker;
 
     vlc_mutex_lock(&worker->lock);
+    bool canceled = task->canceled;
+    task->runner = vlc_thread_id();
+    vlc_mutex_unlock(&worker->lock);
 
-    vlc_list_remove(&thread->node);
-    worker->nthreads--;
-    assert(worker->nthreads >= 0);
-    if (!worker->nthreads)
-        vlc_cond_signal(&worker->nothreads_wait);
+    void *handle;
+    if (canceled
+     || worker->conf.pf_start(worker->owner, task->entity, &handle))
+    {
+        Finish(task);
+        return;
+    }
+
+    if (task->timeout > 0
+     && !vlc_timer_create(&task->timer, OnTimeout, task))
+    {
+        task->has_timer = true;
+        vlc_timer_schedule(task->timer, false, task->timeout, 0);
+    }
 
+    vlc_mutex_lock(&worker->lock);
+    task->handle = handle;
+    task->started = true;
+    canceled = task->canceled;
+    if (canceled)
+        /* a canceler is waiting for this job, do not queue another one */
+        task->checking = true;
+    else
+    {
+        task->runner = 0;
+        if (task->expired || task->probe)
+            RequestCheckLocked(task);
+    }
     vlc_mutex_unlock(&worker->lock);
 
-    background_thread_Destroy(thread);
+    if (canceled)
+        Stop(task);
 }
 
-static void* Thread( void* data )
+static void CheckJob(struct vlc_executor_job *job)
 {
-    struct background_thread *thread = data;
-    struct background_worker *worker = thread->owner;
+    struct task *task = container_of(job, struct task, job);
+    struct background_worker *worker = task->worker;
 
+    vlc_mutex_lock(&worker->lock);
+    task->runner = vlc_thread_id();
     for (;;)
     {
-        vlc_mutex_lock(&worker->lock);
-        struct task *task = QueueTake(worker, 5000);
-        if (!task)
-        {
-            vlc_mutex_unlock(&worker->lock);
-            /* terminate this thread */
-            break;
-        }
-
-        thread->task = task;
-        thread->cancel = false;
-        thread->probe = false;
-        vlc_tick_t deadline;
-        if (task->timeout > 0)
-            deadline = vlc_tick_now() + task->timeout;
-        else
-            deadline = INT64_MAX; /* no deadline */
+        task->probe = false;
+        bool stop = task->canceled || task->expired;
         vlc_mutex_unlock(&worker->lock);
 
-        void *handle;
-        if (worker->conf.pf_start(worker->owner, task->entity, &handle))
+        if (stop || worker->conf.pf_probe(worker->owner, task->handle))
         {
-            TerminateTask(thread, task);
-            continue;
+            Stop(task);
+            return;
         }
 
-        for (;;)
-        {
-            vlc_mutex_lock(&worker->lock);
-            bool timeout = false;
-            while (!timeout && !thread->probe && !thread->cancel)
-                /* any non-zero return value means timeout */
-                timeout = vlc_cond_timedwait(&thread->probe_cancel_wait,
-                                             &worker->lock, deadline) != 0;
-
-            bool cancel = thread->cancel;
-            thread->cancel = false;
-            thread->probe = false;
-            vlc_mutex_unlock(&worker->lock);
-
-            if (timeout || cancel
-                    || worker->conf.pf_probe(worker->owner, handle))
-            {
-                worker->conf.pf_stop(worker->owner, handle);
-                TerminateTask(thread, task);
-                break;
-            }
-        }
+        vlc_mutex_lock(&worker->lock);
+        if (!task->probe)
+            break;
+        /* probe requested meanwhile, check again */
     }
-
-    RemoveThread(thread);
-
-    return NULL;
+    task->checking = false;
+    task->runner = 0;
+    vlc_mutex_unlock(&worker->lock);
 }
 
-static bool SpawnThread(struct background_worker *worker)
+struct background_worker* background_worker_New( void* owner,
+    vlc_executor_t *executor, struct background_worker_config* conf )
 {
-    vlc_mutex_assert(&worker->lock);
-
-    struct background_thread *thread = background_thread_Create(worker);
-    if (!thread)
-        return false;
-
-    if (vlc_clone_detach(NULL, Thread, thread, VLC_THREAD_PRIORITY_LOW))
-    {
-        free(thread);
-        return false;
-    }
-    worker->nthreads++;
-    vlc_list_append(&thread->node, &worker->threads);
+    struct background_worker* worker = malloc(sizeof(*worker));
+    if (unlikely(!worker))
+        return NULL;
 
-    return true;
-}
+    worker->conf = *conf;
+    worker->owner = owner;
+    worker->executor = executor;
+    worker->max_tasks = conf->max_threads > 0
+                      ? conf->max_threads
+                      : (int) vlc_executor_GetThreads(executor);
 
-struct background_worker* background_worker_New( void* owner,
-    struct background_worker_config* conf )
-{
-    return background_worker_Create(owner, conf);
+    vlc_mutex_init(&worker->lock);
+    vlc_list_init(&worker->queue);
+    vlc_list_init(&worker->running);
+    worker->nrunning = 0;
+    vlc_cond_init(&worker->finish_wait);
+    worker->closing = false;
+    return worker;
 }
 
 int background_worker_Push( struct background_worker* worker, void* entity,
@@ -296,50 +290,108 @@ int background_worker_Push( struct background_worker* worker, void* entity,
         return VLC_ENOMEM;
 
     vlc_mutex_lock(&worker->lock);
-    QueuePush(worker, task);
-    if (++worker->uncompleted > worker->nthreads
-            && worker->nthreads < worker->conf.max_threads)
-        SpawnThread(worker);
+    vlc_list_append(&task->node, &worker->queue);
+    StartNextLocked(worker);
     vlc_mutex_unlock(&worker->lock);
 
     return VLC_SUCCESS;
 }
 
-static void BackgroundWorkerCancelLocked(struct background_worker *worker,
-                                         void *id)
+static bool IsCanceledLocked(struct background_worker *worker, void *id)
 {
     vlc_mutex_assert(&worker->lock);
 
-    QueueRemoveAll(worker, id);
+    unsigned long self = vlc_thread_id();
+    struct task *task;
+    vlc_list_foreach(task, &worker->running, node)
+        /* a callback of the task itself may cancel it, do not wait for it */
+        if ((!id || task->id == id) && task->canceled && task->runner != self)
+            return true;
+    return false;
+}
 
-    struct background_thread *thread;
-    vlc_list_foreach(thread, &worker->threads, node)
+/*
+ * Cancel the matching tasks, then wait for them to be stopped.
+ *
+ * The steps not yet run by the executor are taken back and run by the caller,
+ * so that only the jobs already running are waited for.
+ */
+static void BackgroundWorkerCancel(struct background_worker *worker, void *id)
+{
+    struct vlc_list removed; /**< tasks not started, to destroy */
+    struct vlc_list stopping; /**< tasks started, to stop from here */
+    vlc_list_init(&removed);
+    vlc_list_init(&stopping);
+
+    vlc_mutex_lock(&worker->lock);
+
+    struct task *task;
+    vlc_list_foreach(task, &worker->queue, node)
     {
-        if (!id || (thread->task && thread->task->id == id && !thread->cancel))
+        if (!id || task->id == id)
         {
-            thread->cancel = true;
-            vlc_cond_signal(&thread->probe_cancel_wait);
+            vlc_list_remove(&task->node);
+            vlc_list_append(&task->node, &removed);
         }
     }
+
+    vlc_list_foreach(task, &worker->running, node)
+    {
+        if ((id && task->id != id) || task->canceled)
+            continue;
+
+        task->canceled = true;
+        if (!task->started)
+        {
+            if (vlc_executor_Cancel(worker->executor, &task->job))
+            {
+                /* not started yet, and will not be */
+                vlc_list_remove(&task->node);
+                vlc_list_append(&task->node, &removed);
+                worker->nrunning--;
+            }
+            /* otherwise the start job is running, and will stop the task */
+        }
+        else if (!task->checking
+              || vlc_executor_Cancel(worker->executor, &task->job))
+        {
+            /* no step of the task is running: stop it from here */
+            task->checking = true;
+            task->runner = vlc_thread_id();
+            vlc_list_remove(&task->node);
+            vlc_list_append(&task->node, &stopping);
+        }
+        else
+            /* the check job is running, it will see the token */
+            RequestCheckLocked(task);
+    }
+
+    StartNextLocked(worker);
+    vlc_cond_broadcast(&worker->finish_wait);
+    vlc_mutex_unlock(&worker->lock);
+
+    TasksDestroy(worker, &removed);
+    vlc_list_foreach(task, &stopping, node)
+        Stop(task);
+
+    vlc_mutex_lock(&worker->lock);
+    while (IsCanceledLocked(worker, id))
+        vlc_cond_wait(&worker->finish_wait, &worker->lock);
+    vlc_mutex_unlock(&worker->lock);
 }
 
 void background_worker_Cancel( struct background_worker* worker, void* id )
 {
-    vlc_mutex_lock(&worker->lock);
-    BackgroundWorkerCancelLocked(worker, id);
-    vlc_mutex_unlock(&worker->lock);
+    BackgroundWorkerCancel(worker, id);
 }
 
 void background_worker_RequestProbe( struct background_worker* worker )
 {
     vlc_mutex_lock(&worker->lock);
 
-    struct background_thread *thread;
-    vlc_list_foreach(thread, &worker->threads, node)
-    {
-        thread->probe = true;
-        vlc_cond_signal(&thread->probe_cancel_wait);
-    }
+    struct task *task;
+    vlc_list_foreach(task, &worker->running, node)
+        RequestCheckLocked(task);
 
     vlc_mutex_unlock(&worker->lock);
 }
@@ -347,17 +399,16 @@ void background_worker_RequestProbe( struct background_worker* worker )
 void background_worker_Delete( struct background_worker* worker )
 {
     vlc_mutex_lock(&worker->lock);
-
     worker->closing = true;
-    BackgroundWorkerCancelLocked(worker, NULL);
-    /* closing is now true, this will wake up any QueueTake() */
-    vlc_cond_broadcast(&worker->queue_wait);
+    vlc_mutex_unlock(&worker->lock);
 
-    while (worker->nthreads)
-        vlc_cond_wait(&worker->nothreads_wait, &worker->lock);
+    BackgroundWorkerCancel(worker, NULL);
 
+    vlc_mutex_lock(&worker->lock);
+    while (worker->nrunning)
+        vlc_cond_wait(&worker->finish_wait, &worker->lock);
     vlc_mutex_unlock(&worker->lock);
 
-    /* no threads use the worker anymore, we can destroy it */
-    background_worker_Destroy(worker);
+    /* no tasks use the worker anymore, we can destroy it */
+    free(worker);
 }
@@ -19,6 +19,8 @@
 #ifndef BACKGROUND_WORKER_H__
 #define BACKGROUND_WORKER_H__
 
+#include "executor.h"
+
 struct background_worker_config {
     /**
      * Default timeout for completing a task
@@ -30,10 +32,16 @@ struct background_worker_config {
     vlc_tick_t default_timeout;
 
     /**
-     * Maximum number of threads used to execute tasks.
+     * Maximum number of tasks running at once, 0 for one per executor thread.
      */
     int max_threads;
 
+    /**
+     * Priority of the jobs starting, probing and stopping tasks, relative to
+     * the other users of the executor.
+     */
+    enum vlc_executor_priority priority;
+
     /**
      * Release an entity
      *
@@ -125,18 +133,21 @@ struct background_worker_config {
  * Create a background-worker
  *
  * This function creates a new background-worker using the passed configuration.
+ * The callbacks are run by the threads of the given executor, shared with the
+ * other background-workers.
  *
  * \warning all members of `config` shall have been set by the caller.
  * \warning the returned resource must be destroyed using \ref
  *          background_worker_Delete on success.
  *
  * \param owner the owner of the background-worker
+ * \param executor the executor running the tasks
  * \param config the background-worker's configuration
  * \return a pointer-to the created background-worker on success,
  *         `NULL` on failure.
  **/
 struct background_worker* background_worker_New( void* owner,
-    struct background_worker_config* config );
+    vlc_executor_t *executor, struct background_worker_config* config );
 
 /**
  * Request the background-worker to probe the current task
@@ -179,7 +190,8 @@ int background_worker_Push( struct background_worker* worker, void* entity,
  * entities.
  *
  * \warning if the `id` passed refers to an entity that is currently being
- *          processed, the call will block until the task has been terminated.
+ *          processed, the call will block until the task has been terminated,
+ *          unless it is called from a callback of that task.
  *
  * \param worker the background-worker
  * \param id NULL if every entity shall be removed, and the currently running
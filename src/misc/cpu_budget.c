@@ -0,0 +1,199 @@
+/*****************************************************************************
+ * cpu_budget.c: threads of the decoders and encoders
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <assert.h>
+#include <time.h>
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+#include "cpu_budget.h"
+#include "../libvlc.h"
+
+struct vlc_cpu_budget
+{
+    vlc_mutex_t lock;
+    unsigned cores;
+    unsigned codecs;
+    unsigned requested;
+    unsigned assigned;
+    unsigned used; /**< threads counted against the budget */
+
+    vlc_tick_t start; /**< for the load */
+    vlc_tick_t start_cpu;
+};
+
+struct vlc_cpu_quota
+{
+    struct vlc_cpu_budget *budget;
+    unsigned wanted;
+    unsigned granted;
+    unsigned used;
+};
+
+/* CPU time consumed by the process so far, 0 if unknown */
+static vlc_tick_t ProcessTime(void)
+{
+#ifdef CLOCK_PROCESS_CPUTIME_ID
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0)
+        return vlc_tick_from_timespec(&ts);
+#endif
+    return 0;
+}
+
+struct vlc_cpu_budget *vlc_cpu_budget_New(unsigned cores)
+{
+    struct vlc_cpu_budget *budget = malloc(sizeof (*budget));
+    if (unlikely(budget == NULL))
+        return NULL;
+
+    if (cores == 0)
+        cores = vlc_GetCPUCount();
+    if (cores == 0)
+        cores = 1;
+
+    vlc_mutex_init(&budget->lock);
+    budget->cores = cores;
+    budget->codecs = 0;
+    budget->requested = 0;
+    budget->assigned = 0;
+    budget->used = 0;
+    budget->start = vlc_tick_now();
+    budget->start_cpu = ProcessTime();
+    return budget;
+}
+
+void vlc_cpu_budget_Delete(struct vlc_cpu_budget *budget)
+{
+    assert(budget->codecs == 0);
+    free(budget);
+}
+
+void vlc_cpu_budget_Read(struct vlc_cpu_budget *budget,
+                         struct vlc_cpu_budget_stats *stats)
+{
+    vlc_tick_t elapsed = vlc_tick_now() - budget->start;
+    vlc_tick_t cpu = ProcessTime() - budget->start_cpu;
+
+    vlc_mutex_lock(&budget->lock);
+    stats->budget = budget->cores;
+    stats->codecs = budget->codecs;
+    stats->requested = budget->requested;
+    stats->assigned = budget->assigned;
+    stats->used = budget->used;
+    vlc_mutex_unlock(&budget->lock);
+
+    stats->load = elapsed > 0 && cpu > 0 ? cpu * 100 / elapsed : 0;
+}
+
+#undef vlc_cpu_quota_Acquire
+unsigned vlc_cpu_quota_Acquire(vlc_object_t *obj, unsigned wanted,
+                               vlc_cpu_quota_t **quotap)
+{
+    struct vlc_cpu_budget *budget =
+        libvlc_priv(vlc_object_instance(obj))->cpu_budget;
+
+    *quotap = NULL;
+    if (wanted <= 1 || budget == NULL)
+        return wanted > 0 ? wanted : 1; /* nothing to share */
+
+    vlc_cpu_quota_t *quota = malloc(sizeof (*quota));
+    if (unlikely(quota == NULL))
+        return 1;
+
+    vlc_mutex_lock(&budget->lock);
+    /* free cores first, then a fair share, possibly over the budget until
+     * the other codecs close */
+    unsigned free = budget->cores > budget->used
+                  ? budget->cores - budget->used : 0;
+    unsigned share = budget->cores / (budget->codecs + 1);
+    unsigned granted = __MIN(wanted, __MAX(__MAX(free, share), 1));
+
+    budget->codecs++;
+    budget->requested += wanted;
+    budget->assigned += granted;
+    budget->used += granted;
+    unsigned used = budget->used, codecs = budget->codecs;
+    vlc_mutex_unlock(&budget->lock);
+
+    quota->budget = budget;
+    quota->wanted = wanted;
+    quota->granted = granted;
+    quota->used = granted;
+    *quotap = quota;
+
+    msg_Dbg(obj, "granted %u of %u thread(s), %u/%u core(s) for %u codec(s)",
+            granted, wanted, used, budget->cores, codecs);
+    return granted;
+}
+
+void vlc_cpu_quota_Use(vlc_cpu_quota_t *quota, unsigned used)
+{
+    if (quota == NULL)
+        return;
+
+    struct vlc_cpu_budget *budget = quota->budget;
+
+    if (used == 0)
+        used = 1;
+    assert(used <= quota->granted);
+
+    vlc_mutex_lock(&budget->lock);
+    budget->used -= quota->used;
+    budget->used += used;
+    vlc_mutex_unlock(&budget->lock);
+    quota->used = used;
+}
+
+void vlc_cpu_quota_Release(vlc_cpu_quota_t *quota)
+{
+    if (quota == NULL)
+        return;
+
+    struct vlc_cpu_budget *budget = quota->budget;
+
+    vlc_mutex_lock(&budget->lock);
+    assert(budget->codecs > 0);
+    budget->codecs--;
+    budget->requested -= quota->wanted;
+    budget->assigned -= quota->granted;
+    budget->used -= quota->used;
+    vlc_mutex_unlock(&budget->lock);
+    free(quota);
+}
+
+#undef vlc_cpu_budget_GetStats
+void vlc_cpu_budget_GetStats(vlc_object_t *obj,
+                             struct vlc_cpu_budget_stats *stats)
+{
+    struct vlc_cpu_budget *budget =
+        libvlc_priv(vlc_object_instance(obj))->cpu_budget;
+
+    if (budget != NULL)
+        vlc_cpu_budget_Read(budget, stats);
+    else
+        memset(stats, 0, sizeof (*stats));
+}
@@ -0,0 +1,52 @@
+/*****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_CPU_BUDGET_H
+#define VLC_CPU_BUDGET_H
+
+struct vlc_cpu_budget_stats;
+
+/**
+ * Cores shared by the decoders and encoders of a libvlc instance
+ *
+ * \see vlc_cpu_quota_Acquire()
+ */
+struct vlc_cpu_budget;
+
+/**
+ * Create a CPU budget
+ *
+ * \param cores number of cores, 0 for all of them
+ * \return the budget, or NULL on error
+ */
+struct vlc_cpu_budget *vlc_cpu_budget_New(unsigned cores);
+
+/**
+ * Delete a CPU budget
+ *
+ * All the quotas must have been released.
+ */
+void vlc_cpu_budget_Delete(struct vlc_cpu_budget *budget);
+
+/**
+ * Read the counters of a CPU budget
+ */
+void vlc_cpu_budget_Read(struct vlc_cpu_budget *budget,
+                         struct vlc_cpu_budget_stats *stats);
+
+#endif
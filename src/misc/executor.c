@@ -0,0 +1,371 @@
+/*****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <assert.h>
+#include <limits.h>
+#include <vlc_common.h>
+#include <vlc_list.h>
+#include <vlc_threads.h>
+
+#include "executor.h"
+
+#define EXECUTOR_MAX_THREADS 32
+#define QUEUE_NONE UINT_MAX /**< job->queue of a job not queued */
+
+struct vlc_executor_thread
+{
+    vlc_executor_t *owner;
+    unsigned index;
+    vlc_thread_t thread;
+    bool running; /**< the thread is started, protected by owner->lock */
+    bool joinable; /**< the thread was started and not joined yet, idem */
+
+    vlc_mutex_t lock; /**< protects the queues and the counters */
+    struct vlc_list queues[VLC_EXECUTOR_PRIORITY_COUNT];
+
+    uint64_t submitted;
+    uint64_t executed;
+    uint64_t stolen;
+    uint64_t canceled;
+    vlc_tick_t busy;
+    vlc_tick_t waited;
+};
+
+struct vlc_executor
+{
+    unsigned nthreads; /**< maximum number of threads, one per queue */
+    vlc_tick_t timeout; /**< delay before an idle thread exits */
+    atomic_uint next; /**< queue of the next job submitted from outside */
+    atomic_uint pending; /**< number of queued jobs */
+
+    vlc_mutex_t lock; /**< protects the threads state, idle and closing */
+    vlc_cond_t wait; /**< wait for pending jobs or closing */
+    unsigned running;
+    unsigned idle;
+    bool closing;
+
+    struct vlc_executor_thread threads[];
+};
+
+/* the pool thread running the caller, if any */
+static thread_local struct vlc_executor_thread *current;
+
+static struct vlc_executor_job *
+QueueTake(struct vlc_executor_thread *thread, enum vlc_executor_priority prio)
+{
+    vlc_mutex_assert(&thread->lock);
+
+    struct vlc_executor_job *job =
+        vlc_list_first_entry_or_null(&thread->queues[prio],
+                                     struct vlc_executor_job, node);
+    if (job)
+    {
+        vlc_list_remove(&job->node);
+        atomic_store_explicit(&job->queue, QUEUE_NONE, memory_order_relaxed);
+    }
+    return job;
+}
+
+/* Return the most urgent job, preferring our own queue on equal priority */
+static struct vlc_executor_job *Take(struct vlc_executor_thread *self)
+{
+    vlc_executor_t *executor = self->owner;
+
+    if (atomic_load_explicit(&executor->pending, memory_order_relaxed) == 0)
+        return NULL;
+
+    for (int prio = 0; prio < VLC_EXECUTOR_PRIORITY_COUNT; ++prio)
+    {
+        for (unsigned i = 0; i < executor->nthreads; ++i)
+        {
+            struct vlc_executor_thread *thread =
+                &executor->threads[(self->index + i) % executor->nthreads];
+
+            vlc_mutex_lock(&thread->lock);
+            struct vlc_executor_job *job = QueueTake(thread, prio);
+            vlc_mutex_unlock(&thread->lock);
+
+            if (job)
+            {
+                atomic_fetch_sub_explicit(&executor->pending, 1,
+                                          memory_order_relaxed);
+                if (thread != self)
+                {
+                    vlc_mutex_lock(&self->lock);
+                    self->stolen++;
+                    vlc_mutex_unlock(&self->lock);
+                }
+                return job;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void *Thread(void *data)
+{
+    struct vlc_executor_thread *self = data;
+    vlc_executor_t *executor = self->owner;
+
+    current = self;
+
+    for (;;)
+    {
+        struct vlc_executor_job *job = Take(self);
+        if (!job)
+        {
+            vlc_tick_t deadline = vlc_tick_now() + executor->timeout;
+            bool timeout = false;
+
+            vlc_mutex_lock(&executor->lock);
+            while (atomic_load(&executor->pending) == 0 && !executor->closing
+                && !timeout)
+            {
+                executor->idle++;
+                timeout = vlc_cond_timedwait(&executor->wait, &executor->lock,
+                                             deadline) != 0;
+                executor->idle--;
+            }
+            /* the queues are checked under the lock, so that a job submitted
+             * meanwhile either is seen here, or starts another thread */
+            bool done = (executor->closing || timeout)
+                     && atomic_load(&executor->pending) == 0;
+            if (done)
+            {
+                self->running = false;
+                executor->running--;
+            }
+            vlc_mutex_unlock(&executor->lock);
+
+            if (done)
+                break;
+            continue;
+        }
+
+        vlc_tick_t start = vlc_tick_now();
+        vlc_tick_t waited = start - job->date;
+
+        job->run(job); /* the job may be gone afterwards */
+
+        vlc_tick_t busy = vlc_tick_now() - start;
+
+        vlc_mutex_lock(&self->lock);
+        self->executed++;
+        self->busy += busy;
+        self->waited += waited;
+        vlc_mutex_unlock(&self->lock);
+    }
+
+    return NULL;
+}
+
+/* Start the thread of a queue, or of any other queue if it is running */
+static void Spawn(vlc_executor_t *executor, unsigned index)
+{
+    vlc_mutex_assert(&executor->lock);
+
+    if (executor->closing || executor->running >= executor->nthreads)
+        return;
+
+    struct vlc_executor_thread *thread = &executor->threads[index];
+    for (unsigned i = 1; thread->running; ++i)
+        thread = &executor->threads[(index + i) % executor->nthreads];
+
+    /* an exited thread does not use the lock anymore */
+    if (thread->joinable)
+        vlc_join(thread->thread, NULL);
+    thread->joinable = false;
+
+    if (vlc_clone(&thread->thread, Thread, thread, VLC_THREAD_PRIORITY_LOW))
+        return; /* the queued jobs will be run by the other threads */
+
+    thread->running = true;
+    thread->joinable = true;
+    executor->running++;
+}
+
+vlc_executor_t *vlc_executor_New(unsigned nthreads, vlc_tick_t timeout)
+{
+    if (nthreads == 0)
+        nthreads = vlc_GetCPUCount();
+    if (nthreads == 0)
+        nthreads = 1;
+    if (nthreads > EXECUTOR_MAX_THREADS)
+        nthreads = EXECUTOR_MAX_THREADS;
+
+    vlc_executor_t *executor =
+        malloc(sizeof(*executor) + nthreads * sizeof(executor->threads[0]));
+    if (unlikely(!executor))
+        return NULL;
+
+    executor->nthreads = nthreads;
+    executor->timeout = timeout;
+    atomic_init(&executor->next, 0);
+    atomic_init(&executor->pending, 0);
+    vlc_mutex_init(&executor->lock);
+    vlc_cond_init(&executor->wait);
+    executor->running = 0;
+    executor->idle = 0;
+    executor->closing = false;
+
+    /* the threads are started on demand, and may steal from any queue */
+    for (unsigned i = 0; i < nthreads; ++i)
+    {
+        struct vlc_executor_thread *thread = &executor->threads[i];
+
+        thread->owner = executor;
+        thread->index = i;
+        thread->running = false;
+        thread->joinable = false;
+        vlc_mutex_init(&thread->lock);
+        for (int prio = 0; prio < VLC_EXECUTOR_PRIORITY_COUNT; ++prio)
+            vlc_list_init(&thread->queues[prio]);
+        thread->submitted = 0;
+        thread->executed = 0;
+        thread->stolen = 0;
+        thread->canceled = 0;
+        thread->busy = 0;
+        thread->waited = 0;
+    }
+    return executor;
+}
+
+void vlc_executor_Delete(vlc_executor_t *executor)
+{
+    vlc_mutex_lock(&executor->lock);
+    executor->closing = true;
+    vlc_cond_broadcast(&executor->wait);
+    vlc_mutex_unlock(&executor->lock);
+
+    /* no threads are started once closing */
+    for (unsigned i = 0; i < executor->nthreads; ++i)
+        if (executor->threads[i].joinable)
+            vlc_join(executor->threads[i].thread, NULL);
+
+    /* jobs left if no threads could be started */
+    struct vlc_executor_job *job;
+    while ((job = Take(&executor->threads[0])) != NULL)
+        job->run(job);
+
+    assert(atomic_load(&executor->pending) == 0);
+    free(executor);
+}
+
+unsigned vlc_executor_GetThreads(vlc_executor_t *executor)
+{
+    return executor->nthreads;
+}
+
+void vlc_executor_Submit(vlc_executor_t *executor,
+                         struct vlc_executor_job *job)
+{
+    assert(job->run);
+    assert(job->priority < VLC_EXECUTOR_PRIORITY_COUNT);
+
+    unsigned index;
+    if (current && current->owner == executor)
+        index = current->index;
+    else
+        index = atomic_fetch_add_explicit(&executor->next, 1,
+                                          memory_order_relaxed)
+              % executor->nthreads;
+
+    struct vlc_executor_thread *thread = &executor->threads[index];
+
+    job->date = vlc_tick_now();
+
+    vlc_mutex_lock(&thread->lock);
+    vlc_list_append(&job->node, &thread->queues[job->priority]);
+    atomic_store_explicit(&job->queue, index, memory_order_relaxed);
+    thread->submitted++;
+    vlc_mutex_unlock(&thread->lock);
+
+    atomic_fetch_add(&executor->pending, 1);
+
+    /* pending is incremented before checking for idle threads, so that a
+     * thread going to sleep either sees the job or is woken up */
+    vlc_mutex_lock(&executor->lock);
+    if (executor->idle > 0)
+        vlc_cond_signal(&executor->wait);
+    else
+        Spawn(executor, index);
+    vlc_mutex_unlock(&executor->lock);
+}
+
+bool vlc_executor_Cancel(vlc_executor_t *executor,
+                         struct vlc_executor_job *job)
+{
+    for (;;)
+    {
+        unsigned index = atomic_load_explicit(&job->queue,
+                                              memory_order_relaxed);
+        if (index == QUEUE_NONE)
+            return false;
+
+        assert(index < executor->nthreads);
+        struct vlc_executor_thread *thread = &executor->threads[index];
+
+        vlc_mutex_lock(&thread->lock);
+        /* the job may have been taken meanwhile, and even submitted again
+         * to another queue */
+        bool queued = atomic_load_explicit(&job->queue,
+                                           memory_order_relaxed) == index;
+        if (queued)
+        {
+            vlc_list_remove(&job->node);
+            atomic_store_explicit(&job->queue, QUEUE_NONE,
+                                  memory_order_relaxed);
+            thread->canceled++;
+        }
+        vlc_mutex_unlock(&thread->lock);
+
+        if (queued)
+        {
+            atomic_fetch_sub(&executor->pending, 1);
+            return true;
+        }
+    }
+}
+
+void vlc_executor_GetStats(vlc_executor_t *executor,
+                           struct vlc_executor_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->threads = executor->nthreads;
+    vlc_mutex_lock(&executor->lock);
+    stats->running = executor->running;
+    vlc_mutex_unlock(&executor->lock);
+
+    for (unsigned i = 0; i < executor->nthreads; ++i)
+    {
+        struct vlc_executor_thread *thread = &executor->threads[i];
+
+        vlc_mutex_lock(&thread->lock);
+        stats->submitted += thread->submitted;
+        stats->executed += thread->executed;
+        stats->stolen += thread->stolen;
+        stats->canceled += thread->canceled;
+        stats->busy += thread->busy;
+        stats->waited += thread->waited;
+        vlc_mutex_unlock(&thread->lock);
+    }
+}
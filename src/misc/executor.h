@@ -0,0 +1,125 @@
+/*****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_EXECUTOR_H
+#define VLC_EXECUTOR_H
+
+#include <vlc_atomic.h>
+#include <vlc_list.h>
+
+/**
+ * Thread pool shared by the background tasks of a libvlc instance
+ * (preparser, art fetcher, thumbnailer).
+ *
+ * Each thread owns a queue. Jobs submitted from a pool thread go to its own
+ * queue, other jobs are spread over the queues. An idle thread takes the most
+ * urgent job, from its own queue first, then steals from the others.
+ *
+ * Threads are started when jobs are submitted, and exit after being idle for
+ * a while.
+ *
+ * Jobs are expected to be short: long running work (typically an input
+ * thread) is started by a job, and completed by another job.
+ */
+typedef struct vlc_executor vlc_executor_t;
+
+enum vlc_executor_priority
+{
+    VLC_EXECUTOR_PRIORITY_HIGH, /**< the user is waiting for the result */
+    VLC_EXECUTOR_PRIORITY_NORMAL,
+    VLC_EXECUTOR_PRIORITY_LOW, /**< not needed before long */
+};
+#define VLC_EXECUTOR_PRIORITY_COUNT 3
+
+struct vlc_executor_job
+{
+    /**
+     * Run the job
+     *
+     * Called once on a pool thread. The job is not used by the executor
+     * anymore, it may be submitted again or released from this callback.
+     */
+    void (*run)(struct vlc_executor_job *job);
+    enum vlc_executor_priority priority;
+
+    /* private, owned by the executor while queued */
+    struct vlc_list node;
+    atomic_uint queue;
+    vlc_tick_t date;
+};
+
+struct vlc_executor_stats
+{
+    unsigned threads; /**< maximum number of threads */
+    unsigned running; /**< threads currently started */
+    uint64_t submitted; /**< jobs submitted */
+    uint64_t executed; /**< jobs run */
+    uint64_t stolen; /**< jobs run by another thread than their queue's */
+    uint64_t canceled; /**< jobs removed before running */
+    vlc_tick_t busy; /**< total time spent running jobs */
+    vlc_tick_t waited; /**< total time jobs spent queued */
+};
+
+/**
+ * Create an executor
+ *
+ * No threads are started until a job is submitted.
+ *
+ * \param threads maximum number of threads, 0 for one per CPU core
+ * \param timeout delay before an idle thread exits
+ * \return the executor, or NULL on error
+ */
+vlc_executor_t *vlc_executor_New(unsigned threads, vlc_tick_t timeout);
+
+/**
+ * Delete an executor
+ *
+ * The queued jobs are run, then the threads are joined.
+ */
+void vlc_executor_Delete(vlc_executor_t *executor);
+
+/**
+ * Return the maximum number of threads of an executor
+ */
+unsigned vlc_executor_GetThreads(vlc_executor_t *executor);
+
+/**
+ * Queue a job
+ *
+ * The job must not be queued already. The caller sets `run` and `priority`,
+ * the other fields are initialized by this function.
+ */
+void vlc_executor_Submit(vlc_executor_t *executor,
+                         struct vlc_executor_job *job);
+
+/**
+ * Remove a queued job
+ *
+ * \retval true if the job was removed before running
+ * \retval false if it is running, has run, or was not queued
+ */
+bool vlc_executor_Cancel(vlc_executor_t *executor,
+                         struct vlc_executor_job *job);
+
+/**
+ * Read the counters of an executor
+ */
+void vlc_executor_GetStats(vlc_executor_t *executor,
+                           struct vlc_executor_stats *stats);
+
+#endif
@@ -42,6 +42,7 @@
 #include <vlc_url.h>
 #include <vlc_mime.h>
 #include <vlc_block.h>
+#include <vlc_fs.h>
 #include "../libvlc.h"
 
 #include <string.h>
@@ -54,6 +55,12 @@
 #ifdef HAVE_POLL_H
 # include <poll.h>
 #endif
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
+#ifndef _WIN32
+# include <fcntl.h>
+#endif
 
 #if defined(_WIN32)
 #   include <winsock2.h>
@@ -68,8 +75,81 @@
 #define HTTPD_CL_BUFSIZE 10000
 #endif
 
+/* Stream clients that caught up are handed new data at most this often */
+#define HTTPD_WAIT_PERIOD VLC_TICK_FROM_MS(10)
+/* Stream chunks a client holds and sends with a single writev() */
+#define HTTPD_CL_CHUNKS 64
+
+/* Data sent to a stream, shared by all its clients */
+typedef struct
+{
+    atomic_uint refs;
+    bool        keyframe;
+    int64_t     pos;    /* absolute position of data[0] in the stream */
+    size_t      len;
+    uint8_t     data[];
+} httpd_chunk_t;
+
+static httpd_chunk_t *httpd_ChunkHold(httpd_chunk_t *chunk)
+{
+    atomic_fetch_add_explicit(&chunk->refs, 1, memory_order_relaxed);
+    return chunk;
+}
+
+static void httpd_ChunkRelease(httpd_chunk_t *chunk)
+{
+    if (atomic_fetch_sub_explicit(&chunk->refs, 1, memory_order_acq_rel) == 1)
+        free(chunk);
+}
+
+/* HTTP/1.1 chunked transfer coding: hexadecimal size line, data, CRLF */
+#define HTTPD_CHUNK_LINE_MAX (2 * sizeof (size_t) + 3)
+
+static size_t httpd_ChunkLine(char *line, size_t len)
+{
+    return sprintf(line, "%zx\r\n", len);
+}
+
+static size_t httpd_ChunkWireSize(size_t len)
+{
+    char line[HTTPD_CHUNK_LINE_MAX];
+    return httpd_ChunkLine(line, len) + len + 2;
+}
+
 static void httpd_ClientDestroy(httpd_client_t *cl);
-static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data);
+static void httpd_HostWake(httpd_host_t *host);
+static httpd_url_t *httpd_UrlNewInternal(httpd_host_t *, const char *,
+                                         const char *, const char *, bool);
+
+/* Clients are spread over several worker threads, each one waiting on its
+ * own sockets. The host thread only accepts new connections.
+ * Url callbacks run one at a time, under the host lock, except those of the
+ * stream urls for their clients waiting for data: see httpd_ClientLock(). */
+typedef struct
+{
+    httpd_host_t *host;
+    vlc_thread_t thread;
+
+    int          wakefd[2];
+#ifdef HAVE_SYS_EPOLL_H
+    int          epfd;
+#endif
+    atomic_bool  exit;
+    atomic_bool  data; /* a stream got new data since the last waiting pass */
+
+    vlc_mutex_t  lock;
+    size_t       client_count;
+    struct vlc_list clients;  /* only modified by the worker thread */
+    struct vlc_list incoming; /* accepted, not handled yet */
+
+    /* worker thread only */
+    struct vlc_list waiting;  /* clients waiting for stream data */
+    size_t       polled;      /* waiting on urls which never signal data */
+    vlc_tick_t   last_wait;
+    vlc_tick_t   last_check;
+} httpd_worker_t;
+
+static void httpd_WorkerWake(httpd_worker_t *);
 
 /* each host run in his own thread */
 struct httpd_host_t
@@ -88,15 +168,15 @@ struct httpd_host_t
     vlc_thread_t thread;
     vlc_mutex_t lock;
 
+    httpd_worker_t *workers;
+    unsigned     worker_count;
+
     /* all registered url (becarefull that 2 httpd_url_t could point at the same url)
      * This will slow down the url research but make my live easier
      * All url will have their cb trigger, but only the first one can answer
      * */
     struct vlc_list urls;
 
-    size_t client_count;
-    struct vlc_list clients;
-
     /* TLS data */
     vlc_tls_server_t *p_tls;
 };
@@ -112,6 +192,9 @@ struct httpd_url_t
     char      *psz_user;
     char      *psz_password;
 
+    /* new data is signaled with httpd_HostWake() */
+    bool       notify;
+
     struct
     {
         httpd_callback_t     cb;
@@ -142,8 +225,12 @@ struct httpd_client_t
     vlc_tls_t   *sock;
 
     struct vlc_list node;
+    struct vlc_list wait_node;
 
     bool    b_stream_mode;
+    bool    b_chunked; /* stream data sent with chunked transfer coding */
+    bool    b_waiting;
+    bool    b_notify;
     uint8_t i_state;
 
     vlc_tick_t i_activity_date;
@@ -154,6 +241,11 @@ struct httpd_client_t
     int     i_buffer;
     uint8_t *p_buffer;
 
+    /* stream data to send after the buffer, without copy */
+    httpd_chunk_t *chunks[HTTPD_CL_CHUNKS];
+    unsigned i_chunks;
+    size_t   i_chunk_offset; /* already sent from chunks[0], with framing */
+
     /*
      * If waiting for a keyframe, this is the position (in bytes) of the
      * last keyframe the stream saw before this client connected.
@@ -606,9 +698,18 @@ struct httpd_stream_t
     bool        b_has_keyframes;
     int64_t     i_last_keyframe_seen_pos;
 
-    /* circular buffer */
-    int         i_buffer_size;      /* buffer size, can't be reallocated smaller */
-    uint8_t     *p_buffer;          /* buffer */
+    /* Use chunked transfer coding with HTTP/1.1 clients */
+    bool        b_chunked;
+
+    /* Last sent chunks, oldest first. Clients hold references to the
+     * chunks they are sending, so this only bounds what is kept for
+     * late clients and new connections. */
+    httpd_chunk_t **pp_chunks;      /* circular array */
+    size_t      i_chunks_size;      /* allocated */
+    size_t      i_chunks_first;
+    size_t      i_chunks;
+    size_t      i_chunks_bytes;
+    size_t      i_buffer_size;      /* maximum of bytes kept */
     int64_t     i_buffer_pos;       /* absolute position from beginning */
     int64_t     i_buffer_last_pos;  /* a new connection will start with that */
 
@@ -617,6 +718,79 @@ struct httpd_stream_t
     httpd_header * p_http_headers;
 };
 
+static httpd_chunk_t *httpd_StreamChunk(const httpd_stream_t *stream,
+                                        size_t i)
+{
+    assert(i < stream->i_chunks);
+    return stream->pp_chunks[(stream->i_chunks_first + i)
+                             % stream->i_chunks_size];
+}
+
+/* Returns the index of the chunk holding the given stream position */
+static size_t httpd_StreamFind(const httpd_stream_t *stream, int64_t pos)
+{
+    size_t lo = 0, hi = stream->i_chunks;
+
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (httpd_StreamChunk(stream, mid)->pos <= pos)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Returns where a client should (re)start: on the last keyframe if we
+ * still have it, otherwise on the last block */
+static int64_t httpd_StreamJoinPos(const httpd_stream_t *stream)
+{
+    if (stream->b_has_keyframes && stream->i_chunks > 0
+     && stream->i_last_keyframe_seen_pos >= httpd_StreamChunk(stream, 0)->pos)
+        return stream->i_last_keyframe_seen_pos;
+    return stream->i_buffer_last_pos;
+}
+
+/* Hands the client references to the chunks following its position.
+ * Called with the stream lock held. */
+static int httpd_StreamFill(httpd_stream_t *stream, httpd_client_t *cl,
+                            httpd_message_t *answer)
+{
+    if (answer->i_body_offset >= stream->i_buffer_pos)
+        return VLC_EGENERIC;    /* wait, no data available */
+
+    if (cl->i_keyframe_wait_to_pass >= 0) {
+        if (stream->i_last_keyframe_seen_pos <= cl->i_keyframe_wait_to_pass)
+            /* still waiting for the next keyframe */
+            return VLC_EGENERIC;
+
+        /* seek to the new keyframe */
+        answer->i_body_offset = stream->i_last_keyframe_seen_pos;
+        cl->i_keyframe_wait_to_pass = -1;
+    }
+
+    /* this client isn't fast enough */
+    if (answer->i_body_offset < httpd_StreamChunk(stream, 0)->pos)
+        answer->i_body_offset = httpd_StreamJoinPos(stream);
+
+    size_t i = httpd_StreamFind(stream, answer->i_body_offset);
+    httpd_chunk_t *chunk = httpd_StreamChunk(stream, i);
+
+    assert(cl->i_chunks == 0);
+    cl->i_chunk_offset = answer->i_body_offset - chunk->pos;
+    /* clients always resume on a chunk boundary */
+    assert(!cl->b_chunked || cl->i_chunk_offset == 0);
+
+    while (i < stream->i_chunks && cl->i_chunks < HTTPD_CL_CHUNKS) {
+        chunk = httpd_StreamChunk(stream, i++);
+        cl->chunks[cl->i_chunks++] = httpd_ChunkHold(chunk);
+    }
+
+    answer->i_body_offset = chunk->pos + chunk->len;
+    return VLC_SUCCESS;
+}
+
 static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
                                  httpd_client_t *cl, httpd_message_t *answer,
                                  const httpd_message_t *query)
@@ -627,46 +801,18 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
         return VLC_SUCCESS;
 
     if (answer->i_body_offset > 0) {
-        int     i_pos;
-
-        if (answer->i_body_offset >= stream->i_buffer_pos)
-            return VLC_EGENERIC;    /* wait, no data available */
-
-        if (cl->i_keyframe_wait_to_pass >= 0) {
-            if (stream->i_last_keyframe_seen_pos <= cl->i_keyframe_wait_to_pass)
-                /* still waiting for the next keyframe */
-                return VLC_EGENERIC;
-
-            /* seek to the new keyframe */
-            answer->i_body_offset = stream->i_last_keyframe_seen_pos;
-            cl->i_keyframe_wait_to_pass = -1;
-        }
-
-        if (answer->i_body_offset + stream->i_buffer_size < stream->i_buffer_pos)
-            answer->i_body_offset = stream->i_buffer_last_pos; /* this client isn't fast enough */
-
-        i_pos   = answer->i_body_offset % stream->i_buffer_size;
-        int64_t i_write = stream->i_buffer_pos - answer->i_body_offset;
-
-        if (i_write > HTTPD_CL_BUFSIZE)
-            i_write = HTTPD_CL_BUFSIZE;
-        else if (i_write <= 0)
-            return VLC_EGENERIC;    /* wait, no data available */
+        vlc_mutex_lock(&stream->lock);
+        int val = httpd_StreamFill(stream, cl, answer);
+        vlc_mutex_unlock(&stream->lock);
 
-        /* Don't go past the end of the circular buffer */
-        i_write = __MIN(i_write, stream->i_buffer_size - i_pos);
+        if (val != VLC_SUCCESS)
+            return val; /* wait, no data available */
 
         /* using HTTPD_MSG_ANSWER -> data available */
         answer->i_proto  = HTTPD_PROTO_HTTP;
         answer->i_version= 0;
         answer->i_type   = HTTPD_MSG_ANSWER;
 
-        answer->i_body = i_write;
-        answer->p_body = xmalloc(i_write);
-        memcpy(answer->p_body, &stream->p_buffer[i_pos], i_write);
-
-        answer->i_body_offset += i_write;
-
         return VLC_SUCCESS;
     } else {
         answer->i_proto  = HTTPD_PROTO_HTTP;
@@ -694,14 +840,34 @@ static int httpd_StreamCallBack(httpd_callback_sys_t *p_sys,
         if (query->i_type != HTTPD_MSG_HEAD) {
             cl->b_stream_mode = true;
             vlc_mutex_lock(&stream->lock);
+            if (stream->b_chunked && query->i_proto == HTTPD_PROTO_HTTP
+             && query->i_version > 0) {
+                /* each chunk goes out as soon as it is sent to the stream,
+                 * the client does not have to wait for the connection end */
+                cl->b_chunked = true;
+                answer->i_version = 1;
+                httpd_MsgAdd(answer, "Transfer-Encoding", "chunked");
+            }
             /* Send the header */
-            if (stream->i_header > 0) {
+            if (stream->i_header > 0 && cl->b_chunked) {
+                char line[HTTPD_CHUNK_LINE_MAX];
+                size_t linelen = httpd_ChunkLine(line, stream->i_header);
+
+                answer->i_body = httpd_ChunkWireSize(stream->i_header);
+                answer->p_body = xmalloc(answer->i_body);
+                memcpy(answer->p_body, line, linelen);
+                memcpy(answer->p_body + linelen, stream->p_header,
+                       stream->i_header);
+                memcpy(answer->p_body + linelen + stream->i_header, "\r\n", 2);
+            } else if (stream->i_header > 0) {
                 answer->i_body = stream->i_header;
                 answer->p_body = xmalloc(stream->i_header);
                 memcpy(answer->p_body, stream->p_header, stream->i_header);
             }
-            answer->i_body_offset = stream->i_buffer_last_pos;
-            if (stream->b_has_keyframes)
+            answer->i_body_offset = httpd_StreamJoinPos(stream);
+            if (stream->b_has_keyframes
+             && answer->i_body_offset != stream->i_last_keyframe_seen_pos)
+                /* that keyframe is gone already, wait for the next one */
                 cl->i_keyframe_wait_to_pass = stream->i_last_keyframe_seen_pos;
             else
                 cl->i_keyframe_wait_to_pass = -1;
@@ -751,9 +917,9 @@ httpd_stream_t *httpd_StreamNew(httpd_host_t *host,
         return NULL;
 
     stream->psz_mime = NULL;
-    stream->p_buffer = NULL;
 
-    stream->url = httpd_UrlNew(host, psz_url, psz_user, psz_password);
+    stream->url = httpd_UrlNewInternal(host, psz_url, psz_user, psz_password,
+                                       true);
     if (!stream->url)
         goto error;
 
@@ -768,10 +934,11 @@ httpd_stream_t *httpd_StreamNew(httpd_host_t *host,
     stream->i_header = 0;
     stream->p_header = NULL;
     stream->i_buffer_size = 5000000;    /* 5 Mo per stream */
-
-    stream->p_buffer = malloc(stream->i_buffer_size);
-    if (stream->p_buffer == NULL)
-        goto error;
+    stream->pp_chunks = NULL;
+    stream->i_chunks_size = 0;
+    stream->i_chunks_first = 0;
+    stream->i_chunks = 0;
+    stream->i_chunks_bytes = 0;
 
     /* We set to 1 to make life simpler
      * (this way i_body_offset can never be 0) */
@@ -779,6 +946,7 @@ httpd_stream_t *httpd_StreamNew(httpd_host_t *host,
     stream->i_buffer_last_pos = 1;
     stream->b_has_keyframes = false;
     stream->i_last_keyframe_seen_pos = 0;
+    stream->b_chunked = false;
     stream->i_http_headers = 0;
     stream->p_http_headers = NULL;
 
@@ -818,42 +986,87 @@ int httpd_StreamHeader(httpd_stream_t *stream, uint8_t *p_data, int i_data)
     return VLC_SUCCESS;
 }
 
-static void httpd_AppendData(httpd_stream_t *stream, uint8_t *p_data, int i_data)
+void httpd_StreamSetChunked(httpd_stream_t *stream, bool chunked)
 {
-    int i_pos = stream->i_buffer_pos % stream->i_buffer_size;
-    int i_count = i_data;
-    while (i_count > 0) {
-        int i_copy = __MIN(i_count, stream->i_buffer_size - i_pos);
+    vlc_mutex_lock(&stream->lock);
+    stream->b_chunked = chunked;
+    vlc_mutex_unlock(&stream->lock);
+}
 
-        /* Ok, we can't go past the end of our buffer */
-        memcpy(&stream->p_buffer[i_pos], p_data, i_copy);
+static void httpd_StreamDropChunk(httpd_stream_t *stream)
+{
+    httpd_chunk_t *chunk = httpd_StreamChunk(stream, 0);
+
+    stream->i_chunks_first = (stream->i_chunks_first + 1)
+                             % stream->i_chunks_size;
+    stream->i_chunks--;
+    stream->i_chunks_bytes -= chunk->len;
+    httpd_ChunkRelease(chunk);
+}
 
-        i_pos = (i_pos + i_copy) % stream->i_buffer_size;
-        i_count -= i_copy;
-        p_data  += i_copy;
+static int httpd_StreamAppend(httpd_stream_t *stream, httpd_chunk_t *chunk)
+{
+    while (stream->i_chunks > 0
+        && stream->i_chunks_bytes + chunk->len > stream->i_buffer_size)
+        httpd_StreamDropChunk(stream);
+
+    if (stream->i_chunks == stream->i_chunks_size) {
+        size_t size = stream->i_chunks_size ? 2 * stream->i_chunks_size : 256;
+        httpd_chunk_t **pp = vlc_alloc(size, sizeof (*pp));
+
+        if (unlikely(pp == NULL))
+            return VLC_ENOMEM;
+        for (size_t i = 0; i < stream->i_chunks; i++)
+            pp[i] = httpd_StreamChunk(stream, i);
+        free(stream->pp_chunks);
+        stream->pp_chunks = pp;
+        stream->i_chunks_size = size;
+        stream->i_chunks_first = 0;
     }
 
-    stream->i_buffer_pos += i_data;
+    stream->pp_chunks[(stream->i_chunks_first + stream->i_chunks)
+                      % stream->i_chunks_size] = chunk;
+    stream->i_chunks++;
+    stream->i_chunks_bytes += chunk->len;
+    return VLC_SUCCESS;
 }
 
 int httpd_StreamSend(httpd_stream_t *stream, const block_t *p_block)
 {
-    if (!p_block || !p_block->p_buffer)
+    if (!p_block || !p_block->p_buffer || p_block->i_buffer == 0)
         return VLC_SUCCESS;
 
+    /* This is the only copy: clients send straight from the chunk */
+    httpd_chunk_t *chunk = malloc(sizeof (*chunk) + p_block->i_buffer);
+    if (unlikely(chunk == NULL))
+        return VLC_ENOMEM;
+
+    atomic_init(&chunk->refs, 1);
+    chunk->keyframe = (p_block->i_flags & BLOCK_FLAG_TYPE_I) != 0;
+    chunk->len = p_block->i_buffer;
+    memcpy(chunk->data, p_block->p_buffer, p_block->i_buffer);
+
     vlc_mutex_lock(&stream->lock);
+    chunk->pos = stream->i_buffer_pos;
+
+    if (httpd_StreamAppend(stream, chunk)) {
+        vlc_mutex_unlock(&stream->lock);
+        free(chunk);
+        return VLC_ENOMEM;
+    }
 
     /* save this pointer (to be used by new connection) */
     stream->i_buffer_last_pos = stream->i_buffer_pos;
 
-    if (p_block->i_flags & BLOCK_FLAG_TYPE_I) {
+    if (chunk->keyframe) {
         stream->b_has_keyframes = true;
         stream->i_last_keyframe_seen_pos = stream->i_buffer_pos;
     }
 
-    httpd_AppendData(stream, p_block->p_buffer, p_block->i_buffer);
-
+    stream->i_buffer_pos += chunk->len;
     vlc_mutex_unlock(&stream->lock);
+
+    httpd_HostWake(stream->url->host);
     return VLC_SUCCESS;
 }
 
@@ -867,7 +1080,9 @@ void httpd_StreamDelete(httpd_stream_t *stream)
     free(stream->p_http_headers);
     free(stream->psz_mime);
     free(stream->p_header);
-    free(stream->p_buffer);
+    while (stream->i_chunks > 0)
+        httpd_StreamDropChunk(stream);
+    free(stream->pp_chunks);
     free(stream);
 }
 
@@ -875,6 +1090,8 @@ void httpd_StreamDelete(httpd_stream_t *stream)
  * Low level
  *****************************************************************************/
 static void* httpd_HostThread(void *);
+static int httpd_WorkerStart(httpd_host_t *, httpd_worker_t *);
+static void httpd_WorkerStop(httpd_worker_t *);
 static httpd_host_t *httpd_HostCreate(vlc_object_t *, const char *,
                                        const char *, vlc_tls_server_t *);
 
@@ -953,6 +1170,8 @@ static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
 
     vlc_mutex_init(&host->lock);
     atomic_init(&host->ref, 1);
+    host->workers = NULL;
+    host->worker_count = 0;
 
     char *hostname = var_InheritString(p_this, hostvar);
 
@@ -967,10 +1186,24 @@ static httpd_host_t *httpd_HostCreate(vlc_object_t *p_this,
 
     host->port     = port;
     vlc_list_init(&host->urls);
-    host->client_count = 0;
-    vlc_list_init(&host->clients);
     host->p_tls    = p_tls;
 
+    unsigned threads = var_InheritInteger(p_this, "http-threads");
+    if (threads == 0)
+        threads = __MIN(vlc_GetCPUCount(), 4);
+
+    host->workers = vlc_alloc(threads, sizeof (*host->workers));
+    if (unlikely(host->workers == NULL))
+        goto error;
+
+    while (host->worker_count < threads) {
+        if (httpd_WorkerStart(host, &host->workers[host->worker_count])) {
+            msg_Err(p_this, "cannot spawn http worker thread");
+            goto error;
+        }
+        host->worker_count++;
+    }
+
     /* create the thread */
     if (vlc_clone(&host->thread, httpd_HostThread, host,
                    VLC_THREAD_PRIORITY_LOW)) {
@@ -988,6 +1221,9 @@ error:
     vlc_mutex_unlock(&httpd.mutex);
 
     if (host) {
+        for (unsigned i = 0; i < host->worker_count; i++)
+            httpd_WorkerStop(&host->workers[i]);
+        free(host->workers);
         net_ListenClose(host->fds);
         vlc_object_delete(host);
     }
@@ -999,8 +1235,6 @@ error:
 /* delete a host */
 void httpd_HostDelete(httpd_host_t *host)
 {
-    httpd_client_t *client;
-
     vlc_mutex_lock(&httpd.mutex);
 
     if (atomic_fetch_sub_explicit(&host->ref, 1, memory_order_relaxed) > 1) {
@@ -1014,12 +1248,11 @@ void httpd_HostDelete(httpd_host_t *host)
     vlc_cancel(host->thread);
     vlc_join(host->thread, NULL);
 
-    msg_Dbg(host, "HTTP host removed");
+    for (unsigned i = 0; i < host->worker_count; i++)
+        httpd_WorkerStop(&host->workers[i]);
+    free(host->workers);
 
-    vlc_list_foreach(client, &host->clients, node) {
-        msg_Warn(host, "client still connected");
-        httpd_ClientDestroy(client);
-    }
+    msg_Dbg(host, "HTTP host removed");
 
     assert(vlc_list_is_empty(&host->urls));
     vlc_tls_ServerDelete(host->p_tls);
@@ -1028,9 +1261,11 @@ void httpd_HostDelete(httpd_host_t *host)
     vlc_mutex_unlock(&httpd.mutex);
 }
 
-/* register a new url */
-httpd_url_t *httpd_UrlNew(httpd_host_t *host, const char *psz_url,
-                           const char *psz_user, const char *psz_password)
+static httpd_url_t *httpd_UrlNewInternal(httpd_host_t *host,
+                                         const char *psz_url,
+                                         const char *psz_user,
+                                         const char *psz_password,
+                                         bool notify)
 {
     httpd_url_t *url;
 
@@ -1054,6 +1289,7 @@ httpd_url_t *httpd_UrlNew(httpd_host_t *host, const char *psz_url,
     url->psz_password = NULL;
 
     url->host = host;
+    url->notify = notify;
 
     vlc_mutex_init(&url->lock);
 
@@ -1088,6 +1324,13 @@ error:
     return NULL;
 }
 
+/* register a new url */
+httpd_url_t *httpd_UrlNew(httpd_host_t *host, const char *psz_url,
+                           const char *psz_user, const char *psz_password)
+{
+    return httpd_UrlNewInternal(host, psz_url, psz_user, psz_password, false);
+}
+
 /* register callback on a url */
 int httpd_UrlCatch(httpd_url_t *url, int i_msg, httpd_callback_t cb,
                     httpd_callback_sys_t *p_sys)
@@ -1113,14 +1356,27 @@ void httpd_UrlDelete(httpd_url_t *url)
     free(url->psz_user);
     free(url->psz_password);
 
-    vlc_list_foreach(client, &host->clients, node) {
-        if (client->url != url)
-            continue;
+    /* Clients are owned by their worker, which closes them the next time
+     * they need the url. Make sure the ones waiting for data notice. */
+    for (unsigned i = 0; i < host->worker_count; i++) {
+        httpd_worker_t *w = &host->workers[i];
+        bool found = false;
+
+        vlc_mutex_lock(&w->lock);
+        vlc_list_foreach(client, &w->clients, node) {
+            if (client->url != url)
+                continue;
 
-        /* TODO complete it */
-        msg_Warn(host, "force closing connections");
-        host->client_count--;
-        httpd_ClientDestroy(client);
+            msg_Warn(host, "force closing connections");
+            client->url = NULL;
+            found = true;
+        }
+        vlc_mutex_unlock(&w->lock);
+
+        if (found) {
+            atomic_store(&w->data, true);
+            httpd_WorkerWake(w);
+        }
     }
     free(url);
     vlc_mutex_unlock(&host->lock);
@@ -1203,8 +1459,13 @@ static void httpd_ClientInit(httpd_client_t *cl, vlc_tick_t now)
     cl->i_buffer_size = HTTPD_CL_BUFSIZE;
     cl->i_buffer = 0;
     cl->p_buffer = xmalloc(cl->i_buffer_size);
+    cl->i_chunks = 0;
+    cl->i_chunk_offset = 0;
     cl->i_keyframe_wait_to_pass = -1;
     cl->b_stream_mode = false;
+    cl->b_chunked = false;
+    cl->b_waiting = false;
+    cl->b_notify = false;
 
     httpd_MsgInit(&cl->query);
     httpd_MsgInit(&cl->answer);
@@ -1222,11 +1483,12 @@ char* httpd_ServerIP(const httpd_client_t *cl, char *ip, int *port)
 
 static void httpd_ClientDestroy(httpd_client_t *cl)
 {
-    vlc_list_remove(&cl->node);
     vlc_tls_Close(cl->sock);
     httpd_MsgClean(&cl->answer);
     httpd_MsgClean(&cl->query);
 
+    for (unsigned i = 0; i < cl->i_chunks; i++)
+        httpd_ChunkRelease(cl->chunks[i]);
     free(cl->p_buffer);
     free(cl);
 }
@@ -1572,7 +1834,87 @@ static int httpd_ClientRecv(httpd_client_t *cl)
     return 0;
 }
 
-static int httpd_ClientSend(httpd_client_t *cl)
+/* Returns the bytes a stream chunk takes on the wire for a client */
+static size_t httpd_ClientChunkSize(const httpd_client_t *cl,
+                                    const httpd_chunk_t *chunk)
+{
+    return cl->b_chunked ? httpd_ChunkWireSize(chunk->len) : chunk->len;
+}
+
+/* Sends stream chunks straight from the shared memory */
+static ssize_t httpd_ClientSendChunks(httpd_client_t *cl)
+{
+    vlc_tls_t *sock = cl->sock;
+    struct iovec iov[3 * HTTPD_CL_CHUNKS];
+    char lines[HTTPD_CL_CHUNKS][HTTPD_CHUNK_LINE_MAX];
+    unsigned n_iov = 0;
+
+    if (cl->i_chunks == 0)
+        return 0;
+
+    for (unsigned i = 0; i < cl->i_chunks; i++) {
+        if (cl->b_chunked) {
+            iov[n_iov].iov_base = lines[i];
+            iov[n_iov++].iov_len = httpd_ChunkLine(lines[i],
+                                                   cl->chunks[i]->len);
+        }
+        iov[n_iov].iov_base = cl->chunks[i]->data;
+        iov[n_iov++].iov_len = cl->chunks[i]->len;
+        if (cl->b_chunked) {
+            iov[n_iov].iov_base = (char *)"\r\n";
+            iov[n_iov++].iov_len = 2;
+        }
+    }
+
+    /* skip what was already sent from the first chunk */
+    unsigned first = 0;
+    size_t skip = cl->i_chunk_offset;
+
+    while (skip >= iov[first].iov_len) {
+        skip -= iov[first++].iov_len;
+        assert(first < n_iov);
+    }
+    iov[first].iov_base = (char *)iov[first].iov_base + skip;
+    iov[first].iov_len -= skip;
+
+    ssize_t val = sock->ops->writev(sock, iov + first, n_iov - first);
+    if (val <= 0)
+        return val;
+
+    /* release what went out */
+    size_t done = cl->i_chunk_offset + val;
+    unsigned n = 0;
+
+    while (n < cl->i_chunks
+        && done >= httpd_ClientChunkSize(cl, cl->chunks[n])) {
+        done -= httpd_ClientChunkSize(cl, cl->chunks[n]);
+        httpd_ChunkRelease(cl->chunks[n++]);
+    }
+    memmove(cl->chunks, cl->chunks + n, (cl->i_chunks - n) * sizeof (cl->chunks[0]));
+    cl->i_chunks -= n;
+    cl->i_chunk_offset = done;
+    return val;
+}
+
+/* Locks the client url against concurrent callbacks and deletion.
+ *
+ * Streams protect their own state, so the clients of a stream url, once
+ * answered, only hold the lock of their worker. httpd_UrlDelete() takes it
+ * too before detaching them, so the url stays valid. The other clients are
+ * served under the host lock. */
+static vlc_mutex_t *httpd_ClientLock(httpd_worker_t *w, httpd_client_t *cl)
+{
+    vlc_mutex_t *lock = &w->host->lock;
+
+    if (cl->b_notify && (cl->i_state == HTTPD_CLIENT_SENDING
+                      || cl->i_state == HTTPD_CLIENT_SEND_DONE
+                      || cl->i_state == HTTPD_CLIENT_WAITING))
+        lock = &w->lock;
+    vlc_mutex_lock(lock);
+    return lock;
+}
+
+static int httpd_ClientSend(httpd_worker_t *w, httpd_client_t *cl)
 {
     int i_len;
 
@@ -1607,8 +1949,11 @@ static int httpd_ClientSend(httpd_client_t *cl)
         cl->i_buffer_size = (uint8_t*)p - cl->p_buffer;
     }
 
-    i_len = httpd_NetSend(cl, &cl->p_buffer[cl->i_buffer],
-                           cl->i_buffer_size - cl->i_buffer);
+    if (cl->i_buffer < cl->i_buffer_size)
+        i_len = httpd_NetSend(cl, &cl->p_buffer[cl->i_buffer],
+                               cl->i_buffer_size - cl->i_buffer);
+    else
+        i_len = httpd_ClientSendChunks(cl);
 
     if (i_len < 0) {
 #if defined(_WIN32)
@@ -1623,9 +1968,10 @@ static int httpd_ClientSend(httpd_client_t *cl)
         return 0;
     }
 
-    cl->i_buffer += i_len;
+    if (cl->i_buffer < cl->i_buffer_size)
+        cl->i_buffer += i_len;
 
-    if (cl->i_buffer >= cl->i_buffer_size) {
+    if (cl->i_buffer >= cl->i_buffer_size && cl->i_chunks == 0) {
         if (cl->answer.i_body == 0  && cl->answer.i_body_offset > 0) {
             /* catch more body data */
             int     i_msg = cl->query.i_type;
@@ -1634,8 +1980,16 @@ static int httpd_ClientSend(httpd_client_t *cl)
             httpd_MsgClean(&cl->answer);
             cl->answer.i_body_offset = i_offset;
 
-            cl->url->catch[i_msg].cb(cl->url->catch[i_msg].p_sys, cl,
-                                     &cl->answer, &cl->query);
+            vlc_mutex_t *lock = httpd_ClientLock(w, cl);
+            if (cl->url != NULL)
+                cl->url->catch[i_msg].cb(cl->url->catch[i_msg].p_sys, cl,
+                                         &cl->answer, &cl->query);
+            else /* url deleted */
+                cl->i_state = HTTPD_CLIENT_DEAD;
+            vlc_mutex_unlock(lock);
+
+            if (cl->i_state == HTTPD_CLIENT_DEAD)
+                return 0;
         }
 
         if (cl->answer.i_body > 0) {
@@ -1647,7 +2001,7 @@ static int httpd_ClientSend(httpd_client_t *cl)
 
             cl->answer.i_body = 0;
             cl->answer.p_body = NULL;
-        } else /* send finished */
+        } else if (cl->i_chunks == 0) /* send finished */
             cl->i_state = HTTPD_CLIENT_SEND_DONE;
     }
     return 0;
@@ -1704,24 +2058,285 @@ auth_failed:
     return false;
 }
 
-static void httpdLoop(httpd_host_t *host)
+/* Handles a complete request, the end of an answer, or a stream client
+ * waiting for data. Called with the lock from httpd_ClientLock() held.
+ * Returns 0 if the client went forward. */
+static int httpd_ClientHandle(httpd_host_t *host, httpd_client_t *cl)
 {
-    struct pollfd ufd[host->nfd + host->client_count];
-    unsigned nfd;
-    for (nfd = 0; nfd < host->nfd; nfd++) {
-        ufd[nfd].fd = host->fds[nfd];
-        ufd[nfd].events = POLLIN;
-        ufd[nfd].revents = 0;
+    switch (cl->i_state) {
+        case HTTPD_CLIENT_RECEIVE_DONE: {
+            httpd_message_t *answer = &cl->answer;
+            httpd_message_t *query  = &cl->query;
+
+            httpd_MsgInit(answer);
+
+            /* Handle what we received */
+            switch (query->i_type) {
+                case HTTPD_MSG_ANSWER:
+                    cl->url     = NULL;
+                    cl->i_state = HTTPD_CLIENT_DEAD;
+                    break;
+
+                case HTTPD_MSG_OPTIONS:
+                    answer->i_type   = HTTPD_MSG_ANSWER;
+                    answer->i_proto  = query->i_proto;
+                    answer->i_status = 200;
+                    answer->i_body = 0;
+                    answer->p_body = NULL;
+
+                    httpd_MsgAdd(answer, "Server", "VLC/%s", VERSION);
+                    httpd_MsgAdd(answer, "Content-Length", "0");
+
+                    switch(query->i_proto) {
+                    case HTTPD_PROTO_HTTP:
+                        answer->i_version = 1;
+                        httpd_MsgAdd(answer, "Allow", "GET,HEAD,POST,OPTIONS");
+                        break;
+
+                    case HTTPD_PROTO_RTSP:
+                        answer->i_version = 0;
+
+                        const char *p = httpd_MsgGet(query, "Cseq");
+                        if (p)
+                            httpd_MsgAdd(answer, "Cseq", "%s", p);
+                        p = httpd_MsgGet(query, "Timestamp");
+                        if (p)
+                            httpd_MsgAdd(answer, "Timestamp", "%s", p);
+
+                        p = httpd_MsgGet(query, "Require");
+                        if (p) {
+                            answer->i_status = 551;
+                            httpd_MsgAdd(query, "Unsupported", "%s", p);
+                        }
+
+                        httpd_MsgAdd(answer, "Public", "DESCRIBE,SETUP,"
+                                "TEARDOWN,PLAY,PAUSE,GET_PARAMETER");
+                        break;
+                    }
+
+                    if (httpd_MsgGet(&cl->query, "Connection") != NULL)
+                        httpd_MsgAdd(answer, "Connection", "close");
+
+                    cl->i_buffer = -1;  /* Force the creation of the answer in
+                                         * httpd_ClientSend */
+                    cl->i_state = HTTPD_CLIENT_SENDING;
+                    break;
+
+                case HTTPD_MSG_NONE:
+                    if (query->i_proto == HTTPD_PROTO_NONE) {
+                        cl->url = NULL;
+                        cl->i_state = HTTPD_CLIENT_DEAD;
+                    } else {
+                        /* unimplemented */
+                        answer->i_proto  = query->i_proto ;
+                        answer->i_type   = HTTPD_MSG_ANSWER;
+                        answer->i_version= 0;
+                        answer->i_status = 501;
+
+                        char *p;
+                        answer->i_body = httpd_HtmlError (&p, 501, NULL);
+                        answer->p_body = (uint8_t *)p;
+                        httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
+                        httpd_MsgAdd(answer, "Connection", "close");
+
+                        cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
+                        cl->i_state = HTTPD_CLIENT_SENDING;
+                    }
+                    break;
+
+                default: {
+                    httpd_url_t *url;
+                    int i_msg = query->i_type;
+                    bool b_auth_failed = false;
+
+                    /* Search the url and trigger callbacks */
+                    vlc_list_foreach(url, &host->urls, node) {
+                        if (strcmp(url->psz_url, query->psz_url))
+                            continue;
+                        if (!url->catch[i_msg].cb)
+                            continue;
+
+                        if (answer) {
+                            b_auth_failed = !httpdAuthOk(url->psz_user,
+                               url->psz_password,
+                               httpd_MsgGet(query, "Authorization")); /* BASIC id */
+                            if (b_auth_failed)
+                               break;
+                        }
+
+                        if (url->catch[i_msg].cb(url->catch[i_msg].p_sys, cl, answer, query))
+                            continue;
+
+                        if (answer->i_proto == HTTPD_PROTO_NONE)
+                            cl->i_buffer = cl->i_buffer_size; /* Raw answer from a CGI */
+                        else
+                            cl->i_buffer = -1;
+
+                        /* only one url can answer */
+                        answer = NULL;
+                        if (!cl->url) {
+                            cl->url = url;
+                            cl->b_notify = url->notify;
+                        }
+                    }
+
+                    if (answer) {
+                        answer->i_proto  = query->i_proto;
+                        answer->i_type   = HTTPD_MSG_ANSWER;
+                        answer->i_version= 0;
+
+                       if (b_auth_failed) {
+                            httpd_MsgAdd(answer, "WWW-Authenticate",
+                                    "Basic realm=\"VLC stream\"");
+                            answer->i_status = 401;
+                        } else
+                            answer->i_status = 404; /* no url registered */
+
+                        char *p;
+                        answer->i_body = httpd_HtmlError (&p, answer->i_status,
+                                query->psz_url);
+                        answer->p_body = (uint8_t *)p;
+
+                        cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
+                        httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
+                        httpd_MsgAdd(answer, "Content-Type", "%s", "text/html");
+                        if (httpd_MsgGet(&cl->query, "Connection") != NULL)
+                            httpd_MsgAdd(answer, "Connection", "close");
+                    }
+
+                    cl->i_state = HTTPD_CLIENT_SENDING;
+                }
+            }
+            break;
+        }
+
+        case HTTPD_CLIENT_SEND_DONE:
+            if (!cl->b_stream_mode || cl->answer.i_body_offset == 0) {
+                bool do_close = false;
+
+                cl->url = NULL;
+
+                if (cl->query.i_proto != HTTPD_PROTO_HTTP
+                 || cl->query.i_version > 0)
+                {
+                    const char *psz_connection = httpd_MsgGet(&cl->answer,
+                                                             "Connection");
+                    if (psz_connection != NULL)
+                        do_close = !strcasecmp(psz_connection, "close");
+                }
+                else
+                    do_close = true;
+
+                if (!do_close) {
+                    httpd_MsgClean(&cl->query);
+                    httpd_MsgInit(&cl->query);
+
+                    cl->i_buffer = 0;
+                    cl->i_buffer_size = 1000;
+                    free(cl->p_buffer);
+                    // Allocate an extra byte for the null terminating byte
+                    cl->p_buffer = xmalloc(cl->i_buffer_size + 1);
+                    cl->i_state = HTTPD_CLIENT_RECEIVING;
+                } else
+                    cl->i_state = HTTPD_CLIENT_DEAD;
+                httpd_MsgClean(&cl->answer);
+            } else {
+                int64_t i_offset = cl->answer.i_body_offset;
+                httpd_MsgClean(&cl->answer);
+
+                cl->answer.i_body_offset = i_offset;
+                free(cl->p_buffer);
+                cl->p_buffer = NULL;
+                cl->i_buffer = 0;
+                cl->i_buffer_size = 0;
+
+                cl->i_state = HTTPD_CLIENT_WAITING;
+            }
+            break;
+
+        case HTTPD_CLIENT_WAITING: {
+            int64_t i_offset = cl->answer.i_body_offset;
+            int i_msg = cl->query.i_type;
+
+            if (cl->url == NULL) { /* url deleted */
+                cl->i_state = HTTPD_CLIENT_DEAD;
+                break;
+            }
+
+            httpd_MsgInit(&cl->answer);
+            cl->answer.i_body_offset = i_offset;
+
+            cl->url->catch[i_msg].cb(cl->url->catch[i_msg].p_sys, cl,
+                    &cl->answer, &cl->query);
+            if (cl->answer.i_type != HTTPD_MSG_NONE) {
+                /* we have new data, so re-enter send mode */
+                cl->i_buffer      = 0;
+                cl->p_buffer      = cl->answer.p_body;
+                cl->i_buffer_size = cl->answer.i_body;
+                cl->answer.p_body = NULL;
+                cl->answer.i_body = 0;
+                cl->i_state = HTTPD_CLIENT_SENDING;
+            } else
+                return -1; /* no data available */
+        }
     }
+    return 0;
+}
 
-    vlc_mutex_lock(&host->lock);
-    /* add all socket that should be read/write and close dead connection */
-    vlc_tick_t now = vlc_tick_now();
-    int delay = -1;
-    httpd_client_t *cl;
+static void httpd_WorkerWake(httpd_worker_t *w)
+{
+#ifndef _WIN32
+    ssize_t val = write(w->wakefd[1], &(char){ 0 }, 1);
+    VLC_UNUSED(val); /* a full pipe is as good */
+#else
+    VLC_UNUSED(w); /* workers do not sleep longer than HTTPD_WAIT_PERIOD */
+#endif
+}
+
+static void httpd_WorkerDrain(httpd_worker_t *w)
+{
+    char buf[64];
+
+    while (read(w->wakefd[0], buf, sizeof (buf)) > 0);
+}
 
-    int canc = vlc_savecancel();
-    vlc_list_foreach(cl, &host->clients, node) {
+/* Tells the workers that stream clients may have new data */
+static void httpd_HostWake(httpd_host_t *host)
+{
+    for (unsigned i = 0; i < host->worker_count; i++) {
+        httpd_worker_t *w = &host->workers[i];
+
+        if (!atomic_exchange(&w->data, true))
+            httpd_WorkerWake(w);
+    }
+}
+
+static void httpd_WorkerRemove(httpd_worker_t *w, httpd_client_t *cl)
+{
+    if (cl->b_waiting) {
+        vlc_list_remove(&cl->wait_node);
+        if (!cl->b_notify)
+            w->polled--;
+    }
+#ifdef HAVE_SYS_EPOLL_H
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, vlc_tls_GetFD(cl->sock), NULL);
+#endif
+
+    vlc_mutex_lock(&w->lock);
+    vlc_list_remove(&cl->node);
+    w->client_count--;
+    vlc_mutex_unlock(&w->lock);
+
+    httpd_ClientDestroy(cl);
+}
+
+/* Runs the client state machine until it would block */
+static void httpd_ClientRun(httpd_worker_t *w, httpd_client_t *cl,
+                            vlc_tick_t now)
+{
+    httpd_host_t *host = w->host;
+
+    for (;;) {
         int val = -1;
 
         switch (cl->i_state) {
@@ -1729,332 +2344,385 @@ static void httpdLoop(httpd_host_t *host)
                 val = httpd_ClientRecv(cl);
                 break;
             case HTTPD_CLIENT_SENDING:
-                val = httpd_ClientSend(cl);
+                val = httpd_ClientSend(w, cl);
                 break;
             case HTTPD_CLIENT_TLS_HS_IN:
             case HTTPD_CLIENT_TLS_HS_OUT:
                 httpd_ClientTlsHandshake(host, cl);
+                if (cl->i_state != HTTPD_CLIENT_TLS_HS_IN
+                 && cl->i_state != HTTPD_CLIENT_TLS_HS_OUT)
+                    val = 0;
+                break;
+            case HTTPD_CLIENT_DEAD:
+                httpd_WorkerRemove(w, cl);
+                return;
+            default: {
+                vlc_mutex_t *lock = httpd_ClientLock(w, cl);
+                val = httpd_ClientHandle(host, cl);
+                vlc_mutex_unlock(lock);
                 break;
+            }
         }
 
-        if (cl->i_state == HTTPD_CLIENT_DEAD
-         || (cl->i_activity_timeout > 0
-          && cl->i_activity_date + cl->i_activity_timeout < now)) {
-            host->client_count--;
-            httpd_ClientDestroy(cl);
-            continue;
+        if (val != 0)
+            break;
+        cl->i_activity_date = now;
+    }
+
+    bool waiting = cl->i_state == HTTPD_CLIENT_WAITING;
+    if (waiting != cl->b_waiting) {
+        if (waiting)
+            vlc_list_append(&cl->wait_node, &w->waiting);
+        else
+            vlc_list_remove(&cl->wait_node);
+        if (!cl->b_notify) {
+            if (waiting)
+                w->polled++;
+            else
+                w->polled--;
         }
+        cl->b_waiting = waiting;
+    }
+}
 
-        if (val == 0) {
-            cl->i_activity_date = now;
-            delay = 0;
+/* Picks up clients handed over by the host thread */
+static void httpd_WorkerAdopt(httpd_worker_t *w, vlc_tick_t now)
+{
+    for (;;) {
+        vlc_mutex_lock(&w->lock);
+        httpd_client_t *cl = vlc_list_first_entry_or_null(&w->incoming,
+                                                          httpd_client_t, node);
+        if (cl != NULL) {
+            vlc_list_remove(&cl->node);
+            vlc_list_append(&cl->node, &w->clients);
         }
+        vlc_mutex_unlock(&w->lock);
 
-        struct pollfd *pufd = ufd + nfd;
-        assert (pufd < ufd + ARRAY_SIZE (ufd));
+        if (cl == NULL)
+            break;
 
-        pufd->events = pufd->revents = 0;
+#ifdef HAVE_SYS_EPOLL_H
+        /* Edge triggered: the state machine always runs until EAGAIN */
+        struct epoll_event ev = {
+            .events = EPOLLIN | EPOLLOUT | EPOLLET,
+            .data = { .ptr = cl },
+        };
 
-        switch (cl->i_state) {
-            case HTTPD_CLIENT_RECEIVING:
-            case HTTPD_CLIENT_TLS_HS_IN:
-                pufd->events = POLLIN;
-                break;
+        if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, vlc_tls_GetFD(cl->sock), &ev))
+            cl->i_state = HTTPD_CLIENT_DEAD;
+#endif
+        httpd_ClientRun(w, cl, now);
+    }
+}
 
-            case HTTPD_CLIENT_SENDING:
-            case HTTPD_CLIENT_TLS_HS_OUT:
-                pufd->events = POLLOUT;
-                break;
+/* Returns when the clients waiting for stream data should be retried */
+static vlc_tick_t httpd_WorkerWaitDeadline(httpd_worker_t *w)
+{
+    if (vlc_list_is_empty(&w->waiting)
+     || (w->polled == 0 && !atomic_load(&w->data)))
+        return INT64_MAX;
+    return w->last_wait + HTTPD_WAIT_PERIOD;
+}
 
-            case HTTPD_CLIENT_RECEIVE_DONE: {
-                httpd_message_t *answer = &cl->answer;
-                httpd_message_t *query  = &cl->query;
+static void httpd_WorkerRunWaiting(httpd_worker_t *w, vlc_tick_t now)
+{
+    httpd_client_t *cl;
 
-                httpd_MsgInit(answer);
+    atomic_store(&w->data, false);
+    w->last_wait = now;
 
-                /* Handle what we received */
-                switch (query->i_type) {
-                    case HTTPD_MSG_ANSWER:
-                        cl->url     = NULL;
-                        cl->i_state = HTTPD_CLIENT_DEAD;
-                        break;
+    vlc_list_foreach(cl, &w->waiting, wait_node)
+        httpd_ClientRun(w, cl, now);
+}
 
-                    case HTTPD_MSG_OPTIONS:
-                        answer->i_type   = HTTPD_MSG_ANSWER;
-                        answer->i_proto  = query->i_proto;
-                        answer->i_status = 200;
-                        answer->i_body = 0;
-                        answer->p_body = NULL;
+static void httpd_WorkerCheckTimeouts(httpd_worker_t *w, vlc_tick_t now)
+{
+    httpd_client_t *cl;
 
-                        httpd_MsgAdd(answer, "Server", "VLC/%s", VERSION);
-                        httpd_MsgAdd(answer, "Content-Length", "0");
+    vlc_list_foreach(cl, &w->clients, node)
+        if (cl->i_activity_timeout > 0
+         && cl->i_activity_date + cl->i_activity_timeout < now)
+            httpd_WorkerRemove(w, cl);
 
-                        switch(query->i_proto) {
-                        case HTTPD_PROTO_HTTP:
-                            answer->i_version = 1;
-                            httpd_MsgAdd(answer, "Allow", "GET,HEAD,POST,OPTIONS");
-                            break;
+    w->last_check = now;
+}
 
-                        case HTTPD_PROTO_RTSP:
-                            answer->i_version = 0;
+#ifdef HAVE_SYS_EPOLL_H
+static void httpd_WorkerPoll(httpd_worker_t *w, int timeout)
+{
+    struct epoll_event ev[64];
 
-                            const char *p = httpd_MsgGet(query, "Cseq");
-                            if (p)
-                                httpd_MsgAdd(answer, "Cseq", "%s", p);
-                            p = httpd_MsgGet(query, "Timestamp");
-                            if (p)
-                                httpd_MsgAdd(answer, "Timestamp", "%s", p);
+    int n = epoll_wait(w->epfd, ev, ARRAY_SIZE(ev), timeout);
+    if (n < 0) {
+        if (errno != EINTR)
+            msg_Err(w->host, "polling error: %s", vlc_strerror_c(errno));
+        return;
+    }
 
-                            p = httpd_MsgGet(query, "Require");
-                            if (p) {
-                                answer->i_status = 551;
-                                httpd_MsgAdd(query, "Unsupported", "%s", p);
-                            }
+    vlc_tick_t now = vlc_tick_now();
 
-                            httpd_MsgAdd(answer, "Public", "DESCRIBE,SETUP,"
-                                    "TEARDOWN,PLAY,PAUSE,GET_PARAMETER");
-                            break;
-                        }
+    for (int i = 0; i < n; i++) {
+        httpd_client_t *cl = ev[i].data.ptr;
 
-                        if (httpd_MsgGet(&cl->query, "Connection") != NULL)
-                            httpd_MsgAdd(answer, "Connection", "close");
+        if (cl == NULL) {
+            httpd_WorkerDrain(w);
+            continue;
+        }
 
-                        cl->i_buffer = -1;  /* Force the creation of the answer in
-                                             * httpd_ClientSend */
-                        cl->i_state = HTTPD_CLIENT_SENDING;
-                        break;
+        /* nothing else would tell a waiting client is gone */
+        if ((ev[i].events & (EPOLLERR | EPOLLHUP))
+         && cl->i_state == HTTPD_CLIENT_WAITING)
+            cl->i_state = HTTPD_CLIENT_DEAD;
 
-                    case HTTPD_MSG_NONE:
-                        if (query->i_proto == HTTPD_PROTO_NONE) {
-                            cl->url = NULL;
-                            cl->i_state = HTTPD_CLIENT_DEAD;
-                        } else {
-                            /* unimplemented */
-                            answer->i_proto  = query->i_proto ;
-                            answer->i_type   = HTTPD_MSG_ANSWER;
-                            answer->i_version= 0;
-                            answer->i_status = 501;
-
-                            char *p;
-                            answer->i_body = httpd_HtmlError (&p, 501, NULL);
-                            answer->p_body = (uint8_t *)p;
-                            httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
-                            httpd_MsgAdd(answer, "Connection", "close");
+        httpd_ClientRun(w, cl, now);
+    }
+}
+#else
+static void httpd_WorkerPoll(httpd_worker_t *w, int timeout)
+{
+    httpd_client_t *cl;
+    size_t count = 0;
 
-                            cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
-                            cl->i_state = HTTPD_CLIENT_SENDING;
-                        }
-                        break;
+    vlc_list_foreach(cl, &w->clients, node)
+        count++;
 
-                    default: {
-                        httpd_url_t *url;
-                        int i_msg = query->i_type;
-                        bool b_auth_failed = false;
-
-                        /* Search the url and trigger callbacks */
-                        vlc_list_foreach(url, &host->urls, node) {
-                            if (strcmp(url->psz_url, query->psz_url))
-                                continue;
-                            if (!url->catch[i_msg].cb)
-                                continue;
-
-                            if (answer) {
-                                b_auth_failed = !httpdAuthOk(url->psz_user,
-                                   url->psz_password,
-                                   httpd_MsgGet(query, "Authorization")); /* BASIC id */
-                                if (b_auth_failed)
-                                   break;
-                            }
-
-                            if (url->catch[i_msg].cb(url->catch[i_msg].p_sys, cl, answer, query))
-                                continue;
-
-                            if (answer->i_proto == HTTPD_PROTO_NONE)
-                                cl->i_buffer = cl->i_buffer_size; /* Raw answer from a CGI */
-                            else
-                                cl->i_buffer = -1;
-
-                            /* only one url can answer */
-                            answer = NULL;
-                            if (!cl->url)
-                                cl->url = url;
-                        }
+    struct pollfd ufd[1 + count];
+    httpd_client_t *owners[1 + count];
+    unsigned nfd = 0;
 
-                        if (answer) {
-                            answer->i_proto  = query->i_proto;
-                            answer->i_type   = HTTPD_MSG_ANSWER;
-                            answer->i_version= 0;
-
-                           if (b_auth_failed) {
-                                httpd_MsgAdd(answer, "WWW-Authenticate",
-                                        "Basic realm=\"VLC stream\"");
-                                answer->i_status = 401;
-                            } else
-                                answer->i_status = 404; /* no url registered */
-
-                            char *p;
-                            answer->i_body = httpd_HtmlError (&p, answer->i_status,
-                                    query->psz_url);
-                            answer->p_body = (uint8_t *)p;
-
-                            cl->i_buffer = -1;  /* Force the creation of the answer in httpd_ClientSend */
-                            httpd_MsgAdd(answer, "Content-Length", "%d", answer->i_body);
-                            httpd_MsgAdd(answer, "Content-Type", "%s", "text/html");
-                            if (httpd_MsgGet(&cl->query, "Connection") != NULL)
-                                httpd_MsgAdd(answer, "Connection", "close");
-                        }
+    if (w->wakefd[0] != -1) {
+        ufd[nfd].fd = w->wakefd[0];
+        ufd[nfd].events = POLLIN;
+        owners[nfd++] = NULL;
+    }
 
-                        cl->i_state = HTTPD_CLIENT_SENDING;
-                    }
-                }
+    vlc_list_foreach(cl, &w->clients, node) {
+        short events;
+
+        switch (cl->i_state) {
+            case HTTPD_CLIENT_RECEIVING:
+            case HTTPD_CLIENT_TLS_HS_IN:
+                events = POLLIN;
                 break;
-            }
+            case HTTPD_CLIENT_SENDING:
+            case HTTPD_CLIENT_TLS_HS_OUT:
+                events = POLLOUT;
+                break;
+            default:
+                continue;
+        }
 
-            case HTTPD_CLIENT_SEND_DONE:
-                if (!cl->b_stream_mode || cl->answer.i_body_offset == 0) {
-                    bool do_close = false;
+        ufd[nfd].fd = vlc_tls_GetPollFD(cl->sock, &events);
+        ufd[nfd].events = events;
+        owners[nfd++] = cl;
+    }
 
-                    cl->url = NULL;
+    if (poll(ufd, nfd, timeout) < 0) {
+        if (errno != EINTR)
+            msg_Err(w->host, "polling error: %s", vlc_strerror_c(errno));
+        return;
+    }
 
-                    if (cl->query.i_proto != HTTPD_PROTO_HTTP
-                     || cl->query.i_version > 0)
-                    {
-                        const char *psz_connection = httpd_MsgGet(&cl->answer,
-                                                                 "Connection");
-                        if (psz_connection != NULL)
-                            do_close = !strcasecmp(psz_connection, "close");
-                    }
-                    else
-                        do_close = true;
-
-                    if (!do_close) {
-                        httpd_MsgClean(&cl->query);
-                        httpd_MsgInit(&cl->query);
-
-                        cl->i_buffer = 0;
-                        cl->i_buffer_size = 1000;
-                        free(cl->p_buffer);
-                        // Allocate an extra byte for the null terminating byte
-                        cl->p_buffer = xmalloc(cl->i_buffer_size + 1);
-                        cl->i_state = HTTPD_CLIENT_RECEIVING;
-                    } else
-                        cl->i_state = HTTPD_CLIENT_DEAD;
-                    httpd_MsgClean(&cl->answer);
-                } else {
-                    int64_t i_offset = cl->answer.i_body_offset;
-                    httpd_MsgClean(&cl->answer);
+    vlc_tick_t now = vlc_tick_now();
 
-                    cl->answer.i_body_offset = i_offset;
-                    free(cl->p_buffer);
-                    cl->p_buffer = NULL;
-                    cl->i_buffer = 0;
-                    cl->i_buffer_size = 0;
+    for (unsigned i = 0; i < nfd; i++) {
+        if (ufd[i].revents == 0)
+            continue;
+        if (owners[i] == NULL)
+            httpd_WorkerDrain(w);
+        else
+            httpd_ClientRun(w, owners[i], now);
+    }
+}
+#endif
 
-                    cl->i_state = HTTPD_CLIENT_WAITING;
-                }
-                break;
+static void *httpd_WorkerThread(void *data)
+{
+    httpd_worker_t *w = data;
+    vlc_tick_t now = vlc_tick_now();
 
-            case HTTPD_CLIENT_WAITING: {
-                int64_t i_offset = cl->answer.i_body_offset;
-                int i_msg = cl->query.i_type;
+    w->last_wait = w->last_check = now;
 
-                httpd_MsgInit(&cl->answer);
-                cl->answer.i_body_offset = i_offset;
+    while (!atomic_load(&w->exit)) {
+        vlc_tick_t deadline = httpd_WorkerWaitDeadline(w);
+        int timeout = -1;
 
-                cl->url->catch[i_msg].cb(cl->url->catch[i_msg].p_sys, cl,
-                        &cl->answer, &cl->query);
-                if (cl->answer.i_type != HTTPD_MSG_NONE) {
-                    /* we have new data, so re-enter send mode */
-                    cl->i_buffer      = 0;
-                    cl->p_buffer      = cl->answer.p_body;
-                    cl->i_buffer_size = cl->answer.i_body;
-                    cl->answer.p_body = NULL;
-                    cl->answer.i_body = 0;
-                    cl->i_state = HTTPD_CLIENT_SENDING;
-                }
-            }
-        }
+        if (!vlc_list_is_empty(&w->clients))
+            deadline = __MIN(deadline, w->last_check + VLC_TICK_FROM_SEC(1));
+#ifdef _WIN32
+        deadline = __MIN(deadline, now + HTTPD_WAIT_PERIOD);
+#endif
+        if (deadline != INT64_MAX)
+            timeout = deadline > now ? MS_FROM_VLC_TICK(deadline - now) + 1 : 0;
 
-        pufd->fd = vlc_tls_GetPollFD(cl->sock, &pufd->events);
+        httpd_WorkerPoll(w, timeout);
 
-        if (pufd->events != 0)
-            nfd++;
-        /* we will wait 20ms (not too big) if HTTPD_CLIENT_WAITING */
-        else if (delay != 0)
-            delay = 20;
-    }
-    vlc_mutex_unlock(&host->lock);
-    vlc_restorecancel(canc);
+        now = vlc_tick_now();
+        httpd_WorkerAdopt(w, now);
 
-    while (poll(ufd, nfd, delay) < 0)
-    {
-        if (errno != EINTR)
-            msg_Err(host, "polling error: %s", vlc_strerror_c(errno));
+        if (now >= httpd_WorkerWaitDeadline(w))
+            httpd_WorkerRunWaiting(w, now);
+        if (now >= w->last_check + VLC_TICK_FROM_SEC(1))
+            httpd_WorkerCheckTimeouts(w, now);
     }
+    return NULL;
+}
 
-    canc = vlc_savecancel();
-    vlc_mutex_lock(&host->lock);
+static int httpd_WorkerStart(httpd_host_t *host, httpd_worker_t *w)
+{
+    w->host = host;
+    atomic_init(&w->exit, false);
+    atomic_init(&w->data, false);
+    vlc_mutex_init(&w->lock);
+    w->client_count = 0;
+    vlc_list_init(&w->clients);
+    vlc_list_init(&w->incoming);
+    vlc_list_init(&w->waiting);
+    w->polled = 0;
+
+#ifndef _WIN32
+    if (vlc_pipe(w->wakefd))
+        return -1;
+    fcntl(w->wakefd[0], F_SETFL, O_NONBLOCK);
+    fcntl(w->wakefd[1], F_SETFL, O_NONBLOCK);
+#else
+    w->wakefd[0] = w->wakefd[1] = -1;
+#endif
 
-    /* Handle client sockets */
-    now = vlc_tick_now();
-    nfd = host->nfd;
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event ev = { .events = EPOLLIN, .data = { .ptr = NULL } };
 
-    /* Handle server sockets (accept new connections) */
-    for (nfd = 0; nfd < host->nfd; nfd++) {
-        int fd = ufd[nfd].fd;
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (w->epfd == -1)
+        goto error;
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->wakefd[0], &ev))
+        goto error;
+#endif
 
-        assert (fd == host->fds[nfd]);
+    if (vlc_clone(&w->thread, httpd_WorkerThread, w, VLC_THREAD_PRIORITY_LOW))
+        goto error;
+    return 0;
 
-        if (ufd[nfd].revents == 0)
-            continue;
+error:
+#ifdef HAVE_SYS_EPOLL_H
+    if (w->epfd != -1)
+        vlc_close(w->epfd);
+#endif
+#ifndef _WIN32
+    vlc_close(w->wakefd[1]);
+    vlc_close(w->wakefd[0]);
+#endif
+    return -1;
+}
 
-        /* */
-        fd = vlc_accept (fd, NULL, NULL, true);
-        if (fd == -1)
-            continue;
-        setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
-                &(int){ 1 }, sizeof(int));
+static void httpd_WorkerStop(httpd_worker_t *w)
+{
+    httpd_client_t *cl;
+
+    atomic_store(&w->exit, true);
+    httpd_WorkerWake(w);
+    vlc_join(w->thread, NULL);
+
+    vlc_list_foreach(cl, &w->incoming, node)
+        httpd_ClientDestroy(cl);
+    vlc_list_foreach(cl, &w->clients, node) {
+        msg_Warn(w->host, "client still connected");
+        httpd_ClientDestroy(cl);
+    }
 
-        vlc_tls_t *sk = vlc_tls_SocketOpen(fd);
-        if (unlikely(sk == NULL))
+#ifdef HAVE_SYS_EPOLL_H
+    vlc_close(w->epfd);
+#endif
+#ifndef _WIN32
+    vlc_close(w->wakefd[1]);
+    vlc_close(w->wakefd[0]);
+#endif
+}
+
+static void httpd_HostAccept(httpd_host_t *host, int fd)
+{
+    fd = vlc_accept (fd, NULL, NULL, true);
+    if (fd == -1)
+        return;
+    setsockopt (fd, SOL_SOCKET, SO_REUSEADDR,
+            &(int){ 1 }, sizeof(int));
+
+    vlc_tls_t *sk = vlc_tls_SocketOpen(fd);
+    if (unlikely(sk == NULL))
+    {
+        vlc_close(fd);
+        return;
+    }
+
+    if (host->p_tls != NULL)
+    {
+        const char *alpn[] = { "http/1.1", NULL };
+        vlc_tls_t *tls;
+
+        tls = vlc_tls_ServerSessionCreate(host->p_tls, sk, alpn);
+        if (tls == NULL)
         {
-            vlc_close(fd);
-            continue;
+            vlc_tls_SessionDelete(sk);
+            return;
         }
+        sk = tls;
+    }
 
-        if (host->p_tls != NULL)
-        {
-            const char *alpn[] = { "http/1.1", NULL };
-            vlc_tls_t *tls;
+    httpd_client_t *cl = httpd_ClientNew(sk, vlc_tick_now());
+    if (unlikely(cl == NULL))
+    {
+        vlc_tls_Close(sk);
+        return;
+    }
 
-            tls = vlc_tls_ServerSessionCreate(host->p_tls, sk, alpn);
-            if (tls == NULL)
-            {
-                vlc_tls_SessionDelete(sk);
-                continue;
-            }
-            sk = tls;
-        }
+    if (host->p_tls != NULL)
+        cl->i_state = HTTPD_CLIENT_TLS_HS_OUT;
 
-        cl = httpd_ClientNew(sk, now);
+    /* hand it over to the least loaded worker */
+    httpd_worker_t *best = NULL;
+    size_t best_count = SIZE_MAX;
 
-        if (host->p_tls != NULL)
-            cl->i_state = HTTPD_CLIENT_TLS_HS_OUT;
+    for (unsigned i = 0; i < host->worker_count; i++) {
+        httpd_worker_t *w = &host->workers[i];
 
-        host->client_count++;
-        vlc_list_append(&cl->node, &host->clients);
+        vlc_mutex_lock(&w->lock);
+        if (w->client_count < best_count) {
+            best = w;
+            best_count = w->client_count;
+        }
+        vlc_mutex_unlock(&w->lock);
     }
 
-    vlc_mutex_unlock(&host->lock);
-    vlc_restorecancel(canc);
+    vlc_mutex_lock(&best->lock);
+    vlc_list_append(&cl->node, &best->incoming);
+    best->client_count++;
+    vlc_mutex_unlock(&best->lock);
+    httpd_WorkerWake(best);
 }
 
 static void* httpd_HostThread(void *data)
 {
     httpd_host_t *host = data;
+    struct pollfd ufd[host->nfd];
 
-    while (atomic_load_explicit(&host->ref, memory_order_relaxed) > 0)
-        httpdLoop(host);
+    for (unsigned i = 0; i < host->nfd; i++) {
+        ufd[i].fd = host->fds[i];
+        ufd[i].events = POLLIN;
+    }
+
+    for (;;) {
+        while (poll(ufd, host->nfd, -1) < 0)
+        {
+            if (errno != EINTR)
+                msg_Err(host, "polling error: %s", vlc_strerror_c(errno));
+        }
+
+        int canc = vlc_savecancel();
+        for (unsigned i = 0; i < host->nfd; i++)
+            if (ufd[i].revents != 0)
+                httpd_HostAccept(host, ufd[i].fd);
+        vlc_restorecancel(canc);
+    }
     return NULL;
 }
 
@@ -37,6 +37,8 @@ vlc_playlist_ClearItems(vlc_playlist_t *playlist)
     vlc_vector_foreach(item, &playlist->items)
         vlc_playlist_item_Release(item);
     vlc_vector_clear(&playlist->items);
+    vlc_playlist_lookup_Clear(&playlist->lookup);
+    playlist->indexed = 0;
 }
 
 static void
@@ -197,9 +199,18 @@ vlc_playlist_IndexOf(vlc_playlist_t *playlist, const vlc_playlist_item_t *item)
 {
     vlc_playlist_AssertLocked(playlist);
 
-    ssize_t index;
-    vlc_vector_index_of(&playlist->items, item, &index);
-    return index;
+    /* refresh the positions invalidated since the last call, so that a batch
+     * of changes costs a single pass */
+    playlist_item_vector_t *items = &playlist->items;
+    for (size_t i = playlist->indexed; i < items->size; ++i)
+        items->data[i]->index = i;
+    playlist->indexed = items->size;
+
+    /* the item may have been removed (and still be held by the caller) */
+    size_t index = item->index;
+    if (index < items->size && items->data[index] == item)
+        return index;
+    return -1;
 }
 
 ssize_t
@@ -207,11 +218,17 @@ vlc_playlist_IndexOfMedia(vlc_playlist_t *playlist, const input_item_t *media)
 {
     vlc_playlist_AssertLocked(playlist);
 
-    playlist_item_vector_t *items = &playlist->items;
-    for (size_t i = 0; i < items->size; ++i)
-        if (items->data[i]->media == media)
-            return i;
-    return -1;
+    /* several items may share the same media, return the first one */
+    ssize_t first = -1;
+    vlc_playlist_item_t *item = NULL;
+    while ((item = vlc_playlist_lookup_NextMedia(&playlist->lookup, media,
+                                                 item)))
+    {
+        ssize_t index = vlc_playlist_IndexOf(playlist, item);
+        if (first == -1 || index < first)
+            first = index;
+    }
+    return first;
 }
 
 ssize_t
@@ -219,11 +236,9 @@ vlc_playlist_IndexOfId(vlc_playlist_t *playlist, uint64_t id)
 {
     vlc_playlist_AssertLocked(playlist);
 
-    playlist_item_vector_t *items = &playlist->items;
-    for (size_t i = 0; i < items->size; ++i)
-        if (items->data[i]->id == id)
-            return i;
-    return -1;
+    vlc_playlist_item_t *item = vlc_playlist_lookup_FindId(&playlist->lookup,
+                                                           id);
+    return item ? vlc_playlist_IndexOf(playlist, item) : -1;
 }
 
 void
@@ -258,6 +273,9 @@ vlc_playlist_MediaToItems(vlc_playlist_t *playlist, input_item_t *const media[],
             vlc_playlist_item_Release(items[--i]);
         return VLC_ENOMEM;
     }
+
+    for (i = 0; i < count; ++i)
+        vlc_playlist_lookup_Add(&playlist->lookup, items[i]);
     return VLC_SUCCESS;
 }
 
@@ -268,6 +286,9 @@ vlc_playlist_Insert(vlc_playlist_t *playlist, size_t index,
     vlc_playlist_AssertLocked(playlist);
     assert(index <= playlist->items.size);
 
+    if (!vlc_playlist_lookup_Reserve(&playlist->lookup, count))
+        return VLC_ENOMEM;
+
     /* make space in the vector */
     if (!vlc_vector_insert_hole(&playlist->items, index, count))
         return VLC_ENOMEM;
@@ -281,6 +302,7 @@ vlc_playlist_Insert(vlc_playlist_t *playlist, size_t index,
         vlc_vector_remove_slice(&playlist->items, index, count);
         return ret;
     }
+    vlc_playlist_InvalidateIndices(playlist, index);
 
     vlc_playlist_ItemsInserted(playlist, index, count);
     vlc_player_InvalidateNextMedia(playlist->player);
@@ -297,6 +319,7 @@ vlc_playlist_Move(vlc_playlist_t *playlist, size_t index, size_t count,
     assert(target + count <= playlist->items.size);
 
     vlc_vector_move_slice(&playlist->items, index, count, target);
+    vlc_playlist_InvalidateIndices(playlist, index < target ? index : target);
 
     vlc_playlist_ItemsMoved(playlist, index, count, target);
     vlc_player_InvalidateNextMedia(playlist->player);
@@ -311,9 +334,14 @@ vlc_playlist_Remove(vlc_playlist_t *playlist, size_t index, size_t count)
     vlc_playlist_ItemsRemoving(playlist, index, count);
 
     for (size_t i = 0; i < count; ++i)
-        vlc_playlist_item_Release(playlist->items.data[index + i]);
+    {
+        vlc_playlist_item_t *item = playlist->items.data[index + i];
+        vlc_playlist_lookup_Remove(&playlist->lookup, item);
+        vlc_playlist_item_Release(item);
+    }
 
     vlc_vector_remove_slice(&playlist->items, index, count);
+    vlc_playlist_InvalidateIndices(playlist, index);
 
     bool current_media_changed = vlc_playlist_ItemsRemoved(playlist, index,
                                                            count);
@@ -330,6 +358,9 @@ vlc_playlist_Replace(vlc_playlist_t *playlist, size_t index,
     vlc_playlist_AssertLocked(playlist);
     assert(index < playlist->items.size);
 
+    if (!vlc_playlist_lookup_Reserve(&playlist->lookup, 1))
+        return VLC_ENOMEM;
+
     uint64_t id = playlist->idgen++;
     vlc_playlist_item_t *item = vlc_playlist_item_New(media, id);
     if (!item)
@@ -342,8 +373,11 @@ vlc_playlist_Replace(vlc_playlist_t *playlist, size_t index,
         randomizer_Add(&playlist->randomizer, &item, 1);
     }
 
+    vlc_playlist_lookup_Remove(&playlist->lookup, playlist->items.data[index]);
     vlc_playlist_item_Release(playlist->items.data[index]);
     playlist->items.data[index] = item;
+    item->index = index;
+    vlc_playlist_lookup_Add(&playlist->lookup, item);
 
     vlc_playlist_ItemReplaced(playlist, index);
     return VLC_SUCCESS;
@@ -366,6 +400,9 @@ vlc_playlist_Expand(vlc_playlist_t *playlist, size_t index,
 
         if (count > 1)
         {
+            if (!vlc_playlist_lookup_Reserve(&playlist->lookup, count - 1))
+                return VLC_ENOMEM;
+
             /* make space in the vector */
             if (!vlc_vector_insert_hole(&playlist->items, index + 1, count - 1))
                 return VLC_ENOMEM;
@@ -379,6 +416,7 @@ vlc_playlist_Expand(vlc_playlist_t *playlist, size_t index,
                 vlc_vector_remove_slice(&playlist->items, index + 1, count - 1);
                 return ret;
             }
+            vlc_playlist_InvalidateIndices(playlist, index + 1);
             vlc_playlist_ItemsInserted(playlist, index + 1, count - 1);
         }
 
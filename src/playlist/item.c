@@ -37,6 +37,12 @@ vlc_playlist_item_New(input_item_t *media, uint64_t id)
     vlc_atomic_rc_init(&item->rc);
     item->id = id;
     item->media = media;
+    item->index = 0;
+    item->random_index = 0;
+    item->id_next = NULL;
+    item->media_next = NULL;
+    for (int i = 0; i < VLC_PLAYLIST_SORT_STRING_COUNT; ++i)
+        item->sort_keys[i] = NULL;
     input_item_Hold(media);
     return item;
 }
@@ -53,6 +59,8 @@ vlc_playlist_item_Release(vlc_playlist_item_t *item)
     if (vlc_atomic_rc_dec(&item->rc))
     {
         input_item_Release(item->media);
+        for (int i = 0; i < VLC_PLAYLIST_SORT_STRING_COUNT; ++i)
+            free(item->sort_keys[i]);
         free(item);
     }
 }
@@ -26,11 +26,31 @@
 typedef struct vlc_playlist_item vlc_playlist_item_t;
 typedef struct input_item_t input_item_t;
 
+/* string metas sorted by collation key, see sort.c */
+enum vlc_playlist_item_sort_string
+{
+    VLC_PLAYLIST_SORT_STRING_TITLE,
+    VLC_PLAYLIST_SORT_STRING_ARTIST,
+    VLC_PLAYLIST_SORT_STRING_ALBUM,
+    VLC_PLAYLIST_SORT_STRING_ALBUM_ARTIST,
+    VLC_PLAYLIST_SORT_STRING_GENRE,
+    VLC_PLAYLIST_SORT_STRING_URL,
+    VLC_PLAYLIST_SORT_STRING_COUNT,
+};
+
 struct vlc_playlist_item
 {
     input_item_t *media;
     uint64_t id;
     vlc_atomic_rc_t rc;
+
+    /* owned by the playlist, protected by its lock */
+    size_t index; /**< cached position, see vlc_playlist.indexed */
+    size_t random_index; /**< position in the randomizer */
+    vlc_playlist_item_t *id_next; /**< lookup chains, see lookup.h */
+    vlc_playlist_item_t *media_next;
+    /** collation keys of the last sort, reused if the metas did not change */
+    char *sort_keys[VLC_PLAYLIST_SORT_STRING_COUNT];
 };
 
 /* _New() is private, it is called when inserting new media in the playlist */
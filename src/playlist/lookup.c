@@ -0,0 +1,181 @@
+/*****************************************************************************
+ * playlist/lookup.c
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "lookup.h"
+
+#include "item.h"
+
+#define LOOKUP_MIN_BITS 6
+
+static inline size_t
+Hash(uint64_t key, unsigned bits)
+{
+    /* Fibonacci hashing: spreads both sequential ids and aligned pointers */
+    return (key * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - bits);
+}
+
+static inline size_t
+HashMedia(const input_item_t *media, unsigned bits)
+{
+    return Hash((uintptr_t) media, bits);
+}
+
+static inline void
+Link(vlc_playlist_item_t **ids, vlc_playlist_item_t **medias, unsigned bits,
+     vlc_playlist_item_t *item)
+{
+    vlc_playlist_item_t **id_head = &ids[Hash(item->id, bits)];
+    vlc_playlist_item_t **media_head = &medias[HashMedia(item->media, bits)];
+
+    item->id_next = *id_head;
+    *id_head = item;
+    item->media_next = *media_head;
+    *media_head = item;
+}
+
+void
+vlc_playlist_lookup_Init(struct vlc_playlist_lookup *lookup)
+{
+    lookup->ids = NULL;
+    lookup->medias = NULL;
+    lookup->bits = 0;
+    lookup->count = 0;
+}
+
+void
+vlc_playlist_lookup_Destroy(struct vlc_playlist_lookup *lookup)
+{
+    free(lookup->ids);
+    free(lookup->medias);
+}
+
+bool
+vlc_playlist_lookup_Reserve(struct vlc_playlist_lookup *lookup, size_t count)
+{
+    /* keep the load factor below 1 */
+    size_t needed = lookup->count + count;
+    if (lookup->bits && needed <= ((size_t) 1 << lookup->bits))
+        return true;
+
+    unsigned bits = LOOKUP_MIN_BITS;
+    while (((size_t) 1 << bits) < needed)
+        if (++bits >= sizeof(size_t) * 8 - 1)
+            return false;
+
+    size_t size = (size_t) 1 << bits;
+    vlc_playlist_item_t **ids = calloc(size, sizeof(*ids));
+    vlc_playlist_item_t **medias = calloc(size, sizeof(*medias));
+    if (unlikely(!ids || !medias))
+    {
+        free(ids);
+        free(medias);
+        return false;
+    }
+
+    /* every item is in exactly one id chain */
+    for (size_t i = 0; lookup->bits && i < ((size_t) 1 << lookup->bits); ++i)
+    {
+        vlc_playlist_item_t *item = lookup->ids[i];
+        while (item)
+        {
+            vlc_playlist_item_t *next = item->id_next;
+            Link(ids, medias, bits, item);
+            item = next;
+        }
+    }
+
+    free(lookup->ids);
+    free(lookup->medias);
+    lookup->ids = ids;
+    lookup->medias = medias;
+    lookup->bits = bits;
+    return true;
+}
+
+void
+vlc_playlist_lookup_Add(struct vlc_playlist_lookup *lookup,
+                        vlc_playlist_item_t *item)
+{
+    assert(lookup->count < ((size_t) 1 << lookup->bits)); /* reserved */
+    Link(lookup->ids, lookup->medias, lookup->bits, item);
+    lookup->count++;
+}
+
+void
+vlc_playlist_lookup_Remove(struct vlc_playlist_lookup *lookup,
+                           vlc_playlist_item_t *item)
+{
+    vlc_playlist_item_t **pp = &lookup->ids[Hash(item->id, lookup->bits)];
+    while (*pp != item)
+        pp = &(*pp)->id_next;
+    *pp = item->id_next;
+
+    pp = &lookup->medias[HashMedia(item->media, lookup->bits)];
+    while (*pp != item)
+        pp = &(*pp)->media_next;
+    *pp = item->media_next;
+
+    assert(lookup->count > 0);
+    lookup->count--;
+}
+
+void
+vlc_playlist_lookup_Clear(struct vlc_playlist_lookup *lookup)
+{
+    if (lookup->bits)
+    {
+        size_t size = (size_t) 1 << lookup->bits;
+        memset(lookup->ids, 0, size * sizeof(*lookup->ids));
+        memset(lookup->medias, 0, size * sizeof(*lookup->medias));
+    }
+    lookup->count = 0;
+}
+
+vlc_playlist_item_t *
+vlc_playlist_lookup_FindId(struct vlc_playlist_lookup *lookup, uint64_t id)
+{
+    if (!lookup->bits)
+        return NULL;
+
+    vlc_playlist_item_t *item = lookup->ids[Hash(id, lookup->bits)];
+    while (item && item->id != id)
+        item = item->id_next;
+    return item;
+}
+
+vlc_playlist_item_t *
+vlc_playlist_lookup_NextMedia(struct vlc_playlist_lookup *lookup,
+                              const input_item_t *media,
+                              vlc_playlist_item_t *prev)
+{
+    if (!lookup->bits)
+        return NULL;
+
+    vlc_playlist_item_t *item = prev
+                              ? prev->media_next
+                              : lookup->medias[HashMedia(media, lookup->bits)];
+    while (item && item->media != media)
+        item = item->media_next;
+    return item;
+}
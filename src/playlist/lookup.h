@@ -0,0 +1,82 @@
+/*****************************************************************************
+ * playlist/lookup.h
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef VLC_PLAYLIST_LOOKUP_H
+#define VLC_PLAYLIST_LOOKUP_H
+
+#include <vlc_common.h>
+
+typedef struct vlc_playlist_item vlc_playlist_item_t;
+typedef struct input_item_t input_item_t;
+
+/**
+ * Hash tables to find playlist items from their id or their media.
+ *
+ * Items are chained in place (see vlc_playlist_item.id_next and media_next),
+ * so adding an item never allocates once enough room has been reserved.
+ */
+struct vlc_playlist_lookup
+{
+    vlc_playlist_item_t **ids;
+    vlc_playlist_item_t **medias;
+    unsigned bits; /* log2 of the number of buckets, 0 if none */
+    size_t count;
+};
+
+void
+vlc_playlist_lookup_Init(struct vlc_playlist_lookup *lookup);
+
+void
+vlc_playlist_lookup_Destroy(struct vlc_playlist_lookup *lookup);
+
+/**
+ * Make room for count more items, so that the following adds cannot fail.
+ */
+bool
+vlc_playlist_lookup_Reserve(struct vlc_playlist_lookup *lookup, size_t count);
+
+void
+vlc_playlist_lookup_Add(struct vlc_playlist_lookup *lookup,
+                        vlc_playlist_item_t *item);
+
+void
+vlc_playlist_lookup_Remove(struct vlc_playlist_lookup *lookup,
+                           vlc_playlist_item_t *item);
+
+/**
+ * Forget all items (they are not released).
+ */
+void
+vlc_playlist_lookup_Clear(struct vlc_playlist_lookup *lookup);
+
+vlc_playlist_item_t *
+vlc_playlist_lookup_FindId(struct vlc_playlist_lookup *lookup, uint64_t id);
+
+/**
+ * Iterate over the items of a media, in no particular order.
+ *
+ * \param prev the previous result, or NULL to get the first item
+ */
+vlc_playlist_item_t *
+vlc_playlist_lookup_NextMedia(struct vlc_playlist_lookup *lookup,
+                              const input_item_t *media,
+                              vlc_playlist_item_t *prev);
+
+#endif
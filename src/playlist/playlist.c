@@ -29,6 +29,10 @@
 #include "content.h"
 #include "item.h"
 #include "player.h"
+#include "misc/executor.h"
+#ifndef TEST_PLAYLIST
+# include "libvlc.h"
+#endif
 
 vlc_playlist_t *
 vlc_playlist_New(vlc_object_t *parent)
@@ -45,6 +49,8 @@ vlc_playlist_New(vlc_object_t *parent)
     }
 
     vlc_vector_init(&playlist->items);
+    playlist->indexed = 0;
+    vlc_playlist_lookup_Init(&playlist->lookup);
     randomizer_Init(&playlist->randomizer);
     playlist->current = -1;
     playlist->has_prev = false;
@@ -55,10 +61,13 @@ vlc_playlist_New(vlc_object_t *parent)
     playlist->idgen = 0;
 #ifdef TEST_PLAYLIST
     playlist->libvlc = NULL;
+    /* sorts on the calling thread only if this fails */
+    playlist->executor = vlc_executor_New(0, VLC_TICK_FROM_SEC(1));
     playlist->auto_preparse = false;
 #else
     assert(parent);
     playlist->libvlc = vlc_object_instance(parent);
+    playlist->executor = libvlc_priv(playlist->libvlc)->executor;
     playlist->auto_preparse = var_InheritBool(parent, "auto-preparse");
 #endif
 
@@ -73,6 +82,11 @@ vlc_playlist_Delete(vlc_playlist_t *playlist)
     vlc_playlist_PlayerDestroy(playlist);
     randomizer_Destroy(&playlist->randomizer);
     vlc_playlist_ClearItems(playlist);
+    vlc_playlist_lookup_Destroy(&playlist->lookup);
+#ifdef TEST_PLAYLIST
+    if (playlist->executor)
+        vlc_executor_Delete(playlist->executor);
+#endif
     free(playlist);
 }
 
@@ -25,6 +25,7 @@
 #include <vlc_playlist.h>
 #include <vlc_vector.h>
 #include "../player/player.h"
+#include "lookup.h"
 #include "randomizer.h"
 
 typedef struct input_item_t input_item_t;
@@ -45,14 +46,20 @@ typedef struct input_item_t input_item_t;
 
 typedef struct VLC_VECTOR(vlc_playlist_item_t *) playlist_item_vector_t;
 
+struct vlc_executor;
+
 struct vlc_playlist
 {
     vlc_player_t *player;
     libvlc_int_t *libvlc;
+    struct vlc_executor *executor; /**< runs the parallel sort, or NULL */
     bool auto_preparse;
     /* all remaining fields are protected by the lock of the player */
     struct vlc_player_listener_id *player_listener;
     playlist_item_vector_t items;
+    /* items before this position know their index (vlc_playlist_item.index) */
+    size_t indexed;
+    struct vlc_playlist_lookup lookup;
     struct randomizer randomizer;
     ssize_t current;
     bool has_prev;
@@ -74,4 +81,12 @@ vlc_playlist_AssertLocked(vlc_playlist_t *playlist)
 #define vlc_playlist_AssertLocked(x) ((void) (0))
 #endif
 
+/* called after the items from this position have been changed or moved */
+static inline void
+vlc_playlist_InvalidateIndices(vlc_playlist_t *playlist, size_t from)
+{
+    if (from < playlist->indexed)
+        playlist->indexed = from;
+}
+
 #endif
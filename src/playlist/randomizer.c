@@ -32,6 +32,16 @@
 #include <vlc_rand.h>
 #include "randomizer.h"
 
+#ifdef TEST_RANDOMIZER
+/* fake structure to simplify tests */
+struct vlc_playlist_item {
+    size_t index;
+    size_t random_index;
+};
+#else
+# include "item.h"
+#endif
+
 /**
  * \addtogroup playlist_randomizer Playlist randomizer helper
  * \ingroup playlist
@@ -283,12 +293,22 @@ randomizer_SetLoop(struct randomizer *r, bool loop)
     r->loop = loop;
 }
 
+/* Every item knows its position in the randomizer array, so that selecting
+ * or removing an item does not require a linear search */
+static inline void
+randomizer_Reindex(struct randomizer *r, size_t from, size_t to)
+{
+    for (size_t i = from; i < to; ++i)
+        r->items.data[i]->random_index = i;
+}
+
 static inline ssize_t
 randomizer_IndexOf(struct randomizer *r, const vlc_playlist_item_t *item)
 {
-    ssize_t index;
-    vlc_vector_index_of(&r->items, item, &index);
-    return index;
+    size_t index = item->random_index;
+    if (index < r->items.size && r->items.data[index] == item)
+        return index;
+    return -1;
 }
 
 bool
@@ -312,6 +332,8 @@ swap_items(struct randomizer *r, int i, int j)
     vlc_playlist_item_t *item = r->items.data[i];
     r->items.data[i] = r->items.data[j];
     r->items.data[j] = item;
+    r->items.data[i]->random_index = i;
+    item->random_index = j;
 }
 
 static inline void
@@ -425,6 +447,7 @@ randomizer_Add(struct randomizer *r, vlc_playlist_item_t *items[], size_t count)
 {
     if (!vlc_vector_insert_all(&r->items, r->history, items, count))
         return false;
+    randomizer_Reindex(r, r->history, r->items.size);
     /* the insertion shifted history (and possibly next) */
     if (r->next > r->history)
         r->next += count;
@@ -443,6 +466,8 @@ randomizer_SelectIndex(struct randomizer *r, size_t index)
             memmove(&r->items.data[r->history + 1],
                     &r->items.data[r->history],
                     (index - r->history) * sizeof(selected));
+            r->items.data[r->history] = selected;
+            randomizer_Reindex(r, r->history, index + 1);
             index = r->history;
         }
         r->history = (r->history + 1) % r->items.size;
@@ -450,8 +475,7 @@ randomizer_SelectIndex(struct randomizer *r, size_t index)
 
     if (index >= r->head)
     {
-        r->items.data[index] = r->items.data[r->head];
-        r->items.data[r->head] = selected;
+        swap_items(r, index, r->head);
         r->head++;
     }
     else if (index < r->items.size - 1)
@@ -460,6 +484,7 @@ randomizer_SelectIndex(struct randomizer *r, size_t index)
                 &r->items.data[index + 1],
                 (r->head - index - 1) * sizeof(selected));
         r->items.data[r->head - 1] = selected;
+        randomizer_Reindex(r, index, r->head);
     }
 
     r->next = r->head;
@@ -483,6 +508,9 @@ randomizer_RemoveAt(struct randomizer *r, size_t index)
      *    ordered            order irrelevant               ordered
      */
 
+    /* positions change from there */
+    size_t from = index;
+
     /* update next before index may be updated */
     if (index < r->next)
         r->next--;
@@ -514,6 +542,7 @@ randomizer_RemoveAt(struct randomizer *r, size_t index)
     }
 
     r->items.size--;
+    randomizer_Reindex(r, from, r->items.size);
 }
 
 static void
@@ -546,11 +575,6 @@ randomizer_Clear(struct randomizer *r)
 #ifndef DOC
 #ifdef TEST_RANDOMIZER
 
-/* fake structure to simplify tests */
-struct vlc_playlist_item {
-    size_t index;
-};
-
 static void
 ArrayInit(vlc_playlist_item_t *array[], size_t len)
 {
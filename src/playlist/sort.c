@@ -24,25 +24,42 @@
 
 #include <vlc_common.h>
 #include <vlc_rand.h>
-#include <vlc_sort.h>
+#include <vlc_strings.h>
 #include "control.h"
 #include "item.h"
 #include "notify.h"
 #include "playlist.h"
+#include "misc/executor.h"
+
+/* below this size, sort on the calling thread only */
+#define PARALLEL_SORT_MIN 16384
+#define PARALLEL_SORT_MAX_TASKS 8
+
+/**
+ * Collation key of a string meta: the case-folded string, and its first bytes
+ * packed in an integer so that most comparisons do not touch the strings.
+ */
+struct vlc_playlist_sort_string {
+    const char *key; /**< NULL if the meta is missing */
+    uint64_t prefix;
+};
 
 /**
  * Struct containing a copy of (parsed) media metadata, used for sorting
  * without locking all the items.
+ *
+ * The collation keys are cached in the items (see item->sort_keys), so that
+ * successive sorts only rebuild the keys of the metas which changed.
  */
 struct vlc_playlist_item_meta {
     vlc_playlist_item_t *item;
-    const char *title_or_name;
+    struct vlc_playlist_sort_string title_or_name;
     vlc_tick_t duration;
-    const char *artist;
-    const char *album;
-    const char *album_artist;
-    const char *genre;
-    const char *url;
+    struct vlc_playlist_sort_string artist;
+    struct vlc_playlist_sort_string album;
+    struct vlc_playlist_sort_string album_artist;
+    struct vlc_playlist_sort_string genre;
+    struct vlc_playlist_sort_string url;
     int64_t date;
     int64_t track_number;
     int64_t disc_number;
@@ -53,17 +70,53 @@ struct vlc_playlist_item_meta {
     bool has_rating;
 };
 
+/**
+ * Return the cached collation key for a string meta, rebuilding it if the
+ * meta changed since the last sort.
+ *
+ * The cache holds the original value followed by the folded key.
+ */
 static int
-vlc_playlist_item_meta_CopyString(const char **to, const char *from)
+vlc_playlist_item_meta_InitString(struct vlc_playlist_item_meta *meta,
+                                  struct vlc_playlist_sort_string *string,
+                                  enum vlc_playlist_item_sort_string slot,
+                                  const char *value)
 {
-    if (from)
+    char **cache = &meta->item->sort_keys[slot];
+
+    if (!value)
     {
-        *to = strdup(from);
-        if (unlikely(!*to))
+        free(*cache);
+        *cache = NULL;
+        string->key = NULL;
+        string->prefix = 0;
+        return VLC_SUCCESS;
+    }
+
+    size_t len = strlen(value);
+    if (!*cache || strcmp(*cache, value))
+    {
+        char *buf = malloc(2 * (len + 1));
+        if (unlikely(!buf))
             return VLC_ENOMEM;
+
+        memcpy(buf, value, len + 1);
+        /* same ordering as strcasecmp() */
+        for (size_t i = 0; i <= len; ++i)
+            buf[len + 1 + i] = vlc_ascii_tolower(value[i]);
+
+        free(*cache);
+        *cache = buf;
+    }
+
+    string->key = *cache + len + 1;
+    string->prefix = 0;
+    for (size_t i = 0; i < sizeof(string->prefix); ++i)
+    {
+        string->prefix <<= 8;
+        if (i < len)
+            string->prefix |= (unsigned char) string->key[i];
     }
-    else
-        *to = NULL;
     return VLC_SUCCESS;
 }
 
@@ -79,7 +132,9 @@ vlc_playlist_item_meta_InitField(struct vlc_playlist_item_meta *meta,
             const char *value = input_item_GetMetaLocked(media, vlc_meta_Title);
             if (EMPTY_STR(value))
                 value = media->psz_name;
-            return vlc_playlist_item_meta_CopyString(&meta->title_or_name,
+            return vlc_playlist_item_meta_InitString(meta,
+                                                     &meta->title_or_name,
+                                                     VLC_PLAYLIST_SORT_STRING_TITLE,
                                                      value);
         }
         case VLC_PLAYLIST_SORT_KEY_DURATION:
@@ -95,24 +150,31 @@ vlc_playlist_item_meta_InitField(struct vlc_playlist_item_meta *meta,
         {
             const char *value = input_item_GetMetaLocked(media,
                                                          vlc_meta_Artist);
-            return vlc_playlist_item_meta_CopyString(&meta->artist, value);
+            return vlc_playlist_item_meta_InitString(meta, &meta->artist,
+                                                     VLC_PLAYLIST_SORT_STRING_ARTIST,
+                                                     value);
         }
         case VLC_PLAYLIST_SORT_KEY_ALBUM:
         {
             const char *value = input_item_GetMetaLocked(media, vlc_meta_Album);
-            return vlc_playlist_item_meta_CopyString(&meta->album, value);
+            return vlc_playlist_item_meta_InitString(meta, &meta->album,
+                                                     VLC_PLAYLIST_SORT_STRING_ALBUM,
+                                                     value);
         }
         case VLC_PLAYLIST_SORT_KEY_ALBUM_ARTIST:
         {
             const char *value = input_item_GetMetaLocked(media,
                                                          vlc_meta_AlbumArtist);
-            return vlc_playlist_item_meta_CopyString(&meta->album_artist,
+            return vlc_playlist_item_meta_InitString(meta, &meta->album_artist,
+                                                     VLC_PLAYLIST_SORT_STRING_ALBUM_ARTIST,
                                                      value);
         }
         case VLC_PLAYLIST_SORT_KEY_GENRE:
         {
             const char *value = input_item_GetMetaLocked(media, vlc_meta_Genre);
-            return vlc_playlist_item_meta_CopyString(&meta->genre, value);
+            return vlc_playlist_item_meta_InitString(meta, &meta->genre,
+                                                     VLC_PLAYLIST_SORT_STRING_GENRE,
+                                                     value);
         }
         case VLC_PLAYLIST_SORT_KEY_DATE:
         {
@@ -143,7 +205,9 @@ vlc_playlist_item_meta_InitField(struct vlc_playlist_item_meta *meta,
         case VLC_PLAYLIST_SORT_KEY_URL:
         {
             const char *value = input_item_GetMetaLocked(media, vlc_meta_URL);
-            return vlc_playlist_item_meta_CopyString(&meta->url, value);
+            return vlc_playlist_item_meta_InitString(meta, &meta->url,
+                                                     VLC_PLAYLIST_SORT_STRING_URL,
+                                                     value);
         }
         case VLC_PLAYLIST_SORT_KEY_RATING:
         {
@@ -159,74 +223,38 @@ vlc_playlist_item_meta_InitField(struct vlc_playlist_item_meta *meta,
     }
 }
 
-static void
-vlc_playlist_item_meta_DestroyFields(struct vlc_playlist_item_meta *meta)
-{
-    free((void *) meta->title_or_name);
-    free((void *) meta->artist);
-    free((void *) meta->album);
-    free((void *) meta->album_artist);
-    free((void *) meta->genre);
-    free((void *) meta->url);
-}
-
 static int
-vlc_playlist_item_meta_InitFields(struct vlc_playlist_item_meta *meta,
-        const struct vlc_playlist_sort_criterion criteria[], size_t count)
-{
-    for (size_t i = 0; i < count; ++i)
-    {
-        const struct vlc_playlist_sort_criterion *criterion = &criteria[i];
-        int ret = vlc_playlist_item_meta_InitField(meta, criterion->key);
-        if (unlikely(ret != VLC_SUCCESS))
-        {
-            vlc_playlist_item_meta_DestroyFields(meta);
-            return ret;
-        }
-    }
-    return VLC_SUCCESS;
-}
-
-static struct vlc_playlist_item_meta *
-vlc_playlist_item_meta_New(vlc_playlist_item_t *item,
-                           const struct vlc_playlist_sort_criterion criteria[],
-                           size_t count)
+vlc_playlist_item_meta_Init(struct vlc_playlist_item_meta *meta,
+                            vlc_playlist_item_t *item,
+                            const struct vlc_playlist_sort_criterion criteria[],
+                            size_t count)
 {
     /* assume that NULL representation is all-zeros */
-    struct vlc_playlist_item_meta *meta = calloc(1, sizeof(*meta));
-    if (unlikely(!meta))
-        return NULL;
-
+    memset(meta, 0, sizeof(*meta));
     meta->item = item;
 
+    int ret = VLC_SUCCESS;
     vlc_mutex_lock(&item->media->lock);
-    int ret = vlc_playlist_item_meta_InitFields(meta, criteria, count);
+    for (size_t i = 0; i < count && ret == VLC_SUCCESS; ++i)
+        ret = vlc_playlist_item_meta_InitField(meta, criteria[i].key);
     vlc_mutex_unlock(&item->media->lock);
 
-    if (unlikely(ret != VLC_SUCCESS))
-    {
-        free(meta);
-        return NULL;
-    }
-
-    return meta;
-}
-
-static void
-vlc_playlist_item_meta_Delete(struct vlc_playlist_item_meta *meta)
-{
-    vlc_playlist_item_meta_DestroyFields(meta);
-    free(meta);
+    return ret;
 }
 
 static inline int
-CompareStrings(const char *a, const char *b)
+CompareStrings(const struct vlc_playlist_sort_string *a,
+               const struct vlc_playlist_sort_string *b)
 {
-    if (a && b)
-        return strcasecmp(a, b);
-    if (!a && !b)
+    if (a->key && b->key)
+    {
+        if (a->prefix != b->prefix)
+            return a->prefix < b->prefix ? -1 : 1;
+        return strcmp(a->key, b->key);
+    }
+    if (!a->key && !b->key)
         return 0;
-    return a ? 1 : -1;
+    return a->key ? 1 : -1;
 }
 
 static inline int
@@ -259,17 +287,17 @@ CompareMetaByKey(const struct vlc_playlist_item_meta *a,
     switch (key)
     {
         case VLC_PLAYLIST_SORT_KEY_TITLE:
-            return CompareStrings(a->title_or_name, b->title_or_name);
+            return CompareStrings(&a->title_or_name, &b->title_or_name);
         case VLC_PLAYLIST_SORT_KEY_DURATION:
             return CompareIntegers(a->duration, b->duration);
         case VLC_PLAYLIST_SORT_KEY_ARTIST:
-            return CompareStrings(a->artist, b->artist);
+            return CompareStrings(&a->artist, &b->artist);
         case VLC_PLAYLIST_SORT_KEY_ALBUM:
-            return CompareStrings(a->album, b->album);
+            return CompareStrings(&a->album, &b->album);
         case VLC_PLAYLIST_SORT_KEY_ALBUM_ARTIST:
-            return CompareStrings(a->album_artist, b->album_artist);
+            return CompareStrings(&a->album_artist, &b->album_artist);
         case VLC_PLAYLIST_SORT_KEY_GENRE:
-            return CompareStrings(a->genre, b->genre);
+            return CompareStrings(&a->genre, &b->genre);
         case VLC_PLAYLIST_SORT_KEY_DATE:
             return CompareOptionalIntegers(a->has_date, a->date,
                                            b->has_date, b->date);
@@ -280,7 +308,7 @@ CompareMetaByKey(const struct vlc_playlist_item_meta *a,
             return CompareOptionalIntegers(a->has_disc_number, a->disc_number,
                                            b->has_disc_number, b->disc_number);
         case VLC_PLAYLIST_SORT_KEY_URL:
-            return CompareStrings(a->url, b->url);
+            return CompareStrings(&a->url, &b->url);
         case VLC_PLAYLIST_SORT_KEY_RATING:
             return CompareOptionalIntegers(a->has_rating, a->rating,
                                            b->has_rating, b->rating);
@@ -290,7 +318,6 @@ CompareMetaByKey(const struct vlc_playlist_item_meta *a,
      }
 }
 
-/* context for qsort_r() */
 struct sort_request
 {
     const struct vlc_playlist_sort_criterion *criteria;
@@ -298,14 +325,10 @@ struct sort_request
 };
 
 static int
-compare_meta(const void *lhs, const void *rhs, void *userdata)
+compare_meta(const struct vlc_playlist_item_meta *a,
+             const struct vlc_playlist_item_meta *b,
+             const struct sort_request *req)
 {
-    struct sort_request *req = userdata;
-    const struct vlc_playlist_item_meta *a =
-            *(const struct vlc_playlist_item_meta **) lhs;
-    const struct vlc_playlist_item_meta *b =
-            *(const struct vlc_playlist_item_meta **) rhs;
-
     for (size_t i = 0; i < req->count; ++i)
     {
         const struct vlc_playlist_sort_criterion *criterion = &req->criteria[i];
@@ -321,42 +344,188 @@ compare_meta(const void *lhs, const void *rhs, void *userdata)
     return 0;
 }
 
+typedef struct vlc_playlist_item_meta *meta_ptr;
+
+/* Merge two sorted runs into out, keeping equal items in order */
 static void
-vlc_playlist_DeleteMetaArray(struct vlc_playlist_item_meta *array[],
-                             size_t count)
+Merge(const struct sort_request *req, const meta_ptr a[], size_t na,
+      const meta_ptr b[], size_t nb, meta_ptr out[])
 {
-    for (size_t i = 0; i < count; ++i)
-        vlc_playlist_item_meta_Delete(array[i]);
-    free(array);
+    size_t i = 0, j = 0, k = 0;
+    while (i < na && j < nb)
+        out[k++] = compare_meta(b[j], a[i], req) < 0 ? b[j++] : a[i++];
+    while (i < na)
+        out[k++] = a[i++];
+    while (j < nb)
+        out[k++] = b[j++];
+}
+
+/* Stable merge sort of array, using tmp (of the same size) as scratch */
+static void
+MergeSort(const struct sort_request *req, meta_ptr array[], meta_ptr tmp[],
+          size_t count)
+{
+    if (count <= 16)
+    {
+        /* insertion sort */
+        for (size_t i = 1; i < count; ++i)
+        {
+            meta_ptr meta = array[i];
+            size_t j = i;
+            for (; j > 0 && compare_meta(meta, array[j - 1], req) < 0; --j)
+                array[j] = array[j - 1];
+            array[j] = meta;
+        }
+        return;
+    }
+
+    size_t half = count / 2;
+    MergeSort(req, array, tmp, half);
+    MergeSort(req, array + half, tmp + half, count - half);
+    if (compare_meta(array[half], array[half - 1], req) >= 0)
+        return; /* already in order */
+
+    memcpy(tmp, array, count * sizeof(*array));
+    Merge(req, tmp, half, tmp + half, count - half, array);
 }
 
-static struct vlc_playlist_item_meta **
-vlc_playlist_NewMetaArray(vlc_playlist_t *playlist,
-        const struct vlc_playlist_sort_criterion criteria[], size_t count)
+/* Tasks of one step of the parallel sort, waited for by the calling thread */
+struct sort_step
 {
-    struct vlc_playlist_item_meta **array =
-            vlc_alloc(playlist->items.size, sizeof(*array));
+    vlc_mutex_t lock;
+    vlc_cond_t wait;
+    size_t pending;
+};
 
-    if (unlikely(!array))
-        return NULL;
+/* One unit of work of the parallel sort: sort a run, or merge two */
+struct sort_task
+{
+    struct vlc_executor_job job;
+    struct sort_step *step;
+    const struct sort_request *req;
+    meta_ptr *src;
+    meta_ptr *dst;
+    size_t count; /**< size of the run, or of the first run to merge */
+    size_t count2; /**< size of the second run to merge, 0 to sort */
+};
 
-    size_t i;
-    for (i = 0; i < playlist->items.size; ++i)
+static void
+SortTaskRun(struct sort_task *task)
+{
+    if (task->count2)
+        Merge(task->req, task->src, task->count, task->src + task->count,
+              task->count2, task->dst);
+    else
+        MergeSort(task->req, task->src, task->dst, task->count);
+}
+
+static void
+SortTaskDone(struct sort_step *step)
+{
+    vlc_mutex_lock(&step->lock);
+    if (--step->pending == 0)
+        vlc_cond_signal(&step->wait);
+    vlc_mutex_unlock(&step->lock);
+}
+
+static void
+SortTaskRunJob(struct vlc_executor_job *job)
+{
+    struct sort_task *task = container_of(job, struct sort_task, job);
+    struct sort_step *step = task->step;
+
+    SortTaskRun(task);
+    SortTaskDone(step);
+}
+
+static void
+SortTasksRun(vlc_executor_t *executor, struct sort_task tasks[], size_t count)
+{
+    struct sort_step step = { .pending = count - 1 };
+    vlc_mutex_init(&step.lock);
+    vlc_cond_init(&step.wait);
+
+    /* the calling thread runs the first task itself */
+    for (size_t i = 1; i < count; ++i)
     {
-        array[i] = vlc_playlist_item_meta_New(playlist->items.data[i],
-                                              criteria, count);
-        if (unlikely(!array[i]))
-            break;
+        tasks[i].step = &step;
+        tasks[i].job.run = SortTaskRunJob;
+        tasks[i].job.priority = VLC_EXECUTOR_PRIORITY_HIGH;
+        vlc_executor_Submit(executor, &tasks[i].job);
+    }
+    SortTaskRun(&tasks[0]);
+
+    /* then those no pool thread took yet, rather than waiting for one */
+    for (size_t i = count - 1; i > 0; --i)
+        if (vlc_executor_Cancel(executor, &tasks[i].job))
+        {
+            SortTaskRun(&tasks[i]);
+            SortTaskDone(&step);
+        }
+
+    vlc_mutex_lock(&step.lock);
+    while (step.pending > 0)
+        vlc_cond_wait(&step.wait, &step.lock);
+    vlc_mutex_unlock(&step.lock);
+}
+
+static void
+ParallelSort(vlc_executor_t *executor, const struct sort_request *req,
+             meta_ptr array[], meta_ptr tmp[], size_t count)
+{
+    unsigned threads = 1;
+    if (executor != NULL && count >= PARALLEL_SORT_MIN)
+    {
+        /* the pool threads and the calling thread */
+        unsigned cpus = __MIN(vlc_GetCPUCount(),
+                              vlc_executor_GetThreads(executor) + 1);
+        while (threads * 2 <= cpus && threads < PARALLEL_SORT_MAX_TASKS)
+            threads *= 2;
+    }
+
+    if (threads == 1)
+    {
+        MergeSort(req, array, tmp, count);
+        return;
     }
 
-    if (i < playlist->items.size)
+    struct sort_task tasks[PARALLEL_SORT_MAX_TASKS];
+    size_t bounds[PARALLEL_SORT_MAX_TASKS + 1];
+    for (unsigned i = 0; i <= threads; ++i)
+        bounds[i] = count * i / threads;
+
+    /* sort one run per thread */
+    for (unsigned i = 0; i < threads; ++i)
+        tasks[i] = (struct sort_task) {
+            .req = req,
+            .src = array + bounds[i],
+            .dst = tmp + bounds[i],
+            .count = bounds[i + 1] - bounds[i],
+        };
+    SortTasksRun(executor, tasks, threads);
+
+    /* then merge runs pairwise, alternating between the two buffers */
+    meta_ptr *src = array, *dst = tmp;
+    for (unsigned width = 1; width < threads; width *= 2)
     {
-        /* allocation failure */
-        vlc_playlist_DeleteMetaArray(array, i);
-        return NULL;
+        unsigned merges = 0;
+        for (unsigned i = 0; i < threads; i += 2 * width)
+            tasks[merges++] = (struct sort_task) {
+                .req = req,
+                .src = src + bounds[i],
+                .dst = dst + bounds[i],
+                .count = bounds[i + width] - bounds[i],
+                .count2 = bounds[i + 2 * width] - bounds[i + width],
+            };
+        SortTasksRun(executor, tasks, merges);
+
+        meta_ptr *swap = src;
+        src = dst;
+        dst = swap;
     }
 
-    return array;
+    if (src != array)
+        memcpy(array, src, count * sizeof(*array));
 }
 
 int
@@ -371,20 +540,41 @@ vlc_playlist_Sort(vlc_playlist_t *playlist,
                                  ? playlist->items.data[playlist->current]
                                  : NULL;
 
-    struct vlc_playlist_item_meta **array =
-        vlc_playlist_NewMetaArray(playlist, criteria, count);
-    if (unlikely(!array))
+    size_t size = playlist->items.size;
+    struct vlc_playlist_item_meta *metas = vlc_alloc(size, sizeof(*metas));
+    meta_ptr *array = vlc_alloc(2 * size, sizeof(*array));
+    if (unlikely(!metas || !array))
+    {
+        free(metas);
+        free(array);
         return VLC_ENOMEM;
+    }
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        int ret = vlc_playlist_item_meta_Init(&metas[i],
+                                              playlist->items.data[i],
+                                              criteria, count);
+        if (unlikely(ret != VLC_SUCCESS))
+        {
+            free(metas);
+            free(array);
+            return ret;
+        }
+        array[i] = &metas[i];
+    }
 
     struct sort_request req = { criteria, count };
 
-    vlc_qsort(array, playlist->items.size, sizeof(*array), compare_meta, &req);
+    ParallelSort(playlist->executor, &req, array, array + size, size);
 
     /* apply the sorting result to the playlist */
-    for (size_t i = 0; i < playlist->items.size; ++i)
+    for (size_t i = 0; i < size; ++i)
         playlist->items.data[i] = array[i]->item;
+    vlc_playlist_InvalidateIndices(playlist, 0);
 
-    vlc_playlist_DeleteMetaArray(array, playlist->items.size);
+    free(metas);
+    free(array);
 
     struct vlc_playlist_state state;
     if (current)
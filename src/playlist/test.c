@@ -1056,15 +1056,89 @@ test_index_of(void)
     vlc_playlist_item_t *item = vlc_playlist_Get(playlist, 4);
     assert(vlc_playlist_IndexOf(playlist, item) == 4);
 
+    uint64_t id = item->id;
+    assert(vlc_playlist_IndexOfId(playlist, id) == 4);
+
     vlc_playlist_item_Hold(item);
     vlc_playlist_RemoveOne(playlist, 4);
     assert(vlc_playlist_IndexOf(playlist, item) == -1);
+    assert(vlc_playlist_IndexOfId(playlist, id) == -1);
+    assert(vlc_playlist_IndexOfMedia(playlist, media[4]) == -1);
     vlc_playlist_item_Release(item);
 
+    /* the same media may be inserted several times, the first one wins */
+    ret = vlc_playlist_InsertOne(playlist, 6, media[2]);
+    assert(ret == VLC_SUCCESS);
+    assert(vlc_playlist_IndexOfMedia(playlist, media[2]) == 2);
+    vlc_playlist_RemoveOne(playlist, 2);
+    assert(vlc_playlist_IndexOfMedia(playlist, media[2]) == 5);
+
+    /* indices follow the moves */
+    vlc_playlist_Move(playlist, 0, 2, 5);
+    assert(vlc_playlist_IndexOfMedia(playlist, media[0]) == 5);
+    assert(vlc_playlist_IndexOfMedia(playlist, media[1]) == 6);
+    assert(vlc_playlist_IndexOfMedia(playlist, media[3]) == 0);
+    for (size_t i = 0; i < vlc_playlist_Count(playlist); ++i)
+    {
+        item = vlc_playlist_Get(playlist, i);
+        assert(vlc_playlist_IndexOf(playlist, item) == (ssize_t) i);
+        assert(vlc_playlist_IndexOfId(playlist, item->id) == (ssize_t) i);
+    }
+
     DestroyMediaArray(media, 10);
     vlc_playlist_Delete(playlist);
 }
 
+static void
+test_index_of_large(void)
+{
+    #define LARGE_COUNT 100000
+    vlc_playlist_t *playlist = vlc_playlist_New(NULL);
+    assert(playlist);
+
+    input_item_t **media = malloc(LARGE_COUNT * sizeof(*media));
+    assert(media);
+    CreateDummyMediaArray(media, LARGE_COUNT);
+
+    int ret = vlc_playlist_Append(playlist, media, LARGE_COUNT);
+    assert(ret == VLC_SUCCESS);
+
+    vlc_tick_t start = vlc_tick_now();
+    for (size_t i = 0; i < LARGE_COUNT; ++i)
+    {
+        vlc_playlist_item_t *item = vlc_playlist_Get(playlist, i);
+        assert(vlc_playlist_IndexOfId(playlist, item->id) == (ssize_t) i);
+        assert(vlc_playlist_IndexOfMedia(playlist, media[i]) == (ssize_t) i);
+    }
+    vlc_tick_t lookups = vlc_tick_now() - start;
+
+    /* remove every other item, by item (without index hints) */
+    vlc_playlist_item_t **items = malloc(LARGE_COUNT / 2 * sizeof(*items));
+    assert(items);
+    for (size_t i = 0; i < LARGE_COUNT / 2; ++i)
+        items[i] = vlc_playlist_Get(playlist, 2 * i);
+
+    start = vlc_tick_now();
+    ret = vlc_playlist_RequestRemove(playlist, items, LARGE_COUNT / 2, -1);
+    assert(ret == VLC_SUCCESS);
+    vlc_tick_t removal = vlc_tick_now() - start;
+
+    assert(vlc_playlist_Count(playlist) == LARGE_COUNT / 2);
+    for (size_t i = 0; i < LARGE_COUNT / 2; ++i)
+        assert(vlc_playlist_IndexOfMedia(playlist, media[2 * i + 1]) ==
+               (ssize_t) i);
+
+    fprintf(stderr, "%d items: %"PRId64" ms for id and media lookups, "
+            "%"PRId64" ms to remove half of them\n", LARGE_COUNT,
+            MS_FROM_VLC_TICK(lookups), MS_FROM_VLC_TICK(removal));
+
+    free(items);
+    DestroyMediaArray(media, LARGE_COUNT);
+    free(media);
+    vlc_playlist_Delete(playlist);
+    #undef LARGE_COUNT
+}
+
 static void
 test_prev(void)
 {
@@ -2351,6 +2425,66 @@ test_sort(void)
 
 #undef EXPECT_AT
 
+static void
+test_sort_large(void)
+{
+    #define LARGE_COUNT 100000
+    vlc_playlist_t *playlist = vlc_playlist_New(NULL);
+    assert(playlist);
+
+    input_item_t **media = malloc(LARGE_COUNT * sizeof(*media));
+    assert(media);
+    CreateDummyMediaArray(media, LARGE_COUNT);
+
+    /* 100 artists, in mixed case, and descending titles */
+    for (int i = 0; i < LARGE_COUNT; ++i)
+    {
+        char artist[32];
+        snprintf(artist, sizeof(artist), "%s %d", i % 3 ? "artist" : "ARTIST",
+                 (i * 7919) % 100);
+        input_item_SetArtist(media[i], artist);
+    }
+
+    int ret = vlc_playlist_Append(playlist, media, LARGE_COUNT);
+    assert(ret == VLC_SUCCESS);
+
+    struct vlc_playlist_sort_criterion criteria[] = {
+        { VLC_PLAYLIST_SORT_KEY_ARTIST, VLC_PLAYLIST_SORT_ORDER_ASCENDING },
+        { VLC_PLAYLIST_SORT_KEY_TITLE, VLC_PLAYLIST_SORT_ORDER_DESCENDING },
+    };
+
+    vlc_tick_t times[2];
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        vlc_tick_t start = vlc_tick_now();
+        ret = vlc_playlist_Sort(playlist, criteria, ARRAY_SIZE(criteria));
+        assert(ret == VLC_SUCCESS);
+        times[pass] = vlc_tick_now() - start;
+
+        for (size_t i = 1; i < LARGE_COUNT; ++i)
+        {
+            input_item_t *prev = vlc_playlist_Get(playlist, i - 1)->media;
+            input_item_t *cur = vlc_playlist_Get(playlist, i)->media;
+            char *prev_artist = input_item_GetArtist(prev);
+            char *cur_artist = input_item_GetArtist(cur);
+            int cmp = strcasecmp(prev_artist, cur_artist);
+            assert(cmp < 0 || (cmp == 0 &&
+                               strcasecmp(prev->psz_name, cur->psz_name) > 0));
+            free(prev_artist);
+            free(cur_artist);
+        }
+    }
+
+    fprintf(stderr, "%d items sorted by artist and title in %"PRId64" ms, "
+            "then %"PRId64" ms with cached keys\n", LARGE_COUNT,
+            MS_FROM_VLC_TICK(times[0]), MS_FROM_VLC_TICK(times[1]));
+
+    DestroyMediaArray(media, LARGE_COUNT);
+    free(media);
+    vlc_playlist_Delete(playlist);
+    #undef LARGE_COUNT
+}
+
 int main(void)
 {
     test_append();
@@ -2367,6 +2501,7 @@ int main(void)
     test_playback_order_changed_callbacks();
     test_callbacks_on_add_listener();
     test_index_of();
+    test_index_of_large();
     test_prev();
     test_next();
     test_goto();
@@ -2384,6 +2519,7 @@ int main(void)
     test_random();
     test_shuffle();
     test_sort();
+    test_sort_large();
     return 0;
 }
 
@@ -40,6 +40,7 @@
 #include "misc/interrupt.h"
 
 struct input_fetcher_t {
+    vlc_executor_t* executor;
     struct background_worker* local;
     struct background_worker* network;
     struct background_worker* downloader;
@@ -64,9 +65,13 @@ struct fetcher_thread {
     struct fetcher_request* req;
     input_fetcher_t* fetcher;
 
+    struct vlc_executor_job job;
     vlc_interrupt_t interrupt;
-    vlc_thread_t thread;
     atomic_bool active;
+
+    vlc_mutex_t lock;
+    vlc_cond_t wait;
+    bool done; /**< the job does not use this structure anymore */
 };
 
 static char* CreateCacheKey( input_item_t* item )
@@ -332,21 +337,27 @@ static void RequestHold( void* req_ )
     vlc_atomic_rc_inc( &req->rc );
 }
 
-static void* FetcherThread( void* handle )
+static void FetcherRun( struct vlc_executor_job* job )
 {
-    struct fetcher_thread* th = handle;
-    vlc_interrupt_set( &th->interrupt );
+    struct fetcher_thread* th = container_of( job, struct fetcher_thread, job );
+    vlc_interrupt_t *oldctx = vlc_interrupt_set( &th->interrupt );
 
     th->pf_worker( th->fetcher, th->req );
 
+    vlc_interrupt_set( oldctx );
     atomic_store( &th->active, false );
     background_worker_RequestProbe( th->worker );
-    return NULL;
+
+    vlc_mutex_lock( &th->lock );
+    th->done = true;
+    vlc_cond_signal( &th->wait );
+    vlc_mutex_unlock( &th->lock );
 }
 
 static int StartWorker( input_fetcher_t* fetcher,
     void( *pf_worker )( input_fetcher_t*, struct fetcher_request* ),
-    struct background_worker* bg, struct fetcher_request* req, void** handle )
+    struct background_worker* bg, enum vlc_executor_priority priority,
+    struct fetcher_request* req, void** handle )
 {
     struct fetcher_thread* th = malloc( sizeof *th );
 
@@ -358,18 +369,17 @@ static int StartWorker( input_fetcher_t* fetcher,
     th->fetcher = fetcher;
     th->pf_worker = pf_worker;
 
+    th->job.run = FetcherRun;
+    th->job.priority = priority;
     vlc_interrupt_init( &th->interrupt );
     atomic_init( &th->active, true );
+    vlc_mutex_init( &th->lock );
+    vlc_cond_init( &th->wait );
+    th->done = false;
 
-    if( !vlc_clone( &th->thread, FetcherThread, th, VLC_THREAD_PRIORITY_LOW ) )
-    {
-        *handle = th;
-        return VLC_SUCCESS;
-    }
-
-    vlc_interrupt_deinit( &th->interrupt );
-    free( th );
-    return VLC_EGENERIC;
+    vlc_executor_Submit( fetcher->executor, &th->job );
+    *handle = th;
+    return VLC_SUCCESS;
 }
 
 static int ProbeWorker( void* fetcher_, void* th_ )
@@ -380,37 +390,47 @@ static int ProbeWorker( void* fetcher_, void* th_ )
 
 static void CloseWorker( void* fetcher_, void* th_ )
 {
+    input_fetcher_t* fetcher = fetcher_;
     struct fetcher_thread* th = th_;
-    VLC_UNUSED( fetcher_ );
 
-    vlc_interrupt_kill( &th->interrupt );
-    vlc_join( th->thread, NULL );
+    /* the job blocks until interrupted once started */
+    if( !vlc_executor_Cancel( fetcher->executor, &th->job ) )
+    {
+        vlc_interrupt_kill( &th->interrupt );
+
+        vlc_mutex_lock( &th->lock );
+        while( !th->done )
+            vlc_cond_wait( &th->wait, &th->lock );
+        vlc_mutex_unlock( &th->lock );
+    }
     vlc_interrupt_deinit( &th->interrupt );
     free( th );
 }
 
-#define DEF_STARTER(name, worker) \
+#define DEF_STARTER(name, worker, priority) \
 static int Start ## name( void* fetcher_, void* req_, void** out ) { \
     input_fetcher_t* fetcher = fetcher_; \
-    return StartWorker( fetcher, name, worker, req_, out ); }
+    return StartWorker( fetcher, name, worker, priority, req_, out ); }
 
-DEF_STARTER(  SearchLocal, fetcher->local )
-DEF_STARTER(SearchNetwork, fetcher->network )
-DEF_STARTER(   Downloader, fetcher->downloader )
+DEF_STARTER(  SearchLocal, fetcher->local, VLC_EXECUTOR_PRIORITY_NORMAL )
+DEF_STARTER(SearchNetwork, fetcher->network, VLC_EXECUTOR_PRIORITY_LOW )
+DEF_STARTER(   Downloader, fetcher->downloader, VLC_EXECUTOR_PRIORITY_LOW )
 
 static void WorkerInit( input_fetcher_t* fetcher,
-    struct background_worker** worker, int( *starter )( void*, void*, void** ) )
+    struct background_worker** worker, int( *starter )( void*, void*, void** ),
+    enum vlc_executor_priority priority )
 {
     struct background_worker_config conf = {
         .default_timeout = 0,
         .max_threads = var_InheritInteger( fetcher->owner, "fetch-art-threads" ),
+        .priority = priority,
         .pf_start = starter,
         .pf_probe = ProbeWorker,
         .pf_stop = CloseWorker,
         .pf_release = RequestRelease,
         .pf_hold = RequestHold };
 
-    *worker = background_worker_New( fetcher, &conf );
+    *worker = background_worker_New( fetcher, fetcher->executor, &conf );
 }
 
 input_fetcher_t* input_fetcher_New( vlc_object_t* owner )
@@ -421,10 +441,14 @@ input_fetcher_t* input_fetcher_New( vlc_object_t* owner )
         return NULL;
 
     fetcher->owner = owner;
-
-    WorkerInit( fetcher, &fetcher->local, StartSearchLocal );
-    WorkerInit( fetcher, &fetcher->network, StartSearchNetwork );
-    WorkerInit( fetcher, &fetcher->downloader, StartDownloader );
+    fetcher->executor = libvlc_priv( vlc_object_instance(owner) )->executor;
+
+    WorkerInit( fetcher, &fetcher->local, StartSearchLocal,
+                VLC_EXECUTOR_PRIORITY_NORMAL );
+    WorkerInit( fetcher, &fetcher->network, StartSearchNetwork,
+                VLC_EXECUTOR_PRIORITY_LOW );
+    WorkerInit( fetcher, &fetcher->downloader, StartDownloader,
+                VLC_EXECUTOR_PRIORITY_LOW );
 
     if( unlikely( !fetcher->local || !fetcher->network || !fetcher->downloader ) )
     {
@@ -24,12 +24,16 @@
 
 #include <vlc_common.h>
 #include <vlc_atomic.h>
+#include <vlc_list.h>
 
+#include "libvlc.h"
 #include "misc/background_worker.h"
+#include "misc/executor.h"
 #include "input/input_interface.h"
 #include "input/input_internal.h"
 #include "preparser.h"
 #include "fetcher.h"
+#include "probe.h"
 
 struct input_preparser_t
 {
@@ -37,6 +41,25 @@ struct input_preparser_t
     input_fetcher_t* fetcher;
     struct background_worker* worker;
     atomic_bool deactivated;
+
+    /* local files probed without input thread, see probe.h */
+    struct
+    {
+        bool enabled;
+        vlc_executor_t *executor;
+        vlc_tick_t default_timeout;
+
+        vlc_mutex_t lock;
+        vlc_cond_t wait; /**< signaled when a job is done */
+        struct vlc_list queue; /**< requests waiting for a job */
+        struct vlc_list jobs; /**< requests submitted to the executor */
+        unsigned count; /**< maximum number of jobs */
+        unsigned running;
+
+        uint64_t probed;
+        uint64_t fallbacks; /**< probed, then preparsed by an input thread */
+        vlc_tick_t busy;
+    } fast;
 };
 
 typedef struct input_preparser_req_t
@@ -46,6 +69,15 @@ typedef struct input_preparser_req_t
     const input_preparser_callbacks_t *cbs;
     void *userdata;
     vlc_atomic_rc_t rc;
+
+    /* fast path only */
+    struct vlc_executor_job job;
+    input_preparser_t *preparser;
+    struct vlc_list node;
+    void *id;
+    int timeout;
+    bool canceled;
+    unsigned long runner; /**< thread running the job, or 0 */
 } input_preparser_req_t;
 
 typedef struct input_preparser_task_t
@@ -176,14 +208,36 @@ static const input_fetcher_callbacks_t input_fetcher_callbacks = {
     .on_art_fetch_ended = on_art_fetch_ended,
 };
 
-static void PreparserCloseInput( void* preparser_, void* task_ )
+static void PreparserEnd( input_preparser_t *preparser,
+                          input_preparser_task_t *task, int status )
 {
-    input_preparser_task_t* task = task_;
     input_preparser_req_t *req = task->req;
-
-    input_preparser_t* preparser = preparser_;
     input_item_t* item = req->item;
 
+    if( preparser->fetcher && (req->options & META_REQUEST_OPTION_FETCH_ANY) )
+    {
+        task->preparse_status = status;
+        ReqHold(task->req);
+        if (!input_fetcher_Push(preparser->fetcher, item,
+                                req->options & META_REQUEST_OPTION_FETCH_ANY,
+                                &input_fetcher_callbacks, task))
+        {
+            return;
+        }
+        ReqRelease(task->req);
+    }
+
+    free(task);
+
+    input_item_SetPreparsed( item, true );
+    if (req->cbs && req->cbs->on_preparse_ended)
+        req->cbs->on_preparse_ended(req->item, status, req->userdata);
+}
+
+static void PreparserCloseInput( void* preparser_, void* task_ )
+{
+    input_preparser_task_t* task = task_;
+
     int status;
     switch( atomic_load( &task->state ) )
     {
@@ -200,24 +254,165 @@ static void PreparserCloseInput( void* preparser_, void* task_ )
 
     input_item_parser_id_Release( task->parser );
 
-    if( preparser->fetcher && (req->options & META_REQUEST_OPTION_FETCH_ANY) )
+    PreparserEnd( preparser_, task, status );
+}
+
+/* Preparse by an input thread, from the background worker */
+static void PreparserPushInput( input_preparser_t *preparser,
+                                input_preparser_req_t *req, int timeout,
+                                void *id )
+{
+    if (background_worker_Push(preparser->worker, req, id, timeout))
+        if (req->cbs && req->cbs->on_preparse_ended)
+            req->cbs->on_preparse_ended(req->item, ITEM_PREPARSE_FAILED,
+                                        req->userdata);
+}
+
+static void PreparserProbe( input_preparser_t *preparser,
+                            input_preparser_req_t *req, bool *fallback )
+{
+    vlc_tick_t timeout = req->timeout < 0 ? preparser->fast.default_timeout
+                       : VLC_TICK_FROM_MS( req->timeout );
+    int ret = input_preparser_Probe( preparser->owner, req->item, timeout );
+
+    *fallback = ret == VLC_EGENERIC;
+    if( *fallback )
     {
-        task->preparse_status = status;
-        ReqHold(task->req);
-        if (!input_fetcher_Push(preparser->fetcher, item,
-                                req->options & META_REQUEST_OPTION_FETCH_ANY,
-                                &input_fetcher_callbacks, task))
+        PreparserPushInput( preparser, req, req->timeout, req->id );
+        return;
+    }
+
+    input_preparser_task_t *task = malloc( sizeof( *task ) );
+    if( unlikely( task == NULL ) )
+    {
+        if (req->cbs && req->cbs->on_preparse_ended)
+            req->cbs->on_preparse_ended(req->item, ITEM_PREPARSE_FAILED,
+                                        req->userdata);
+        return;
+    }
+    task->req = req;
+    task->preparser = preparser;
+    task->parser = NULL;
+
+    PreparserEnd( preparser, task,
+                  ret == VLC_SUCCESS ? ITEM_PREPARSE_DONE :
+                  ret == VLC_ETIMEOUT ? ITEM_PREPARSE_TIMEOUT :
+                                        ITEM_PREPARSE_FAILED );
+}
+
+/* Submits queued requests, up to the maximum number of jobs */
+static void PreparserScheduleFast( input_preparser_t *preparser )
+{
+    vlc_mutex_assert( &preparser->fast.lock );
+
+    while( preparser->fast.running < preparser->fast.count )
+    {
+        input_preparser_req_t *req =
+            vlc_list_first_entry_or_null( &preparser->fast.queue,
+                                          input_preparser_req_t, node );
+        if( req == NULL )
+            break;
+
+        vlc_list_remove( &req->node );
+        vlc_list_append( &req->node, &preparser->fast.jobs );
+        preparser->fast.running++;
+        vlc_executor_Submit( preparser->fast.executor, &req->job );
+    }
+}
+
+/* Probes one request, so that more urgent jobs are not held behind */
+static void PreparserRunFast( struct vlc_executor_job *job )
+{
+    input_preparser_req_t *req =
+        container_of( job, input_preparser_req_t, job );
+    input_preparser_t *preparser = req->preparser;
+    bool fallback;
+
+    vlc_mutex_lock( &preparser->fast.lock );
+    req->runner = vlc_thread_id();
+    vlc_mutex_unlock( &preparser->fast.lock );
+
+    vlc_tick_t start = vlc_tick_now();
+    PreparserProbe( preparser, req, &fallback );
+    vlc_tick_t busy = vlc_tick_now() - start;
+
+    vlc_mutex_lock( &preparser->fast.lock );
+    vlc_list_remove( &req->node );
+    preparser->fast.running--;
+    preparser->fast.probed++;
+    if( fallback )
+        preparser->fast.fallbacks++;
+    preparser->fast.busy += busy;
+    PreparserScheduleFast( preparser );
+    vlc_cond_broadcast( &preparser->fast.wait );
+    vlc_mutex_unlock( &preparser->fast.lock );
+
+    ReqRelease( req );
+}
+
+static void PreparserPushFast( input_preparser_t *preparser,
+                               input_preparser_req_t *req )
+{
+    req->job.run = PreparserRunFast;
+    req->job.priority = VLC_EXECUTOR_PRIORITY_NORMAL;
+    req->preparser = preparser;
+    req->canceled = false;
+    req->runner = 0;
+
+    vlc_mutex_lock( &preparser->fast.lock );
+    vlc_list_append( &req->node, &preparser->fast.queue );
+    PreparserScheduleFast( preparser );
+    vlc_mutex_unlock( &preparser->fast.lock );
+}
+
+static bool PreparserIsCanceledFast( input_preparser_t *preparser, void *id )
+{
+    vlc_mutex_assert( &preparser->fast.lock );
+
+    unsigned long self = vlc_thread_id();
+    input_preparser_req_t *req;
+    vlc_list_foreach( req, &preparser->fast.jobs, node )
+        /* the callback of a request may cancel it, do not wait for it */
+        if( ( id == NULL || req->id == id ) && req->canceled
+         && req->runner != self )
+            return true;
+    return false;
+}
+
+/* Cancels the matching requests, then waits for the jobs already running */
+static void PreparserCancelFast( input_preparser_t *preparser, void *id )
+{
+    input_preparser_req_t *req;
+
+    vlc_mutex_lock( &preparser->fast.lock );
+    vlc_list_foreach( req, &preparser->fast.queue, node )
+    {
+        if( id == NULL || req->id == id )
         {
-            return;
+            vlc_list_remove( &req->node );
+            ReqRelease( req );
         }
-        ReqRelease(task->req);
     }
+    vlc_list_foreach( req, &preparser->fast.jobs, node )
+    {
+        if( id != NULL && req->id != id )
+            continue;
 
-    free(task);
+        if( vlc_executor_Cancel( preparser->fast.executor, &req->job ) )
+        {
+            vlc_list_remove( &req->node );
+            preparser->fast.running--;
+            ReqRelease( req );
+        }
+        else
+            req->canceled = true;
+    }
+    PreparserScheduleFast( preparser );
+    vlc_cond_broadcast( &preparser->fast.wait );
 
-    input_item_SetPreparsed( item, true );
-    if (req->cbs && req->cbs->on_preparse_ended)
-        req->cbs->on_preparse_ended(req->item, status, req->userdata);
+    while( PreparserIsCanceledFast( preparser, id ) )
+        vlc_cond_wait( &preparser->fast.wait, &preparser->fast.lock );
+    vlc_mutex_unlock( &preparser->fast.lock );
 }
 
 static void ReqHoldVoid(void *item) { ReqHold(item); }
@@ -230,6 +425,7 @@ input_preparser_t* input_preparser_New( vlc_object_t *parent )
     struct background_worker_config conf = {
         .default_timeout = VLC_TICK_FROM_MS(var_InheritInteger( parent, "preparse-timeout" )),
         .max_threads = var_InheritInteger( parent, "preparse-threads" ),
+        .priority = VLC_EXECUTOR_PRIORITY_NORMAL,
         .pf_start = PreparserOpenInput,
         .pf_probe = PreparserProbeInput,
         .pf_stop = PreparserCloseInput,
@@ -239,7 +435,8 @@ input_preparser_t* input_preparser_New( vlc_object_t *parent )
 
 
     if( likely( preparser ) )
-        preparser->worker = background_worker_New( preparser, &conf );
+        preparser->worker = background_worker_New( preparser,
+            libvlc_priv( vlc_object_instance(parent) )->executor, &conf );
 
     if( unlikely( !preparser || !preparser->worker ) )
     {
@@ -248,9 +445,25 @@ input_preparser_t* input_preparser_New( vlc_object_t *parent )
     }
 
     preparser->owner = parent;
-    preparser->fetcher = input_fetcher_New( parent );
     atomic_init( &preparser->deactivated, false );
 
+    preparser->fast.enabled = var_InheritBool( parent, "preparse-fast" );
+    preparser->fast.executor =
+        libvlc_priv( vlc_object_instance(parent) )->executor;
+    preparser->fast.default_timeout = conf.default_timeout;
+    vlc_mutex_init( &preparser->fast.lock );
+    vlc_cond_init( &preparser->fast.wait );
+    vlc_list_init( &preparser->fast.queue );
+    vlc_list_init( &preparser->fast.jobs );
+    preparser->fast.count = conf.max_threads > 0 ? conf.max_threads
+                          : vlc_executor_GetThreads( preparser->fast.executor );
+    preparser->fast.running = 0;
+    preparser->fast.probed = 0;
+    preparser->fast.fallbacks = 0;
+    preparser->fast.busy = 0;
+
+    preparser->fetcher = input_fetcher_New( parent );
+
     if( unlikely( !preparser->fetcher ) )
         msg_Warn( parent, "unable to create art fetcher" );
 
@@ -289,11 +502,22 @@ void input_preparser_Push( input_preparser_t *preparser,
 
     struct input_preparser_req_t *req = ReqCreate(item, i_options,
                                                   cbs, cbs_userdata);
-
-    if (background_worker_Push(preparser->worker, req, id, timeout))
-        if (req->cbs && cbs->on_preparse_ended)
+    if (unlikely(!req))
+    {
+        if (cbs && cbs->on_preparse_ended)
             cbs->on_preparse_ended(item, ITEM_PREPARSE_FAILED, cbs_userdata);
+        return;
+    }
+
+    if (preparser->fast.enabled && input_preparser_CanProbe(item))
+    {
+        req->id = id;
+        req->timeout = timeout;
+        PreparserPushFast(preparser, req); /* the queue owns the request */
+        return;
+    }
 
+    PreparserPushInput(preparser, req, timeout, id);
     ReqRelease(req);
 }
 
@@ -308,17 +532,34 @@ void input_preparser_fetcher_Push( input_preparser_t *preparser,
 
 void input_preparser_Cancel( input_preparser_t *preparser, void *id )
 {
+    PreparserCancelFast( preparser, id );
     background_worker_Cancel( preparser->worker, id );
 }
 
 void input_preparser_Deactivate( input_preparser_t* preparser )
 {
     atomic_store( &preparser->deactivated, true );
+    PreparserCancelFast( preparser, NULL );
     background_worker_Cancel( preparser->worker, NULL );
 }
 
 void input_preparser_Delete( input_preparser_t *preparser )
 {
+    /* Running jobs may still hand requests over to the worker */
+    PreparserCancelFast( preparser, NULL );
+    vlc_mutex_lock( &preparser->fast.lock );
+    while( preparser->fast.running > 0 )
+        vlc_cond_wait( &preparser->fast.wait, &preparser->fast.lock );
+    vlc_mutex_unlock( &preparser->fast.lock );
+
+    if( preparser->fast.probed > 0 )
+        msg_Dbg( preparser->owner, "%"PRIu64" items probed in %"PRId64" ms "
+                 "(%.1f items/s per thread), %"PRIu64" needed an input",
+                 preparser->fast.probed, MS_FROM_VLC_TICK( preparser->fast.busy ),
+                 preparser->fast.busy > 0 ? (double) preparser->fast.probed
+                     * CLOCK_FREQ / preparser->fast.busy : 0.,
+                 preparser->fast.fallbacks );
+
     background_worker_Delete( preparser->worker );
 
     if( preparser->fetcher )
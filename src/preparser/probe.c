@@ -0,0 +1,357 @@
+/*****************************************************************************
+ * probe.c: preparsing without an input thread
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <vlc_common.h>
+#include <vlc_atomic.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_interrupt.h>
+#include <vlc_list.h>
+#include <vlc_meta.h>
+#include <vlc_modules.h>
+
+#include "input/demux.h"
+#include "input/item.h"
+#include "input/stream.h"
+#include "art.h"
+#include "probe.h"
+
+/* demux calls allowed to find the tracks not declared by the header */
+#define PROBE_MAX_DEMUX 64
+
+struct es_out_id_t
+{
+    int i_id;
+    struct vlc_list node;
+};
+
+struct probe_es_out
+{
+    es_out_t out;
+    input_item_t *item;
+    struct vlc_list ids;
+    int auto_id;
+    bool subnode; /**< the demux found sub-items */
+};
+
+static void ProbeUpdateTrack( struct probe_es_out *sys, const es_out_id_t *id,
+                              const es_format_t *fmt )
+{
+    es_format_t track = *fmt; /* copied by input_item_UpdateTracksInfo */
+    track.i_id = id->i_id;
+    input_item_UpdateTracksInfo( sys->item, &track );
+}
+
+static void ProbeMergeMeta( input_item_t *item, const vlc_meta_t *meta )
+{
+    vlc_mutex_lock( &item->lock );
+    vlc_meta_Merge( item->p_meta, meta );
+    vlc_mutex_unlock( &item->lock );
+
+    const char *title = vlc_meta_Get( meta, vlc_meta_Title );
+    if( title != NULL )
+        input_item_SetName( item, title );
+}
+
+static es_out_id_t *EsOutAdd( es_out_t *out, input_source_t *in,
+                              const es_format_t *fmt )
+{
+    struct probe_es_out *sys = container_of( out, struct probe_es_out, out );
+    es_out_id_t *id = malloc( sizeof( *id ) );
+    VLC_UNUSED(in);
+
+    if( unlikely(id == NULL) )
+        return NULL;
+    id->i_id = fmt->i_id >= 0 ? fmt->i_id : sys->auto_id++;
+    vlc_list_append( &id->node, &sys->ids );
+    ProbeUpdateTrack( sys, id, fmt );
+    return id;
+}
+
+static int EsOutSend( es_out_t *out, es_out_id_t *id, block_t *block )
+{
+    VLC_UNUSED(out); VLC_UNUSED(id);
+    block_Release( block );
+    return VLC_SUCCESS;
+}
+
+static void EsOutDel( es_out_t *out, es_out_id_t *id )
+{
+    VLC_UNUSED(out);
+    vlc_list_remove( &id->node );
+    free( id );
+}
+
+static int EsOutControl( es_out_t *out, input_source_t *in, int query,
+                         va_list args )
+{
+    struct probe_es_out *sys = container_of( out, struct probe_es_out, out );
+    VLC_UNUSED(in);
+
+    switch( query )
+    {
+        case ES_OUT_SET_ES_FMT:
+        {
+            es_out_id_t *id = va_arg( args, es_out_id_t * );
+            const es_format_t *fmt = va_arg( args, const es_format_t * );
+            ProbeUpdateTrack( sys, id, fmt );
+            return VLC_SUCCESS;
+        }
+        case ES_OUT_SET_META:
+            ProbeMergeMeta( sys->item, va_arg( args, const vlc_meta_t * ) );
+            return VLC_SUCCESS;
+        case ES_OUT_GET_ES_STATE:
+            (void) va_arg( args, es_out_id_t * );
+            *va_arg( args, bool * ) = false; /* nothing is decoded */
+            return VLC_SUCCESS;
+        case ES_OUT_GET_EMPTY:
+            *va_arg( args, bool * ) = true;
+            return VLC_SUCCESS;
+        case ES_OUT_POST_SUBNODE:
+            input_item_node_Delete( va_arg( args, input_item_node_t * ) );
+            sys->subnode = true;
+            return VLC_SUCCESS;
+        default:
+            return VLC_EGENERIC;
+    }
+}
+
+static void EsOutDestroy( es_out_t *out )
+{
+    struct probe_es_out *sys = container_of( out, struct probe_es_out, out );
+    es_out_id_t *id;
+
+    vlc_list_foreach( id, &sys->ids, node )
+        EsOutDel( out, id );
+}
+
+static const struct es_out_callbacks probe_es_out_cbs =
+{
+    .add = EsOutAdd,
+    .send = EsOutSend,
+    .del = EsOutDel,
+    .control = EsOutControl,
+    .destroy = EsOutDestroy,
+};
+
+/* Caches the art attached to the item, as the input thread would do */
+static void ProbeSaveArt( vlc_object_t *obj, input_item_t *item,
+                          input_attachment_t **attachments, int count )
+{
+    char *arturl = input_item_GetArtURL( item );
+    if( arturl == NULL || strncmp( arturl, "attachment://", 13 ) )
+    {
+        free( arturl );
+        return;
+    }
+
+    for( int i = 0; i < count; i++ )
+    {
+        const input_attachment_t *a = attachments[i];
+        if( strcmp( a->psz_name, arturl + 13 ) )
+            continue;
+
+        const char *type = NULL;
+        if( !strcmp( a->psz_mime, "image/jpeg" ) )
+            type = ".jpg";
+        else if( !strcmp( a->psz_mime, "image/png" ) )
+            type = ".png";
+        else if( !strcmp( a->psz_mime, "image/x-pict" ) )
+            type = ".pct";
+
+        input_SaveArt( obj, item, a->p_data, a->i_data, type );
+        break;
+    }
+    free( arturl );
+}
+
+/* Same as the input thread: prefer the demux meta, unless it is incomplete */
+static void ProbeMeta( vlc_object_t *obj, demux_t *demux, input_item_t *item )
+{
+    vlc_meta_t *meta = vlc_meta_New();
+    if( unlikely(meta == NULL) )
+        return;
+
+    input_attachment_t **attachments;
+    int count;
+    if( demux_Control( demux, DEMUX_GET_ATTACHMENTS, &attachments, &count ) )
+    {
+        attachments = NULL;
+        count = 0;
+    }
+
+    bool has_meta = !demux_Control( demux, DEMUX_GET_META, meta );
+    bool has_unsupported;
+    if( demux_Control( demux, DEMUX_HAS_UNSUPPORTED_META, &has_unsupported ) )
+        has_unsupported = true;
+
+    if( !has_meta || has_unsupported )
+    {
+        demux_meta_t *demux_meta =
+            vlc_custom_create( obj, sizeof( *demux_meta ), "demux meta" );
+        if( likely(demux_meta != NULL) )
+        {
+            demux_meta->p_item = item;
+
+            module_t *reader = module_need( demux_meta, "meta reader",
+                                            NULL, false );
+            if( reader != NULL )
+            {
+                if( demux_meta->p_meta )
+                {
+                    vlc_meta_Merge( meta, demux_meta->p_meta );
+                    vlc_meta_Delete( demux_meta->p_meta );
+                }
+                for( int i = 0; i < demux_meta->i_attachments; i++ )
+                    TAB_APPEND( count, attachments,
+                                demux_meta->attachments[i] );
+                free( demux_meta->attachments );
+                module_unneed( demux_meta, reader );
+            }
+            vlc_object_delete( demux_meta );
+        }
+    }
+
+    ProbeMergeMeta( item, meta );
+    vlc_meta_Delete( meta );
+
+    /* Without an input, the attachments are only kept as cached art */
+    ProbeSaveArt( obj, item, attachments, count );
+    for( int i = 0; i < count; i++ )
+        vlc_input_attachment_Delete( attachments[i] );
+    free( attachments );
+}
+
+bool input_preparser_CanProbe( input_item_t *item )
+{
+    vlc_mutex_lock( &item->lock );
+    bool ret = item->i_type == ITEM_TYPE_FILE && !item->b_net
+            && item->i_options == 0
+            && !strncmp( item->psz_uri, "file://", 7 )
+            && strchr( item->psz_uri, '#' ) == NULL;
+    vlc_mutex_unlock( &item->lock );
+    return ret;
+}
+
+struct probe_timeout
+{
+    vlc_interrupt_t *interrupt;
+    atomic_bool expired;
+};
+
+static void OnTimeout( void *data )
+{
+    struct probe_timeout *timeout = data;
+
+    atomic_store( &timeout->expired, true );
+    vlc_interrupt_kill( timeout->interrupt );
+}
+
+int input_preparser_Probe( vlc_object_t *obj, input_item_t *item,
+                           vlc_tick_t timeout )
+{
+    struct probe_timeout expiry;
+    vlc_timer_t timer;
+
+    expiry.interrupt = vlc_interrupt_create();
+    if( unlikely(expiry.interrupt == NULL) )
+        return VLC_ENOMEM;
+    atomic_init( &expiry.expired, false );
+
+    if( timeout > 0 )
+    {
+        if( vlc_timer_create( &timer, OnTimeout, &expiry ) )
+        {
+            vlc_interrupt_destroy( expiry.interrupt );
+            return VLC_ENOMEM;
+        }
+        vlc_timer_schedule( timer, false, timeout, VLC_TIMER_FIRE_ONCE );
+    }
+    vlc_interrupt_t *oldctx = vlc_interrupt_set( expiry.interrupt );
+
+    struct probe_es_out sys = {
+        .out = { .cbs = &probe_es_out_cbs },
+        .item = item,
+        .auto_id = 0,
+        .subnode = false,
+    };
+    vlc_list_init( &sys.ids );
+
+    int ret = VLC_EGENERIC;
+    char *url = input_item_GetURI( item );
+    if( unlikely(url == NULL) )
+        goto out;
+
+    stream_t *stream = stream_AccessNew( obj, NULL, NULL, true, url );
+    if( stream == NULL )
+        goto out;
+    stream = stream_FilterAutoNew( stream );
+
+    if( stream->pf_read == NULL && stream->pf_block == NULL )
+    {   /* access_demux or directory */
+        vlc_stream_Delete( stream );
+        goto out;
+    }
+
+    demux_t *demux = demux_NewAdvanced( obj, NULL, "any", url, stream,
+                                        &sys.out, true );
+    if( demux == NULL )
+    {
+        vlc_stream_Delete( stream );
+        goto out;
+    }
+
+    bool is_playlist;
+    if( demux_Control( demux, DEMUX_IS_PLAYLIST, &is_playlist ) )
+        is_playlist = false;
+
+    /* Some formats only declare their tracks along with the data */
+    for( unsigned i = 0; !is_playlist && vlc_list_is_empty( &sys.ids )
+                      && !sys.subnode && i < PROBE_MAX_DEMUX; i++ )
+        if( demux_Demux( demux ) != VLC_DEMUXER_SUCCESS )
+            break;
+
+    if( !is_playlist && !sys.subnode )
+    {
+        vlc_tick_t length;
+        if( !demux_Control( demux, DEMUX_GET_LENGTH, &length )
+         && length != VLC_TICK_INVALID )
+            input_item_SetDuration( item, length );
+
+        ProbeMeta( obj, demux, item );
+        ret = VLC_SUCCESS;
+    }
+    demux_Delete( demux );
+
+out:
+    es_out_Delete( &sys.out );
+    free( url );
+    vlc_interrupt_set( oldctx );
+    if( timeout > 0 )
+        vlc_timer_destroy( timer );
+    if( ret != VLC_SUCCESS && atomic_load( &expiry.expired ) )
+        ret = VLC_ETIMEOUT;
+    vlc_interrupt_destroy( expiry.interrupt );
+    return ret;
+}
@@ -0,0 +1,49 @@
+/*****************************************************************************
+ * probe.h
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef _INPUT_PROBE_H
+#define _INPUT_PROBE_H 1
+
+#include <vlc_input_item.h>
+
+/**
+ * Tells whether an item may be preparsed with input_preparser_Probe().
+ *
+ * Only plain local files qualify: other items may need an access_demux,
+ * stream extractors, or the slaves and sub-items found by an input thread.
+ */
+bool input_preparser_CanProbe( input_item_t * );
+
+/**
+ * Reads the duration, the tracks and the meta data of an item synchronously.
+ *
+ * Only the access and the demux are opened, without any input thread, ES
+ * output or decoder. If the demux does not report meta data, the "meta
+ * reader" modules are used. Art attached to the file is saved to the art
+ * cache, as there is no input to keep the attachments.
+ *
+ * @param timeout maximum time allowed, 0 for none
+ * @retval VLC_SUCCESS the item was updated
+ * @retval VLC_ETIMEOUT the timeout expired
+ * @retval VLC_EGENERIC the item needs a full preparsing (e.g. a playlist)
+ */
+int input_preparser_Probe( vlc_object_t *, input_item_t *, vlc_tick_t timeout );
+
+#endif
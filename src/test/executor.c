@@ -0,0 +1,250 @@
+/*****************************************************************************
+ * executor.c: Test for the background job executor
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#undef NDEBUG
+#include <assert.h>
+
+#include <vlc_common.h>
+#include "../misc/executor.h"
+
+/* blocks the thread running it until opened */
+struct gate
+{
+    struct vlc_executor_job job;
+    vlc_mutex_t lock;
+    vlc_cond_t wait;
+    bool entered;
+    bool open;
+};
+
+static void gate_Run(struct vlc_executor_job *job)
+{
+    struct gate *gate = container_of(job, struct gate, job);
+
+    vlc_mutex_lock(&gate->lock);
+    gate->entered = true;
+    vlc_cond_broadcast(&gate->wait);
+    while (!gate->open)
+        vlc_cond_wait(&gate->wait, &gate->lock);
+    vlc_mutex_unlock(&gate->lock);
+}
+
+static void gate_Init(struct gate *gate)
+{
+    gate->job.run = gate_Run;
+    gate->job.priority = VLC_EXECUTOR_PRIORITY_NORMAL;
+    vlc_mutex_init(&gate->lock);
+    vlc_cond_init(&gate->wait);
+    gate->entered = false;
+    gate->open = false;
+}
+
+static void gate_WaitEntered(struct gate *gate)
+{
+    vlc_mutex_lock(&gate->lock);
+    while (!gate->entered)
+        vlc_cond_wait(&gate->wait, &gate->lock);
+    vlc_mutex_unlock(&gate->lock);
+}
+
+static void gate_Open(struct gate *gate)
+{
+    vlc_mutex_lock(&gate->lock);
+    gate->open = true;
+    vlc_cond_broadcast(&gate->wait);
+    vlc_mutex_unlock(&gate->lock);
+}
+
+/* records the order in which jobs run */
+struct order
+{
+    struct vlc_executor_job job;
+    int *log;
+    atomic_int *count;
+    int value;
+};
+
+static void order_Run(struct vlc_executor_job *job)
+{
+    struct order *order = container_of(job, struct order, job);
+    order->log[atomic_fetch_add(order->count, 1)] = order->value;
+}
+
+static void test_priorities(void)
+{
+    vlc_executor_t *executor = vlc_executor_New(1, VLC_TICK_FROM_SEC(5));
+    assert(executor);
+
+    struct gate gate;
+    gate_Init(&gate);
+    vlc_executor_Submit(executor, &gate.job);
+    gate_WaitEntered(&gate);
+
+    /* queued while the only thread is busy */
+    static const enum vlc_executor_priority prios[] = {
+        VLC_EXECUTOR_PRIORITY_LOW, VLC_EXECUTOR_PRIORITY_NORMAL,
+        VLC_EXECUTOR_PRIORITY_HIGH, VLC_EXECUTOR_PRIORITY_LOW,
+        VLC_EXECUTOR_PRIORITY_HIGH,
+    };
+    struct order jobs[ARRAY_SIZE(prios)];
+    int log[ARRAY_SIZE(prios)];
+    atomic_int count = ATOMIC_VAR_INIT(0);
+
+    for (size_t i = 0; i < ARRAY_SIZE(prios); ++i)
+    {
+        jobs[i].job.run = order_Run;
+        jobs[i].job.priority = prios[i];
+        jobs[i].log = log;
+        jobs[i].count = &count;
+        jobs[i].value = i;
+        vlc_executor_Submit(executor, &jobs[i].job);
+    }
+
+    /* cancel the first low priority job */
+    assert(vlc_executor_Cancel(executor, &jobs[0].job));
+    assert(!vlc_executor_Cancel(executor, &jobs[0].job));
+
+    gate_Open(&gate);
+    vlc_executor_Delete(executor); /* runs the queued jobs */
+
+    /* by priority, then in submission order */
+    assert(atomic_load(&count) == 4);
+    assert(log[0] == 2);
+    assert(log[1] == 4);
+    assert(log[2] == 1);
+    assert(log[3] == 3);
+}
+
+#define PARENTS 1000
+#define CHILDREN 99
+#define JOBS (PARENTS * (CHILDREN + 1))
+
+struct counter
+{
+    struct vlc_executor_job job;
+    vlc_executor_t *executor;
+    unsigned children; /**< jobs to submit from this one */
+};
+
+static vlc_mutex_t done_lock = VLC_STATIC_MUTEX;
+static vlc_cond_t done_wait = VLC_STATIC_COND;
+static unsigned done;
+
+static void counter_Run(struct vlc_executor_job *job)
+{
+    struct counter *counter = container_of(job, struct counter, job);
+
+    /* submitted from a pool thread: queued locally, stolen by the others */
+    for (unsigned i = 0; i < counter->children; ++i)
+    {
+        struct counter *child = counter + 1 + i;
+        vlc_executor_Submit(counter->executor, &child->job);
+    }
+
+    vlc_mutex_lock(&done_lock);
+    if (++done == JOBS)
+        vlc_cond_signal(&done_wait);
+    vlc_mutex_unlock(&done_lock);
+}
+
+static void test_throughput(void)
+{
+    vlc_executor_t *executor = vlc_executor_New(0, VLC_TICK_FROM_SEC(5));
+    assert(executor);
+
+    struct counter *counters = malloc(JOBS * sizeof(*counters));
+    assert(counters);
+
+    for (size_t i = 0; i < JOBS; ++i)
+    {
+        counters[i].job.run = counter_Run;
+        counters[i].job.priority = VLC_EXECUTOR_PRIORITY_NORMAL;
+        counters[i].executor = executor;
+        counters[i].children = i % (CHILDREN + 1) ? 0 : CHILDREN;
+    }
+
+    vlc_tick_t start = vlc_tick_now();
+    for (size_t i = 0; i < PARENTS; ++i)
+        vlc_executor_Submit(executor, &counters[i * (CHILDREN + 1)].job);
+    vlc_mutex_lock(&done_lock);
+    while (done < JOBS)
+        vlc_cond_wait(&done_wait, &done_lock);
+    vlc_mutex_unlock(&done_lock);
+    vlc_tick_t duration = vlc_tick_now() - start;
+
+    struct vlc_executor_stats stats;
+    vlc_executor_GetStats(executor, &stats);
+    assert(stats.submitted == JOBS);
+    assert(stats.canceled == 0);
+
+    fprintf(stderr, "%u jobs on %u threads in %"PRId64" ms "
+            "(%"PRIu64" stolen)\n", JOBS, stats.threads,
+            MS_FROM_VLC_TICK(duration), stats.stolen);
+
+    vlc_executor_Delete(executor);
+    free(counters);
+}
+
+static void test_idle(void)
+{
+    vlc_executor_t *executor = vlc_executor_New(2, VLC_TICK_FROM_MS(50));
+    assert(executor);
+
+    struct vlc_executor_stats stats;
+    vlc_executor_GetStats(executor, &stats);
+    assert(stats.threads == 2);
+    assert(stats.running == 0);
+
+    for (int round = 0; round < 2; ++round)
+    {
+        struct gate gate;
+        gate_Init(&gate);
+        vlc_executor_Submit(executor, &gate.job);
+        gate_WaitEntered(&gate);
+
+        vlc_executor_GetStats(executor, &stats);
+        assert(stats.running >= 1);
+        gate_Open(&gate);
+
+        /* the threads exit once idle, and are started again on demand */
+        do
+        {
+            vlc_tick_wait(vlc_tick_now() + VLC_TICK_FROM_MS(10));
+            vlc_executor_GetStats(executor, &stats);
+        }
+        while (stats.running > 0);
+    }
+
+    vlc_executor_Delete(executor);
+}
+
+int main(void)
+{
+    test_priorities();
+    test_throughput();
+    test_idle();
+    return 0;
+}
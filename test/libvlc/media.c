@@ -140,6 +140,58 @@ static void test_media_preparsed(libvlc_instance_t *vlc, const char *path,
     libvlc_media_release (media);
 }
 
+static size_t count_tracks(libvlc_media_t *media, libvlc_track_type_t type)
+{
+    libvlc_media_tracklist_t *tracklist =
+        libvlc_media_get_tracklist(media, type);
+    assert(tracklist);
+
+    size_t count = libvlc_media_tracklist_count(tracklist);
+    libvlc_media_tracklist_delete(tracklist);
+    return count;
+}
+
+/* Preparses several copies of a local file at once, and checks them */
+static void test_media_probed(libvlc_instance_t *vlc, const char *path,
+                              libvlc_time_t duration, size_t audio_tracks,
+                              size_t video_tracks)
+{
+    test_log ("test_media_probed: %s\n", path);
+
+    libvlc_media_t *medias[8];
+    vlc_sem_t sem;
+    vlc_sem_init (&sem, 0);
+
+    for (size_t i = 0; i < ARRAY_SIZE(medias); ++i)
+    {
+        medias[i] = libvlc_media_new_path (vlc, path);
+        assert (medias[i] != NULL);
+
+        libvlc_event_manager_t *em = libvlc_media_event_manager (medias[i]);
+        libvlc_event_attach (em, libvlc_MediaParsedChanged,
+                             media_parse_ended, &sem);
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(medias); ++i)
+        assert (libvlc_media_parse_with_options (medias[i],
+                                libvlc_media_parse_local, -1) == 0);
+    for (size_t i = 0; i < ARRAY_SIZE(medias); ++i)
+        vlc_sem_wait (&sem);
+
+    for (size_t i = 0; i < ARRAY_SIZE(medias); ++i)
+    {
+        libvlc_media_t *media = medias[i];
+
+        assert (libvlc_media_get_parsed_status(media)
+                == libvlc_media_parsed_status_done);
+        assert (libvlc_media_get_duration(media) == duration);
+        assert (count_tracks(media, libvlc_track_audio) == audio_tracks);
+        assert (count_tracks(media, libvlc_track_video) == video_tracks);
+        assert (count_tracks(media, libvlc_track_text) == 0);
+        libvlc_media_release (media);
+    }
+}
+
 static void input_item_preparse_timeout( input_item_t *item,
                                          enum input_item_preparse_status status,
                                          void *user_data )
@@ -340,6 +392,93 @@ static void test_media_subitems(libvlc_instance_t *vlc)
     libvlc_media_release (media);
 }
 
+static unsigned count_subitems(libvlc_media_t *media, unsigned *dirs)
+{
+    libvlc_media_list_t *list = libvlc_media_subitems (media);
+    assert (list != NULL);
+
+    unsigned files = 0;
+    libvlc_media_list_lock (list);
+    for (int i = 0; i < libvlc_media_list_count (list); ++i)
+    {
+        libvlc_media_t *m = libvlc_media_list_item_at_index (list, i);
+        if (libvlc_media_get_type (m) == libvlc_media_type_directory)
+        {
+            (*dirs)++;
+            files += count_subitems (m, dirs);
+        }
+        else
+            files++;
+        libvlc_media_release (m);
+    }
+    libvlc_media_list_unlock (list);
+    libvlc_media_list_release (list);
+    return files;
+}
+
+static void test_media_subitems_depth(libvlc_instance_t *vlc)
+{
+    static const char *const paths[] = {
+        "a", "a/b", "a/b/c", "top.mkv", "a/a.ts", "a/b/b.mp3", "a/b/c/c.mp3",
+    };
+    char root[] = "/tmp/vlc-subitems-XXXXXX";
+    char path[64];
+
+    test_log ("Testing media_subitems with subdirectories\n");
+    assert (mkdtemp (root) != NULL);
+    for (size_t i = 0; i < ARRAY_SIZE(paths); ++i)
+    {
+        snprintf (path, sizeof (path), "%s/%s", root, paths[i]);
+        if (strchr (paths[i], '.') == NULL)
+            assert (vlc_mkdir (path, 0700) == 0);
+        else
+        {
+            FILE *file = vlc_fopen (path, "w");
+            assert (file != NULL);
+            fclose (file);
+        }
+    }
+#ifndef _WIN32
+    /* a link back to the root is not listed again */
+    snprintf (path, sizeof (path), "%s/a/loop", root);
+    assert (symlink ("..", path) == 0);
+#endif
+
+    libvlc_media_t *media = libvlc_media_new_path (vlc, root);
+    assert (media != NULL);
+    libvlc_media_add_option (media, ":ignore-filetypes= ");
+    libvlc_media_add_option (media, ":directory-depth=2");
+    libvlc_media_add_option (media, ":directory-threads=3");
+
+    vlc_sem_t sem;
+    vlc_sem_init (&sem, 0);
+    libvlc_event_manager_t *em = libvlc_media_event_manager (media);
+    libvlc_event_attach (em, libvlc_MediaParsedChanged, subitem_parse_ended, &sem);
+    assert (libvlc_media_parse_with_options (media, libvlc_media_parse_local,
+                                             -1) == 0);
+    vlc_sem_wait (&sem);
+
+    /* "a" and "a/b" listed with the root, "a/b/c" left to expand */
+    unsigned dirs = 0;
+    assert (count_subitems (media, &dirs) == 3);
+    assert (dirs == 3);
+    libvlc_media_release (media);
+
+#ifndef _WIN32
+    snprintf (path, sizeof (path), "%s/a/loop", root);
+    vlc_unlink (path);
+#endif
+    for (size_t i = ARRAY_SIZE(paths); i-- > 0;)
+    {
+        snprintf (path, sizeof (path), "%s/%s", root, paths[i]);
+        if (strchr (paths[i], '.') == NULL)
+            rmdir (path);
+        else
+            vlc_unlink (path);
+    }
+    rmdir (root);
+}
+
 int main(int i_argc, char *ppsz_argv[])
 {
     test_init();
@@ -380,6 +519,7 @@ int main(int i_argc, char *ppsz_argv[])
                           libvlc_media_parse_local,
                           libvlc_media_parsed_status_skipped);
     test_media_subitems (vlc);
+    test_media_subitems_depth (vlc);
 
     /* Testing libvlc_MetadataRequest timeout and libvlc_MetadataCancel. For
      * that, we need to create a local input_item_t based on a pipe. There is
@@ -391,5 +531,22 @@ int main(int i_argc, char *ppsz_argv[])
 
     libvlc_release (vlc);
 
+    /* Local files probed without input thread, directories still need one */
+    static const char *fast_args[] = {
+        "-v", "--vout=vdummy", "--aout=adummy", "--text-renderer=tdummy",
+        "--preparse-fast",
+    };
+    vlc = libvlc_new (ARRAY_SIZE(fast_args), fast_args);
+    assert (vlc != NULL);
+
+    test_media_preparsed (vlc, SRCDIR"/samples/image.jpg", NULL,
+                          libvlc_media_parse_local,
+                          libvlc_media_parsed_status_done);
+    /* an image lasts 10 seconds by default (--image-duration) */
+    test_media_probed (vlc, SRCDIR"/samples/image.jpg", 10000, 0, 1);
+    test_media_subitems (vlc);
+
+    libvlc_release (vlc);
+
     return 0;
 }
@@ -0,0 +1,124 @@
+/*****************************************************************************
+ * file.c: file output tests
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../../libvlc/test.h"
+#include "../../../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_sout.h>
+#include <vlc_block.h>
+#include <vlc_fs.h>
+
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ASSERT(a) do {\
+    if(!(a)) { \
+        fprintf(stderr, "failed line %d\n", __LINE__); \
+        return 1; } \
+    } while(0)
+
+#define SIZE (3 * 1024 * 1024 + 17)
+
+static char path[] = "/tmp/vlc-file-XXXXXX";
+
+static uint8_t Pattern(size_t i)
+{
+    return i * 7 + (i >> 12);
+}
+
+/* Moves the data as the MP4 muxer does for fast start files */
+static int TestCopyRange(libvlc_instance_t *vlc, uint64_t shift)
+{
+    sout_access_out_t *access =
+        sout_AccessOutNew(vlc->p_libvlc_int, "file{overwrite}", path);
+    ASSERT(access != NULL);
+
+    block_t *block = block_Alloc(SIZE);
+    ASSERT(block != NULL);
+    for (size_t i = 0; i < SIZE; i++)
+        block->p_buffer[i] = Pattern(i);
+    ASSERT(sout_AccessOutWrite(access, block) == SIZE);
+
+    /* towards the end, then back */
+    ASSERT(sout_AccessOutControl(access, ACCESS_OUT_COPY_RANGE,
+                                 (uint64_t)0, shift,
+                                 (uint64_t)SIZE) == VLC_SUCCESS);
+    sout_AccessOutSeek(access, 0);
+    block = block_Alloc(SIZE);
+    ASSERT(block != NULL);
+    ASSERT(sout_AccessOutRead(access, block) == SIZE);
+    ASSERT(sout_AccessOutRead(access, block) == (ssize_t)shift);
+    sout_AccessOutSeek(access, shift);
+    ASSERT(sout_AccessOutRead(access, block) == SIZE);
+    for (size_t i = 0; i < SIZE; i++)
+        ASSERT(block->p_buffer[i] == Pattern(i));
+
+    ASSERT(sout_AccessOutControl(access, ACCESS_OUT_COPY_RANGE,
+                                 shift, (uint64_t)0,
+                                 (uint64_t)SIZE) == VLC_SUCCESS);
+    sout_AccessOutSeek(access, 0);
+    ASSERT(sout_AccessOutRead(access, block) == SIZE);
+    for (size_t i = 0; i < SIZE; i++)
+        ASSERT(block->p_buffer[i] == Pattern(i));
+
+    block_Release(block);
+    sout_AccessOutDelete(access);
+    return 0;
+}
+
+int main(void)
+{
+    test_init();
+
+    static const char *argv[] = { "-v", "--ignore-config" };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+
+    int fd = vlc_mkstemp(path);
+    assert(fd != -1);
+    vlc_close(fd);
+
+    sout_access_out_t *access =
+        sout_AccessOutNew(vlc->p_libvlc_int, "file{overwrite}", path);
+    if (access == NULL
+     || sout_AccessOutControl(access, ACCESS_OUT_COPY_RANGE, (uint64_t)0,
+                              (uint64_t)0, (uint64_t)0) != VLC_SUCCESS)
+    {
+        if (access != NULL)
+            sout_AccessOutDelete(access);
+        unlink(path);
+        libvlc_release(vlc);
+        return 77; /* not supported */
+    }
+    sout_AccessOutDelete(access);
+
+    int ret = TestCopyRange(vlc, 8) || TestCopyRange(vlc, 100)
+           || TestCopyRange(vlc, 2 * 1024 * 1024);
+
+    unlink(path);
+    libvlc_release(vlc);
+    return ret;
+}
@@ -0,0 +1,301 @@
+/*****************************************************************************
+ * livehttp.c: HTTP Live Streaming segmenter output tests
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../../libvlc/test.h"
+#include "../../../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_sout.h>
+#include <vlc_block.h>
+#include <vlc_fs.h>
+
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ASSERT(a) do {\
+    if(!(a)) { \
+        fprintf(stderr, "failed line %d\n", __LINE__); \
+        return 1; } \
+    } while(0)
+
+static char dir[] = "/tmp/vlc-livehttp-XXXXXX";
+
+static int Output(libvlc_instance_t *vlc, const char *options, const char *name,
+                  sout_access_out_t **access)
+{
+    char *cfg, *path;
+
+    if (asprintf(&cfg, "livehttp{seglen=1,delsegs=false,index=%s/index.m3u8%s}",
+                 dir, options) < 0)
+        return -1;
+    if (asprintf(&path, "%s/%s", dir, name) < 0)
+    {
+        free(cfg);
+        return -1;
+    }
+    *access = sout_AccessOutNew(vlc->p_libvlc_int, cfg, path);
+    free(path);
+    free(cfg);
+    return *access != NULL ? 0 : -1;
+}
+
+static block_t *Block(size_t size, vlc_tick_t length, uint32_t flags)
+{
+    block_t *block = block_Alloc(size);
+    assert(block != NULL);
+    memset(block->p_buffer, 0x47, size);
+    block->i_length = length;
+    block->i_flags = flags;
+    return block;
+}
+
+static char *Load(const char *name, size_t *size)
+{
+    char *path, *data = NULL;
+    struct stat st;
+
+    if (asprintf(&path, "%s/%s", dir, name) < 0)
+        return NULL;
+    FILE *stream = vlc_fopen(path, "rb");
+    free(path);
+    if (stream == NULL)
+        return NULL;
+    if (fstat(fileno(stream), &st) == 0 && (data = malloc(st.st_size + 1)))
+    {
+        *size = fread(data, 1, st.st_size, stream);
+        data[*size] = '\0';
+    }
+    fclose(stream);
+    return data;
+}
+
+static unsigned Count(const char *text, const char *pattern)
+{
+    unsigned count = 0;
+    for (const char *p = strstr(text, pattern); p; p = strstr(p + 1, pattern))
+        count++;
+    return count;
+}
+
+/* Removes everything, telling whether temporary files were left behind */
+static unsigned Clean(void)
+{
+    unsigned leftovers = 0;
+    DIR *d = opendir(dir);
+    struct dirent *ent;
+
+    assert(d != NULL);
+    while ((ent = readdir(d)) != NULL)
+    {
+        char *path;
+
+        if (ent->d_name[0] == '.')
+            continue;
+        if (strstr(ent->d_name, ".tmp"))
+            leftovers++;
+        if (asprintf(&path, "%s/%s", dir, ent->d_name) >= 0)
+        {
+            unlink(path);
+            free(path);
+        }
+    }
+    closedir(d);
+    return leftovers;
+}
+
+/* MPEG-TS like: headers every 500ms, 1s segments */
+static int TestSegments(libvlc_instance_t *vlc)
+{
+    sout_access_out_t *access;
+    size_t total = 0, size;
+
+    ASSERT(Output(vlc, "", "seg-###.ts", &access) == 0);
+    for (unsigned i = 0; i < 50; i++)
+    {
+        block_t *block = Block(188 * 7, VLC_TICK_FROM_MS(100),
+                               (i % 5) ? 0 : BLOCK_FLAG_HEADER);
+        total += block->i_buffer;
+        ASSERT(sout_AccessOutWrite(access, block) >= 0);
+    }
+    sout_AccessOutDelete(access);
+
+    char *index = Load("index.m3u8", &size);
+    ASSERT(index != NULL);
+    ASSERT(!strncmp(index, "#EXTM3U\n", 8));
+    ASSERT(strstr(index, "#EXT-X-VERSION:3\n"));
+    ASSERT(strstr(index, "#EXT-X-ENDLIST\n"));
+    ASSERT(!strstr(index, "#EXT-X-MAP"));
+
+    unsigned segments = Count(index, "#EXTINF:");
+    ASSERT(segments >= 4);
+    free(index);
+
+    /* every byte ends up in a listed segment, in order */
+    size_t written = 0;
+    for (unsigned i = 1; i <= segments; i++)
+    {
+        char name[16];
+        snprintf(name, sizeof (name), "seg-%03u.ts", i);
+        char *data = Load(name, &size);
+        ASSERT(data != NULL);
+        written += size;
+        free(data);
+    }
+    ASSERT(written == total);
+    ASSERT(Clean() == 0);
+    return 0;
+}
+
+/* A segment that cannot be written is listed as a gap, never as a file */
+static int TestFailedSegment(libvlc_instance_t *vlc)
+{
+    sout_access_out_t *access;
+    char *path;
+    size_t size;
+
+    /* the writer cannot create the temporary file of the 3rd segment */
+    ASSERT(asprintf(&path, "%s/seg-003.ts.tmp", dir) >= 0);
+    ASSERT(vlc_mkdir(path, 0700) == 0);
+
+    ASSERT(Output(vlc, "", "seg-###.ts", &access) == 0);
+    for (unsigned i = 0; i < 50; i++)
+        ASSERT(sout_AccessOutWrite(access, Block(188 * 7, VLC_TICK_FROM_MS(100),
+                                   (i % 5) ? 0 : BLOCK_FLAG_HEADER)) >= 0);
+    sout_AccessOutDelete(access);
+
+    rmdir(path);
+    free(path);
+
+    char *index = Load("index.m3u8", &size);
+    ASSERT(index != NULL);
+    ASSERT(strstr(index, "#EXT-X-ENDLIST\n"));
+    ASSERT(Count(index, "#EXT-X-GAP\n") == 1);
+    ASSERT(Count(index, "#EXTINF:") >= 4);
+
+    /* every other listed segment is there */
+    bool gap = false;
+    unsigned listed = 0;
+    for (char *line = strtok(index, "\n"); line; line = strtok(NULL, "\n"))
+    {
+        if (!strcmp(line, "#EXT-X-GAP"))
+            gap = true;
+        else if (line[0] != '#')
+        {
+            const char *name = strrchr(line, '/');
+            name = name ? name + 1 : line;
+            char *data = Load(name, &size);
+            if (gap)
+                ASSERT(data == NULL && !strcmp(name, "seg-003.ts"));
+            else
+                ASSERT(data != NULL);
+            free(data);
+            gap = false;
+            listed++;
+        }
+    }
+    free(index);
+    ASSERT(listed >= 4);
+
+    ASSERT(Clean() == 0);
+    return 0;
+}
+
+/* Fragmented MP4: init section, 200ms fragments, 1s segments, 300ms parts */
+static int TestFragments(libvlc_instance_t *vlc)
+{
+    static const uint8_t ftyp[] = { 0, 0, 0, 16, 'f', 't', 'y', 'p',
+                                    'i', 's', 'o', '6', 0, 0, 0, 0 };
+    sout_access_out_t *access;
+    size_t size;
+
+    ASSERT(Output(vlc, ",part-length=300", "seg-###.m4s", &access) == 0);
+
+    block_t *init = Block(sizeof (ftyp), 0, BLOCK_FLAG_HEADER);
+    memcpy(init->p_buffer, ftyp, sizeof (ftyp));
+    ASSERT(sout_AccessOutWrite(access, init) >= 0);
+
+    for (unsigned i = 0; i < 20; i++)
+    {
+        ASSERT(sout_AccessOutWrite(access, Block(64, VLC_TICK_FROM_MS(200),
+                                                 BLOCK_FLAG_TYPE_I)) >= 0);
+        ASSERT(sout_AccessOutWrite(access, Block(4096, 0, 0)) >= 0);
+    }
+    sout_AccessOutDelete(access);
+
+    char *data = Load("seg-init.m4s", &size);
+    ASSERT(data != NULL && size == sizeof (ftyp));
+    ASSERT(!memcmp(data, ftyp, size));
+    free(data);
+
+    char *index = Load("index.m3u8", &size);
+    ASSERT(index != NULL);
+    ASSERT(strstr(index, "#EXT-X-VERSION:6\n"));
+    ASSERT(strstr(index, "#EXT-X-PART-INF:PART-TARGET=0.300\n"));
+    ASSERT(strstr(index, "seg-init.m4s\"\n"));
+    ASSERT(Count(index, "#EXT-X-PART:") > 0);
+    ASSERT(Count(index, "#EXTINF:") >= 3);
+    free(index);
+
+    /* segments start on a fragment, parts too */
+    data = Load("seg-001.m4s", &size);
+    ASSERT(data != NULL && size % (64 + 4096) == 0);
+    free(data);
+    data = Load("seg-001.m4s.part0", &size);
+    ASSERT(data != NULL && size % (64 + 4096) == 0);
+    free(data);
+
+    ASSERT(Clean() == 0);
+    return 0;
+}
+
+int main(void)
+{
+    test_init();
+
+    static const char *argv[] = { "-v", "--ignore-config" };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+
+    ASSERT(mkdtemp(dir) != NULL);
+
+    sout_access_out_t *access;
+    if (Output(vlc, "", "probe", &access))
+    {
+        rmdir(dir);
+        libvlc_release(vlc);
+        return 77; /* module not built */
+    }
+    sout_AccessOutDelete(access);
+    Clean();
+
+    int ret = TestSegments(vlc) || TestFailedSegment(vlc) ||
+              TestFragments(vlc);
+
+    Clean();
+    rmdir(dir);
+    libvlc_release(vlc);
+    return ret;
+}
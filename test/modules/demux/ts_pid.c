@@ -0,0 +1,231 @@
+/*****************************************************************************
+ * ts_pid.c: MPEG TS PID table tests and lookup benchmark
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+
+#include "../../../modules/demux/mpeg/ts_pid.h"
+
+#include "../../libvlc/test.h"
+
+/* PSI/SI storage is not exercised here */
+ts_pat_t *ts_pat_New( demux_t *p ) { VLC_UNUSED(p); return NULL; }
+void ts_pat_Del( demux_t *p, ts_pat_t *t ) { VLC_UNUSED(p); VLC_UNUSED(t); }
+ts_pmt_t *ts_pmt_New( demux_t *p ) { VLC_UNUSED(p); return NULL; }
+void ts_pmt_Del( demux_t *p, ts_pmt_t *t ) { VLC_UNUSED(p); VLC_UNUSED(t); }
+ts_stream_t *ts_stream_New( demux_t *p, ts_pmt_t *t ) { VLC_UNUSED(p); VLC_UNUSED(t); return NULL; }
+void ts_stream_Del( demux_t *p, ts_stream_t *t ) { VLC_UNUSED(p); VLC_UNUSED(t); }
+ts_si_t *ts_si_New( demux_t *p ) { VLC_UNUSED(p); return NULL; }
+void ts_si_Del( demux_t *p, ts_si_t *t ) { VLC_UNUSED(p); VLC_UNUSED(t); }
+ts_psip_t *ts_psip_New( demux_t *p ) { VLC_UNUSED(p); return NULL; }
+void ts_psip_Del( demux_t *p, ts_psip_t *t ) { VLC_UNUSED(p); VLC_UNUSED(t); }
+
+#define ASSERT(a) do {\
+    if(!(a)) { \
+        fprintf(stderr, "failed line %d\n", __LINE__); \
+        return 1; } \
+    } while(0)
+
+/* Full transponder: 24 programs with PMT, video, 3 audio and teletext,
+ * plus PAT, SI and stuffing. Repeats give rough packet shares.
+ * Set TS_PID_BENCHMARK to time the lookups on a large capture. */
+#define PROGRAMS       24
+#define PACKETS        (64 * 1000)
+#define BENCH_PACKETS  (4 * 1000 * 1000)
+
+static void BuildCapture(uint16_t *pids, size_t count)
+{
+    uint16_t table[1024];
+    size_t entries = 0;
+
+    for(int i=0; i<4; i++)
+        table[entries++] = 0x1FFF; /* stuffing */
+    table[entries++] = 0x00;
+    table[entries++] = 0x11;
+    table[entries++] = 0x12;
+
+    for(int p=0; p<PROGRAMS; p++)
+    {
+        const uint16_t base = 0x100 + p * 0x40;
+        table[entries++] = base; /* pmt */
+        for(int i=0; i<24; i++)
+            table[entries++] = base + 1; /* video */
+        for(int a=0; a<3; a++)
+            table[entries++] = base + 2 + a; /* audio */
+        table[entries++] = base + 5; /* teletext */
+    }
+
+    uint64_t seed = 0x2545F4914F6CDD1D;
+    for(size_t i=0; i<count; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        pids[i] = table[seed % entries];
+    }
+}
+
+static int CheckTable(void)
+{
+    ts_pid_list_t *list = malloc(sizeof(*list));
+    ASSERT(list);
+    ts_pid_list_Init(list);
+
+    ASSERT(ts_pid_Get(list, 0) == &list->pat);
+    ASSERT(ts_pid_Get(list, 0x1FFB) == &list->base_si);
+    ASSERT(ts_pid_Get(list, 0x1FFF) == &list->dummy);
+    ASSERT(SEEN(ts_pid_Get(list, 0x1FFF)));
+
+    static const uint16_t order[] = { 0x300, 0x20, 0x1FFE, 0x100, 0x21, 0x1000, 0x1F };
+    ts_pid_t *created[ARRAY_SIZE(order)];
+    for(size_t i=0; i<ARRAY_SIZE(order); i++)
+    {
+        created[i] = ts_pid_Get(list, order[i]);
+        ASSERT(created[i] && created[i]->i_pid == order[i]);
+        ASSERT(created[i]->i_cc == 0xff);
+        ASSERT(created[i]->type == TYPE_FREE);
+    }
+    /* stable on lookup */
+    for(size_t i=0; i<ARRAY_SIZE(order); i++)
+        ASSERT(ts_pid_Get(list, order[i]) == created[i]);
+    ASSERT((size_t)list->i_all == ARRAY_SIZE(order));
+
+    /* iteration is sorted and only covers non common pids */
+    ts_pid_next_context_t ctx = ts_pid_NextContextInitValue;
+    ts_pid_t *pid;
+    size_t count = 0;
+    uint16_t prev = 0;
+    while((pid = ts_pid_Next(list, &ctx)))
+    {
+        ASSERT(pid->i_pid > prev);
+        prev = pid->i_pid;
+        count++;
+    }
+    ASSERT(count == ARRAY_SIZE(order));
+
+    ts_pid_list_Release(NULL, list);
+    free(list);
+    return 0;
+}
+
+/* Previous implementation: sorted array, bsearch and last used cache */
+struct legacy_list
+{
+    ts_pid_t **pp_all;
+    int i_all;
+    uint16_t i_last_pid;
+    ts_pid_t *p_last;
+};
+
+static int LegacyCompare(const void *key, const void *other)
+{
+    const uint16_t i_pid = *(const uint16_t *)key;
+    const ts_pid_t *p_pid = *(ts_pid_t *const *)other;
+    return (int)i_pid - (int)p_pid->i_pid;
+}
+
+static ts_pid_t * LegacyGet(struct legacy_list *list, uint16_t i_pid)
+{
+    if(list->i_last_pid == i_pid)
+        return list->p_last;
+    ts_pid_t **pp = bsearch(&i_pid, list->pp_all, list->i_all,
+                            sizeof(ts_pid_t *), LegacyCompare);
+    if(!pp)
+        return NULL;
+    list->i_last_pid = i_pid;
+    list->p_last = *pp;
+    return *pp;
+}
+
+static double Rate(size_t packets, vlc_tick_t duration)
+{
+    return (double) packets / secf_from_vlc_tick(duration ? duration : 1) / 1000000.0;
+}
+
+static int Benchmark(size_t packets)
+{
+    uint16_t *pids = malloc(packets * sizeof(*pids));
+    ts_pid_list_t *list = malloc(sizeof(*list));
+    ASSERT(pids && list);
+    BuildCapture(pids, packets);
+
+    ts_pid_list_Init(list);
+    for(size_t i=0; i<packets; i++)
+        ts_pid_Get(list, pids[i]);
+
+    struct legacy_list legacy = {
+        .pp_all = list->pp_all,
+        .i_all = list->i_all,
+        .i_last_pid = 0,
+        .p_last = NULL,
+    };
+
+    /* both find the same pids */
+    for(size_t i=0; i<packets; i++)
+    {
+        uint16_t i_pid = pids[i];
+        if(i_pid != 0 && i_pid != 0x1FFF && i_pid != 0x1FFB)
+            ASSERT(LegacyGet(&legacy, i_pid) == ts_pid_Get(list, i_pid));
+    }
+
+    /* mimic the per packet continuity update of the demuxer */
+    unsigned sum = 0;
+    vlc_tick_t start = vlc_tick_now();
+    for(size_t i=0; i<packets; i++)
+    {
+        ts_pid_t *pid = (pids[i] == 0 || pids[i] == 0x1FFF || pids[i] == 0x1FFB)
+                      ? ts_pid_Get(list, pids[i]) : LegacyGet(&legacy, pids[i]);
+        pid->i_cc = (pid->i_cc + 1) & 0x0f;
+        sum += pid->i_cc;
+    }
+    vlc_tick_t legacytime = vlc_tick_now() - start;
+
+    start = vlc_tick_now();
+    for(size_t i=0; i<packets; i++)
+    {
+        ts_pid_t *pid = ts_pid_Get(list, pids[i]);
+        pid->i_cc = (pid->i_cc + 1) & 0x0f;
+        sum += pid->i_cc;
+    }
+    vlc_tick_t tabletime = vlc_tick_now() - start;
+
+    fprintf(stderr, "%d pids, %d programs, %zu packets (checksum %u)\n",
+            list->i_all + 3, PROGRAMS, packets, sum);
+    fprintf(stderr, "  bsearch lookup: %8.2f Mpkt/s\n", Rate(packets, legacytime));
+    fprintf(stderr, "  table lookup:   %8.2f Mpkt/s\n", Rate(packets, tabletime));
+
+    ts_pid_list_Release(NULL, list);
+    free(list);
+    free(pids);
+    return 0;
+}
+
+int main(void)
+{
+    test_init();
+
+    if(CheckTable())
+        return 1;
+
+    return Benchmark(getenv("TS_PID_BENCHMARK") ? BENCH_PACKETS : PACKETS);
+}
@@ -0,0 +1,403 @@
+/*****************************************************************************
+ * ts_threads.c: MPEG TS demux program output threads tests
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../../libvlc/test.h"
+#include "../../../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_demux.h>
+#include <vlc_es_out.h>
+#include <vlc_block.h>
+
+#define ASSERT(a) do {\
+    if(!(a)) { \
+        fprintf(stderr, "failed line %d\n", __LINE__); \
+        return 1; } \
+    } while(0)
+
+/* Several programs, so that the output threads run concurrently */
+#define PROGRAMS    4
+#define STREAMS     2   /* per program, the first one carrying the PCR */
+#define FRAMES      200
+#define FRAME_SIZE  700
+#define TS_SIZE     188
+
+#define PMT_PID(p)      (0x100 + (p) * 0x10)
+#define ES_PID(p, s)    (PMT_PID(p) + 1 + (s))
+
+static uint8_t Pattern(unsigned pid, unsigned frame, size_t i)
+{
+    return pid + frame * 7 + i;
+}
+
+/*
+ * Stream generation
+ */
+struct ts_writer
+{
+    uint8_t *buf;
+    size_t   size;
+    uint8_t  cc[0x2000];
+};
+
+static uint32_t Crc32(const uint8_t *p, size_t size)
+{
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= (uint32_t) p[i] << 24;
+        for (int j = 0; j < 8; j++)
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+    }
+    return crc;
+}
+
+/* Writes one packet, returns the number of payload bytes consumed */
+static size_t WritePacket(struct ts_writer *w, uint16_t pid, bool unit_start,
+                          int64_t pcr, const uint8_t *data, size_t size)
+{
+    uint8_t *p = &w->buf[w->size];
+    size_t payload = __MIN(size, (size_t)(TS_SIZE - 4 - (pcr >= 0 ? 8 : 0)));
+    size_t adaptation = TS_SIZE - 4 - payload;
+
+    p[0] = 0x47;
+    p[1] = (unit_start ? 0x40 : 0x00) | (pid >> 8);
+    p[2] = pid;
+    p[3] = (adaptation ? 0x30 : 0x10) | (w->cc[pid]++ & 0x0f);
+
+    if (adaptation > 0)
+    {
+        p[4] = adaptation - 1;
+        memset(&p[5], 0xff, adaptation - 1);
+        if (adaptation > 1)
+            p[5] = 0x00;
+        if (pcr >= 0)
+        {
+            p[5] = 0x10;
+            p[6] = pcr >> 25;
+            p[7] = pcr >> 17;
+            p[8] = pcr >> 9;
+            p[9] = pcr >> 1;
+            p[10] = ((pcr & 1) << 7) | 0x7e;
+            p[11] = 0x00;
+        }
+    }
+    memcpy(&p[4 + adaptation], data, payload);
+    w->size += TS_SIZE;
+    return payload;
+}
+
+static void WriteSection(struct ts_writer *w, uint16_t pid,
+                         uint8_t *section, size_t size)
+{
+    /* section_length covers everything after it, CRC included */
+    section[1] = 0xb0 | ((size + 4 - 3) >> 8);
+    section[2] = size + 4 - 3;
+    uint32_t crc = Crc32(section, size);
+    SetDWBE(&section[size], crc);
+
+    uint8_t data[TS_SIZE];
+    data[0] = 0x00; /* pointer field */
+    memcpy(&data[1], section, size + 4);
+    WritePacket(w, pid, true, -1, data, size + 5);
+}
+
+static void WritePSI(struct ts_writer *w)
+{
+    uint8_t pat[TS_SIZE] = { 0x00, 0, 0, 0x00, 0x01, 0xc1, 0x00, 0x00 };
+    size_t size = 8;
+    for (unsigned p = 0; p < PROGRAMS; p++)
+    {
+        SetWBE(&pat[size], p + 1);
+        SetWBE(&pat[size + 2], 0xe000 | PMT_PID(p));
+        size += 4;
+    }
+    WriteSection(w, 0x00, pat, size);
+
+    for (unsigned p = 0; p < PROGRAMS; p++)
+    {
+        uint8_t pmt[TS_SIZE] = { 0x02, 0, 0, 0, 0, 0xc1, 0x00, 0x00 };
+        SetWBE(&pmt[3], p + 1);
+        SetWBE(&pmt[8], 0xe000 | ES_PID(p, 0));
+        SetWBE(&pmt[10], 0xf000);
+        size = 12;
+        for (unsigned s = 0; s < STREAMS; s++)
+        {
+            pmt[size] = 0x03; /* MPEG audio */
+            SetWBE(&pmt[size + 1], 0xe000 | ES_PID(p, s));
+            SetWBE(&pmt[size + 3], 0xf000);
+            size += 5;
+        }
+        WriteSection(w, PMT_PID(p), pmt, size);
+    }
+}
+
+static void WritePES(struct ts_writer *w, uint16_t pid, unsigned stream,
+                     unsigned frame, bool pcr)
+{
+    uint8_t pes[14 + FRAME_SIZE];
+    int64_t pts = 90000 + frame * 3600;
+
+    SetDWBE(&pes[0], 0x000001c0 + stream);
+    SetWBE(&pes[4], 8 + FRAME_SIZE);
+    pes[6] = 0x80;
+    pes[7] = 0x80; /* PTS only */
+    pes[8] = 5;
+    pes[9] = 0x21 | ((pts >> 29) & 0x0e);
+    SetWBE(&pes[10], ((pts >> 14) & 0xfffe) | 1);
+    SetWBE(&pes[12], ((pts << 1) & 0xfffe) | 1);
+    for (size_t i = 0; i < FRAME_SIZE; i++)
+        pes[14 + i] = Pattern(pid, frame, i);
+
+    size_t done = WritePacket(w, pid, true, pcr ? pts - 9000 : -1,
+                              pes, sizeof(pes));
+    while (done < sizeof(pes))
+        done += WritePacket(w, pid, false, -1, &pes[done], sizeof(pes) - done);
+}
+
+static uint8_t *Generate(size_t *size)
+{
+    /* at most 5 packets per PES, PSI every 10 frames */
+    size_t packets = FRAMES * PROGRAMS * STREAMS * 5
+                   + (FRAMES / 10 + 1) * (PROGRAMS + 1);
+    struct ts_writer *w = calloc(1, sizeof(*w));
+    if (w == NULL)
+        return NULL;
+    w->buf = malloc(packets * TS_SIZE);
+    if (w->buf == NULL)
+    {
+        free(w);
+        return NULL;
+    }
+
+    for (unsigned f = 0; f < FRAMES; f++)
+    {
+        if (f % 10 == 0)
+            WritePSI(w);
+        for (unsigned p = 0; p < PROGRAMS; p++)
+            for (unsigned s = 0; s < STREAMS; s++)
+                WritePES(w, ES_PID(p, s), s, f, s == 0);
+    }
+
+    uint8_t *buf = w->buf;
+    *size = w->size;
+    free(w);
+    return buf;
+}
+
+/*
+ * Capture of the ES output, called from the program output threads
+ */
+struct es_out_id_t
+{
+    int pid;
+    unsigned blocks;
+    size_t bytes;
+    uint32_t hash;
+    vlc_tick_t last_pts;
+    bool unordered;
+};
+
+struct capture
+{
+    es_out_t out;
+    vlc_mutex_t lock;
+    struct es_out_id_t *ids[PROGRAMS * STREAMS];
+    unsigned count;
+};
+
+static es_out_id_t *CaptureAdd(es_out_t *out, input_source_t *in,
+                               const es_format_t *fmt)
+{
+    struct capture *c = container_of(out, struct capture, out);
+    VLC_UNUSED(in);
+
+    es_out_id_t *id = calloc(1, sizeof(*id));
+    if (id == NULL)
+        return NULL;
+    id->pid = fmt->i_id;
+    id->hash = 2166136261u;
+    id->last_pts = VLC_TICK_INVALID;
+
+    vlc_mutex_lock(&c->lock);
+    if (c->count < ARRAY_SIZE(c->ids))
+        c->ids[c->count++] = id;
+    else
+        id->pid = -1;
+    vlc_mutex_unlock(&c->lock);
+    return id;
+}
+
+static int CaptureSend(es_out_t *out, es_out_id_t *id, block_t *block)
+{
+    struct capture *c = container_of(out, struct capture, out);
+
+    vlc_mutex_lock(&c->lock);
+    id->blocks++;
+    id->bytes += block->i_buffer;
+    for (size_t i = 0; i < block->i_buffer; i++)
+        id->hash = (id->hash ^ block->p_buffer[i]) * 16777619u;
+    if (block->i_pts != VLC_TICK_INVALID)
+    {
+        if (id->last_pts != VLC_TICK_INVALID && block->i_pts <= id->last_pts)
+            id->unordered = true;
+        id->last_pts = block->i_pts;
+    }
+    vlc_mutex_unlock(&c->lock);
+
+    block_Release(block);
+    return VLC_SUCCESS;
+}
+
+static void CaptureDel(es_out_t *out, es_out_id_t *id)
+{
+    VLC_UNUSED(out);
+    if (id->pid == -1)
+        free(id); /* not recorded */
+}
+
+static int CaptureControl(es_out_t *out, input_source_t *in, int query,
+                          va_list args)
+{
+    VLC_UNUSED(out); VLC_UNUSED(in);
+
+    switch (query)
+    {
+        case ES_OUT_GET_ES_STATE:
+            (void) va_arg(args, es_out_id_t *);
+            *va_arg(args, bool *) = true;
+            return VLC_SUCCESS;
+        case ES_OUT_GET_EMPTY:
+            *va_arg(args, bool *) = true;
+            return VLC_SUCCESS;
+        case ES_OUT_SET_GROUP_PCR:
+        case ES_OUT_SET_ES_SCRAMBLED_STATE:
+        case ES_OUT_SET_GROUP_META:
+        case ES_OUT_SET_GROUP_EPG:
+        case ES_OUT_DEL_GROUP:
+        case ES_OUT_SET_ES_FMT:
+            return VLC_SUCCESS;
+        default:
+            return VLC_EGENERIC;
+    }
+}
+
+static void CaptureDestroy(es_out_t *out)
+{
+    VLC_UNUSED(out);
+}
+
+static const struct es_out_callbacks capture_cbs =
+{
+    .add = CaptureAdd,
+    .send = CaptureSend,
+    .del = CaptureDel,
+    .control = CaptureControl,
+    .destroy = CaptureDestroy,
+};
+
+static void CaptureClean(struct capture *c)
+{
+    for (unsigned i = 0; i < c->count; i++)
+        free(c->ids[i]);
+}
+
+static const struct es_out_id_t *CaptureFind(const struct capture *c, int pid)
+{
+    for (unsigned i = 0; i < c->count; i++)
+        if (c->ids[i]->pid == pid)
+            return c->ids[i];
+    return NULL;
+}
+
+static int Demux(libvlc_instance_t *vlc, const uint8_t *buf, size_t size,
+                 int threads, struct capture *c)
+{
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    var_SetInteger(obj, "ts-program-threads", threads);
+
+    c->out.cbs = &capture_cbs;
+    vlc_mutex_init(&c->lock);
+    c->count = 0;
+
+    stream_t *s = vlc_stream_MemoryNew(obj, (uint8_t *)buf, size, true);
+    ASSERT(s != NULL);
+
+    demux_t *demux = demux_New(obj, "ts", s, &c->out);
+    ASSERT(demux != NULL);
+    ASSERT(demux_Control(demux, DEMUX_SET_GROUP_ALL) == VLC_SUCCESS);
+
+    while (demux_Demux(demux) == VLC_DEMUXER_SUCCESS)
+    {
+        /* controls drain the output threads */
+        double position;
+        demux_Control(demux, DEMUX_GET_POSITION, &position);
+    }
+
+    demux_Delete(demux);
+    vlc_stream_Delete(s);
+    return 0;
+}
+
+int main(void)
+{
+    test_init();
+
+    static const char *argv[] = { "-v", "--ignore-config" };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+    var_Create(vlc->p_libvlc_int, "ts-program-threads", VLC_VAR_INTEGER);
+
+    size_t size;
+    uint8_t *buf = Generate(&size);
+    assert(buf != NULL);
+
+    /* The output threads must give the same ES as the input thread */
+    struct capture ref = { .count = 0 }, out = { .count = 0 };
+    int ret = Demux(vlc, buf, size, 0, &ref);
+    if (ret == 0)
+        ret = Demux(vlc, buf, size, 3, &out);
+
+    for (unsigned p = 0; ret == 0 && p < PROGRAMS; p++)
+        for (unsigned s = 0; s < STREAMS; s++)
+        {
+            const struct es_out_id_t *a = CaptureFind(&ref, ES_PID(p, s));
+            const struct es_out_id_t *b = CaptureFind(&out, ES_PID(p, s));
+            if (a == NULL || b == NULL || a->blocks < FRAMES / 2
+             || a->unordered || b->unordered || a->blocks != b->blocks
+             || a->bytes != b->bytes || a->hash != b->hash
+             || a->last_pts != b->last_pts)
+            {
+                fprintf(stderr, "pid %d differs\n", ES_PID(p, s));
+                ret = 1;
+            }
+        }
+
+    CaptureClean(&ref);
+    CaptureClean(&out);
+    free(buf);
+    libvlc_release(vlc);
+    return ret;
+}
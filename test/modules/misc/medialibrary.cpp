@@ -0,0 +1,202 @@
+/*****************************************************************************
+ * medialibrary.cpp: media library local directories cache tests
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors, VideoLAN and VideoLabs
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+#include <vlc_common.h>
+#include <vlc_fs.h>
+#include <vlc_url.h>
+
+#include "../../../modules/misc/medialibrary/fs/snapshot.h"
+#include "../../../modules/misc/medialibrary/fs/watcher.h"
+
+using namespace vlc::medialibrary;
+
+/* lib/libvlc_internal.h is C only */
+VLC_API libvlc_int_t *libvlc_InternalCreate(void);
+VLC_API int libvlc_InternalInit(libvlc_int_t *, int, const char *ppsz_argv[]);
+VLC_API void libvlc_InternalCleanup(libvlc_int_t *);
+VLC_API void libvlc_InternalDestroy(libvlc_int_t *);
+
+static char dir[] = "/tmp/vlc-ml-XXXXXX";
+
+static std::string Path(const char *name)
+{
+    return std::string(dir) + "/" + name;
+}
+
+static void CreateFile(const char *name, size_t size)
+{
+    FILE *file = vlc_fopen(Path(name).c_str(), "wb");
+    assert(file != nullptr);
+    for (size_t i = 0; i < size; i++)
+        fputc(i, file);
+    fclose(file);
+}
+
+static void TestCache(vlc_object_t *obj, const std::string &mrl)
+{
+    SnapshotCache cache(obj);
+
+    /* hidden files and ignored extensions are skipped, as by the access */
+    auto root = cache.get(mrl);
+    assert(root != nullptr);
+    assert(root->files.size() == 1);
+    assert(root->files[0].name == "a.mp3");
+    assert(root->files[0].mrl == mrl + "a.mp3");
+    assert(root->files[0].size == 100);
+    assert(root->dirs.size() == 1);
+    assert(root->dirs[0] == mrl + "sub");
+
+    auto sub = cache.get(mrl + "sub/");
+    assert(sub != nullptr);
+    assert(sub->files.size() == 1);
+    assert(sub->files[0].name == "b.mkv");
+    assert(cache.size() == 2);
+
+    /* an unreadable directory is not kept */
+    assert(cache.get(mrl + "none/") == nullptr);
+    assert(cache.size() == 2);
+
+    /* a removed subdirectory is forgotten once its parent is read again */
+    assert(vlc_unlink(Path("sub/b.mkv").c_str()) == 0);
+    assert(rmdir(Path("sub").c_str()) == 0);
+    root = cache.get(mrl);
+    assert(root != nullptr);
+    assert(root->dirs.empty());
+    assert(cache.size() == 1);
+
+    /* a watched listing is reused until invalidated */
+    cache.setWatched(mrl, true);
+    root = cache.get(mrl);
+    assert(root != nullptr);
+    CreateFile("c.mp3", 10);
+    assert(cache.get(mrl) == root);
+    cache.invalidate(mrl);
+    assert(cache.size() == 1);
+    root = cache.get(mrl);
+    assert(root != nullptr);
+    assert(root->files.size() == 2);
+
+    cache.remove(mrl);
+    assert(cache.size() == 0);
+}
+
+struct changes
+{
+    vlc::threads::mutex lock;
+    vlc::threads::semaphore sem;
+    std::unordered_set<std::string> mrls;
+};
+
+static std::unordered_set<std::string> WaitChanges(struct changes &changes)
+{
+    changes.sem.wait();
+    vlc::threads::mutex_locker locker(changes.lock);
+    auto mrls = std::move(changes.mrls);
+    changes.mrls.clear();
+    return mrls;
+}
+
+static void TestWatcher(vlc_object_t *obj, const std::string &mrl)
+{
+    SnapshotCache cache(obj);
+    struct changes changes;
+    DirectoryWatcher watcher(obj, cache,
+        [&changes](const std::unordered_set<std::string> &mrls) {
+            vlc::threads::mutex_locker locker(changes.lock);
+            changes.mrls = mrls;
+            changes.sem.post();
+        });
+
+    if (!watcher.start())
+        return; /* no change notifications here */
+
+    assert(vlc_mkdir(Path("sub").c_str(), 0700) == 0);
+    watcher.watch(mrl);
+    watcher.watch(mrl + "sub/");
+    auto root = cache.get(mrl);
+    assert(root != nullptr);
+    assert(cache.get(mrl) == root);
+    assert(cache.get(mrl + "sub/") != nullptr);
+    assert(cache.size() == 2);
+
+    /* a change invalidates the listing, then reports the directory */
+    CreateFile("d.mp3", 10);
+    auto mrls = WaitChanges(changes);
+    assert(mrls.size() == 1);
+    assert(mrls.count(mrl) == 1);
+    auto updated = cache.get(mrl);
+    assert(updated != nullptr && updated != root);
+    assert(updated->files.size() == root->files.size() + 1);
+
+    /* a removed directory is dropped from the cache */
+    assert(rmdir(Path("sub").c_str()) == 0);
+    mrls = WaitChanges(changes);
+    assert(mrls.count(mrl + "sub/") == 1);
+    assert(mrls.count(mrl) == 1);
+    assert(cache.size() == 1);
+
+    watcher.stop();
+}
+
+int main(void)
+{
+    alarm(10); /* make sure "make check" does not get stuck */
+
+    static const char *argv[] = { "-v", "--ignore-config" };
+    libvlc_int_t *vlc = libvlc_InternalCreate();
+    assert(vlc != nullptr);
+    assert(libvlc_InternalInit(vlc, ARRAY_SIZE(argv), argv) == VLC_SUCCESS);
+    vlc_object_t *obj = VLC_OBJECT(vlc);
+
+    assert(mkdtemp(dir) != nullptr);
+    char *uri = vlc_path2uri(dir, nullptr);
+    assert(uri != nullptr);
+    const std::string mrl = std::string(uri) + "/";
+    free(uri);
+
+    CreateFile("a.mp3", 100);
+    CreateFile(".hidden.mp3", 10);
+    CreateFile("a.nfo", 10);
+    assert(vlc_mkdir(Path("sub").c_str(), 0700) == 0);
+    CreateFile("sub/b.mkv", 10);
+
+    TestCache(obj, mrl);
+    TestWatcher(obj, mrl);
+
+    for (const char *name : { "a.mp3", ".hidden.mp3", "a.nfo", "c.mp3",
+                              "d.mp3" })
+        vlc_unlink(Path(name).c_str());
+    rmdir(dir);
+
+    libvlc_InternalCleanup(vlc);
+    libvlc_InternalDestroy(vlc);
+    return 0;
+}
@@ -0,0 +1,376 @@
+/*****************************************************************************
+ * mp4.c: MP4 muxer tests
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../../libvlc/test.h"
+#include "../../../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_sout.h>
+#include <vlc_block.h>
+#include <vlc_es.h>
+#include <vlc_fs.h>
+
+#define MODULE_NAME test_mp4
+#define MODULE_STRING "test_mp4"
+#undef __PLUGIN__
+#include <vlc_plugin.h>
+
+#include <string.h>
+#include <unistd.h>
+
+#define ASSERT(a) do {\
+    if(!(a)) { \
+        fprintf(stderr, "failed line %d\n", __LINE__); \
+        return 1; } \
+    } while(0)
+
+#define FRAMES      400
+#define FRAME_SIZE  1000
+
+static char path[] = "/tmp/vlc-mp4-XXXXXX";
+
+static uint8_t Pattern(unsigned frame, size_t i)
+{
+    return frame * 3 + i;
+}
+
+struct box
+{
+    char type[5];
+    uint64_t offset;
+    uint64_t size;
+};
+
+/*****************************************************************************
+ * Capture access output: keeps the blocks written by the muxer, as they come
+ *****************************************************************************/
+static block_t *captured;
+static block_t **captured_end = &captured;
+
+static ssize_t CaptureWrite(sout_access_out_t *access, block_t *chain)
+{
+    size_t len;
+
+    (void)access;
+    block_ChainProperties(chain, NULL, &len, NULL);
+    block_ChainLastAppend(&captured_end, chain);
+    return len;
+}
+
+static int OpenCapture(vlc_object_t *obj)
+{
+    sout_access_out_t *access = (sout_access_out_t *)obj;
+
+    access->pf_write = CaptureWrite;
+    return VLC_SUCCESS;
+}
+
+static void ReleaseCaptured(void)
+{
+    if (captured != NULL)
+        block_ChainRelease(captured);
+    captured = NULL;
+    captured_end = &captured;
+}
+
+vlc_module_begin()
+    set_description("mp4 test capture output")
+    set_capability("sout access", 0)
+    add_shortcut("test_mp4_capture")
+    set_callback(OpenCapture)
+vlc_module_end()
+
+/* Inject the test module as a static module */
+typedef int (*vlc_plugin_cb)(vlc_set_cb, void *);
+
+VLC_EXPORT vlc_plugin_cb vlc_static_modules[] = {
+    VLC_SYMBOL(vlc_entry), NULL
+};
+
+/* Muxes the test frames to the given access output */
+static int MuxTo(libvlc_instance_t *vlc, const char *access_name,
+                 const char *dst, const char *mux)
+{
+    sout_access_out_t *access =
+        sout_AccessOutNew(vlc->p_libvlc_int, access_name, dst);
+    ASSERT(access != NULL);
+    sout_mux_t *p_mux = sout_MuxNew(access, mux);
+    ASSERT(p_mux != NULL);
+
+    es_format_t fmt;
+    es_format_Init(&fmt, VIDEO_ES, VLC_CODEC_MP4V);
+    fmt.video.i_width = fmt.video.i_visible_width = 320;
+    fmt.video.i_height = fmt.video.i_visible_height = 240;
+    fmt.video.i_frame_rate = 25;
+    fmt.video.i_frame_rate_base = 1;
+    sout_input_t *input = sout_MuxAddStream(p_mux, &fmt);
+    ASSERT(input != NULL);
+
+    for (unsigned i = 0; i < FRAMES; i++)
+    {
+        block_t *block = block_Alloc(FRAME_SIZE);
+        ASSERT(block != NULL);
+        for (size_t j = 0; j < FRAME_SIZE; j++)
+            block->p_buffer[j] = Pattern(i, j);
+        block->i_dts = block->i_pts = VLC_TICK_0 + i * VLC_TICK_FROM_MS(40);
+        block->i_length = VLC_TICK_FROM_MS(40);
+        if (i % 25 == 0)
+            block->i_flags |= BLOCK_FLAG_TYPE_I;
+        sout_MuxSendBuffer(p_mux, input, block);
+    }
+
+    sout_MuxDeleteStream(p_mux, input);
+    sout_MuxDelete(p_mux);
+    sout_AccessOutDelete(access);
+    return 0;
+}
+
+/* Muxes the test frames to the temporary file */
+static int Mux(libvlc_instance_t *vlc, const char *mux)
+{
+    return MuxTo(vlc, "file{overwrite}", path, mux);
+}
+
+static const uint8_t *FindType(const uint8_t *data, size_t size,
+                              const char *type)
+{
+    for (size_t i = 4; i + 4 <= size; i++)
+        if (!memcmp(&data[i], type, 4))
+            return &data[i - 4];
+    return NULL;
+}
+
+/* Lists the top level boxes of the file, and checks the samples */
+static int ReadBoxes(struct box *boxes, size_t *count)
+{
+    FILE *file = vlc_fopen(path, "rb");
+    ASSERT(file != NULL);
+    ASSERT(fseek(file, 0, SEEK_END) == 0);
+    long size = ftell(file);
+    ASSERT(size > 0);
+    uint8_t *data = malloc(size);
+    ASSERT(data != NULL);
+    rewind(file);
+    ASSERT(fread(data, 1, size, file) == (size_t)size);
+    fclose(file);
+
+    size_t n = 0;
+    for (uint64_t offset = 0; offset < (uint64_t)size; n++)
+    {
+        ASSERT(n < *count);
+        ASSERT(offset + 8 <= (uint64_t)size);
+        boxes[n].offset = offset;
+        boxes[n].size = GetDWBE(&data[offset]);
+        memcpy(boxes[n].type, &data[offset + 4], 4);
+        boxes[n].type[4] = '\0';
+        ASSERT(boxes[n].size >= 8);
+        offset += boxes[n].size;
+        ASSERT(offset <= (uint64_t)size);
+    }
+    *count = n;
+
+    /* the chunk offset table must point to the samples, wherever moved */
+    const uint8_t *stco = FindType(data, size, "stco");
+    ASSERT(stco != NULL);
+    uint32_t chunks = GetDWBE(&stco[12]);
+    ASSERT(chunks > 0);
+    uint64_t chunk = GetDWBE(&stco[16]);
+    ASSERT(chunk + FRAME_SIZE <= (uint64_t)size);
+    for (size_t j = 0; j < FRAME_SIZE; j++)
+        ASSERT(data[chunk + j] == Pattern(0, j));
+
+    free(data);
+    return 0;
+}
+
+static int CheckLayout(const struct box *boxes, size_t count,
+                       const char *const *types)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        ASSERT(types[i] != NULL);
+        ASSERT(!strcmp(boxes[i].type, types[i]));
+    }
+    ASSERT(types[count] == NULL);
+    return 0;
+}
+
+static int TestMoovReserve(libvlc_instance_t *vlc)
+{
+    struct box boxes[8];
+    size_t count;
+
+    /* No reserve: moov at the end, or moved to the start */
+    ASSERT(Mux(vlc, "mp4") == 0);
+    count = ARRAY_SIZE(boxes);
+    ASSERT(ReadBoxes(boxes, &count) == 0);
+    ASSERT(CheckLayout(boxes, count, (const char *const[]){
+        "ftyp", "wide", "mdat", "moov", NULL }) == 0);
+    uint64_t moov_size = boxes[3].size;
+
+    ASSERT(Mux(vlc, "mp4{faststart}") == 0);
+    count = ARRAY_SIZE(boxes);
+    ASSERT(ReadBoxes(boxes, &count) == 0);
+    ASSERT(CheckLayout(boxes, count, (const char *const[]){
+        "ftyp", "moov", "wide", "mdat", NULL }) == 0);
+
+    /* Enough reserve: moov in place, followed by the remainder */
+    ASSERT(moov_size + 8 <= 4096);
+    ASSERT(Mux(vlc, "mp4{moov-reserve=4}") == 0);
+    count = ARRAY_SIZE(boxes);
+    ASSERT(ReadBoxes(boxes, &count) == 0);
+    ASSERT(CheckLayout(boxes, count, (const char *const[]){
+        "ftyp", "moov", "free", "wide", "mdat", NULL }) == 0);
+    ASSERT(boxes[1].size == moov_size);
+    ASSERT(boxes[1].size + boxes[2].size == 4096);
+
+    /* Too small a reserve: moov at the end, the reserve left free */
+    ASSERT(moov_size > 1024);
+    ASSERT(Mux(vlc, "mp4{moov-reserve=1}") == 0);
+    count = ARRAY_SIZE(boxes);
+    ASSERT(ReadBoxes(boxes, &count) == 0);
+    ASSERT(CheckLayout(boxes, count, (const char *const[]){
+        "ftyp", "free", "wide", "mdat", "moov", NULL }) == 0);
+    ASSERT(boxes[1].size == 1024);
+
+    /* or, with faststart, the data shifted by the missing space only */
+    ASSERT(Mux(vlc, "mp4{moov-reserve=1,faststart}") == 0);
+    count = ARRAY_SIZE(boxes);
+    ASSERT(ReadBoxes(boxes, &count) == 0);
+    ASSERT(CheckLayout(boxes, count, (const char *const[]){
+        "ftyp", "moov", "free", "wide", "mdat", NULL }) == 0);
+    ASSERT(boxes[1].size == moov_size);
+    ASSERT(boxes[2].size == 8);
+    return 0;
+}
+
+/* Returns the first frame of a fragment, from its decode time */
+static int GetMoofFrame(const block_t *moof, uint32_t timescale,
+                        unsigned *frame)
+{
+    const uint8_t *tfdt = FindType(moof->p_buffer, moof->i_buffer, "tfdt");
+    ASSERT(tfdt != NULL);
+    ASSERT(tfdt + 20 <= moof->p_buffer + moof->i_buffer);
+    uint64_t time = tfdt[8] == 1 ? GetQWBE(&tfdt[12]) : GetDWBE(&tfdt[12]);
+    ASSERT(time * 25 % timescale == 0);
+    *frame = time * 25 / timescale;
+    return 0;
+}
+
+/* Checks the fragments and their random access points flags */
+static int CheckFragments(bool chunked)
+{
+    bool cmfc = false;
+    uint32_t timescale = 0;
+    unsigned fragments = 0, keyframes = 0;
+
+    for (const block_t *b = captured; b != NULL; b = b->p_next)
+    {
+        if (b->i_buffer < 8)
+            continue;
+
+        if (!memcmp(&b->p_buffer[4], "ftyp", 4))
+        {
+            ASSERT(b->i_flags & BLOCK_FLAG_HEADER);
+            /* major brand, version, then the compatible brands */
+            for (size_t i = 16; i + 4 <= b->i_buffer; i += 4)
+                if (!memcmp(&b->p_buffer[i], "cmfc", 4))
+                    cmfc = true;
+        }
+        else if (!memcmp(&b->p_buffer[4], "moov", 4))
+        {
+            const uint8_t *mdhd = FindType(b->p_buffer, b->i_buffer, "mdhd");
+            ASSERT(mdhd != NULL);
+            timescale = GetDWBE(&mdhd[mdhd[8] == 1 ? 28 : 20]);
+            ASSERT(timescale > 0);
+        }
+        else if (!memcmp(&b->p_buffer[4], "moof", 4))
+        {
+            unsigned frame;
+
+            ASSERT(timescale > 0);
+            ASSERT(GetMoofFrame(b, timescale, &frame) == 0);
+            ASSERT(frame < FRAMES);
+            fragments++;
+            /* only the fragments starting with a keyframe are flagged */
+            if (frame % 25 == 0)
+            {
+                ASSERT(b->i_flags & BLOCK_FLAG_TYPE_I);
+                keyframes++;
+            }
+            else
+            {
+                ASSERT(chunked);
+                ASSERT(!(b->i_flags & BLOCK_FLAG_TYPE_I));
+            }
+        }
+    }
+
+    ASSERT(cmfc == chunked);
+    /* every keyframe starts a fragment */
+    ASSERT(keyframes == FRAMES / 25);
+    if (chunked)
+        ASSERT(fragments > keyframes);
+    else
+        ASSERT(fragments == keyframes);
+    return 0;
+}
+
+static int TestChunks(libvlc_instance_t *vlc)
+{
+    int ret;
+
+    ASSERT(MuxTo(vlc, "test_mp4_capture", "", "mp4frag") == 0);
+    ret = CheckFragments(false);
+    ReleaseCaptured();
+    ASSERT(ret == 0);
+
+    ASSERT(MuxTo(vlc, "test_mp4_capture", "",
+                 "mp4frag{chunk-length=200}") == 0);
+    ret = CheckFragments(true);
+    ReleaseCaptured();
+    ASSERT(ret == 0);
+    return 0;
+}
+
+int main(void)
+{
+    test_init();
+
+    static const char *argv[] = { "-v", "--ignore-config" };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+
+    int fd = vlc_mkstemp(path);
+    assert(fd != -1);
+    vlc_close(fd);
+
+    int ret = TestMoovReserve(vlc);
+    if (ret == 0)
+        ret = TestChunks(vlc);
+
+    unlink(path);
+    libvlc_release(vlc);
+    return ret;
+}
@@ -0,0 +1,208 @@
+/*****************************************************************************
+ * prefetch.c: prefetch stream filter test
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#undef NDEBUG
+#include <assert.h>
+#include <string.h>
+
+#include <vlc_common.h>
+#include <vlc_stream.h>
+#include "../../../lib/libvlc_internal.h"
+#include "../../libvlc/test.h"
+
+#include <vlc/vlc.h>
+
+#define CHUNK 4096
+
+static vlc_stream_fifo_t *writer;
+static stream_t *reader;
+static uint64_t written;
+
+static uint8_t Pattern(uint64_t i)
+{
+    return i * 7 + (i >> 12);
+}
+
+static void Write(size_t len)
+{
+    uint8_t *buf = malloc(len);
+    assert(buf != NULL);
+    for (size_t i = 0; i < len; i++)
+        buf[i] = Pattern(written + i);
+    assert(vlc_stream_fifo_Write(writer, buf, len) == (ssize_t)len);
+    written += len;
+    free(buf);
+}
+
+/* Reads exactly len bytes, checking their values */
+static void Read(uint64_t offset, size_t len)
+{
+    uint8_t buf[CHUNK];
+
+    assert(vlc_stream_Tell(reader) == offset);
+    while (len > 0)
+    {
+        ssize_t val = vlc_stream_ReadPartial(reader, buf,
+                                             len < CHUNK ? len : CHUNK);
+        assert(val > 0);
+        for (ssize_t i = 0; i < val; i++)
+            assert(buf[i] == Pattern(offset + i));
+        offset += val;
+        len -= val;
+    }
+}
+
+static void GetStats(struct vlc_stream_buffer_stats *stats)
+{
+    int val = vlc_stream_Control(reader, STREAM_GET_BUFFER_STATS, stats);
+    assert(val == VLC_SUCCESS);
+}
+
+/* Writes once the reader waits on an empty buffer, or after a delay if that
+ * wait does not count as a stall */
+struct delayed_write
+{
+    size_t len;
+    unsigned stalls;
+    vlc_thread_t thread;
+};
+
+static void *DelayedWrite(void *data)
+{
+    struct delayed_write *dw = data;
+    struct vlc_stream_buffer_stats stats;
+
+    if (dw->stalls > 0)
+    {
+        do
+        {
+            vlc_tick_wait(vlc_tick_now() + VLC_TICK_FROM_MS(10));
+            GetStats(&stats);
+        }
+        while (stats.stalls < dw->stalls);
+    }
+    else
+        vlc_tick_wait(vlc_tick_now() + VLC_TICK_FROM_MS(100));
+
+    Write(dw->len);
+    return NULL;
+}
+
+static void ReadWaiting(uint64_t offset, size_t len, unsigned stalls)
+{
+    struct delayed_write dw = { .len = len, .stalls = stalls };
+
+    assert(vlc_clone(&dw.thread, DelayedWrite, &dw,
+                     VLC_THREAD_PRIORITY_LOW) == 0);
+    Read(offset, len);
+    vlc_join(dw.thread, NULL);
+}
+
+int main(void)
+{
+    struct vlc_stream_buffer_stats stats;
+    stream_t *source;
+
+    test_init();
+
+    static const char *const argv[] = {
+        "--prefetch-buffer-size=16", "--prefetch-max-buffer-size=1024",
+    };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+
+    writer = vlc_stream_fifo_New(VLC_OBJECT(vlc->p_libvlc_int), &source);
+    assert(writer != NULL);
+    reader = vlc_stream_FilterNew(source, "prefetch");
+    if (reader == NULL)
+    {
+        vlc_stream_fifo_Close(writer);
+        vlc_stream_Delete(source);
+        libvlc_release(vlc);
+        return 77; /* not built */
+    }
+
+    GetStats(&stats);
+    assert(stats.size == 16 << 10);
+    assert(stats.max_size == 1024 << 10);
+    assert(stats.fill == 0);
+    assert(stats.stalls == 0);
+    assert(stats.resizes == 0);
+
+    /* Waiting for the first data is not a stall */
+    ReadWaiting(0, CHUNK, 0);
+    GetStats(&stats);
+    assert(stats.stalls == 0);
+    assert(stats.resizes == 0);
+    assert(stats.size == 16 << 10);
+
+    /* Neither is waiting after a seek beyond the buffered data */
+    Write(CHUNK);
+    assert(vlc_stream_Seek(reader, 3 * CHUNK) == VLC_SUCCESS);
+    Write(CHUNK);
+    ReadWaiting(3 * CHUNK, CHUNK, 0);
+    GetStats(&stats);
+    assert(stats.stalls == 0);
+    assert(stats.resizes == 0);
+    assert(stats.input_rate > 0);
+    assert(stats.read_size > 0 && stats.read_size <= stats.size / 4);
+
+    /* Data consumed faster than it comes: the buffer grows */
+    ReadWaiting(4 * CHUNK, CHUNK, 1);
+    GetStats(&stats);
+    assert(stats.stalls == 1);
+    assert(stats.resizes == 1);
+    assert(stats.size >= 32 << 10 && stats.size <= stats.max_size);
+    assert(stats.fill == 0);
+
+    /* Again, from the grown buffer */
+    ReadWaiting(5 * CHUNK, CHUNK, 2);
+    GetStats(&stats);
+    assert(stats.stalls == 2);
+    assert(stats.resizes == 2);
+    assert(stats.size >= 64 << 10 && stats.size <= stats.max_size);
+
+    /* Data is buffered ahead of the reader */
+    Write(2 * CHUNK);
+    do
+    {
+        vlc_tick_wait(vlc_tick_now() + VLC_TICK_FROM_MS(10));
+        GetStats(&stats);
+    }
+    while (stats.fill < 2 * CHUNK);
+    assert(stats.fill == 2 * CHUNK);
+    Read(6 * CHUNK, 2 * CHUNK);
+    GetStats(&stats);
+    assert(stats.stalls == 2);
+    assert(stats.fill == 0);
+
+    vlc_stream_fifo_Close(writer);
+    uint8_t byte;
+    assert(vlc_stream_Read(reader, &byte, 1) == 0);
+    assert(vlc_stream_Eof(reader));
+
+    vlc_stream_Delete(reader);
+    libvlc_release(vlc);
+    return 0;
+}
@@ -0,0 +1,232 @@
+/*****************************************************************************
+ * lookahead.c: transcoding keyframe placement tests
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../../libvlc/test.h"
+#include "../../../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_picture.h>
+
+#include "../../../modules/stream_out/transcode/lookahead.h"
+
+#define ASSERT(a) do {\
+    if(!(a)) { \
+        fprintf(stderr, "failed line %d\n", __LINE__); \
+        return 1; } \
+    } while(0)
+
+#define DEPTH     4
+#define THRESHOLD 10 /* luma levels */
+#define PERIOD    VLC_TICK_FROM_MS(40)
+#define MAX_PICS  64
+
+/* Flat pictures: the luma difference between two of them is exact */
+static picture_t *Picture(uint8_t luma, vlc_tick_t date)
+{
+    video_format_t fmt;
+
+    video_format_Setup(&fmt, VLC_CODEC_I420, 64, 48, 64, 48, 1, 1);
+    picture_t *pic = picture_NewFromFormat(&fmt);
+    assert(pic != NULL);
+    for (int i = 0; i < pic->i_planes; i++)
+        memset(pic->p[i].p_pixels, i ? 128 : luma,
+               pic->p[i].i_pitch * pic->p[i].i_lines);
+    pic->date = date;
+    return pic;
+}
+
+/* Feeds the pictures as the transcoder does, and tells which ones are
+ * flagged as keyframes, in output order */
+static int Run(vlc_object_t *obj, unsigned depth, vlc_tick_t segment,
+               const uint8_t *lumas, const vlc_tick_t *dates, size_t count,
+               bool *keyframes)
+{
+    transcode_lookahead_t *la =
+        transcode_lookahead_New(obj, depth, depth ? THRESHOLD : 0, segment);
+    ASSERT(la != NULL);
+
+    size_t out = 0;
+    for (size_t i = 0; i <= count; i++)
+    {
+        if (i < count)
+            transcode_lookahead_Push(la,
+                Picture(lumas ? lumas[i] : 128,
+                        dates ? dates[i] : VLC_TICK_0 + i * PERIOD));
+
+        picture_t *pic;
+        while ((pic = transcode_lookahead_Pop(la, i == count)) != NULL)
+        {
+            ASSERT(out < count);
+            /* the delay never exceeds the depth */
+            ASSERT(out + depth >= i);
+            keyframes[out++] = pic->b_keyframe;
+            picture_Release(pic);
+        }
+    }
+    ASSERT(out == count);
+
+    transcode_lookahead_Delete(la);
+    return 0;
+}
+
+/* Builds a clip from (luma, count) runs */
+static size_t Clip(uint8_t *lumas, const unsigned *runs, size_t run_count)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < run_count; i += 2)
+        for (unsigned j = 0; j < runs[i + 1]; j++)
+        {
+            assert(count < MAX_PICS);
+            lumas[count++] = runs[i];
+        }
+    return count;
+}
+
+static int Keyframes(const bool *keyframes, size_t count,
+                     const size_t *expected, size_t expected_count)
+{
+    size_t found = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!keyframes[i])
+            continue;
+        if (found >= expected_count || expected[found] != i)
+        {
+            fprintf(stderr, "unexpected keyframe at %zu\n", i);
+            return 1;
+        }
+        found++;
+    }
+    ASSERT(found == expected_count);
+    return 0;
+}
+
+static int TestSceneCuts(vlc_object_t *obj)
+{
+    uint8_t lumas[MAX_PICS];
+    bool keyframes[MAX_PICS];
+    size_t count;
+
+    /* a cut */
+    static const unsigned cut[] = { 16, 12, 200, 12 };
+    static const size_t cut_keys[] = { 12 };
+    count = Clip(lumas, cut, ARRAY_SIZE(cut));
+    ASSERT(Run(obj, DEPTH, 0, lumas, NULL, count, keyframes) == 0);
+    ASSERT(Keyframes(keyframes, count, cut_keys, ARRAY_SIZE(cut_keys)) == 0);
+
+    /* under the threshold */
+    static const unsigned small[] = { 16, 12, 16 + THRESHOLD - 1, 12 };
+    count = Clip(lumas, small, ARRAY_SIZE(small));
+    ASSERT(Run(obj, DEPTH, 0, lumas, NULL, count, keyframes) == 0);
+    ASSERT(Keyframes(keyframes, count, NULL, 0) == 0);
+
+    /* a flash: neither the flash nor the return to the scene is a cut */
+    static const unsigned flash[] = { 16, 12, 200, 1, 16, 12 };
+    count = Clip(lumas, flash, ARRAY_SIZE(flash));
+    ASSERT(Run(obj, DEPTH, 0, lumas, NULL, count, keyframes) == 0);
+    ASSERT(Keyframes(keyframes, count, NULL, 0) == 0);
+
+    /* sustained motion: every picture differs as much from the previous */
+    for (count = 0; count < 12; count++)
+        lumas[count] = 16 + count * 2 * THRESHOLD;
+    ASSERT(Run(obj, DEPTH, 0, lumas, NULL, count, keyframes) == 0);
+    ASSERT(Keyframes(keyframes, count, NULL, 0) == 0);
+
+    /* at least LOOKAHEAD_MIN_DISTANCE (8) pictures between two cuts */
+    static const unsigned close[] = { 16, 12, 200, 8, 60, 12 };
+    static const size_t close_keys[] = { 12 };
+    count = Clip(lumas, close, ARRAY_SIZE(close));
+    ASSERT(Run(obj, DEPTH, 0, lumas, NULL, count, keyframes) == 0);
+    ASSERT(Keyframes(keyframes, count, close_keys, ARRAY_SIZE(close_keys)) == 0);
+
+    static const unsigned apart[] = { 16, 12, 200, 9, 60, 12 };
+    static const size_t apart_keys[] = { 12, 21 };
+    count = Clip(lumas, apart, ARRAY_SIZE(apart));
+    ASSERT(Run(obj, DEPTH, 0, lumas, NULL, count, keyframes) == 0);
+    ASSERT(Keyframes(keyframes, count, apart_keys, ARRAY_SIZE(apart_keys)) == 0);
+
+    /* no lookahead, no detection */
+    count = Clip(lumas, cut, ARRAY_SIZE(cut));
+    ASSERT(Run(obj, 0, 0, lumas, NULL, count, keyframes) == 0);
+    ASSERT(Keyframes(keyframes, count, NULL, 0) == 0);
+    return 0;
+}
+
+static int TestSegments(vlc_object_t *obj)
+{
+    /* boundaries every second from the first date, skipped ones included */
+    static const unsigned ms[] = {
+        0, 400, 999, 1000, 1500, 2100, 2999, 5000, 5999, 6000, 6001,
+    };
+    static const size_t keys[] = { 3, 5, 7, 9 };
+    vlc_tick_t dates[ARRAY_SIZE(ms) + 1];
+    bool keyframes[ARRAY_SIZE(ms) + 1];
+
+    for (size_t i = 0; i < ARRAY_SIZE(ms); i++)
+        dates[i] = VLC_TICK_FROM_SEC(10) + VLC_TICK_FROM_MS(ms[i]);
+
+    ASSERT(Run(obj, 0, VLC_TICK_FROM_SEC(1), NULL, dates, ARRAY_SIZE(ms),
+               keyframes) == 0);
+    ASSERT(Keyframes(keyframes, ARRAY_SIZE(ms), keys, ARRAY_SIZE(keys)) == 0);
+
+    /* undated pictures are not counted */
+    dates[ARRAY_SIZE(ms) - 1] = VLC_TICK_INVALID;
+    dates[ARRAY_SIZE(ms)] = VLC_TICK_FROM_SEC(10) + VLC_TICK_FROM_MS(7000);
+    static const size_t undated_keys[] = { 3, 5, 7, 9, 11 };
+    ASSERT(Run(obj, 0, VLC_TICK_FROM_SEC(1), NULL, dates, ARRAY_SIZE(ms) + 1,
+               keyframes) == 0);
+    ASSERT(Keyframes(keyframes, ARRAY_SIZE(ms) + 1, undated_keys,
+                     ARRAY_SIZE(undated_keys)) == 0);
+
+    /* a boundary within a scene cut distance is still honoured */
+    uint8_t lumas[MAX_PICS];
+    vlc_tick_t cut_dates[MAX_PICS];
+    bool cut_keyframes[MAX_PICS];
+    static const unsigned cut[] = { 16, 12, 200, 12 };
+    static const size_t cut_keys[] = { 12, 15 };
+    size_t count = Clip(lumas, cut, ARRAY_SIZE(cut));
+    for (size_t i = 0; i < count; i++)
+        cut_dates[i] = VLC_TICK_FROM_SEC(10) + i * VLC_TICK_FROM_MS(100);
+    ASSERT(Run(obj, DEPTH, VLC_TICK_FROM_MS(1500), lumas, cut_dates, count,
+               cut_keyframes) == 0);
+    ASSERT(Keyframes(cut_keyframes, count, cut_keys, ARRAY_SIZE(cut_keys)) == 0);
+    return 0;
+}
+
+int main(void)
+{
+    test_init();
+
+    static const char *argv[] = { "-v", "--ignore-config" };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+
+    int ret = TestSceneCuts(obj) || TestSegments(obj);
+
+    libvlc_release(vlc);
+    return ret;
+}
@@ -0,0 +1,343 @@
+/*****************************************************************************
+ * transcode.c: transcode stream output tests
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../../libvlc/test.h"
+
+#include <vlc_common.h>
+#include <vlc_atomic.h>
+#include <vlc_codec.h>
+#include <vlc_sout.h>
+
+#define MODULE_NAME test_transcode
+#define MODULE_STRING "test_transcode"
+#undef __PLUGIN__
+#include <vlc_plugin.h>
+
+#define TEST_CODEC VLC_FOURCC('t','e','s','t')
+
+/* The mock demuxer output, 1 second at 25 fps and 40 ms audio blocks */
+#define TEST_MRL "mock://video_track_count=1;audio_track_count=1;" \
+                 "length=1000000;video_width=64;video_height=48"
+
+/* The other renditions are output with the source ES ID plus N times this */
+#define RENDITION_ID_OFFSET 10000
+
+#define MAX_STREAMS 4
+
+struct es_counters
+{
+    enum es_format_category_e cat;
+    unsigned width, height; /**< expected video size */
+    atomic_uint encoded; /**< blocks returned by the encoder */
+    atomic_uint received; /**< blocks received by the output */
+    atomic_uint lag; /**< most encoded blocks not received yet, seen */
+    atomic_ulong encoder_thread;
+    atomic_ulong output_thread;
+    atomic_bool drained;
+    atomic_bool added;
+    atomic_bool deleted;
+    int id; /**< ES ID at the output */
+    vlc_tick_t last_pts; /**< output thread only */
+};
+
+/* The audio, the main video, then the other video renditions */
+static struct es_counters streams[MAX_STREAMS];
+static size_t stream_count;
+
+static struct es_counters *GetCounters(const es_format_t *fmt)
+{
+    assert(fmt->i_cat == VIDEO_ES || fmt->i_cat == AUDIO_ES);
+    for (size_t i = 0; i < stream_count; i++)
+    {
+        struct es_counters *c = &streams[i];
+
+        if (c->cat == fmt->i_cat &&
+            (c->cat != VIDEO_ES ||
+             (c->width == fmt->video.i_visible_width &&
+              c->height == fmt->video.i_visible_height)))
+            return c;
+    }
+    fprintf(stderr, "unexpected ES %4.4s %ux%u\n", (const char *)&fmt->i_codec,
+            fmt->video.i_visible_width, fmt->video.i_visible_height);
+    abort();
+}
+
+static void AddCounters(enum es_format_category_e cat,
+                        unsigned width, unsigned height)
+{
+    assert(stream_count < MAX_STREAMS);
+    struct es_counters *c = &streams[stream_count++];
+
+    c->cat = cat;
+    c->width = width;
+    c->height = height;
+    atomic_store(&c->encoded, 0);
+    atomic_store(&c->received, 0);
+    atomic_store(&c->lag, 0);
+    atomic_store(&c->encoder_thread, 0);
+    atomic_store(&c->output_thread, 0);
+    atomic_store(&c->drained, false);
+    atomic_store(&c->added, false);
+    atomic_store(&c->deleted, false);
+    c->id = -1;
+    c->last_pts = VLC_TICK_INVALID;
+}
+
+/*****************************************************************************
+ * Encoder: one block per picture or audio buffer, with its timestamps
+ *****************************************************************************/
+static block_t *Encode(encoder_t *enc, vlc_tick_t pts, vlc_tick_t length)
+{
+    struct es_counters *c = GetCounters(&enc->fmt_in);
+
+    /* the previous output must be on its way to the next stream */
+    unsigned lag = atomic_load(&c->encoded) - atomic_load(&c->received);
+    if (lag > atomic_load(&c->lag))
+        atomic_store(&c->lag, lag);
+    atomic_store(&c->encoder_thread, vlc_thread_id());
+
+    block_t *block = block_Alloc(4);
+    assert(block != NULL);
+    memset(block->p_buffer, 0, block->i_buffer);
+    block->i_dts = block->i_pts = pts;
+    block->i_length = length;
+    atomic_fetch_add(&c->encoded, 1);
+    return block;
+}
+
+static block_t *EncodeVideo(encoder_t *enc, picture_t *pic)
+{
+    if (pic == NULL)
+    {
+        /* drain, nothing delayed */
+        atomic_store(&GetCounters(&enc->fmt_in)->drained, true);
+        return NULL;
+    }
+    return Encode(enc, pic->date, 0);
+}
+
+static block_t *EncodeAudio(encoder_t *enc, block_t *in)
+{
+    if (in == NULL)
+    {
+        atomic_store(&GetCounters(&enc->fmt_in)->drained, true);
+        return NULL;
+    }
+    return Encode(enc, in->i_pts, in->i_length);
+}
+
+static int OpenEncoder(vlc_object_t *obj)
+{
+    encoder_t *enc = (encoder_t *)obj;
+
+    if (enc->fmt_out.i_codec != TEST_CODEC)
+        return VLC_EGENERIC;
+
+    /* take the decoded format as is */
+    switch (enc->fmt_in.i_cat)
+    {
+        case VIDEO_ES:
+            enc->fmt_in.video.i_chroma = enc->fmt_in.i_codec;
+            enc->pf_encode_video = EncodeVideo;
+            break;
+        case AUDIO_ES:
+            enc->fmt_in.audio.i_format = enc->fmt_in.i_codec;
+            enc->fmt_out.audio.i_rate = enc->fmt_in.audio.i_rate;
+            enc->fmt_out.audio.i_channels = enc->fmt_in.audio.i_channels;
+            enc->pf_encode_audio = EncodeAudio;
+            break;
+        default:
+            return VLC_EGENERIC;
+    }
+    return VLC_SUCCESS;
+}
+
+/*****************************************************************************
+ * Output: checks and counts the encoded blocks
+ *****************************************************************************/
+static void *OutputAdd(sout_stream_t *stream, const es_format_t *fmt)
+{
+    (void)stream;
+    if (fmt->i_codec != TEST_CODEC)
+        return NULL;
+
+    /* one output ES per rendition, of the requested size */
+    struct es_counters *c = GetCounters(fmt);
+    assert(!atomic_load(&c->added));
+    c->id = fmt->i_id;
+    atomic_store(&c->added, true);
+    return c;
+}
+
+static void OutputDel(sout_stream_t *stream, void *id)
+{
+    struct es_counters *c = id;
+
+    (void)stream;
+    assert(!atomic_load(&c->deleted));
+    atomic_store(&c->deleted, true);
+}
+
+static int OutputSend(sout_stream_t *stream, void *id, block_t *chain)
+{
+    struct es_counters *c = id;
+
+    (void)stream;
+    atomic_store(&c->output_thread, vlc_thread_id());
+    for (block_t *block = chain; block != NULL; block = block->p_next)
+    {
+        assert(block->i_pts != VLC_TICK_INVALID);
+        assert(c->last_pts == VLC_TICK_INVALID || block->i_pts > c->last_pts);
+        c->last_pts = block->i_pts;
+        atomic_fetch_add(&c->received, 1);
+    }
+    block_ChainRelease(chain);
+    return VLC_SUCCESS;
+}
+
+static const struct sout_stream_operations output_ops = {
+    OutputAdd, OutputDel, OutputSend, NULL, NULL,
+};
+
+static int OpenOutput(vlc_object_t *obj)
+{
+    sout_stream_t *stream = (sout_stream_t *)obj;
+
+    stream->ops = &output_ops;
+    stream->p_sys = NULL;
+    return VLC_SUCCESS;
+}
+
+vlc_module_begin()
+    set_description("transcode test encoder")
+    set_capability("encoder", 1000)
+    set_callback(OpenEncoder)
+    add_submodule()
+        set_description("transcode test output")
+        set_capability("sout output", 0)
+        add_shortcut("test_transcode_output")
+        set_callback(OpenOutput)
+vlc_module_end()
+
+/* Inject the test modules as static modules */
+typedef int (*vlc_plugin_cb)(vlc_set_cb, void *);
+
+VLC_EXPORT vlc_plugin_cb vlc_static_modules[] = {
+    VLC_SYMBOL(vlc_entry), NULL
+};
+
+/*****************************************************************************
+ * Tests
+ *****************************************************************************/
+static void OnEndReached(const struct libvlc_event_t *event, void *data)
+{
+    (void)event;
+    vlc_sem_post(data);
+}
+
+/* Transcodes the video to its own size and to the other renditions, given
+ * as WIDTHxHEIGHT@BITRATE with the sizes expected after aspect ratio */
+static void Transcode(libvlc_instance_t *vlc, bool es_threads,
+                      const char *renditions, const unsigned (*sizes)[2],
+                      size_t rendition_count)
+{
+    char *option;
+
+    stream_count = 0;
+    AddCounters(AUDIO_ES, 0, 0);
+    AddCounters(VIDEO_ES, 64, 48);
+    for (size_t i = 0; i < rendition_count; i++)
+        AddCounters(VIDEO_ES, sizes[i][0], sizes[i][1]);
+
+    libvlc_media_t *md = libvlc_media_new_location(vlc, TEST_MRL);
+    assert(md != NULL);
+    assert(asprintf(&option, ":sout=#transcode{vcodec=test,acodec=test,"
+                    "%ses-threads,renditions=\"%s\"}:test_transcode_output",
+                    es_threads ? "" : "no-",
+                    renditions ? renditions : "") != -1);
+    libvlc_media_add_option(md, option);
+    free(option);
+
+    libvlc_media_player_t *mp = libvlc_media_player_new_from_media(md);
+    assert(mp != NULL);
+    libvlc_media_release(md);
+
+    vlc_sem_t end;
+    vlc_sem_init(&end, 0);
+    libvlc_event_manager_t *em = libvlc_media_player_event_manager(mp);
+    assert(libvlc_event_attach(em, libvlc_MediaPlayerEndReached,
+                               OnEndReached, &end) == 0);
+
+    assert(libvlc_media_player_play(mp) == 0);
+    vlc_sem_wait(&end);
+    libvlc_media_player_release(mp); /* deletes the stream output */
+
+    for (size_t i = 0; i < stream_count; i++)
+    {
+        const struct es_counters *c = &streams[i];
+
+        assert(atomic_load(&c->added));
+        assert(atomic_load(&c->deleted));
+        /* nothing is left behind at the end */
+        assert(atomic_load(&c->drained));
+        assert(atomic_load(&c->encoded) > 0);
+        assert(atomic_load(&c->received) == atomic_load(&c->encoded));
+
+        if (es_threads)
+            /* encoded away from the thread feeding the stream */
+            assert(atomic_load(&c->encoder_thread)
+                   != atomic_load(&c->output_thread));
+        else
+            /* each block is forwarded as soon as it is encoded */
+            assert(atomic_load(&c->lag) == 0);
+
+        if (c->cat == VIDEO_ES)
+        {
+            /* every rendition gets every picture: 1 second at 25 fps */
+            assert(atomic_load(&c->received) == 25);
+            /* the Nth rendition after the main one */
+            assert(c->id == streams[1].id + (int)(i - 1) * RENDITION_ID_OFFSET);
+        }
+    }
+}
+
+int main(void)
+{
+    test_init();
+
+    static const char *argv[] = { "-v", "--ignore-config" };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+
+    Transcode(vlc, false, NULL, NULL, 0);
+    Transcode(vlc, true, NULL, NULL, 0);
+
+    /* a missing dimension keeps the 4:3 aspect ratio of the source */
+    static const unsigned sizes[][2] = { { 32, 24 }, { 16, 12 } };
+    Transcode(vlc, false, "32x0@100,0x12@50", sizes, ARRAY_SIZE(sizes));
+    Transcode(vlc, true, "32x0@100,0x12@50", sizes, ARRAY_SIZE(sizes));
+
+    libvlc_release(vlc);
+    return 0;
+}
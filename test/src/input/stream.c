@@ -35,6 +35,7 @@
 
 #ifndef TEST_NET
 #define RAND_FILE_SIZE (1024 * 1024)
+#define BENCH_FILE_SIZE (32 * 1024 * 1024)
 #else
 #define HTTP_URL "http://streams.videolan.org/streams/ogm/MJPEG.ogm"
 #define HTTP_MD5 "4eaf9e8837759b670694398a33f02bc0"
@@ -182,11 +183,9 @@ stream_close( struct reader *p_reader )
     free( p_reader );
 }
 
-static struct reader *
-stream_open( const char *psz_url )
+static libvlc_instance_t *
+stream_instance( const char *psz_option )
 {
-    libvlc_instance_t *p_vlc;
-    struct reader *p_reader;
     const char * argv[] = {
         "-v",
         "--ignore-config",
@@ -195,12 +194,22 @@ stream_open( const char *psz_url )
         "--no-media-library",
         "--vout=dummy",
         "--aout=dummy",
+        psz_option,
     };
 
+    return libvlc_new( ARRAY_SIZE(argv) - ( psz_option == NULL ), argv );
+}
+
+static struct reader *
+stream_open( const char *psz_url, const char *psz_option )
+{
+    libvlc_instance_t *p_vlc;
+    struct reader *p_reader;
+
     p_reader = calloc( 1, sizeof(struct reader) );
     assert( p_reader );
 
-    p_vlc = libvlc_new( ARRAY_SIZE(argv), argv );
+    p_vlc = stream_instance( psz_option );
     assert( p_vlc != NULL );
 
     p_reader->u.s = vlc_stream_NewURL( p_vlc->p_libvlc_int, psz_url );
@@ -217,7 +226,7 @@ stream_open( const char *psz_url )
     p_reader->pf_tell = stream_tell;
     p_reader->pf_seek = stream_seek;
     p_reader->p_data = p_vlc;
-    p_reader->psz_name = "stream";
+    p_reader->psz_name = psz_option ? psz_option : "stream";
     return p_reader;
 }
 
@@ -358,12 +367,41 @@ fill_rand( int i_fd, size_t i_size )
     }
     assert( i_written == i_size );
 }
+
+/* Reads a large file like a demuxer would, with the given access options */
+static void
+bench( const char *psz_url, uint64_t i_size, const char *psz_option )
+{
+    libvlc_instance_t *p_vlc = stream_instance( psz_option );
+    assert( p_vlc != NULL );
+
+    stream_t *s = vlc_stream_NewURL( p_vlc->p_libvlc_int, psz_url );
+    assert( s != NULL );
+
+    static uint8_t p_buf[65536];
+    uint64_t i_read = 0;
+    ssize_t i_ret;
+    vlc_tick_t i_start = vlc_tick_now();
+
+    while( ( i_ret = vlc_stream_Read( s, p_buf, sizeof (p_buf) ) ) > 0 )
+        i_read += i_ret;
+
+    vlc_tick_t i_duration = vlc_tick_now() - i_start;
+    assert( i_read == i_size );
+    test_log( "%s: %"PRIu64" MiB in %"PRId64" ms (%.0f MiB/s)\n",
+              psz_option ? psz_option : "on demand", i_size >> 20,
+              MS_FROM_VLC_TICK( i_duration ),
+              ( i_size >> 20 ) / secf_from_vlc_tick( i_duration ) );
+
+    vlc_stream_Delete( s );
+    libvlc_release( p_vlc );
+}
 #endif
 
 int
 main( void )
 {
-    struct reader *pp_readers[3];
+    struct reader *pp_readers[4];
 
     test_init();
 
@@ -380,19 +418,30 @@ main( void )
     assert( asprintf( &psz_url, "file://%s", psz_tmp_path ) != -1 );
 
     assert( ( pp_readers[0] = libc_open( psz_tmp_path ) ) );
-    assert( ( pp_readers[1] = stream_open( psz_url ) ) );
+    assert( ( pp_readers[1] = stream_open( psz_url, NULL ) ) );
+    assert( ( pp_readers[2] = stream_open( psz_url,
+                                           "--file-readahead=4" ) ) );
+    assert( ( pp_readers[3] = stream_open( psz_url, "--file-mmap" ) ) );
 
-    test( pp_readers, 2, NULL );
-    for( unsigned int i = 0; i < 2; ++i )
+    test( pp_readers, 4, NULL );
+    for( unsigned int i = 0; i < 4; ++i )
         pp_readers[i]->pf_close( pp_readers[i] );
+
+    /* Grow the file for the throughput comparison */
+    test_log( "Comparing file access throughput...\n" );
+    fill_rand( i_tmp_fd, BENCH_FILE_SIZE - RAND_FILE_SIZE );
+    bench( psz_url, BENCH_FILE_SIZE, NULL );
+    bench( psz_url, BENCH_FILE_SIZE, "--file-readahead=8" );
+    bench( psz_url, BENCH_FILE_SIZE, "--file-mmap" );
     free( psz_url );
 
     close( i_tmp_fd );
+    unlink( psz_tmp_path );
 #else
 
     test_log( "Testing http url with stream...\n" );
     alarm( 0 );
-    if( !( pp_readers[0] = stream_open( HTTP_URL ) ) )
+    if( !( pp_readers[0] = stream_open( HTTP_URL, NULL ) ) )
     {
         test_log( "WARNING: can't test http url" );
         return 0;
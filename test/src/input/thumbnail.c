@@ -207,6 +207,87 @@ static void test_cancel_thumbnail( libvlc_instance_t* p_vlc )
     vlc_thumbnailer_Release( p_thumbnailer );
 }
 
+struct batch_ctx
+{
+    vlc_cond_t cond;
+    vlc_mutex_t lock;
+    unsigned received[3];
+    size_t count;
+};
+
+static void thumbnailer_callback_batch( void* data, size_t index,
+                                        picture_t* thumbnail )
+{
+    struct batch_ctx* p_ctx = data;
+    assert( thumbnail != NULL );
+    assert( thumbnail->format.i_chroma == VLC_CODEC_ARGB );
+    assert( index < ARRAY_SIZE(p_ctx->received) );
+
+    vlc_mutex_lock( &p_ctx->lock );
+    p_ctx->received[index]++;
+    p_ctx->count++;
+    vlc_cond_signal( &p_ctx->cond );
+    vlc_mutex_unlock( &p_ctx->lock );
+}
+
+static void test_batch_thumbnails( libvlc_instance_t* p_vlc )
+{
+    vlc_thumbnailer_t* p_thumbnailer = vlc_thumbnailer_Create(
+                VLC_OBJECT( p_vlc->p_libvlc_int ) );
+    assert( p_thumbnailer != NULL );
+
+    char* psz_mrl;
+    if ( asprintf( &psz_mrl, "mock://video_track_count=1;audio_track_count=1"
+                   ";length=%" PRId64 ";video_chroma=ARGB", MOCK_DURATION ) < 0 )
+        assert( !"Failed to allocate mock mrl" );
+    input_item_t* p_item = input_item_New( psz_mrl, "mock item" );
+    assert( p_item != NULL );
+
+    /* Not sorted on purpose: the indexes refer to the caller's order */
+    static const vlc_tick_t times[] = {
+        VLC_TICK_FROM_SEC( 240 ), VLC_TICK_FROM_SEC( 60 ),
+        VLC_TICK_FROM_SEC( 120 ),
+    };
+    static const enum vlc_thumbnailer_seek_speed speeds[] = {
+        VLC_THUMBNAILER_SEEK_PRECISE, VLC_THUMBNAILER_SEEK_KEYFRAME,
+    };
+
+    for ( size_t i = 0; i < 2 * ARRAY_SIZE(speeds); ++i )
+    {
+        struct batch_ctx ctx = { .count = 0 };
+        vlc_cond_init( &ctx.cond );
+        vlc_mutex_init( &ctx.lock );
+
+        vlc_mutex_lock( &ctx.lock );
+        vlc_thumbnailer_request_t* p_req;
+        if ( i < ARRAY_SIZE(speeds) )
+            p_req = vlc_thumbnailer_RequestBatchByTime( p_thumbnailer, times,
+                ARRAY_SIZE(times), speeds[i], p_item, VLC_TICK_FROM_SEC( 5 ),
+                thumbnailer_callback_batch, &ctx );
+        else
+            p_req = vlc_thumbnailer_RequestBatchByPos( p_thumbnailer,
+                ARRAY_SIZE(ctx.received), speeds[i - ARRAY_SIZE(speeds)],
+                p_item, VLC_TICK_FROM_SEC( 5 ), thumbnailer_callback_batch,
+                &ctx );
+        assert( p_req != NULL );
+
+        while ( ctx.count < ARRAY_SIZE(ctx.received) )
+        {
+            vlc_tick_t timeout = vlc_tick_now() + VLC_TICK_FROM_SEC( 10 );
+            int res = vlc_cond_timedwait( &ctx.cond, &ctx.lock, timeout );
+            assert( res != ETIMEDOUT );
+        }
+        vlc_mutex_unlock( &ctx.lock );
+
+        for ( size_t j = 0; j < ARRAY_SIZE(ctx.received); ++j )
+            assert( ctx.received[j] == 1 );
+    }
+
+    input_item_Release( p_item );
+    free( psz_mrl );
+    vlc_thumbnailer_Release( p_thumbnailer );
+}
+
 int main()
 {
     test_init();
@@ -220,6 +301,7 @@ int main()
 
     test_thumbnails( vlc );
     test_cancel_thumbnail( vlc );
+    test_batch_thumbnails( vlc );
 
     libvlc_release( vlc );
 }
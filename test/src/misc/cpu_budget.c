@@ -0,0 +1,85 @@
+/*****************************************************************************
+ * cpu_budget.c: test the threads shared by the codecs
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../../libvlc/test.h"
+#include "../../../lib/libvlc_internal.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+#include <vlc_common.h>
+#include <vlc_cpu.h>
+
+static void assert_stats(vlc_object_t *obj, unsigned codecs,
+                         unsigned requested, unsigned assigned, unsigned used)
+{
+    struct vlc_cpu_budget_stats stats;
+
+    vlc_cpu_budget_GetStats(obj, &stats);
+    assert(stats.budget == 8);
+    assert(stats.codecs == codecs);
+    assert(stats.requested == requested);
+    assert(stats.assigned == assigned);
+    assert(stats.used == used);
+}
+
+int main(void)
+{
+    test_init();
+
+    static const char *argv[] = { "-v", "--ignore-config", "--cpu-budget=8" };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+
+    vlc_object_t *obj = VLC_OBJECT(vlc->p_libvlc_int);
+    vlc_cpu_quota_t *q1, *q2, *q3, *q4, *q5;
+
+    /* free cores first */
+    assert(vlc_cpu_quota_Acquire(obj, 6, &q1) == 6);
+    /* then what is left, or a fair share */
+    assert(vlc_cpu_quota_Acquire(obj, 6, &q2) == 4);
+    assert(vlc_cpu_quota_Acquire(obj, 6, &q3) == 2);
+    assert_stats(obj, 3, 18, 12, 12);
+
+    /* single threaded codecs are not counted */
+    assert(vlc_cpu_quota_Acquire(obj, 1, &q5) == 1);
+    assert(q5 == NULL);
+
+    /* unused threads go back to the budget */
+    vlc_cpu_quota_Use(q2, 1);
+    assert_stats(obj, 3, 18, 12, 9);
+
+    vlc_cpu_quota_Release(q1);
+    assert_stats(obj, 2, 12, 6, 3);
+    assert(vlc_cpu_quota_Acquire(obj, 8, &q4) == 5);
+
+    vlc_cpu_quota_Release(q2);
+    vlc_cpu_quota_Release(q3);
+    vlc_cpu_quota_Release(q4);
+    vlc_cpu_quota_Release(q5);
+    assert_stats(obj, 0, 0, 0, 0);
+
+    libvlc_release(vlc);
+    return 0;
+}
@@ -0,0 +1,356 @@
+/*****************************************************************************
+ * httpd.c: HTTP server stream tests
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../../libvlc/test.h"
+#include "../../../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_httpd.h>
+#include <vlc_block.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* One stream served to many local clients, then to a late one. Each block
+ * starts with its sequence number and a keyframe flag, so that clients
+ * check they get every block in order. The load benchmark lives in
+ * httpd_bench.c. */
+#define CLIENTS     32
+#define BLOCKS      1000 /* less than the stream buffer, none is dropped */
+#define BLOCK_SIZE  1316
+#define BLOCK_HEAD  (sizeof (uint32_t) + 1)
+#define KEYFRAMES   20 /* one block out of */
+
+struct client
+{
+    int        fd;
+    uint64_t   offset;     /* body bytes received */
+    uint8_t    stamp[BLOCK_HEAD];
+    bool       keyframe_start;
+    uint32_t   first;      /* sequence number of the first block */
+    unsigned   blocks;
+    bool       in_order;
+};
+
+static unsigned port;
+
+/* The server listens on an ephemeral port, the only listening socket here */
+static unsigned ListeningPort(void)
+{
+    for (int fd = 0; fd < 1024; fd++)
+    {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof (addr);
+        int val;
+        socklen_t vlen = sizeof (val);
+
+        if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &val, &vlen) == 0 && val
+         && getsockname(fd, (struct sockaddr *)&addr, &len) == 0
+         && addr.sin_family == AF_INET)
+            return ntohs(addr.sin_port);
+    }
+    return 0;
+}
+
+static int Request(const char *request)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+    size_t len = strlen(request);
+
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof (addr))
+     || write(fd, request, len) != (ssize_t)len)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Reads exactly size bytes, or up to the end of the answer header if
+ * eoh is set, within a few seconds */
+static ssize_t ReadFull(int fd, char *buf, size_t size, bool eoh)
+{
+    size_t len = 0;
+
+    while (len < size)
+    {
+        ssize_t val = read(fd, buf + len, eoh ? 1 : size - len);
+        if (val <= 0)
+            return -1;
+        len += val;
+        if (eoh && len >= 4 && !memcmp(buf + len - 4, "\r\n\r\n", 4))
+            break;
+    }
+    return len;
+}
+
+/* Returns once the server answered, that is, knows where the client starts */
+static int Connect(struct client *c)
+{
+    char head[4096];
+
+    memset(c, 0, sizeof (*c));
+    c->in_order = true;
+    c->fd = Request("GET /stream HTTP/1.1\r\n\r\n");
+    if (c->fd == -1)
+        return -1;
+    if (ReadFull(c->fd, head, sizeof (head), true) <= 0)
+    {
+        close(c->fd);
+        return -1;
+    }
+    fcntl(c->fd, F_SETFL, O_NONBLOCK);
+    return 0;
+}
+
+/* HTTP/1.1 clients of a chunked stream get every block as a chunk, the
+ * stream header first, HTTP/1.0 clients get the raw data */
+static int TestChunked(httpd_host_t *host)
+{
+    static const char *const requests[] = {
+        "GET /chunked HTTP/1.1\r\n\r\n", "GET /chunked HTTP/1.0\r\n\r\n",
+    };
+    static const size_t sizes[] = { 1, 188, 4096, 70000 };
+    struct timeval timeout = { .tv_sec = 5 };
+    char head[4096];
+    int fds[ARRAY_SIZE(requests)];
+
+    httpd_stream_t *stream = httpd_StreamNew(host, "/chunked", "video/mp4",
+                                             NULL, NULL);
+    assert(stream != NULL);
+    httpd_StreamSetChunked(stream, true);
+    httpd_StreamHeader(stream, (uint8_t *)"ftyp", 4);
+
+    for (size_t i = 0; i < ARRAY_SIZE(requests); i++)
+    {
+        fds[i] = Request(requests[i]);
+        assert(fds[i] != -1);
+        setsockopt(fds[i], SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+
+        ssize_t len = ReadFull(fds[i], head, sizeof (head) - 1, true);
+        assert(len > 0);
+        head[len] = '\0';
+        if (i == 0)
+            assert(!strncmp(head, "HTTP/1.1 200", 12)
+                && strstr(head, "Transfer-Encoding: chunked\r\n") != NULL);
+        else
+            assert(!strncmp(head, "HTTP/1.0 200", 12)
+                && strstr(head, "Transfer-Encoding") == NULL);
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(sizes); i++)
+        total += sizes[i];
+
+    char *expected = malloc(2 * (total + 64));
+    char *received = malloc(2 * (total + 64));
+    assert(expected != NULL && received != NULL);
+
+    size_t chunked = sprintf(expected, "4\r\nftyp\r\n");
+    char *raw = expected + total + 64;
+    size_t plain = sprintf(raw, "ftyp");
+
+    for (size_t i = 0; i < ARRAY_SIZE(sizes); i++)
+    {
+        block_t *block = block_Alloc(sizes[i]);
+        assert(block != NULL);
+        memset(block->p_buffer, 'a' + i, sizes[i]);
+        httpd_StreamSend(stream, block);
+
+        chunked += sprintf(expected + chunked, "%zx\r\n", sizes[i]);
+        memcpy(expected + chunked, block->p_buffer, sizes[i]);
+        chunked += sizes[i];
+        chunked += sprintf(expected + chunked, "\r\n");
+        memcpy(raw + plain, block->p_buffer, sizes[i]);
+        plain += sizes[i];
+        block_Release(block);
+    }
+
+    assert(ReadFull(fds[0], received, chunked, false) == (ssize_t)chunked);
+    assert(!memcmp(received, expected, chunked));
+    assert(ReadFull(fds[1], received, plain, false) == (ssize_t)plain);
+    assert(!memcmp(received, raw, plain));
+
+    for (size_t i = 0; i < ARRAY_SIZE(requests); i++)
+        close(fds[i]);
+    free(received);
+    free(expected);
+    httpd_StreamDelete(stream);
+    return 0;
+}
+
+static int Receive(struct client *c)
+{
+    uint8_t buf[16384];
+    ssize_t len = read(c->fd, buf, sizeof (buf));
+
+    if (len <= 0)
+        return (len < 0 && errno == EAGAIN) ? 0 : -1;
+
+    for (ssize_t i = 0; i < len; i++)
+    {
+        size_t pos = c->offset++ % BLOCK_SIZE;
+        if (pos >= sizeof (c->stamp))
+            continue;
+
+        c->stamp[pos] = buf[i];
+        if (pos == sizeof (c->stamp) - 1)
+        {
+            uint32_t seq;
+
+            memcpy(&seq, c->stamp, sizeof (seq));
+            if (c->blocks == 0)
+            {
+                c->first = seq;
+                c->keyframe_start = c->stamp[sizeof (seq)];
+            }
+            else if (seq != c->first + c->blocks)
+                c->in_order = false;
+            c->blocks++;
+        }
+    }
+    return 0;
+}
+
+static void Send(httpd_stream_t *stream, uint32_t seq)
+{
+    block_t *block = block_Alloc(BLOCK_SIZE);
+    assert(block != NULL);
+    memset(block->p_buffer, 0x47, BLOCK_SIZE);
+    memcpy(block->p_buffer, &seq, sizeof (seq));
+    block->p_buffer[sizeof (seq)] = (seq % KEYFRAMES) == 0;
+    if (block->p_buffer[sizeof (seq)])
+        block->i_flags |= BLOCK_FLAG_TYPE_I;
+    httpd_StreamSend(stream, block);
+    block_Release(block);
+}
+
+/* Clients connected from the start get every block, a late one joins on
+ * the last keyframe and gets everything from there */
+static int TestStream(httpd_host_t *host)
+{
+    httpd_stream_t *stream = httpd_StreamNew(host, "/stream",
+                                             "application/octet-stream",
+                                             NULL, NULL);
+    assert(stream != NULL);
+
+    struct client clients[CLIENTS + 1];
+    struct pollfd ufd[CLIENTS + 1];
+    struct client *late = &clients[CLIENTS];
+
+    for (unsigned i = 0; i < CLIENTS; i++)
+        assert(Connect(&clients[i]) == 0);
+
+    uint32_t seq = 0;
+    while (seq < BLOCKS / 2 + KEYFRAMES / 2)
+        Send(stream, seq++);
+    assert(Connect(late) == 0);
+    while (seq < BLOCKS)
+        Send(stream, seq++);
+
+    for (unsigned i = 0; i <= CLIENTS; i++)
+    {
+        ufd[i].fd = clients[i].fd;
+        ufd[i].events = POLLIN;
+    }
+
+    /* no deadline but the test timeout: slow machines are fine */
+    for (;;)
+    {
+        unsigned pending = 0;
+        for (unsigned i = 0; i <= CLIENTS; i++)
+        {
+            const struct client *c = &clients[i];
+            bool done = c->blocks > 0 && c->first + c->blocks == BLOCKS;
+            ufd[i].fd = done ? -1 : c->fd;
+            pending += !done;
+        }
+        if (pending == 0)
+            break;
+
+        int val = poll(ufd, CLIENTS + 1, -1);
+        assert(val >= 0 || errno == EINTR);
+        for (unsigned i = 0; i <= CLIENTS && val > 0; i++)
+        {
+            if (ufd[i].fd == -1 || ufd[i].revents == 0)
+                continue;
+            val--;
+            assert(Receive(&clients[i]) == 0);
+        }
+    }
+
+    for (unsigned i = 0; i < CLIENTS; i++)
+    {
+        const struct client *c = &clients[i];
+
+        assert(c->first == 0 && c->blocks == BLOCKS && c->in_order);
+        assert(c->offset == (uint64_t)BLOCKS * BLOCK_SIZE);
+        close(c->fd);
+    }
+
+    assert(late->keyframe_start && late->first % KEYFRAMES == 0);
+    assert(late->first == (BLOCKS / 2 + KEYFRAMES / 2) / KEYFRAMES * KEYFRAMES);
+    assert(late->in_order);
+    close(late->fd);
+
+    httpd_StreamDelete(stream);
+    return 0;
+}
+
+int main(void)
+{
+    test_init();
+
+    static const char *argv[] = {
+        "-v", "--ignore-config",
+        "--http-host=127.0.0.1", "--http-port=0",
+    };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+
+    httpd_host_t *host = vlc_http_HostNew(VLC_OBJECT(vlc->p_libvlc_int));
+    assert(host != NULL);
+    port = ListeningPort();
+    assert(port != 0);
+
+    int ret = TestChunked(host) || TestStream(host);
+
+    httpd_HostDelete(host);
+    libvlc_release(vlc);
+    return ret;
+}
@@ -0,0 +1,297 @@
+/*****************************************************************************
+ * httpd_bench.c: HTTP server stream load benchmark
+ *****************************************************************************
+ * Copyright (C) 2020 VLC authors and VideoLAN
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "../../libvlc/test.h"
+#include "../../../lib/libvlc_internal.h"
+
+#include <vlc_common.h>
+#include <vlc_httpd.h>
+#include <vlc_block.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* One stream served to many local clients. Each block starts with its
+ * send date and a keyframe flag, so clients measure how late they get the
+ * data. Override the client count with HTTPD_TEST_CLIENTS to load the
+ * server harder. This depends on the machine, hence not part of the tests,
+ * run it with "make test_src_network_httpd_bench". */
+#define CLIENTS     256
+#define BLOCK_SIZE  1316
+#define BLOCK_HEAD  (sizeof (vlc_tick_t) + 1)
+#define KEYFRAMES   20 /* one block out of */
+#define PERIOD      VLC_TICK_FROM_MS(5)
+#define DURATION    VLC_TICK_FROM_SEC(3)
+
+struct client
+{
+    int        fd;
+    unsigned   header;     /* matched bytes of the end of the answer header */
+    uint64_t   offset;     /* body bytes received */
+    uint8_t    stamp[BLOCK_HEAD];
+    vlc_tick_t last;       /* date of the last complete stamp */
+    unsigned   blocks;
+    vlc_tick_t latency;    /* sum */
+    vlc_tick_t latency_max;
+};
+
+static unsigned port;
+
+/* The server listens on an ephemeral port, the only listening socket here */
+static unsigned ListeningPort(void)
+{
+    for (int fd = 0; fd < 1024; fd++)
+    {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof (addr);
+        int val;
+        socklen_t vlen = sizeof (val);
+
+        if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &val, &vlen) == 0 && val
+         && getsockname(fd, (struct sockaddr *)&addr, &len) == 0
+         && addr.sin_family == AF_INET)
+            return ntohs(addr.sin_port);
+    }
+    return 0;
+}
+
+static int Request(const char *request)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+    size_t len = strlen(request);
+
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof (addr))
+     || write(fd, request, len) != (ssize_t)len)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int Connect(struct client *c)
+{
+    memset(c, 0, sizeof (*c));
+    c->fd = Request("GET /stream HTTP/1.1\r\n\r\n");
+    if (c->fd == -1)
+        return -1;
+    fcntl(c->fd, F_SETFL, O_NONBLOCK);
+    return 0;
+}
+
+static int Receive(struct client *c, vlc_tick_t now)
+{
+    uint8_t buf[16384];
+    ssize_t len = read(c->fd, buf, sizeof (buf));
+
+    if (len <= 0)
+        return (len < 0 && errno == EAGAIN) ? 0 : -1;
+
+    for (ssize_t i = 0; i < len; i++)
+    {
+        if (c->header < 4)
+        {
+            static const char eoh[] = "\r\n\r\n";
+
+            if (buf[i] == eoh[c->header])
+                c->header++;
+            else
+                c->header = (buf[i] == '\r');
+            continue;
+        }
+
+        /* clients join, and catch up, on block boundaries */
+        size_t pos = c->offset++ % BLOCK_SIZE;
+        if (pos >= sizeof (c->stamp))
+            continue;
+
+        c->stamp[pos] = buf[i];
+        if (pos == sizeof (c->stamp) - 1)
+        {
+            vlc_tick_t date, latency;
+
+            memcpy(&date, c->stamp, sizeof (date));
+            latency = now - date;
+            c->latency += latency;
+            if (latency > c->latency_max)
+                c->latency_max = latency;
+            c->blocks++;
+            c->last = now;
+        }
+    }
+    return 0;
+}
+
+static unsigned ClientCount(void)
+{
+    unsigned count = CLIENTS;
+    const char *env = getenv("HTTPD_TEST_CLIENTS");
+    struct rlimit lim;
+
+    if (env != NULL && atoi(env) > 0)
+        count = atoi(env);
+
+    /* both ends of every connection live in this process */
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur != RLIM_INFINITY
+     && count > (lim.rlim_cur - 64) / 2)
+        count = (lim.rlim_cur - 64) / 2;
+    return count;
+}
+
+int main(void)
+{
+    test_init();
+
+    static const char *argv[] = {
+        "-v", "--ignore-config",
+        "--http-host=127.0.0.1", "--http-port=0",
+    };
+    libvlc_instance_t *vlc = libvlc_new(ARRAY_SIZE(argv), argv);
+    assert(vlc != NULL);
+
+    httpd_host_t *host = vlc_http_HostNew(VLC_OBJECT(vlc->p_libvlc_int));
+    assert(host != NULL);
+    port = ListeningPort();
+    assert(port != 0);
+
+    httpd_stream_t *stream = httpd_StreamNew(host, "/stream",
+                                             "application/octet-stream",
+                                             NULL, NULL);
+    assert(stream != NULL);
+
+    unsigned count = ClientCount();
+    struct client *clients = calloc(count, sizeof (*clients));
+    struct pollfd *ufd = calloc(count, sizeof (*ufd));
+    assert(clients != NULL && ufd != NULL);
+
+    vlc_tick_t start = vlc_tick_now();
+    for (unsigned i = 0; i < count; i++)
+    {
+        if (Connect(&clients[i]))
+        {
+            fprintf(stderr, "connection %u failed: %s\n", i, strerror(errno));
+            return 1;
+        }
+        ufd[i].fd = clients[i].fd;
+        ufd[i].events = POLLIN;
+    }
+    fprintf(stderr, "%u clients connected in %"PRId64" ms\n", count,
+            MS_FROM_VLC_TICK(vlc_tick_now() - start));
+
+    unsigned sent = 0;
+    vlc_tick_t next = vlc_tick_now();
+    vlc_tick_t end = next + DURATION;
+
+    for (;;)
+    {
+        vlc_tick_t now = vlc_tick_now();
+
+        if (now >= next)
+        {
+            if (now >= end)
+                break;
+
+            block_t *block = block_Alloc(BLOCK_SIZE);
+            assert(block != NULL);
+            memset(block->p_buffer, 0x47, BLOCK_SIZE);
+            memcpy(block->p_buffer, &now, sizeof (now));
+            block->p_buffer[sizeof (now)] = (sent % KEYFRAMES) == 0;
+            if (block->p_buffer[sizeof (now)])
+                block->i_flags |= BLOCK_FLAG_TYPE_I;
+            httpd_StreamSend(stream, block);
+            block_Release(block);
+            sent++;
+            next += PERIOD;
+            continue;
+        }
+
+        int val = poll(ufd, count, MS_FROM_VLC_TICK(next - now) + 1);
+        assert(val >= 0 || errno == EINTR);
+
+        now = vlc_tick_now();
+        for (unsigned i = 0; i < count && val > 0; i++)
+        {
+            if (ufd[i].revents == 0)
+                continue;
+            val--;
+            if (Receive(&clients[i], now))
+            {
+                fprintf(stderr, "client %u disconnected\n", i);
+                return 1;
+            }
+        }
+    }
+
+    /* sustained: still getting data during the last second */
+    unsigned sustained = 0;
+    uint64_t blocks = 0;
+    vlc_tick_t latency = 0, latency_max = 0;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        const struct client *c = &clients[i];
+
+        if (c->blocks > 0 && c->last >= end - VLC_TICK_FROM_SEC(1))
+            sustained++;
+        blocks += c->blocks;
+        latency += c->latency;
+        if (c->latency_max > latency_max)
+            latency_max = c->latency_max;
+        close(c->fd);
+    }
+
+    fprintf(stderr, "%u blocks of %u bytes sent to %u clients\n",
+            sent, BLOCK_SIZE, count);
+    fprintf(stderr, "  sustained clients: %u\n", sustained);
+    fprintf(stderr, "  received blocks:   %"PRIu64" (%.1f%%)\n", blocks,
+            100. * blocks / ((uint64_t)sent * count));
+    if (blocks > 0)
+        fprintf(stderr, "  latency:           %"PRId64" us mean, "
+                "%"PRId64" us max\n",
+                US_FROM_VLC_TICK(latency / (vlc_tick_t)blocks),
+                US_FROM_VLC_TICK(latency_max));
+
+    httpd_StreamDelete(stream);
+    httpd_HostDelete(host);
+    libvlc_release(vlc);
+    free(ufd);
+    free(clients);
+
+    return 0;
+}